@@ -0,0 +1,32 @@
+//Frame uniform of the culling and the geometry passes, same layout as CullUniform in ModuleVulkan.h (std140)
+//Every shader reading it defines CULL_UNIFORM_BINDING before including this file
+layout(std140, binding = CULL_UNIFORM_BINDING) uniform uboData
+{
+	vec4 frustumPlanes[6];
+	uint numCommands;
+	uint statsEnabled;
+	//projected diameter in pixels under which the meshlets go to SoftwareRaster.comp, 0 disables it
+	float swRasterThreshold;
+	//pixels per unit at view depth 1
+	float projectionScale;
+	uint screenWidth;
+	uint screenHeight;
+	uint primitiveCulling;
+	float simulationTime;
+	uint depthSort;
+	//Visibility cache: bit 0 the instances, bit 1 the meshlets. Newest epoch, valid epochs by age, frame and rotating refresh period of the tracker
+	uint visibilityCache;
+	uint cacheEpoch;
+	uint cacheValidMask;
+	uint cacheFrame;
+	uint cacheRefreshFrames;
+	//meshlet state words of every slot
+	uint meshletStateWords;
+	//projected diameter in pixels under which the instances are impostors, 0 when off
+	float impostorThreshold;
+	//frusta of the newest epoch, the new entries are tested with them
+	vec4 inflatedPlanes[6];
+	vec4 deflatedPlanes[6];
+	//VkPhysicalDeviceLimits::subPixelPrecisionBits, the primitive culling snaps like the rasterizer
+	uint subPixelBits;
+};
@@ -0,0 +1,51 @@
+#version 460
+
+layout(location = 0) out vec4 outColor;
+
+layout(location = 0) in vec2 cellCoords;
+layout(location = 1) in flat uint frameOffset;
+layout(location = 2) in flat vec3 objectLight;
+layout(location = 3) in flat uint meshID;
+
+//Texels of the frames baked by Impostor::Bake
+layout(std430, binding = 22) readonly buffer ImpostorAtlas { uint atlasTexels[]; };
+
+//Same as Impostor::CELL_SIZE and COVERAGE_SHIFT
+#define CELL_SIZE 32
+#define COVERAGE_SHIFT 24
+
+//Same as Shader.frag
+const vec3 ambientCol = vec3(0.0f, 0.0f, 0.2f);
+#define MAX_COLORS 10
+vec3 meshletColors[MAX_COLORS] = {
+  vec3(1,0,0),
+  vec3(0,1,0),
+  vec3(0,0,1),
+  vec3(1,1,0),
+  vec3(1,0,1),
+  vec3(0,1,1),
+  vec3(1,0.5,0),
+  vec3(0.5,1,0),
+  vec3(0,0.5,1),
+  vec3(1,1,1)
+  };
+
+//Impostor::DecodeNormal
+vec3 DecodeNormal(uint texel)
+{
+	const vec2 encoded = vec2(texel & 0xFF, (texel >> 8) & 0xFF) / 255.0 * 2.0 - 1.0;
+	vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	if (n.z < 0.0)
+		n.xy = vec2((1.0 - abs(encoded.y)) * (encoded.x >= 0.0 ? 1.0 : -1.0), (1.0 - abs(encoded.x)) * (encoded.y >= 0.0 ? 1.0 : -1.0));
+	return normalize(n);
+}
+
+//Nearest texel of the frame, the empty ones are the outside of the silhouette
+void main()
+{
+	const uvec2 texel = min(uvec2(cellCoords * CELL_SIZE), uvec2(CELL_SIZE - 1));
+	const uint value = atlasTexels[frameOffset + texel.y * CELL_SIZE + texel.x];
+	if ((value >> COVERAGE_SHIFT) == 0)
+		discard;
+	outColor = vec4(ambientCol, 1) + vec4(meshletColors[meshID % MAX_COLORS] * max(dot(DecodeNormal(value), objectLight), 0.0f), 1.0f);
+}
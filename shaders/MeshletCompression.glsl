@@ -0,0 +1,110 @@
+//Compressed meshlet streams, same as MeshletCompression.h: the record counts, the vertex references (mask words and delta coded old vertices)
+//and the packed triangles
+//Every shader including this file declares the Meshlet record and the meshletVertices and meshletTriangles buffers before it. The shaders where a
+//workgroup decodes a whole meshlet define SHARED_REFERENCE_VERTICES (the most vertices of a meshlet) too: LoadReferenceMasks keeps the mask words on
+//shared memory for DecodeVertex. Without it DecodeVertex reads them from the pool, for a few vertices per invocation
+#define COUNT_MASK 0x1ff
+#define TRIANGLE_COUNT_SHIFT 9
+#define DELTA_BITS_SHIFT 18
+#define DELTA_BITS_MASK 0x1f
+#define INDEX_BITS_SHIFT 23
+#define INDEX_BITS_MASK 0xf
+
+uint VertexCount(Meshlet meshlet)
+{
+	return meshlet.counts & COUNT_MASK;
+}
+
+uint TriangleCount(Meshlet meshlet)
+{
+	return (meshlet.counts >> TRIANGLE_COUNT_SHIFT) & COUNT_MASK;
+}
+
+//Same as ReadBits on MeshletCompression.cpp, bits from bitOffset of the stream at firstWord
+uint ReadReferenceBits(uint firstWord, uint bitOffset, uint bits)
+{
+	if (bits == 0)
+		return 0;
+	const uint word = firstWord + (bitOffset >> 5);
+	const uint shift = bitOffset & 31;
+	uint value = meshletVertices[word] >> shift;
+	if (shift + bits > 32)
+		value |= meshletVertices[word + 1] << (32 - shift);
+	return bitfieldExtract(value, 0, int(bits));
+}
+
+uint ReadTriangleBits(uint firstWord, uint bitOffset, uint bits)
+{
+	const uint word = firstWord + (bitOffset >> 5);
+	const uint shift = bitOffset & 31;
+	uint value = meshletTriangles[word] >> shift;
+	if (shift + bits > 32)
+		value |= meshletTriangles[word + 1] << (32 - shift);
+	return bitfieldExtract(value, 0, int(bits));
+}
+
+//The old vertex with oldBefore old vertices before it on the meshlet
+uint DecodeOldVertex(Meshlet meshlet, uint oldBefore)
+{
+	const uint deltaBits = (meshlet.counts >> DELTA_BITS_SHIFT) & DELTA_BITS_MASK;
+	const uint maskWords = (VertexCount(meshlet) + 31) / 32;
+	return meshlet.vertexBase - 1 - ReadReferenceBits(meshlet.vertexStream + maskWords, oldBefore * deltaBits, deltaBits);
+}
+
+#ifdef SHARED_REFERENCE_VERTICES
+#define REFERENCE_MASK_WORDS ((SHARED_REFERENCE_VERTICES + 31) / 32)
+
+//Mask words of the meshlet and the old vertices before each word, every invocation decodes its vertices from them without a scan
+shared uint referenceMasks[REFERENCE_MASK_WORDS];
+shared uint referenceRanks[REFERENCE_MASK_WORDS];
+
+//The first invocation loads the mask words, the whole workgroup has to call it
+void LoadReferenceMasks(Meshlet meshlet)
+{
+	if (gl_LocalInvocationIndex == 0)
+	{
+		uint rank = 0;
+		for (uint i = 0; i < (VertexCount(meshlet) + 31) / 32; ++i)
+		{
+			referenceMasks[i] = meshletVertices[meshlet.vertexStream + i];
+			referenceRanks[i] = rank;
+			rank += uint(bitCount(referenceMasks[i]));
+		}
+	}
+	barrier();
+}
+
+//Same as MeshletCompression::DecodeVertex: the new vertices follow vertexBase, the old ones are deltas before it
+uint DecodeVertex(Meshlet meshlet, uint index)
+{
+	const uint mask = referenceMasks[index >> 5];
+	const uint bit = 1u << (index & 31);
+	const uint oldBefore = referenceRanks[index >> 5] + uint(bitCount(mask & (bit - 1)));
+	if ((mask & bit) == 0)
+		return meshlet.vertexBase + index - oldBefore;
+	return DecodeOldVertex(meshlet, oldBefore);
+}
+#else
+//Same as MeshletCompression::DecodeVertex, the mask words before index are counted from the pool
+uint DecodeVertex(Meshlet meshlet, uint index)
+{
+	uint oldBefore = 0;
+	for (uint word = 0; word < (index >> 5); ++word)
+		oldBefore += uint(bitCount(meshletVertices[meshlet.vertexStream + word]));
+	const uint mask = meshletVertices[meshlet.vertexStream + (index >> 5)];
+	const uint bit = 1u << (index & 31);
+	oldBefore += uint(bitCount(mask & (bit - 1)));
+	if ((mask & bit) == 0)
+		return meshlet.vertexBase + index - oldBefore;
+	return DecodeOldVertex(meshlet, oldBefore);
+}
+#endif // SHARED_REFERENCE_VERTICES
+
+//Same as MeshletCompression::DecodeTriangle, the 3 indices are at most 24 bits
+uvec3 DecodeTriangle(Meshlet meshlet, uint triangle)
+{
+	const uint indexBits = (meshlet.counts >> INDEX_BITS_SHIFT) & INDEX_BITS_MASK;
+	const uint packed = ReadTriangleBits(meshlet.triangleStream, triangle * 3 * indexBits, 3 * indexBits);
+	const uint mask = (1u << indexBits) - 1;
+	return uvec3(packed & mask, (packed >> indexBits) & mask, (packed >> (2 * indexBits)) & mask);
+}
@@ -0,0 +1,40 @@
+//Per triangle culling of Shader.mesh and Visibility.mesh, CPU reference on PrimitiveCulling.cpp
+//Needs uboData (CullUniform.glsl) and MESHLET_MAX_VERTICES. The vertices are snapped with subPixelBits, the precision of the device rasterizer
+//Same as PrimitiveCulling::GUARD_BAND and MAX_EXTENT, in subpixels
+#define GUARD_BAND 268435456.0f
+#define MAX_EXTENT 16384
+//The triangles using this vertex are left to the hardware (behind the camera or too far for the fixed point math)
+#define UNTESTED_VERTEX 0x7fffffff
+
+shared ivec2 screenPositions[MESHLET_MAX_VERTICES];
+
+ivec2 SnapVertex(vec4 clip)
+{
+    const vec2 subpixel = (clip.xy / clip.w * 0.5f + 0.5f) * vec2(screenWidth, screenHeight) * float(1u << subPixelBits);
+    if (clip.w <= 0.0f || any(greaterThanEqual(abs(subpixel), vec2(GUARD_BAND))))
+        return ivec2(UNTESTED_VERTEX);
+    return ivec2(floor(subpixel + 0.5f));
+}
+
+//Same tests as PrimitiveCulling::Classify: back facing, zero area and no pixel center inside the bounds
+bool CullTriangle(uvec3 indices)
+{
+    const ivec2 v0 = screenPositions[indices.x];
+    const ivec2 v1 = screenPositions[indices.y];
+    const ivec2 v2 = screenPositions[indices.z];
+    if (v0.x == UNTESTED_VERTEX || v1.x == UNTESTED_VERTEX || v2.x == UNTESTED_VERTEX)
+        return false;
+    const ivec2 minBounds = min(v0, min(v1, v2));
+    const ivec2 maxBounds = max(v0, max(v1, v2));
+    //the edge function only fits in 32 bits for the small triangles
+    if (any(greaterThan(maxBounds - minBounds, ivec2(MAX_EXTENT))))
+        return false;
+    //The counter clockwise front faces have a negative area on a y down framebuffer
+    const int signedArea = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+    if (signedArea >= 0)
+        return true;
+    const int scale = 1 << subPixelBits;
+    const ivec2 firstSample = (minBounds - scale / 2 + scale - 1) >> subPixelBits;
+    const ivec2 lastSample = (maxBounds - scale / 2) >> subPixelBits;
+    return any(greaterThan(firstSample, lastSample));
+}
@@ -8,6 +8,7 @@ layout(location = 0) out vec4 outColor;
 layout(location=0) in vec3 normal;
 layout(location=1) in flat uint meshletID;
 layout(location=2) in flat uint meshID;
+layout(location=3) in vec3 worldPosition;
 //lambertian shader
 const vec3 lightDir = normalize(vec3(0.0f,1.0f, 1.0f));
 const vec3 diffuseCol = vec3(0.5f, 0.5f, 0.0f);
@@ -27,11 +28,91 @@ vec3 meshletColors[MAX_COLORS] = {
   vec3(1,1,1)
   };
 
+//Clustered point lights (ClusteredLighting.h), the lists are written by ClusterLights.comp
+//Same as ClusteredLighting::CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z and MAX_LIGHTS_PER_CLUSTER
+#define CLUSTERS_X 16
+#define CLUSTERS_Y 9
+#define CLUSTERS_Z 24
+#define CLUSTER_COUNT (CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z)
+#define MAX_LIGHTS_PER_CLUSTER 64
+//Same layout as ClusteredLighting::Params
+layout(std140, binding = 23) uniform ClusterParams
+{
+	vec4 cameraPlanes[6];
+	vec4 columnPlanes[CLUSTERS_X + 1];
+	vec4 rowPlanes[CLUSTERS_Y + 1];
+	vec4 sliceDepths[(CLUSTERS_Z + 1 + 3) / 4];
+	uint lightCount;
+	float nearDepth;
+	float farDepth;
+	float sliceScale;
+};
+//Same layout as ClusteredLighting::Light
+struct Light
+{
+	vec4 positionRadius;
+	vec4 color;
+};
+layout(std430, binding = 24) readonly buffer Lights { Light lights[]; };
+layout(std430, binding = 25) readonly buffer ClusterGrid { uint clusterGrid[]; };
+
+float PlaneDistance(vec4 plane, vec3 point)
+{
+	return dot(plane.xyz, point) - plane.w;
+}
+
+//ClusteredLighting::GridCoordinate and ClusterIndex
+uint GridCoordinate(vec4 a, vec4 b, vec3 position, uint cells)
+{
+	const float da = PlaneDistance(a, position);
+	const float sum = da + PlaneDistance(b, position);
+	const float t = sum < 0.0 ? da / sum : 0.0;
+	return uint(clamp(t * float(cells), 0.0, float(cells - 1)));
+}
+
+uint ClusterIndex(vec3 position)
+{
+	const uint column = GridCoordinate(cameraPlanes[2], cameraPlanes[3], position, CLUSTERS_X);
+	const uint row = GridCoordinate(cameraPlanes[4], cameraPlanes[5], position, CLUSTERS_Y);
+	const float depth = nearDepth - PlaneDistance(cameraPlanes[0], position);
+	//start of slice 1
+	const float minDepth = sliceDepths[0].y;
+	uint slice = 0;
+	if (depth >= minDepth)
+		slice = min(1 + uint(log(depth / minDepth) * sliceScale), CLUSTERS_Z - 1);
+	return (slice * CLUSTERS_Y + row) * CLUSTERS_X + column;
+}
+
+//ClusteredLighting::ShadePoint, only the lights listed on the cluster of the point
+vec3 PointLights(vec3 position, vec3 normal)
+{
+	if (lightCount == 0)
+		return vec3(0.0);
+	const uint cluster = ClusterIndex(position);
+	const uint count = min(clusterGrid[cluster], MAX_LIGHTS_PER_CLUSTER);
+	const uint first = CLUSTER_COUNT + cluster * MAX_LIGHTS_PER_CLUSTER;
+	vec3 color = vec3(0.0);
+	for (uint i = 0; i < count; ++i)
+	{
+		const Light light = lights[clusterGrid[first + i]];
+		const vec3 toLight = light.positionRadius.xyz - position;
+		const float distanceSquared = dot(toLight, toLight);
+		const float radiusSquared = light.positionRadius.w * light.positionRadius.w;
+		if (distanceSquared >= radiusSquared)
+			continue;
+		const float falloff = 1.0 - distanceSquared / radiusSquared;
+		const float diffuse = max(dot(normal, toLight * inversesqrt(max(distanceSquared, 1e-8))), 0.0);
+		color += light.color.rgb * light.color.a * falloff * falloff * diffuse;
+	}
+	return color;
+}
+
 void main() {
     //outColor = vec4(0.0f, 1.0f, 0.0f, 1.0f);
     //outColor = vec4(normal, 1.0f);
     //outColor = vec4(meshletColors[meshletID%MAX_COLORS],1.0f);
     //outColor = vec4(ambientCol,1) + vec4(diffuseCol * max(dot(normalize(normal), lightDir), 0.0f), 1.0f);
     //outColor = vec4(ambientCol,1) + vec4(meshletColors[meshID%MAX_COLORS] * max(dot(normalize(normal), lightDir), 0.0f), 1.0f);
-    outColor = vec4(ambientCol,1) + vec4(mix(meshletColors[meshID%MAX_COLORS], meshletColors[meshletID%MAX_COLORS], 0.3) * max(dot(normalize(normal), lightDir), 0.0f), 1.0f);
+    const vec3 n = normalize(normal);
+    outColor = vec4(ambientCol,1) + vec4(mix(meshletColors[meshID%MAX_COLORS], meshletColors[meshletID%MAX_COLORS], 0.3) * (max(dot(n, lightDir), 0.0f) + PointLights(worldPosition, n)), 1.0f);
 }
\ No newline at end of file
@@ -0,0 +1,18 @@
+#version 460
+#extension GL_EXT_mesh_shader : require
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
+#extension GL_EXT_shader_atomic_int64 : require
+#extension GL_GOOGLE_include_directive : require
+
+//Visibility buffer pass: no shading, the closest triangle id is kept with a 64 bit atomicMin on depth | id
+//SoftwareRaster.comp writes the same buffer, the early depth test just rejects the hidden hardware fragments
+layout(early_fragment_tests) in;
+layout(location=0) perprimitiveEXT in flat uint visibilityID;
+#define CULL_UNIFORM_BINDING 8
+#include "CullUniform.glsl"
+layout(std430, binding = 12) buffer VisibilityBuffer { uint64_t visibility[]; };
+
+void main() {
+    const uint pixel = uint(gl_FragCoord.y) * screenWidth + uint(gl_FragCoord.x);
+    atomicMin(visibility[pixel], (uint64_t(floatBitsToUint(gl_FragCoord.z)) << 32) | uint64_t(visibilityID));
+}
@@ -4,10 +4,15 @@
 #include "ModuleInput.h"
 #include "ModuleVulkan.h"
 #include "ModuleEditorCamera.h"
+#ifdef ENGINE_BENCHMARK
+#include "ModuleBenchmark.h"
+#endif // ENGINE_BENCHMARK
+#include "Profiler.h"
 #include "SDL3/SDL_timer.h"
 
-Application::Application() : performanceFrequency(SDL_GetPerformanceFrequency())
+Application::Application(int argc, char* argv[], unsigned int run) : performanceFrequency(SDL_GetPerformanceFrequency())
 {
+	PROFILE_THREAD("Main");
 	//modules.reserve(); Alguna forma de fer saver quans modules hi haura?
 	ModuleWindow* mWindow = new ModuleWindow();
 	ModuleInput* mInput = new ModuleInput();
@@ -16,9 +21,52 @@ Application::Application() : performanceFrequency(SDL_GetPerformanceFrequency())
 	modules.push_back(mWindow);
 	modules.push_back(mInput);
 	modules.push_back(mCamera);
+#ifdef ENGINE_BENCHMARK
+	//After the editor camera so the scripted path overrides the keyboard input
+	BenchmarkConfig benchmarkConfig = ModuleBenchmark::ParseArguments(argc, argv);
+	benchmarkConfig.run = run;
+	mWindow->SetHidden(benchmarkConfig.hiddenWindow);
+	mVulkan->SetPreferredDevice(benchmarkConfig.gpuName);
+	mVulkan->SetRenderPath(benchmarkConfig.visibilityBuffer ? RenderPath::VISIBILITY_BUFFER : RenderPath::FORWARD);
+	if (benchmarkConfig.swRasterThreshold >= 0.0f)
+		mVulkan->SetSoftwareRasterThreshold(benchmarkConfig.swRasterThreshold);
+	mVulkan->SetPrimitiveCulling(benchmarkConfig.primitiveCulling);
+	mVulkan->SetAsyncCompute(benchmarkConfig.asyncCompute);
+	mVulkan->SetOcclusionCulling(benchmarkConfig.occlusionCulling);
+	mVulkan->SetDepthSort(benchmarkConfig.depthSort);
+	mVulkan->SetVisibilityCache(benchmarkConfig.visibilityCache);
+	mVulkan->SetMeshletCache(benchmarkConfig.meshletCache);
+	mVulkan->SetShadowCascades(benchmarkConfig.shadowCascades);
+	mVulkan->SetShadowMultiView(benchmarkConfig.shadowMultiView);
+	mVulkan->SetImpostorThreshold(benchmarkConfig.impostorThreshold);
+	mVulkan->SetLightCount(benchmarkConfig.lightCount);
+	if (benchmarkConfig.visibilityCacheRefresh >= 0)
+		mVulkan->SetVisibilityCacheRefresh(static_cast<uint32_t>(benchmarkConfig.visibilityCacheRefresh));
+	mVulkan->SetInstanceMotion(benchmarkConfig.instanceMotion);
+	mVulkan->SetSimulationStep(1.0f / 60.0f);
+	mVulkan->SetInstanceValidation(benchmarkConfig.validateInstances);
+	if (benchmarkConfig.presentMode >= 0)
+		mVulkan->SetPresentMode(static_cast<PresentMode>(benchmarkConfig.presentMode));
+	if (benchmarkConfig.frameLatency >= 0)
+		mVulkan->SetFrameLatency(static_cast<uint32_t>(benchmarkConfig.frameLatency));
+	if (benchmarkConfig.geometryBudgetMB != 0)
+		mVulkan->SetGeometryBudget(static_cast<VkDeviceSize>(benchmarkConfig.geometryBudgetMB) * 1024 * 1024);
+	if (run < benchmarkConfig.meshletLimits.size())
+		mVulkan->SetMeshletLimits(benchmarkConfig.meshletLimits[run].maxVertices, benchmarkConfig.meshletLimits[run].maxPrimitives);
+	modules.push_back(new ModuleBenchmark(mCamera, mVulkan, benchmarkConfig));
+#endif // ENGINE_BENCHMARK
 	modules.push_back(mVulkan);
 }
 
+unsigned int Application::GetRunCount(int argc, char* argv[])
+{
+#ifdef ENGINE_BENCHMARK
+	return ModuleBenchmark::GetRunCount(ModuleBenchmark::ParseArguments(argc, argv));
+#else
+	return 1;
+#endif // ENGINE_BENCHMARK
+}
+
 Application::~Application()
 {
 	for (std::vector<Module*>::reverse_iterator it = modules.rbegin(); it != modules.rend(); ++it)
@@ -30,9 +78,13 @@ Application::~Application()
 
 bool Application::Init()
 {
+	PROFILE_ZONE("Init");
 	for (Module* mod : modules)
+	{
+		PROFILE_ZONE(mod->GetName());
 		if (!mod->Init())
 			return false;
+	}
 
 	performanceFrequency = SDL_GetPerformanceFrequency();
 	return true;
@@ -44,30 +96,43 @@ UpdateStatus Application::Update()
 	//const float dt = (currentTick - lastTickMs) / 1000.0f;
 	//lastTickMs = currentTick;
 
+	PROFILE_FRAME();
 	uint64_t counter = SDL_GetPerformanceCounter();
 	uint64_t elapsed = counter - lastPerformanceCounter;
 	lastPerformanceCounter = counter;
 	float dt = static_cast<float>(elapsed) / static_cast<float>(performanceFrequency);
 	UpdateStatus ret;
-	for (Module* mod : modules)
 	{
-		ret = mod->PreUpdate(dt);
-		if (ret != UpdateStatus::UPDATE_CONTINUE)
-			return ret;
+		PROFILE_ZONE("PreUpdate");
+		for (Module* mod : modules)
+		{
+			PROFILE_ZONE(mod->GetName());
+			ret = mod->PreUpdate(dt);
+			if (ret != UpdateStatus::UPDATE_CONTINUE)
+				return ret;
+		}
 	}
 
-	for (Module* mod : modules)
 	{
-		ret = mod->Update(dt);
-		if (ret != UpdateStatus::UPDATE_CONTINUE)
-			return ret;
+		PROFILE_ZONE("Update");
+		for (Module* mod : modules)
+		{
+			PROFILE_ZONE(mod->GetName());
+			ret = mod->Update(dt);
+			if (ret != UpdateStatus::UPDATE_CONTINUE)
+				return ret;
+		}
 	}
 
-	for (Module* mod : modules)
 	{
-		ret = mod->PostUpdate(dt);
-		if (ret != UpdateStatus::UPDATE_CONTINUE)
-			return ret;
+		PROFILE_ZONE("PostUpdate");
+		for (Module* mod : modules)
+		{
+			PROFILE_ZONE(mod->GetName());
+			ret = mod->PostUpdate(dt);
+			if (ret != UpdateStatus::UPDATE_CONTINUE)
+				return ret;
+		}
 	}
 
 	return UpdateStatus::UPDATE_CONTINUE;
@@ -78,5 +143,9 @@ bool Application::CleanUp()
 	for (std::vector<Module*>::reverse_iterator it = modules.rbegin(); it != modules.rend(); ++it)
 		if (!(*it)->CleanUp())
 			return false;
+#if defined(ENGINE_PROFILER) && !defined(ENGINE_BENCHMARK)
+	//The benchmark writes it next to its results
+	Profiler::WriteChromeTrace("trace.json");
+#endif // ENGINE_PROFILER && !ENGINE_BENCHMARK
 	return true;
 }
\ No newline at end of file
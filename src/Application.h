@@ -3,13 +3,17 @@
 
 #include "Module.h"
 #include <vector>
+#include <stdint.h>
 
 class Module;
 
 class Application final
 {
 public:
-	Application();
+	//run: index of the benchmark meshlet sweep configuration, 0 otherwise
+	Application(int argc, char* argv[], unsigned int run = 0);
+	//Times main runs the whole engine
+	static unsigned int GetRunCount(int argc, char* argv[]);
 	~Application();
 	bool Init();
 	UpdateStatus Update();
@@ -0,0 +1,488 @@
+#include "AsyncIO.h"
+#include "Globals.h"
+#include "Profiler.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#ifdef ASYNC_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif // ASYNC_IO_URING
+
+bool AsyncIO::Init(unsigned int workerThreads)
+{
+	if (initialized)
+		return true;
+	quitting = false;
+	initialized = true;
+#ifdef ASYNC_IO_URING
+	if (InitUring())
+		return true;
+#endif // ASYNC_IO_URING
+	workerThreads = std::max(workerThreads, 1u);
+	for (unsigned int i = 0; i < workerThreads; ++i)
+		workers.emplace_back(&AsyncIO::WorkerLoop, this);
+	return true;
+}
+
+void AsyncIO::CleanUp()
+{
+	if (initialized)
+		StopBackend();
+	queued.clear();
+	submitted.clear();
+	for (Request& request : requests)
+		request = Request();
+	for (char* buffer : poolBuffers)
+		delete[] buffer;
+	poolBuffers.clear();
+	poolCapacities.clear();
+	poolUsed.clear();
+}
+
+void AsyncIO::StopBackend()
+{
+	{
+		//The reads in flight still write to their buffers
+		std::unique_lock<std::mutex> lock(mutex);
+		completed.wait(lock, [this]() { return std::none_of(requests, requests + MAX_REQUESTS, [](const Request& request) { return request.state == State::SUBMITTED; }); });
+		quitting = true;
+	}
+	work.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+	workers.clear();
+#ifdef ASYNC_IO_URING
+	CleanUpUring();
+#endif // ASYNC_IO_URING
+	initialized = false;
+}
+
+const char* AsyncIO::GetBackendName() const
+{
+#ifdef ASYNC_IO_URING
+	if (ringFd >= 0)
+		return "io_uring";
+#endif // ASYNC_IO_URING
+	return workers.empty() ? "blocking" : "thread pool";
+}
+
+AsyncIO::Handle AsyncIO::Read(const char* path, char* buffer, long capacity, Callback callback, void* userData)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (Handle handle = 0; handle < MAX_REQUESTS; ++handle)
+	{
+		Request& request = requests[handle];
+		if (request.state != State::FREE)
+			continue;
+		request = Request();
+		request.path = path;
+		request.buffer = buffer;
+		request.capacity = capacity;
+		request.callback = callback;
+		request.userData = userData;
+		request.state = State::QUEUED;
+		queued.push_back(handle);
+		return handle;
+	}
+	LOG("Error: there are already %u file reads in flight, %s is not read", MAX_REQUESTS, path);
+	return INVALID_HANDLE;
+}
+
+void AsyncIO::Submit()
+{
+	std::vector<Handle> batch;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		batch.swap(queued);
+		for (Handle handle : batch)
+			requests[handle].state = State::SUBMITTED;
+	}
+	if (batch.empty())
+		return;
+#ifdef ASYNC_IO_URING
+	if (ringFd >= 0)
+	{
+		SubmitUring(batch);
+		return;
+	}
+#endif // ASYNC_IO_URING
+	//Not initialized, the reads are done right away
+	if (workers.empty())
+	{
+		for (Handle handle : batch)
+			ReadBlocking(handle);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		submitted.insert(submitted.end(), batch.begin(), batch.end());
+	}
+	work.notify_all();
+}
+
+long AsyncIO::Wait(Handle handle, char*& buffer)
+{
+	if (handle >= MAX_REQUESTS)
+		return 0;
+	bool queuedOnly;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (requests[handle].state == State::FREE)
+			return 0;
+		//The slot is freed after the callback and may hold another read by then
+		if (requests[handle].callback != nullptr)
+		{
+			LOG("Error: waiting on the read of %s, it completes on its callback", requests[handle].path.c_str());
+			return 0;
+		}
+		queuedOnly = requests[handle].state == State::QUEUED;
+	}
+	//Waiting on a read nobody submitted would never return
+	if (queuedOnly)
+		Submit();
+	std::unique_lock<std::mutex> lock(mutex);
+	completed.wait(lock, [this, handle]() { return requests[handle].state == State::DONE; });
+	Request& request = requests[handle];
+	const long size = request.size;
+	if (size != 0)
+		buffer = request.buffer;
+	request = Request();
+	return size;
+}
+
+bool AsyncIO::IsDone(Handle handle)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return handle < MAX_REQUESTS && requests[handle].state == State::DONE;
+}
+
+char* AsyncIO::Acquire(long size)
+{
+	std::lock_guard<std::mutex> lock(poolMutex);
+	//smallest free buffer the size fits in
+	size_t best = poolBuffers.size();
+	for (size_t i = 0; i < poolBuffers.size(); ++i)
+		if (!poolUsed[i] && poolCapacities[i] >= size && (best == poolBuffers.size() || poolCapacities[i] < poolCapacities[best]))
+			best = i;
+	if (best != poolBuffers.size())
+	{
+		poolUsed[best] = true;
+		return poolBuffers[best];
+	}
+	poolBuffers.push_back(new char[size]);
+	poolCapacities.push_back(size);
+	poolUsed.push_back(true);
+	return poolBuffers.back();
+}
+
+void AsyncIO::Release(char* buffer)
+{
+	if (buffer == nullptr)
+		return;
+	std::lock_guard<std::mutex> lock(poolMutex);
+	for (size_t i = 0; i < poolBuffers.size(); ++i)
+	{
+		if (poolBuffers[i] == buffer)
+		{
+			poolUsed[i] = false;
+			return;
+		}
+	}
+	LOG("Warning: released a buffer that is not from the AsyncIO pool");
+}
+
+bool AsyncIO::PrepareBuffer(Request& request, long fileSize)
+{
+	if (request.buffer == nullptr)
+	{
+		request.buffer = Acquire(fileSize);
+		request.pooled = true;
+		return true;
+	}
+	if (request.capacity < fileSize)
+	{
+		LOG("Error: the %ld bytes of %s do not fit on the %ld byte buffer", fileSize, request.path.c_str(), request.capacity);
+		return false;
+	}
+	return true;
+}
+
+void AsyncIO::Complete(Handle handle, long size)
+{
+	Request& request = requests[handle];
+	if (size == 0 && request.pooled)
+	{
+		Release(request.buffer);
+		request.buffer = nullptr;
+		request.pooled = false;
+	}
+	if (request.callback != nullptr)
+		request.callback(handle, request.buffer, size, request.userData);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		request.size = size;
+		//Nobody waits on a read with a callback, its slot goes back for the next Read
+		if (request.callback != nullptr)
+			request = Request();
+		else
+			request.state = State::DONE;
+	}
+	//StopBackend waits for the slots that leave SUBMITTED either way
+	completed.notify_all();
+}
+
+void AsyncIO::WorkerLoop()
+{
+	PROFILE_THREAD("AsyncIO");
+	for (;;)
+	{
+		Handle handle;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			work.wait(lock, [this]() { return quitting || !submitted.empty(); });
+			if (submitted.empty())
+				return;
+			handle = submitted.front();
+			submitted.pop_front();
+		}
+		ReadBlocking(handle);
+	}
+}
+
+//Same as FileSystem::ReadToBuffer, a missing file is not an error (the mesh shader variants rely on it)
+void AsyncIO::ReadBlocking(Handle handle)
+{
+	PROFILE_ZONE("ReadBlocking");
+	Request& request = requests[handle];
+	long size = 0;
+	FILE* fileHandle = fopen(request.path.c_str(), "rb");
+	if (fileHandle != NULL)
+	{
+		fseek(fileHandle, 0, SEEK_END);
+		const long fileSize = ftell(fileHandle);
+		rewind(fileHandle);
+		if (fileSize > 0 && PrepareBuffer(request, fileSize))
+		{
+			if (fread(request.buffer, sizeof(char), fileSize, fileHandle) == static_cast<size_t>(fileSize))
+				size = fileSize;
+			else
+				LOG("Error reading file %s", request.path.c_str());
+		}
+		fclose(fileHandle);
+	}
+	Complete(handle, size);
+}
+
+#ifdef ASYNC_IO_URING
+static constexpr uint64_t WAKE_USER_DATA = ~0ull;
+
+static int UringSetup(unsigned entries, io_uring_params* params)
+{
+	return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int UringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+	return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+bool AsyncIO::InitUring()
+{
+	io_uring_params params{};
+	ringFd = UringSetup(MAX_REQUESTS, &params);
+	if (ringFd < 0)
+	{
+		//Usually a kernel older than 5.1 or a seccomp profile that blocks it
+		LOG("io_uring is not available (errno %d), file reads use the thread pool", errno);
+		ringFd = -1;
+		return false;
+	}
+	sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	const bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (singleMmap)
+		sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+	sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+	cqRing = singleMmap ? sqRing : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+	sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	void* sqesMemory = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+	if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqesMemory == MAP_FAILED)
+	{
+		LOG("Error mapping the io_uring rings, file reads use the thread pool");
+		sqRing = sqRing == MAP_FAILED ? nullptr : sqRing;
+		cqRing = cqRing == MAP_FAILED ? nullptr : cqRing;
+		sqes = sqesMemory == MAP_FAILED ? nullptr : static_cast<io_uring_sqe*>(sqesMemory);
+		CleanUpUring();
+		return false;
+	}
+	sqes = static_cast<io_uring_sqe*>(sqesMemory);
+	unsigned char* sq = static_cast<unsigned char*>(sqRing);
+	sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+	sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+	sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+	sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+	sqEntries = params.sq_entries;
+	unsigned char* cq = static_cast<unsigned char*>(cqRing);
+	cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+	cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+	cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+	cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+	iovecs = new iovec[MAX_REQUESTS];
+	completionThread = std::thread(&AsyncIO::CompletionLoop, this);
+	return true;
+}
+
+void AsyncIO::CleanUpUring()
+{
+	if (completionThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(sqMutex);
+			const unsigned tail = *sqTail;
+			const unsigned index = tail & *sqMask;
+			memset(&sqes[index], 0, sizeof(io_uring_sqe));
+			sqes[index].opcode = IORING_OP_NOP;
+			sqes[index].user_data = WAKE_USER_DATA;
+			sqArray[index] = index;
+			__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+			UringEnter(ringFd, pendingSubmissions + 1, 0, 0);
+			pendingSubmissions = 0;
+		}
+		completionThread.join();
+	}
+	if (sqes != nullptr)
+		munmap(sqes, sqesSize);
+	if (cqRing != nullptr && cqRing != sqRing)
+		munmap(cqRing, cqRingSize);
+	if (sqRing != nullptr)
+		munmap(sqRing, sqRingSize);
+	if (ringFd >= 0)
+		close(ringFd);
+	delete[] iovecs;
+	ringFd = -1;
+	sqRing = cqRing = nullptr;
+	sqes = nullptr;
+	cqes = nullptr;
+	iovecs = nullptr;
+}
+
+//The file is opened and sized on the submitting thread, the reads of the whole batch go to the kernel with one io_uring_enter
+void AsyncIO::SubmitUring(const std::vector<Handle>& handles)
+{
+	for (Handle handle : handles)
+	{
+		Request& request = requests[handle];
+		request.fd = open(request.path.c_str(), O_RDONLY | O_CLOEXEC);
+		struct stat fileStat;
+		if (request.fd < 0 || fstat(request.fd, &fileStat) != 0 || fileStat.st_size == 0 || !PrepareBuffer(request, static_cast<long>(fileStat.st_size)))
+		{
+			if (request.fd >= 0)
+				close(request.fd);
+			request.fd = -1;
+			Complete(handle, 0);
+			continue;
+		}
+		request.size = static_cast<long>(fileStat.st_size);
+		request.offset = 0;
+		std::lock_guard<std::mutex> lock(sqMutex);
+		if (!PushRead(handle))
+		{
+			//the ring is full, what is on it goes to the kernel first
+			UringEnter(ringFd, pendingSubmissions, 0, 0);
+			pendingSubmissions = 0;
+			PushRead(handle);
+		}
+	}
+	std::lock_guard<std::mutex> lock(sqMutex);
+	if (pendingSubmissions != 0 && UringEnter(ringFd, pendingSubmissions, 0, 0) < 0)
+		LOG("Error submitting the file reads to io_uring (errno %d)", errno);
+	pendingSubmissions = 0;
+}
+
+//Needs sqMutex, reads what is left of the file
+bool AsyncIO::PushRead(Handle handle)
+{
+	const unsigned tail = *sqTail;
+	if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+		return false;
+	Request& request = requests[handle];
+	const unsigned index = tail & *sqMask;
+	io_uring_sqe& sqe = sqes[index];
+	memset(&sqe, 0, sizeof(sqe));
+	iovecs[handle].iov_base = request.buffer + request.offset;
+	iovecs[handle].iov_len = static_cast<size_t>(request.size - request.offset);
+	//READV instead of READ, it is there since the first io_uring kernel
+	sqe.opcode = IORING_OP_READV;
+	sqe.fd = request.fd;
+	sqe.off = static_cast<uint64_t>(request.offset);
+	sqe.addr = reinterpret_cast<uint64_t>(&iovecs[handle]);
+	sqe.len = 1;
+	sqe.user_data = handle;
+	sqArray[index] = index;
+	__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+	++pendingSubmissions;
+	return true;
+}
+
+void AsyncIO::CompletionLoop()
+{
+	PROFILE_THREAD("AsyncIO completion");
+	for (;;)
+	{
+		if (UringEnter(ringFd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+		{
+			LOG("Error waiting for the io_uring completions (errno %d)", errno);
+			return;
+		}
+		{
+			//pairs with the submitting thread, the request fields are written before its sqe is pushed under sqMutex
+			std::lock_guard<std::mutex> lock(sqMutex);
+		}
+		bool quit = false;
+		unsigned head = *cqHead;
+		const unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+		for (; head != tail; ++head)
+		{
+			const io_uring_cqe& cqe = cqes[head & *cqMask];
+			if (cqe.user_data == WAKE_USER_DATA)
+			{
+				quit = true;
+				continue;
+			}
+			const Handle handle = static_cast<Handle>(cqe.user_data);
+			Request& request = requests[handle];
+			if (cqe.res > 0)
+				request.offset += cqe.res;
+			//short reads and interrupted reads go again for the rest of the file
+			if ((cqe.res > 0 && request.offset < request.size) || cqe.res == -EINTR || cqe.res == -EAGAIN)
+			{
+				std::lock_guard<std::mutex> lock(sqMutex);
+				if (!PushRead(handle))
+				{
+					UringEnter(ringFd, pendingSubmissions, 0, 0);
+					pendingSubmissions = 0;
+					PushRead(handle);
+				}
+				UringEnter(ringFd, pendingSubmissions, 0, 0);
+				pendingSubmissions = 0;
+				continue;
+			}
+			if (cqe.res < 0)
+				LOG("Error reading file %s (errno %d)", request.path.c_str(), -cqe.res);
+			close(request.fd);
+			request.fd = -1;
+			Complete(handle, request.offset == request.size ? request.size : 0);
+		}
+		__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+		if (quit)
+			return;
+	}
+}
+#endif // ASYNC_IO_URING
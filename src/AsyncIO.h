@@ -0,0 +1,119 @@
+#ifndef __ASYNC_IO_H__
+#define __ASYNC_IO_H__
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define ASYNC_IO_URING
+#endif
+#endif
+
+//Batched asynchronous whole file reads: io_uring on Linux when the kernel allows it, a pool of threads doing blocking reads otherwise
+//Read() only queues, Submit() sends the queued reads as one batch and Wait() is the future of each read
+//The read only assets that are parsed in place (gltf/glb and their buffers) are better mapped with FileSystem::Map
+class AsyncIO
+{
+public:
+	typedef uint32_t Handle;
+	static constexpr Handle INVALID_HANDLE = ~0u;
+	//Called once per read from the io thread when it completes, size is 0 if the file could not be read
+	//The request is freed right after it returns: the handle is not valid for Wait or IsDone and a pooled buffer is the callback's to Release
+	typedef void (*Callback)(Handle handle, const char* buffer, long size, void* userData);
+
+	AsyncIO() {}
+	~AsyncIO() { CleanUp(); }
+
+	bool Init(unsigned int workerThreads = 2);
+	void CleanUp();
+	const char* GetBackendName() const;
+
+	//Without a buffer the destination comes from the pool and has to be given back with Release
+	Handle Read(const char* path, char* buffer = nullptr, long capacity = 0, Callback callback = nullptr, void* userData = nullptr);
+	void Submit();
+	//Same contract as FileSystem::ReadToBuffer: returns the file size, 0 if it could not be read. Only for the reads without a callback
+	long Wait(Handle handle, char*& buffer);
+	bool IsDone(Handle handle);
+
+	//Pooled destination buffers, they are reused by the next reads that fit and freed on CleanUp
+	char* Acquire(long size);
+	void Release(char* buffer);
+
+private:
+	enum class State { FREE, QUEUED, SUBMITTED, DONE };
+	struct Request
+	{
+		std::string path;
+		char* buffer = nullptr;
+		long capacity = 0;
+		long size = 0;
+		//bytes read so far, io_uring can complete a read partially
+		long offset = 0;
+		int fd = -1;
+		bool pooled = false;
+		Callback callback = nullptr;
+		void* userData = nullptr;
+		State state = State::FREE;
+	};
+	static constexpr unsigned int MAX_REQUESTS = 64;
+
+	void StopBackend();
+	bool PrepareBuffer(Request& request, long fileSize);
+	void Complete(Handle handle, long size);
+	void WorkerLoop();
+	void ReadBlocking(Handle handle);
+#ifdef ASYNC_IO_URING
+	bool InitUring();
+	void CleanUpUring();
+	void SubmitUring(const std::vector<Handle>& handles);
+	bool PushRead(Handle handle);
+	void CompletionLoop();
+#endif // ASYNC_IO_URING
+
+	Request requests[MAX_REQUESTS];
+	std::mutex mutex;
+	std::condition_variable completed;
+	std::condition_variable work;
+	std::vector<Handle> queued;
+	std::deque<Handle> submitted;
+	std::vector<std::thread> workers;
+	bool quitting = false;
+	bool initialized = false;
+
+	std::mutex poolMutex;
+	std::vector<char*> poolBuffers;
+	std::vector<long> poolCapacities;
+	std::vector<bool> poolUsed;
+
+#ifdef ASYNC_IO_URING
+	//Raw io_uring rings, no liburing dependency
+	int ringFd = -1;
+	void* sqRing = nullptr;
+	void* cqRing = nullptr;
+	size_t sqRingSize = 0;
+	size_t cqRingSize = 0;
+	struct io_uring_sqe* sqes = nullptr;
+	size_t sqesSize = 0;
+	unsigned* sqHead = nullptr;
+	unsigned* sqTail = nullptr;
+	unsigned* sqMask = nullptr;
+	unsigned* sqArray = nullptr;
+	unsigned sqEntries = 0;
+	unsigned* cqHead = nullptr;
+	unsigned* cqTail = nullptr;
+	unsigned* cqMask = nullptr;
+	struct io_uring_cqe* cqes = nullptr;
+	std::mutex sqMutex;
+	unsigned pendingSubmissions = 0;
+	std::thread completionThread;
+	struct iovec* iovecs = nullptr;
+#endif // ASYNC_IO_URING
+};
+
+#endif // !__ASYNC_IO_H__
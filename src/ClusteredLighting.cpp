@@ -0,0 +1,216 @@
+#include "ClusteredLighting.h"
+#include "glm/geometric.hpp"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+namespace
+{
+	//Distance of the point to the plane, positive on the outer side
+	float PlaneDistance(const glm::vec4& plane, const glm::vec3& point)
+	{
+		return glm::dot(glm::vec3(plane), point) - plane.w;
+	}
+
+	//Plane through the eye at fraction t between the planes a (t = 0) and b (t = 1) of the frustum, positive on the side of a. A point in front of the eye is
+	//at fraction da / (da + db), the planes of the frustum point outward and da + db is negative there
+	glm::vec4 LerpPlane(const glm::vec4& a, const glm::vec4& b, float t)
+	{
+		const glm::vec4 plane = a * (1.0f - t) - b * t;
+		return plane / glm::length(glm::vec3(plane));
+	}
+
+	//Fraction of the point between the planes a and b, clamped to the grid
+	uint32_t GridCoordinate(const glm::vec4& a, const glm::vec4& b, const glm::vec3& position, uint32_t cells)
+	{
+		const float da = PlaneDistance(a, position);
+		const float db = PlaneDistance(b, position);
+		const float sum = da + db;
+		const float t = sum < 0.0f ? da / sum : 0.0f;
+		return static_cast<uint32_t>(std::min(std::max(t * static_cast<float>(cells), 0.0f), static_cast<float>(cells - 1)));
+	}
+}
+
+void ClusteredLighting::BuildParams(const glm::vec4(&planes)[6], float nearDepth, float farDepth, uint32_t lightCount, Params& params)
+{
+	memset(&params, 0, sizeof(Params));
+	for (uint32_t i = 0; i < 6; ++i)
+		params.cameraPlanes[i] = planes[i];
+	for (uint32_t c = 0; c <= CLUSTERS_X; ++c)
+		params.columnPlanes[c] = LerpPlane(planes[2], planes[3], static_cast<float>(c) / static_cast<float>(CLUSTERS_X));
+	for (uint32_t r = 0; r <= CLUSTERS_Y; ++r)
+		params.rowPlanes[r] = LerpPlane(planes[4], planes[5], static_cast<float>(r) / static_cast<float>(CLUSTERS_Y));
+	//Slice 0 goes from the near plane to MIN_SLICE_DEPTH, the rest split the remaining depth exponentially
+	const float minDepth = std::min(std::max(MIN_SLICE_DEPTH, nearDepth * 2.0f), farDepth * 0.5f);
+	float* depths = &params.sliceDepths[0].x;
+	depths[0] = nearDepth;
+	for (uint32_t s = 1; s < CLUSTERS_Z; ++s)
+		depths[s] = minDepth * powf(farDepth / minDepth, static_cast<float>(s - 1) / static_cast<float>(CLUSTERS_Z - 1));
+	depths[CLUSTERS_Z] = farDepth;
+	params.lightCount = std::min(lightCount, MAX_LIGHTS);
+	params.nearDepth = nearDepth;
+	params.farDepth = farDepth;
+	params.sliceScale = static_cast<float>(CLUSTERS_Z - 1) / logf(farDepth / minDepth);
+}
+
+float ClusteredLighting::SliceDepth(const Params& params, uint32_t slice)
+{
+	return params.sliceDepths[slice / 4][slice % 4];
+}
+
+uint32_t ClusteredLighting::ClusterIndex(const Params& params, const glm::vec3& position)
+{
+	const uint32_t column = GridCoordinate(params.cameraPlanes[2], params.cameraPlanes[3], position, CLUSTERS_X);
+	const uint32_t row = GridCoordinate(params.cameraPlanes[4], params.cameraPlanes[5], position, CLUSTERS_Y);
+	//View depth from the near plane, the slices past the first one are logarithmic
+	const float depth = params.nearDepth - PlaneDistance(params.cameraPlanes[0], position);
+	const float minDepth = SliceDepth(params, 1);
+	uint32_t slice = 0;
+	if (depth >= minDepth)
+		slice = std::min(1 + static_cast<uint32_t>(logf(depth / minDepth) * params.sliceScale), CLUSTERS_Z - 1);
+	return (slice * CLUSTERS_Y + row) * CLUSTERS_X + column;
+}
+
+bool ClusteredLighting::SphereInColumn(const Params& params, uint32_t column, const glm::vec3& center, float radius)
+{
+	return (column == 0 || PlaneDistance(params.columnPlanes[column], center) <= radius) &&
+		(column == CLUSTERS_X - 1 || PlaneDistance(params.columnPlanes[column + 1], center) >= -radius);
+}
+
+bool ClusteredLighting::SphereInRow(const Params& params, uint32_t row, const glm::vec3& center, float radius)
+{
+	return (row == 0 || PlaneDistance(params.rowPlanes[row], center) <= radius) &&
+		(row == CLUSTERS_Y - 1 || PlaneDistance(params.rowPlanes[row + 1], center) >= -radius);
+}
+
+bool ClusteredLighting::SphereInSlice(const Params& params, uint32_t slice, const glm::vec3& center, float radius)
+{
+	const float depth = params.nearDepth - PlaneDistance(params.cameraPlanes[0], center);
+	return depth + radius >= SliceDepth(params, slice) && depth - radius <= SliceDepth(params, slice + 1);
+}
+
+uint32_t ClusteredLighting::BinLights(const Params& params, const Light* lights, uint32_t* grid)
+{
+	uint32_t* counts = grid;
+	uint32_t* indices = grid + CLUSTER_COUNT;
+	memset(counts, 0, sizeof(uint32_t) * CLUSTER_COUNT);
+	bool columns[CLUSTERS_X];
+	bool rows[CLUSTERS_Y];
+	for (uint32_t l = 0; l < params.lightCount; ++l)
+	{
+		const glm::vec3 center(lights[l].positionRadius);
+		const float radius = lights[l].positionRadius.w;
+		//The slices first, most of the lights are out of the depth range
+		uint32_t firstSlice = CLUSTERS_Z;
+		uint32_t lastSlice = 0;
+		for (uint32_t s = 0; s < CLUSTERS_Z; ++s)
+		{
+			if (SphereInSlice(params, s, center, radius))
+			{
+				firstSlice = std::min(firstSlice, s);
+				lastSlice = s;
+			}
+		}
+		if (firstSlice == CLUSTERS_Z)
+			continue;
+		bool anyColumn = false;
+		for (uint32_t c = 0; c < CLUSTERS_X; ++c)
+		{
+			columns[c] = SphereInColumn(params, c, center, radius);
+			anyColumn |= columns[c];
+		}
+		bool anyRow = false;
+		for (uint32_t r = 0; r < CLUSTERS_Y; ++r)
+		{
+			rows[r] = SphereInRow(params, r, center, radius);
+			anyRow |= rows[r];
+		}
+		if (!anyColumn || !anyRow)
+			continue;
+		for (uint32_t s = firstSlice; s <= lastSlice; ++s)
+		{
+			if (!SphereInSlice(params, s, center, radius))
+				continue;
+			for (uint32_t r = 0; r < CLUSTERS_Y; ++r)
+			{
+				if (!rows[r])
+					continue;
+				for (uint32_t c = 0; c < CLUSTERS_X; ++c)
+				{
+					if (!columns[c])
+						continue;
+					const uint32_t cluster = (s * CLUSTERS_Y + r) * CLUSTERS_X + c;
+					if (counts[cluster] < MAX_LIGHTS_PER_CLUSTER)
+						indices[cluster * MAX_LIGHTS_PER_CLUSTER + counts[cluster]] = l;
+					++counts[cluster];
+				}
+			}
+		}
+	}
+	uint32_t overflow = 0;
+	for (uint32_t i = 0; i < CLUSTER_COUNT; ++i)
+		overflow += counts[i] > MAX_LIGHTS_PER_CLUSTER ? 1 : 0;
+	return overflow;
+}
+
+uint32_t ClusteredLighting::BinLightsPerCluster(const Params& params, const Light* lights, uint32_t* grid)
+{
+	uint32_t* counts = grid;
+	uint32_t* indices = grid + CLUSTER_COUNT;
+	uint32_t overflow = 0;
+	for (uint32_t cluster = 0; cluster < CLUSTER_COUNT; ++cluster)
+	{
+		const uint32_t column = cluster % CLUSTERS_X;
+		const uint32_t row = (cluster / CLUSTERS_X) % CLUSTERS_Y;
+		const uint32_t slice = cluster / (CLUSTERS_X * CLUSTERS_Y);
+		uint32_t count = 0;
+		for (uint32_t l = 0; l < params.lightCount; ++l)
+		{
+			const glm::vec3 center(lights[l].positionRadius);
+			const float radius = lights[l].positionRadius.w;
+			if (!SphereInSlice(params, slice, center, radius) || !SphereInRow(params, row, center, radius) || !SphereInColumn(params, column, center, radius))
+				continue;
+			if (count < MAX_LIGHTS_PER_CLUSTER)
+				indices[cluster * MAX_LIGHTS_PER_CLUSTER + count] = l;
+			++count;
+		}
+		counts[cluster] = count;
+		overflow += count > MAX_LIGHTS_PER_CLUSTER ? 1 : 0;
+	}
+	return overflow;
+}
+
+void ClusteredLighting::SceneLights(uint32_t count, float minRadius, float maxRadius, Light* lights)
+{
+	uint32_t state = 7;
+	auto random = [&state]() { state ^= state << 13; state ^= state >> 17; state ^= state << 5; return static_cast<float>(state) / 4294967296.0f; };
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		lights[i].positionRadius = glm::vec4(random() * 12000.0f - 6000.0f, random() * 12000.0f - 6000.0f, random() * 12000.0f - 6000.0f, minRadius + random() * (maxRadius - minRadius));
+		lights[i].color = glm::vec4(0.5f + random() * 0.5f, 0.5f + random() * 0.5f, 0.5f + random() * 0.5f, 1.0f);
+	}
+}
+
+glm::vec3 ClusteredLighting::ShadePoint(const Params& params, const Light* lights, const uint32_t* grid, const glm::vec3& position, const glm::vec3& normal, uint32_t* walked)
+{
+	const uint32_t cluster = ClusterIndex(params, position);
+	const uint32_t count = std::min(grid[cluster], MAX_LIGHTS_PER_CLUSTER);
+	const uint32_t* indices = grid + CLUSTER_COUNT + cluster * MAX_LIGHTS_PER_CLUSTER;
+	glm::vec3 color(0.0f);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const Light& light = lights[indices[i]];
+		const glm::vec3 toLight = glm::vec3(light.positionRadius) - position;
+		const float distanceSquared = glm::dot(toLight, toLight);
+		const float radiusSquared = light.positionRadius.w * light.positionRadius.w;
+		if (distanceSquared >= radiusSquared)
+			continue;
+		//Smooth falloff to 0 at the radius
+		const float falloff = 1.0f - distanceSquared / radiusSquared;
+		const float diffuse = std::max(glm::dot(normal, toLight / sqrtf(std::max(distanceSquared, 1e-8f))), 0.0f);
+		color += glm::vec3(light.color) * light.color.w * falloff * falloff * diffuse;
+	}
+	if (walked != nullptr)
+		*walked = count;
+	return color;
+}
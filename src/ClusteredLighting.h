@@ -0,0 +1,80 @@
+#ifndef __CLUSTERED_LIGHTING_H__
+#define __CLUSTERED_LIGHTING_H__
+
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+#include <stdint.h>
+
+//Clustered forward lighting: the view frustum of the camera (Camera::GetPlanes) is split into a froxel grid of CLUSTERS_X x CLUSTERS_Y columns and rows
+//and CLUSTERS_Z exponential depth slices. ClusterLights.comp tests the spheres of the point lights against every cluster and lists up to
+//MAX_LIGHTS_PER_CLUSTER of them in light order, Shader.frag and VisibilityShade.comp find the cluster of the fragment and only walk its list. The clusters
+//of the border columns and rows reach out to infinity on their outer side, every point in front of the camera between the near and far planes belongs to
+//one cluster
+//This is also the CPU reference of the binning of ClusterLights.comp and the cluster lookup of Shader.frag
+namespace ClusteredLighting
+{
+	//Same as ClusterLights.comp, Shader.frag and VisibilityShade.comp
+	constexpr uint32_t CLUSTERS_X = 16;
+	constexpr uint32_t CLUSTERS_Y = 9;
+	constexpr uint32_t CLUSTERS_Z = 24;
+	constexpr uint32_t CLUSTER_COUNT = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+	//Lights a fragment walks at most, the lights past it on a cluster are dropped (and counted as overflow)
+	constexpr uint32_t MAX_LIGHTS_PER_CLUSTER = 64;
+	constexpr uint32_t MAX_LIGHTS = 16384;
+	//Same as ClusterLights.comp: lights loaded to shared memory per batch, one per invocation
+	constexpr uint32_t GROUP_SIZE = 64;
+	//View depth of the end of the first slice, the slices grow exponentially from there to the far plane
+	constexpr float MIN_SLICE_DEPTH = 10.0f;
+	//Radius range of the lights of the scene
+	constexpr float DEFAULT_MIN_RADIUS = 100.0f;
+	constexpr float DEFAULT_MAX_RADIUS = 600.0f;
+
+	//Same layout as Lights on ClusterLights.comp, Shader.frag and VisibilityShade.comp
+	struct Light
+	{
+		//world position and radius of influence
+		glm::vec4 positionRadius;
+		//rgb and intensity
+		glm::vec4 color;
+	};
+
+	//Same layout (std140) as the clusterParams uniform: the camera planes, the boundary planes of the columns and rows and the depth of the slices
+	struct Params
+	{
+		glm::vec4 cameraPlanes[6];
+		//plane between column c - 1 and c, the points with a positive distance are on the left of it
+		glm::vec4 columnPlanes[CLUSTERS_X + 1];
+		//plane between row r - 1 and r, positive above it
+		glm::vec4 rowPlanes[CLUSTERS_Y + 1];
+		//view depth where slice s starts, four per vec4
+		glm::vec4 sliceDepths[(CLUSTERS_Z + 1 + 3) / 4];
+		uint32_t lightCount;
+		float nearDepth;
+		float farDepth;
+		//slices per unit of log(depth) past the first slice
+		float sliceScale;
+	};
+	//Cluster grid on the GPU: lights of every cluster (may be over MAX_LIGHTS_PER_CLUSTER, only that many are listed) then the light indices of every cluster
+	constexpr uint32_t GRID_WORDS = CLUSTER_COUNT + CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER;
+
+	//Boundaries of the grid from the Camera::GetPlanes planes (near, far, left, right, top, bottom) and the near and far distances of the camera
+	void BuildParams(const glm::vec4(&planes)[6], float nearDepth, float farDepth, uint32_t lightCount, Params& params);
+	float SliceDepth(const Params& params, uint32_t slice);
+	//Cluster of a point, the lookup of Shader.frag
+	uint32_t ClusterIndex(const Params& params, const glm::vec3& position);
+	//Tests of ClusterLights.comp: the sphere reaches column, row or slice (the border columns and rows are open on their outer side)
+	bool SphereInColumn(const Params& params, uint32_t column, const glm::vec3& center, float radius);
+	bool SphereInRow(const Params& params, uint32_t row, const glm::vec3& center, float radius);
+	bool SphereInSlice(const Params& params, uint32_t slice, const glm::vec3& center, float radius);
+	//CPU binning, one pass over the lights that only visits the clusters of its column, row and slice ranges. grid is GRID_WORDS, the lists are in light
+	//order and match ClusterLights.comp. Returns the clusters that dropped lights
+	uint32_t BinLights(const Params& params, const Light* lights, uint32_t* grid);
+	//Same loop as ClusterLights.comp: every cluster tests every light
+	uint32_t BinLightsPerCluster(const Params& params, const Light* lights, uint32_t* grid);
+	//Lights spread over the volume of the scene of ModuleVulkan (and the boxes of the MeshTool simulations), the same ones for the same count
+	void SceneLights(uint32_t count, float minRadius, float maxRadius, Light* lights);
+	//Diffuse of the point lights listed on the cluster of the point, the loop of Shader.frag. walked returns the lights read
+	glm::vec3 ShadePoint(const Params& params, const Light* lights, const uint32_t* grid, const glm::vec3& position, const glm::vec3& normal, uint32_t* walked);
+}
+
+#endif // !__CLUSTERED_LIGHTING_H__
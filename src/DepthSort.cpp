@@ -0,0 +1,52 @@
+#include "DepthSort.h"
+#include <string.h>
+#include <algorithm>
+
+uint32_t DepthSort::DepthKey(float depth, float range)
+{
+	return static_cast<uint32_t>(std::min(std::max(depth / range, 0.0f), 1.0f) * static_cast<float>(KEY_MAX));
+}
+
+uint32_t DepthSort::BlockCount(uint32_t count)
+{
+	return (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+void DepthSort::Sort(uint32_t* keys, uint32_t* values, uint32_t count, uint32_t* scratchKeys, uint32_t* scratchValues, uint32_t* blockCounts)
+{
+	const uint32_t blockCount = BlockCount(count);
+	uint32_t* inKeys = keys;
+	uint32_t* inValues = values;
+	uint32_t* outKeys = scratchKeys;
+	uint32_t* outValues = scratchValues;
+	for (uint32_t pass = 0; pass < PASSES; ++pass)
+	{
+		const uint32_t shift = pass * RADIX_BITS;
+		//histogram stage, digit major like the scan reads them
+		memset(blockCounts, 0, sizeof(uint32_t) * RADIX * blockCount);
+		for (uint32_t i = 0; i < count; ++i)
+			++blockCounts[((inKeys[i] >> shift) & (RADIX - 1)) * blockCount + i / BLOCK_SIZE];
+		//scan stage, every count becomes the first position of its digit on its block
+		uint32_t offset = 0;
+		for (uint32_t i = 0; i < RADIX * blockCount; ++i)
+		{
+			const uint32_t blockDigits = blockCounts[i];
+			blockCounts[i] = offset;
+			offset += blockDigits;
+		}
+		//scatter stage, the workgroup ranks the elements of the block in order
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const uint32_t position = blockCounts[((inKeys[i] >> shift) & (RADIX - 1)) * blockCount + i / BLOCK_SIZE]++;
+			outKeys[position] = inKeys[i];
+			outValues[position] = inValues[i];
+		}
+		std::swap(inKeys, outKeys);
+		std::swap(inValues, outValues);
+	}
+	if (inKeys != keys)
+	{
+		memcpy(keys, inKeys, sizeof(uint32_t) * count);
+		memcpy(values, inValues, sizeof(uint32_t) * count);
+	}
+}
@@ -0,0 +1,30 @@
+#ifndef __DEPTH_SORT_H__
+#define __DEPTH_SORT_H__
+
+#include <stdint.h>
+
+//Front to back order of the instances that pass culling.comp. The cull appends the survivors with atomics so the draw order is random and early Z
+//rejects little, with SetDepthSort the cull writes a depth key per survivor and RadixSort.comp sorts the (key, instance + record) pairs before
+//vkCmdDrawMeshTasksIndirectCountEXT reads the commands. This is the CPU reference of RadixSort.comp, the same passes over the same blocks
+//Every pass is a least significant digit pass: a histogram per block, an exclusive scan of the histograms in digit major order (the offset of every
+//digit of every block) and a stable scatter, the elements of a block keep their order inside each digit
+namespace DepthSort
+{
+	//Same as RadixSort.comp: one workgroup per block, 4 elements per invocation
+	constexpr uint32_t WORKGROUP_SIZE = 256;
+	constexpr uint32_t BLOCK_SIZE = 1024;
+	constexpr uint32_t RADIX_BITS = 8;
+	constexpr uint32_t RADIX = 1u << RADIX_BITS;
+	//Depth quantized to 16 bits over the near to far distance (0.15 units with the engine camera), an even pass count leaves the result where it started
+	constexpr uint32_t KEY_BITS = 16;
+	constexpr uint32_t KEY_MAX = (1u << KEY_BITS) - 1;
+	constexpr uint32_t PASSES = KEY_BITS / RADIX_BITS;
+
+	//Same as culling.comp: depth is the distance past the near plane along the view direction, range the near to far distance
+	uint32_t DepthKey(float depth, float range);
+	uint32_t BlockCount(uint32_t count);
+	//Sorts keys and values in place, the scratch arrays have count elements and blockCounts RADIX * BlockCount(count)
+	void Sort(uint32_t* keys, uint32_t* values, uint32_t count, uint32_t* scratchKeys, uint32_t* scratchValues, uint32_t* blockCounts);
+}
+
+#endif // !__DEPTH_SORT_H__
@@ -21,3 +21,88 @@ long FileSystem::ReadToBuffer(const char* path, char*& buffer, const char* mode)
     fclose(fileHandle);
     return fileSize;
 }
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+bool FileSystem::Map(const char* path, MappedFile& file)
+{
+    HANDLE fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(fileHandle);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    //the view keeps the file open
+    CloseHandle(fileHandle);
+    if (mapping == NULL)
+    {
+        LOG("Error mapping file %s", path);
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL)
+    {
+        LOG("Error mapping file %s", path);
+        CloseHandle(mapping);
+        return false;
+    }
+    file.data = static_cast<const unsigned char*>(view);
+    file.size = static_cast<size_t>(fileSize.QuadPart);
+    file.handle = mapping;
+    return true;
+}
+
+void FileSystem::Unmap(MappedFile& file)
+{
+    if (file.data != nullptr)
+        UnmapViewOfFile(file.data);
+    if (file.handle != nullptr)
+        CloseHandle(file.handle);
+    file = MappedFile();
+}
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+bool FileSystem::Map(const char* path, MappedFile& file)
+{
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    //the mapping keeps the file open
+    close(fd);
+    if (view == MAP_FAILED)
+    {
+        LOG("Error mapping file %s", path);
+        return false;
+    }
+    //the importer reads the chunks front to back once
+    madvise(view, static_cast<size_t>(fileStat.st_size), MADV_SEQUENTIAL);
+    file.data = static_cast<const unsigned char*>(view);
+    file.size = static_cast<size_t>(fileStat.st_size);
+    file.handle = nullptr;
+    return true;
+}
+
+void FileSystem::Unmap(MappedFile& file)
+{
+    if (file.data != nullptr)
+        munmap(const_cast<unsigned char*>(file.data), file.size);
+    file = MappedFile();
+}
+#endif // _WIN32
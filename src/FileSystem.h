@@ -1,10 +1,22 @@
 #ifndef __FILE_SYSTEM_H__
 #define __FILE_SYSTEM_H__
 
+#include <stddef.h>
+
 namespace FileSystem
 {
 	//TODO: crear una enum pel mode i fer una funci constexpr que ens doni el const char* a partir de la enum del mode (lookup)
 	long ReadToBuffer(const char* path, char*& buffer, const char* mode);
+
+	//Read only view of a whole file, the pages are loaded on demand by the OS instead of copied to a buffer
+	struct MappedFile
+	{
+		const unsigned char* data = nullptr;
+		size_t size = 0;
+		void* handle = nullptr;
+	};
+	bool Map(const char* path, MappedFile& file);
+	void Unmap(MappedFile& file);
 }
 
 #endif // !__FILE_SYSTEM_H__
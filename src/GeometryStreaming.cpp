@@ -0,0 +1,427 @@
+#include "GeometryStreaming.h"
+#include "Globals.h"
+#include "meshoptimizer.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+namespace
+{
+	//"MLPG"
+	constexpr uint32_t MAGIC = 0x47504C4D;
+	//Bump it when the page layout changes
+	constexpr uint32_t VERSION = 2;
+	//The pages start on OS page boundaries, a page never shares a mapped page with the next one
+	constexpr size_t PAGE_ALIGNMENT = 4096;
+	//Simplification error of the fallback LOD, relative to the mesh extents
+	constexpr float FALLBACK_TARGET_ERROR = 0.05f;
+
+	struct FileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t maxVertices;
+		uint32_t maxPrimitives;
+		//FNV-1a of the meshlets, their vertex indices, triangles and the vertices of both LODs
+		uint32_t hash;
+		uint32_t pageCount;
+		uint32_t fallbackPageCount;
+		uint32_t pageSize;
+	};
+	static_assert(sizeof(FileHeader) <= GeometryStreaming::PAGE_FILE_HEADER_SIZE, "The page file header does not fit");
+
+	//At the start of every page, the arrays follow with their full capacity: meshlet records, vertex reference words, vertices, triangle words
+	//The records have the stream offsets and the vertex base of the page, ExpandPage rebases them
+	struct PageHeader
+	{
+		uint32_t meshletCount;
+		uint32_t referenceWords;
+		uint32_t triangleWords;
+		uint32_t vertexCount;
+	};
+
+	uint32_t Hash(const void* data, size_t size, uint32_t hash)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; ++i)
+			hash = (hash ^ bytes[i]) * 16777619u;
+		return hash;
+	}
+
+	uint32_t HashMeshlets(const MeshletMesh& meshletMesh, uint32_t hash)
+	{
+		const meshopt_Meshlet& last = meshletMesh.meshlets[meshletMesh.meshletCount - 1];
+		hash = Hash(meshletMesh.meshlets, sizeof(meshopt_Meshlet) * meshletMesh.meshletCount, hash);
+		hash = Hash(meshletMesh.meshletVertices, sizeof(unsigned int) * (last.vertex_offset + last.vertex_count), hash);
+		hash = Hash(meshletMesh.meshletTriangles, last.triangle_offset + last.triangle_count * 3, hash);
+		return Hash(meshletMesh.mesh.vertices, sizeof(Vertex) * meshletMesh.mesh.numVertices, hash);
+	}
+
+	size_t MeshletsOffset() { return sizeof(PageHeader); }
+	size_t ReferencesOffset() { return MeshletsOffset() + sizeof(MeshletCompression::Record) * GeometryStreaming::PAGE_MESHLETS; }
+	size_t VerticesOffset(const GeometryStreaming::PageLayout& layout) { return ReferencesOffset() + sizeof(uint32_t) * layout.ReferenceCapacity(); }
+	size_t TrianglesOffset(const GeometryStreaming::PageLayout& layout) { return VerticesOffset(layout) + sizeof(Vertex) * layout.VertexCapacity(); }
+
+	bool WritePages(FILE* file, const MeshletMesh& meshletMesh, const GeometryStreaming::PageLayout& layout, unsigned char* page)
+	{
+		std::vector<uint32_t> vertexRemap(meshletMesh.mesh.numVertices, GeometryStreaming::NOT_RESIDENT);
+		const size_t pageSize = layout.PageSize();
+		for (size_t first = 0; first < meshletMesh.meshletCount; first += GeometryStreaming::PAGE_MESHLETS)
+		{
+			memset(page, 0, pageSize);
+			if (!GeometryStreaming::BuildPage(meshletMesh, first, layout, vertexRemap, page) || fwrite(page, 1, pageSize, file) != pageSize)
+				return false;
+		}
+		return true;
+	}
+}
+
+size_t GeometryStreaming::PageLayout::PageSize() const
+{
+	const size_t size = TrianglesOffset(*this) + sizeof(uint32_t) * TriangleCapacity();
+	return (size + PAGE_ALIGNMENT - 1) & ~(PAGE_ALIGNMENT - 1);
+}
+
+void GeometryStreaming::BuildFallbackMesh(const Mesh& mesh, Mesh& fallback)
+{
+	unsigned int* indices = HostMemory::NewArray<unsigned int>(mesh.numIndices, HostMemory::Tag::MESHES);
+	const size_t targetIndices = std::max<size_t>(3, static_cast<size_t>(mesh.numIndices * FALLBACK_TRIANGLE_RATIO) / 3 * 3);
+	size_t indexCount = meshopt_simplify(indices, mesh.indices, mesh.numIndices, &mesh.vertices->position[0], mesh.numVertices, sizeof(Vertex), targetIndices, FALLBACK_TARGET_ERROR, 0, nullptr);
+	//Nothing left under the error, the mesh is already coarse
+	if (indexCount == 0)
+	{
+		memcpy(indices, mesh.indices, sizeof(unsigned int) * mesh.numIndices);
+		indexCount = mesh.numIndices;
+	}
+	fallback.numIndices = static_cast<unsigned int>(indexCount);
+	fallback.indices = indices;
+	fallback.vertices = HostMemory::NewArray<Vertex>(mesh.numVertices, HostMemory::Tag::MESHES);
+	//drops the vertices the simplified triangles do not use
+	fallback.numVertices = static_cast<unsigned int>(meshopt_optimizeVertexFetch(fallback.vertices, fallback.indices, fallback.numIndices, mesh.vertices, mesh.numVertices, sizeof(Vertex)));
+}
+
+void GeometryStreaming::GetPageFilePath(const char* meshPath, const PageLayout& layout, char* path, size_t size)
+{
+	snprintf(path, size, "%s.%u_%u.pages", meshPath, layout.maxVertices, layout.maxPrimitives);
+}
+
+bool GeometryStreaming::WritePageFile(const char* meshPath, const PageLayout& layout, const MeshletMesh& meshletMesh, const MeshletMesh& fallbackMesh)
+{
+	char path[512];
+	GetPageFilePath(meshPath, layout, path, sizeof(path));
+	FileHeader header{};
+	header.magic = MAGIC;
+	header.version = VERSION;
+	header.maxVertices = layout.maxVertices;
+	header.maxPrimitives = layout.maxPrimitives;
+	header.hash = HashMeshlets(fallbackMesh, HashMeshlets(meshletMesh, 2166136261u));
+	header.pageCount = PageCount(meshletMesh.meshletCount) + PageCount(fallbackMesh.meshletCount);
+	header.fallbackPageCount = PageCount(fallbackMesh.meshletCount);
+	header.pageSize = static_cast<uint32_t>(layout.PageSize());
+
+	FILE* file = fopen(path, "rb");
+	if (file != nullptr)
+	{
+		FileHeader current;
+		const bool same = fread(&current, sizeof(FileHeader), 1, file) == 1 && memcmp(&current, &header, sizeof(FileHeader)) == 0 &&
+			fseek(file, 0, SEEK_END) == 0 && static_cast<size_t>(ftell(file)) == PAGE_FILE_HEADER_SIZE + static_cast<size_t>(header.pageCount) * header.pageSize;
+		fclose(file);
+		if (same)
+			return true;
+	}
+	file = fopen(path, "wb");
+	if (file == nullptr)
+	{
+		LOG("Error: could not write the page file %s", path);
+		return false;
+	}
+	unsigned char* page = new unsigned char[std::max<size_t>(header.pageSize, PAGE_FILE_HEADER_SIZE)]{};
+	memcpy(page, &header, sizeof(FileHeader));
+	const bool written = fwrite(page, 1, PAGE_FILE_HEADER_SIZE, file) == PAGE_FILE_HEADER_SIZE &&
+		WritePages(file, meshletMesh, layout, page) && WritePages(file, fallbackMesh, layout, page);
+	delete[] page;
+	fclose(file);
+	if (!written)
+	{
+		LOG("Error: could not write the page file %s", path);
+		remove(path);
+	}
+	return written;
+}
+
+bool GeometryStreaming::BuildPage(const MeshletMesh& meshletMesh, size_t first, const PageLayout& layout, std::vector<uint32_t>& vertexRemap, unsigned char* page)
+{
+	PageHeader header{};
+	MeshletCompression::Record* records = reinterpret_cast<MeshletCompression::Record*>(page + MeshletsOffset());
+	uint32_t* references = reinterpret_cast<uint32_t*>(page + ReferencesOffset());
+	Vertex* vertices = reinterpret_cast<Vertex*>(page + VerticesOffset(layout));
+	uint32_t* triangles = reinterpret_cast<uint32_t*>(page + TrianglesOffset(layout));
+	uint32_t pageVertices[ModuleVulkan::MAX_MESHLET_OUTPUTS];
+	bool encoded = true;
+	const size_t end = std::min(meshletMesh.meshletCount, first + PAGE_MESHLETS);
+	for (size_t m = first; m < end; ++m)
+	{
+		const meshopt_Meshlet& source = meshletMesh.meshlets[m];
+		//the vertices the meshlet uses first get the next page numbers, the encoder only stores the ones before them
+		const uint32_t firstNewVertex = header.vertexCount;
+		for (unsigned int v = 0; v < source.vertex_count; ++v)
+		{
+			const unsigned int vertex = meshletMesh.meshletVertices[source.vertex_offset + v];
+			if (vertexRemap[vertex] == NOT_RESIDENT)
+			{
+				vertexRemap[vertex] = header.vertexCount;
+				vertices[header.vertexCount++] = meshletMesh.mesh.vertices[vertex];
+			}
+			pageVertices[v] = vertexRemap[vertex];
+		}
+		MeshletCompression::Record& record = records[header.meshletCount++];
+		uint32_t referenceWords, triangleWords;
+		encoded = encoded && MeshletCompression::Encode(pageVertices, source.vertex_count, &meshletMesh.meshletTriangles[source.triangle_offset], source.triangle_count,
+			firstNewVertex, record, references + header.referenceWords, referenceWords, triangles + header.triangleWords, triangleWords);
+		record.vertexStream = header.referenceWords;
+		record.triangleStream = header.triangleWords;
+		header.referenceWords += referenceWords;
+		header.triangleWords += triangleWords;
+	}
+	for (size_t m = first; m < end; ++m)
+	{
+		for (unsigned int v = 0; v < meshletMesh.meshlets[m].vertex_count; ++v)
+			vertexRemap[meshletMesh.meshletVertices[meshletMesh.meshlets[m].vertex_offset + v]] = NOT_RESIDENT;
+	}
+	memcpy(page, &header, sizeof(PageHeader));
+	if (!encoded)
+		LOG("Error: the meshlets of page %zu are not on first use order", first / PAGE_MESHLETS);
+	return encoded;
+}
+
+GeometryStreaming::PageUpload GeometryStreaming::ExpandPage(const unsigned char* page, const PageLayout& layout, uint32_t slot, unsigned char* dst)
+{
+	PageHeader header;
+	memcpy(&header, page, sizeof(PageHeader));
+	const uint32_t vertexBase = slot * layout.VertexCapacity();
+	const uint32_t referenceBase = slot * layout.ReferenceCapacity();
+	const uint32_t triangleBase = slot * layout.TriangleCapacity();
+	MeshletCompression::Record* records = reinterpret_cast<MeshletCompression::Record*>(dst);
+	unsigned char* references = dst + layout.SlotMeshletsSize();
+	unsigned char* triangles = references + layout.SlotMeshletVerticesSize();
+	unsigned char* vertices = triangles + layout.SlotTrianglesSize();
+
+	//the mapped page may not be aligned for the records, everything is read with memcpy. The streams are the same on the pools, only the
+	//offsets of the records move
+	memcpy(records, page + MeshletsOffset(), sizeof(MeshletCompression::Record) * header.meshletCount);
+	for (uint32_t i = 0; i < header.meshletCount; ++i)
+	{
+		records[i].vertexStream += referenceBase;
+		records[i].triangleStream += triangleBase;
+		records[i].vertexBase += vertexBase;
+	}
+	memcpy(references, page + ReferencesOffset(), sizeof(uint32_t) * header.referenceWords);
+	memcpy(triangles, page + TrianglesOffset(layout), sizeof(uint32_t) * header.triangleWords);
+	memcpy(vertices, page + VerticesOffset(layout), sizeof(Vertex) * header.vertexCount);
+
+	PageUpload upload;
+	upload.meshletCount = header.meshletCount;
+	upload.referenceWords = header.referenceWords;
+	upload.triangleWords = header.triangleWords;
+	upload.vertexCount = header.vertexCount;
+	return upload;
+}
+
+void GeometryStreaming::ResidencyManager::Init(const std::vector<uint32_t>& groups, uint32_t groupCount, uint32_t slotCount)
+{
+	pageGroups = groups;
+	pageSlots.assign(pageGroups.size(), NOT_RESIDENT);
+	groupMissing.assign(groupCount, 0);
+	for (uint32_t group : pageGroups)
+		++groupMissing[group];
+	slotPages.assign(slotCount, NOT_RESIDENT);
+	slotLastUse.assign(slotCount, 0);
+	pinned.assign(slotCount, false);
+	lruPrev.assign(slotCount, NOT_RESIDENT);
+	lruNext.assign(slotCount, NOT_RESIDENT);
+	lruHead = NOT_RESIDENT;
+	lruTail = NOT_RESIDENT;
+	//the lowest slots are given first
+	freeSlots.resize(slotCount);
+	for (uint32_t i = 0; i < slotCount; ++i)
+		freeSlots[i] = slotCount - 1 - i;
+	residentPages = 0;
+	evictions = 0;
+	//the whole tables are uploaded the first time
+	pageDirty = DirtyRange();
+	groupDirty = DirtyRange();
+	if (!pageSlots.empty())
+	{
+		pageDirty.Add(0);
+		pageDirty.Add(static_cast<uint32_t>(pageSlots.size() - 1));
+	}
+	if (groupCount != 0)
+	{
+		groupDirty.Add(0);
+		groupDirty.Add(groupCount - 1);
+	}
+}
+
+uint32_t GeometryStreaming::ResidencyManager::Pin(uint32_t page)
+{
+	uint32_t slot = pageSlots[page];
+	if (slot != NOT_RESIDENT)
+	{
+		if (!pinned[slot])
+			Unlink(slot);
+	}
+	else
+	{
+		if (freeSlots.empty())
+			return NOT_RESIDENT;
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+		Assign(page, slot);
+	}
+	pinned[slot] = true;
+	return slot;
+}
+
+void GeometryStreaming::ResidencyManager::Touch(uint32_t page, uint64_t frame)
+{
+	const uint32_t slot = pageSlots[page];
+	if (slot == NOT_RESIDENT || pinned[slot])
+		return;
+	slotLastUse[slot] = std::max(slotLastUse[slot], frame);
+	Unlink(slot);
+	LinkFront(slot);
+}
+
+uint32_t GeometryStreaming::ResidencyManager::MakeResident(uint32_t page, uint64_t frame, uint32_t& evictedPage)
+{
+	evictedPage = NOT_RESIDENT;
+	uint32_t slot = pageSlots[page];
+	if (slot != NOT_RESIDENT)
+		return slot;
+	if (!freeSlots.empty())
+	{
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else
+	{
+		slot = lruTail;
+		//Everything resident is still in use, evicting it would only move the misses to other pages
+		if (slot == NOT_RESIDENT || slotLastUse[slot] + minEvictionAge > frame)
+			return NOT_RESIDENT;
+		evictedPage = slotPages[slot];
+		Unlink(slot);
+		Unassign(slot);
+		++evictions;
+	}
+	Assign(page, slot);
+	slotLastUse[slot] = frame;
+	LinkFront(slot);
+	return slot;
+}
+
+void GeometryStreaming::ResidencyManager::Assign(uint32_t page, uint32_t slot)
+{
+	pageSlots[page] = slot;
+	slotPages[slot] = page;
+	pageDirty.Add(page);
+	--groupMissing[pageGroups[page]];
+	groupDirty.Add(pageGroups[page]);
+	++residentPages;
+}
+
+void GeometryStreaming::ResidencyManager::Unassign(uint32_t slot)
+{
+	const uint32_t page = slotPages[slot];
+	pageSlots[page] = NOT_RESIDENT;
+	slotPages[slot] = NOT_RESIDENT;
+	pageDirty.Add(page);
+	++groupMissing[pageGroups[page]];
+	groupDirty.Add(pageGroups[page]);
+	--residentPages;
+}
+
+void GeometryStreaming::ResidencyManager::LinkFront(uint32_t slot)
+{
+	lruPrev[slot] = NOT_RESIDENT;
+	lruNext[slot] = lruHead;
+	if (lruHead != NOT_RESIDENT)
+		lruPrev[lruHead] = slot;
+	lruHead = slot;
+	if (lruTail == NOT_RESIDENT)
+		lruTail = slot;
+}
+
+void GeometryStreaming::ResidencyManager::Unlink(uint32_t slot)
+{
+	if (lruPrev[slot] != NOT_RESIDENT)
+		lruNext[lruPrev[slot]] = lruNext[slot];
+	else if (lruHead == slot)
+		lruHead = lruNext[slot];
+	if (lruNext[slot] != NOT_RESIDENT)
+		lruPrev[lruNext[slot]] = lruPrev[slot];
+	else if (lruTail == slot)
+		lruTail = lruPrev[slot];
+	lruPrev[slot] = NOT_RESIDENT;
+	lruNext[slot] = NOT_RESIDENT;
+}
+
+void GeometryStreaming::ResidencyManager::TakeDirty(DirtyRange& range, uint32_t& first, uint32_t& end)
+{
+	if (range.first >= range.end)
+	{
+		first = 0;
+		end = 0;
+		return;
+	}
+	first = range.first;
+	end = range.end;
+	range = DirtyRange();
+}
+
+bool GeometryStreaming::ResidencyManager::Validate() const
+{
+	uint32_t resident = 0;
+	std::vector<uint32_t> missing(groupMissing.size(), 0);
+	for (uint32_t page = 0; page < pageSlots.size(); ++page)
+	{
+		const uint32_t slot = pageSlots[page];
+		if (slot == NOT_RESIDENT)
+		{
+			++missing[pageGroups[page]];
+			continue;
+		}
+		if (slot >= slotPages.size() || slotPages[slot] != page)
+			return false;
+		++resident;
+	}
+	if (resident != residentPages || missing != groupMissing)
+		return false;
+	uint32_t pinnedCount = 0;
+	for (uint32_t slot = 0; slot < slotPages.size(); ++slot)
+	{
+		if (pinned[slot])
+			++pinnedCount;
+		if (slotPages[slot] != NOT_RESIDENT && pageSlots[slotPages[slot]] != slot)
+			return false;
+	}
+	if (freeSlots.size() + resident != slotPages.size())
+		return false;
+	for (uint32_t slot : freeSlots)
+	{
+		if (slotPages[slot] != NOT_RESIDENT || pinned[slot])
+			return false;
+	}
+	//the list has every evictable page, from the most to the least recently used
+	uint32_t listed = 0;
+	uint32_t previous = NOT_RESIDENT;
+	for (uint32_t slot = lruHead; slot != NOT_RESIDENT; slot = lruNext[slot])
+	{
+		if (++listed > slotPages.size() || pinned[slot] || slotPages[slot] == NOT_RESIDENT || lruPrev[slot] != previous)
+			return false;
+		if (previous != NOT_RESIDENT && slotLastUse[slot] > slotLastUse[previous])
+			return false;
+		previous = slot;
+	}
+	return previous == lruTail && listed + pinnedCount == resident;
+}
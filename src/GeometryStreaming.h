@@ -0,0 +1,134 @@
+#ifndef __GEOMETRY_STREAMING_H__
+#define __GEOMETRY_STREAMING_H__
+
+#include "ModuleVulkan.h"
+#include "MeshletCompression.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+//Page based geometry streaming. The meshlets of every mesh record are cut in pages of PAGE_MESHLETS consecutive meshlets with their own vertices,
+//stored next to the mesh as <mesh path>.<max vertices>_<max primitives>.pages (the full detail pages and then the fallback LOD pages)
+//The device geometry pools are an array of fixed size page slots. culling.comp and the task shader read the page table and write the pages they
+//miss or use on a feedback buffer, the ResidencyManager turns the feedback into slot uploads and LRU evictions under the memory budget
+//The culling info of every meshlet and the pages of the coarse fallback LOD are always resident, an instance whose mesh misses pages draws the fallback
+namespace GeometryStreaming
+{
+	//Same as PAGE_MESHLETS on culling.comp and Shader.task
+	constexpr uint32_t PAGE_MESHLETS = 32;
+	//Page table entry of the pages that are not on a slot, same as NOT_RESIDENT on the shaders
+	constexpr uint32_t NOT_RESIDENT = ~0u;
+	//Requests the GPU records per frame, the pages past it are requested again on the next frames
+	constexpr uint32_t MAX_PAGE_REQUESTS = 1024;
+	//Pages uploaded per frame, it bounds the staging memory and the copy time of a frame
+	constexpr uint32_t MAX_PAGE_UPLOADS = 16;
+	//Target triangle ratio of the fallback LOD
+	constexpr float FALLBACK_TRIANGLE_RATIO = 0.125f;
+
+	//Capacity of a page for the meshlet limits, every slot of the pools can hold any page
+	struct PageLayout
+	{
+		uint32_t maxVertices;
+		uint32_t maxPrimitives;
+		//vertices, a page never has more unique vertices than meshlet vertex slots
+		uint32_t VertexCapacity() const { return PAGE_MESHLETS * maxVertices; }
+		//words of the compressed vertex references and triangles (MeshletCompression) of a page of worst case meshlets
+		uint32_t ReferenceCapacity() const { return PAGE_MESHLETS * MeshletCompression::MaxVertexWords(maxVertices, VertexCapacity()); }
+		uint32_t TriangleCapacity() const { return PAGE_MESHLETS * MeshletCompression::MaxTriangleWords(maxVertices, maxPrimitives); }
+		//Bytes of a page on the page file
+		size_t PageSize() const;
+		//Bytes of a slot on each pool: meshlet records, vertex references, triangles and vertices
+		size_t SlotMeshletsSize() const { return sizeof(MeshletCompression::Record) * PAGE_MESHLETS; }
+		size_t SlotMeshletVerticesSize() const { return sizeof(uint32_t) * ReferenceCapacity(); }
+		size_t SlotTrianglesSize() const { return sizeof(uint32_t) * TriangleCapacity(); }
+		size_t SlotVerticesSize() const { return sizeof(Vertex) * VertexCapacity(); }
+		size_t SlotSize() const { return SlotMeshletsSize() + SlotMeshletVerticesSize() + SlotTrianglesSize() + SlotVerticesSize(); }
+	};
+
+	//Used part of each pool of an expanded page, the copies only move these
+	struct PageUpload
+	{
+		uint32_t meshletCount;
+		uint32_t referenceWords;
+		uint32_t triangleWords;
+		uint32_t vertexCount;
+	};
+
+	inline uint32_t PageCount(size_t meshletCount) { return static_cast<uint32_t>((meshletCount + PAGE_MESHLETS - 1) / PAGE_MESHLETS); }
+	//Simplified copy of the mesh (own vertices and indices) to FALLBACK_TRIANGLE_RATIO of its triangles
+	void BuildFallbackMesh(const Mesh& mesh, Mesh& fallback);
+	//Writes the pages of the full detail and the fallback meshlets, skipped when the file is already built from the same meshlets
+	bool WritePageFile(const char* meshPath, const PageLayout& layout, const MeshletMesh& meshletMesh, const MeshletMesh& fallbackMesh);
+	//Path of the page file of a mesh, the header is HEADER_SIZE bytes and page i starts at HEADER_SIZE + i * PageSize()
+	void GetPageFilePath(const char* meshPath, const PageLayout& layout, char* path, size_t size);
+	constexpr size_t PAGE_FILE_HEADER_SIZE = 4096;
+	//Packs the meshlets [first, first + PAGE_MESHLETS) on page (PageSize bytes, zeroed) with their own vertices numbered on first use and the compressed
+	//streams, vertexRemap is all NOT_RESIDENT before and after. False when a meshlet could not be encoded
+	bool BuildPage(const MeshletMesh& meshletMesh, size_t first, const PageLayout& layout, std::vector<uint32_t>& vertexRemap, unsigned char* page);
+	//Copies a page of the page file to dst with the layout of a slot (SlotSize bytes), the stream offsets and the vertex base of the meshlet records
+	//are rebased to the slot position on the pools so the shaders read it like any other meshlet
+	PageUpload ExpandPage(const unsigned char* page, const PageLayout& layout, uint32_t slot, unsigned char* dst);
+
+	//Page -> slot assignment of the pools. The pages belong to groups (the mesh records) and the manager keeps the missing pages of every group,
+	//culling.comp draws the fallback of a record while it is not 0. Both tables have the same layout as the GPU buffers and track the dirty range to upload
+	class ResidencyManager
+	{
+	public:
+		void Init(const std::vector<uint32_t>& pageGroups, uint32_t groupCount, uint32_t slotCount);
+		//The page gets a slot it never leaves (the fallback LOD), NOT_RESIDENT when there are no free slots
+		uint32_t Pin(uint32_t page);
+		//The GPU used the page on the frame, it moves to the front of the LRU list
+		void Touch(uint32_t page, uint64_t frame);
+		//Slot for a requested page: a free one or the least recently used page is evicted (evictedPage, NOT_RESIDENT otherwise)
+		//Pages used on the last minEvictionAge frames are never evicted, NOT_RESIDENT is returned when the working set does not fit
+		uint32_t MakeResident(uint32_t page, uint64_t frame, uint32_t& evictedPage);
+		void SetMinEvictionAge(uint64_t frames) { minEvictionAge = frames; }
+
+		uint32_t GetSlot(uint32_t page) const { return pageSlots[page]; }
+		bool IsResident(uint32_t page) const { return pageSlots[page] != NOT_RESIDENT; }
+		bool IsPinned(uint32_t page) const { return IsResident(page) && pinned[pageSlots[page]]; }
+		uint32_t GetPageCount() const { return static_cast<uint32_t>(pageSlots.size()); }
+		uint32_t GetSlotCount() const { return static_cast<uint32_t>(slotPages.size()); }
+		uint32_t GetResidentPages() const { return residentPages; }
+		uint64_t GetEvictions() const { return evictions; }
+		const uint32_t* GetPageTable() const { return pageSlots.data(); }
+		const uint32_t* GetGroupMissingPages() const { return groupMissing.data(); }
+		//[first, end) entries of the tables changed since the last call, empty when first == end
+		void TakeDirtyPages(uint32_t& first, uint32_t& end) { TakeDirty(pageDirty, first, end); }
+		void TakeDirtyGroups(uint32_t& first, uint32_t& end) { TakeDirty(groupDirty, first, end); }
+		//Tables, LRU list and counters agree with each other, used by the streaming simulation of MeshTool
+		bool Validate() const;
+	private:
+		struct DirtyRange
+		{
+			uint32_t first = ~0u;
+			uint32_t end = 0;
+			void Add(uint32_t index) { first = index < first ? index : first; end = index + 1 > end ? index + 1 : end; }
+		};
+		static void TakeDirty(DirtyRange& range, uint32_t& first, uint32_t& end);
+		void Assign(uint32_t page, uint32_t slot);
+		void Unassign(uint32_t slot);
+		void LinkFront(uint32_t slot);
+		void Unlink(uint32_t slot);
+
+		std::vector<uint32_t> pageSlots;
+		std::vector<uint32_t> pageGroups;
+		std::vector<uint32_t> groupMissing;
+		std::vector<uint32_t> slotPages;
+		std::vector<uint64_t> slotLastUse;
+		std::vector<bool> pinned;
+		std::vector<uint32_t> freeSlots;
+		//Doubly linked list of the evictable slots, the head is the most recently used
+		std::vector<uint32_t> lruPrev;
+		std::vector<uint32_t> lruNext;
+		uint32_t lruHead = NOT_RESIDENT;
+		uint32_t lruTail = NOT_RESIDENT;
+		DirtyRange pageDirty;
+		DirtyRange groupDirty;
+		uint32_t residentPages = 0;
+		uint64_t evictions = 0;
+		uint64_t minEvictionAge = 1;
+	};
+}
+
+#endif // !__GEOMETRY_STREAMING_H__
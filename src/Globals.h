@@ -9,7 +9,7 @@ enum class UpdateStatus : unsigned char
 };
 
 //LOG
-#define LOG(format, ...) log(__FILE__, __LINE__, format, __VA_ARGS__);
+#define LOG(format, ...) log(__FILE__, __LINE__, format, ##__VA_ARGS__);
 void log(const char file[], int line, const char* format, ...);
 
 #endif // __GLOBALS_H__
\ No newline at end of file
@@ -0,0 +1,187 @@
+#include "HostMemory.h"
+#include "Globals.h"
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+
+namespace
+{
+	//Keeps the payload 16 byte aligned
+	struct alignas(16) Header
+	{
+		size_t size;
+		HostMemory::Tag tag;
+	};
+
+	struct Counters
+	{
+		std::atomic<size_t> bytes{ 0 };
+		std::atomic<size_t> peakBytes{ 0 };
+		std::atomic<uint64_t> allocations{ 0 };
+		std::atomic<uint64_t> frees{ 0 };
+	};
+	Counters counters[static_cast<size_t>(HostMemory::Tag::COUNT)];
+	Counters total;
+
+	void UpdatePeak(std::atomic<size_t>& peak, size_t bytes)
+	{
+		size_t current = peak.load(std::memory_order_relaxed);
+		while (bytes > current && !peak.compare_exchange_weak(current, bytes, std::memory_order_relaxed))
+			;
+	}
+
+	void Add(Counters& target, size_t size)
+	{
+		const size_t bytes = target.bytes.fetch_add(size, std::memory_order_relaxed) + size;
+		UpdatePeak(target.peakBytes, bytes);
+		target.allocations.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void Remove(Counters& target, size_t size)
+	{
+		target.bytes.fetch_sub(size, std::memory_order_relaxed);
+		target.frees.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	HostMemory::TagStats Snapshot(const Counters& source)
+	{
+		HostMemory::TagStats stats;
+		stats.bytes = source.bytes.load(std::memory_order_relaxed);
+		stats.peakBytes = source.peakBytes.load(std::memory_order_relaxed);
+		stats.allocations = source.allocations.load(std::memory_order_relaxed);
+		stats.frees = source.frees.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	size_t AlignUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+}
+
+const char* HostMemory::GetTagName(Tag tag)
+{
+	static const char* names[] = { "meshes", "meshlets", "import_scratch", "frame_scratch" };
+	return tag < Tag::COUNT ? names[static_cast<size_t>(tag)] : "unknown";
+}
+
+void* HostMemory::Allocate(size_t size, Tag tag)
+{
+	Header* header = static_cast<Header*>(malloc(sizeof(Header) + size));
+	if (header == nullptr)
+	{
+		LOG("Error: out of host memory allocating %zu bytes of %s", size, GetTagName(tag));
+		return nullptr;
+	}
+	header->size = size;
+	header->tag = tag;
+	Add(counters[static_cast<size_t>(tag)], size);
+	Add(total, size);
+	return header + 1;
+}
+
+void HostMemory::Free(void* memory)
+{
+	if (memory == nullptr)
+		return;
+	Header* header = static_cast<Header*>(memory) - 1;
+	Remove(counters[static_cast<size_t>(header->tag)], header->size);
+	Remove(total, header->size);
+	free(header);
+}
+
+HostMemory::TagStats HostMemory::GetStats(Tag tag)
+{
+	return Snapshot(counters[static_cast<size_t>(tag)]);
+}
+
+HostMemory::TagStats HostMemory::GetTotalStats()
+{
+	return Snapshot(total);
+}
+
+void HostMemory::ResetPeaks()
+{
+	for (Counters& tagCounters : counters)
+		tagCounters.peakBytes.store(tagCounters.bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	total.peakBytes.store(total.bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void HostMemory::LogStats()
+{
+	for (size_t i = 0; i < static_cast<size_t>(Tag::COUNT); ++i)
+	{
+		const TagStats stats = GetStats(static_cast<Tag>(i));
+		LOG("Host memory %-14s %9.2f MB in use, peak %9.2f MB, %llu allocations, %llu frees", GetTagName(static_cast<Tag>(i)), stats.bytes / (1024.0 * 1024.0),
+			stats.peakBytes / (1024.0 * 1024.0), static_cast<unsigned long long>(stats.allocations), static_cast<unsigned long long>(stats.frees));
+	}
+	const TagStats stats = GetTotalStats();
+	LOG("Host memory %-14s %9.2f MB in use, peak %9.2f MB, %llu allocations, %llu frees", "total", stats.bytes / (1024.0 * 1024.0), stats.peakBytes / (1024.0 * 1024.0),
+		static_cast<unsigned long long>(stats.allocations), static_cast<unsigned long long>(stats.frees));
+}
+
+void* HostMemory::Arena::Allocate(size_t size, size_t alignment)
+{
+	//The data of the blocks starts 16 byte aligned, the larger alignments are applied to the address
+	uintptr_t base = 0;
+	size_t start = 0;
+	if (current != nullptr)
+	{
+		base = reinterpret_cast<uintptr_t>(current + 1);
+		start = AlignUp(base + offset, alignment) - base;
+	}
+	if (current == nullptr || start + size > current->size)
+	{
+		if (!AddBlock(std::max(blockSize, size + (alignment > DEFAULT_ALIGNMENT ? alignment - DEFAULT_ALIGNMENT : 0))))
+			return nullptr;
+		base = reinterpret_cast<uintptr_t>(current + 1);
+		start = AlignUp(base, alignment) - base;
+	}
+	++allocations;
+	offset = start + size;
+	peak = std::max(peak, GetUsed());
+	return reinterpret_cast<char*>(base + start);
+}
+
+bool HostMemory::Arena::AddBlock(size_t size)
+{
+	Block* block = static_cast<Block*>(HostMemory::Allocate(sizeof(Block) + size, tag));
+	//HostMemory::Allocate logged it, the current block and offset stay as they were
+	if (block == nullptr)
+		return false;
+	block->previous = current;
+	block->size = size;
+	usedBefore += offset;
+	offset = 0;
+	capacity += size;
+	current = block;
+	++blockAllocations;
+	return true;
+}
+
+void HostMemory::Arena::Reset()
+{
+	//Several blocks: one of the whole size next time
+	if (current != nullptr && current->previous != nullptr)
+	{
+		const size_t merged = capacity;
+		Release();
+		AddBlock(merged);
+	}
+	offset = 0;
+	usedBefore = 0;
+	peak = 0;
+}
+
+void HostMemory::Arena::Release()
+{
+	while (current != nullptr)
+	{
+		Block* previous = current->previous;
+		HostMemory::Free(current);
+		current = previous;
+	}
+	offset = 0;
+	usedBefore = 0;
+	capacity = 0;
+}
@@ -0,0 +1,99 @@
+#ifndef __HOST_MEMORY_H__
+#define __HOST_MEMORY_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//Host memory accounting: every allocation is tagged with the subsystem that owns it, the bytes in use, the peak and the heap calls are counted per tag
+//The arrays of Mesh and MeshletMesh are allocated here (Mesh::Free and MeshletMesh::Free release them), the temporaries of the import and of every frame
+//come from an Arena instead of the heap
+namespace HostMemory
+{
+	enum class Tag : uint8_t
+	{
+		//vertices and indices of the imported meshes and of their fallback LODs
+		MESHES,
+		//meshlets, bounds, meshlet vertices and triangles
+		MESHLETS,
+		//blocks of the import arena and the decoded EXT_meshopt_compression buffer views
+		IMPORT_SCRATCH,
+		//blocks of the per frame arena of ModuleVulkan
+		FRAME_SCRATCH,
+		COUNT
+	};
+
+	struct TagStats
+	{
+		size_t bytes = 0;
+		size_t peakBytes = 0;
+		//heap calls
+		uint64_t allocations = 0;
+		uint64_t frees = 0;
+	};
+
+	const char* GetTagName(Tag tag);
+	//malloc with a 16 byte header, the result is 16 byte aligned. Thread safe
+	void* Allocate(size_t size, Tag tag);
+	//nullptr does nothing
+	void Free(void* memory);
+	//Only for the trivial types (the constructors are not run, like new[] of a POD)
+	template<typename T> T* NewArray(size_t count, Tag tag) { return static_cast<T*>(Allocate(sizeof(T) * count, tag)); }
+	TagStats GetStats(Tag tag);
+	//Sum of every tag, the peak is the one of the sum
+	TagStats GetTotalStats();
+	//The peaks start again from the bytes in use, to measure a phase
+	void ResetPeaks();
+	void LogStats();
+
+	//Linear allocator: Allocate bumps an offset on the current block, nothing is freed until Reset. A round that does not fit on one block chains more,
+	//Reset merges them into one block of the size used so the next rounds of the same size do not touch the heap. Not thread safe, one per thread
+	class Arena
+	{
+	public:
+		static constexpr size_t DEFAULT_BLOCK_SIZE = 1u << 20;
+		static constexpr size_t DEFAULT_ALIGNMENT = 16;
+
+		explicit Arena(Tag tag, size_t blockSize = DEFAULT_BLOCK_SIZE) : tag(tag), blockSize(blockSize) {}
+		~Arena() { Release(); }
+		Arena(const Arena&) = delete;
+		Arena& operator=(const Arena&) = delete;
+
+		//nullptr when the heap can not give a new block (out of host memory), the arena stays usable
+		void* Allocate(size_t size, size_t alignment = DEFAULT_ALIGNMENT);
+		template<typename T> T* AllocateArray(size_t count) { return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T) > DEFAULT_ALIGNMENT ? alignof(T) : DEFAULT_ALIGNMENT)); }
+		//Everything allocated is invalid after it
+		void Reset();
+		//Gives the blocks back to the heap
+		void Release();
+
+		size_t GetUsed() const { return usedBefore + offset; }
+		size_t GetCapacity() const { return capacity; }
+		//Most bytes used between two resets
+		size_t GetPeak() const { return peak; }
+		//Allocate calls served and the blocks they needed from the heap
+		uint64_t GetAllocations() const { return allocations; }
+		uint64_t GetBlockAllocations() const { return blockAllocations; }
+
+	private:
+		struct Block
+		{
+			Block* previous;
+			size_t size;
+		};
+		//false when the heap is out of memory
+		bool AddBlock(size_t size);
+
+		Tag tag;
+		size_t blockSize;
+		Block* current = nullptr;
+		size_t offset = 0;
+		//bytes used on the blocks before the current one
+		size_t usedBefore = 0;
+		size_t capacity = 0;
+		size_t peak = 0;
+		uint64_t allocations = 0;
+		uint64_t blockAllocations = 0;
+	};
+}
+
+#endif // !__HOST_MEMORY_H__
@@ -0,0 +1,644 @@
+#include "ImportMesh.h"
+#include "FileSystem.h"
+#include "Globals.h"
+#include "Profiler.h"
+#include <nlohmann/json.hpp>
+#include "meshoptimizer.h"
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GLB_SSE2
+#include <emmintrin.h>
+#endif
+
+//Binary glTF: 12 byte header followed by the JSON chunk and an optional BIN chunk, every chunk is 4 byte aligned
+//https://registry.khronos.org/glTF/specs/2.0/glTF-2.0.html#glb-file-format-specification
+namespace
+{
+	constexpr uint32_t GLB_MAGIC = 0x46546C67; //"glTF"
+	constexpr uint32_t GLB_VERSION = 2;
+	constexpr uint32_t CHUNK_JSON = 0x4E4F534A; //"JSON"
+	constexpr uint32_t CHUNK_BIN = 0x004E4942; //"BIN\0"
+	constexpr size_t HEADER_SIZE = 12;
+	constexpr size_t CHUNK_HEADER_SIZE = 8;
+
+	constexpr int COMPONENT_BYTE = 5120;
+	constexpr int COMPONENT_UNSIGNED_BYTE = 5121;
+	constexpr int COMPONENT_SHORT = 5122;
+	constexpr int COMPONENT_UNSIGNED_SHORT = 5123;
+	constexpr int COMPONENT_UNSIGNED_INT = 5125;
+	constexpr int COMPONENT_FLOAT = 5126;
+
+	using json = nlohmann::json;
+
+	//Bytes of a buffer or of a decoded buffer view, the mapped ones are not owned
+	struct Bytes
+	{
+		const unsigned char* data = nullptr;
+		size_t size = 0;
+	};
+
+	//EXT_meshopt_compression buffer view decoded to its uncompressed layout
+	struct DecodedView
+	{
+		size_t bufferView = 0;
+		unsigned char* data = nullptr;
+		size_t size = 0;
+		bool decoded = false;
+	};
+
+	struct Document
+	{
+		json root;
+		std::vector<Bytes> buffers;
+		std::vector<FileSystem::MappedFile> mappedBuffers;
+		std::vector<DecodedView> decodedViews;
+
+		~Document()
+		{
+			for (FileSystem::MappedFile& file : mappedBuffers)
+				FileSystem::Unmap(file);
+			for (DecodedView& view : decodedViews)
+				HostMemory::Free(view.data);
+		}
+	};
+
+	//Elements of an accessor inside a mapped buffer or a decoded view, nothing is copied
+	struct AccessorView
+	{
+		const unsigned char* data = nullptr;
+		//end of the buffer view, the 16 byte loads of the interleaved attributes can go past the last element until here
+		const unsigned char* viewEnd = nullptr;
+		size_t count = 0;
+		size_t stride = 0;
+		int componentType = 0;
+		bool normalized = false;
+	};
+
+	uint32_t ReadU32(const unsigned char* data)
+	{
+		uint32_t value;
+		memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	const json* Find(const json& object, const char* key)
+	{
+		if (!object.is_object())
+			return nullptr;
+		const auto it = object.find(key);
+		return it != object.end() ? &*it : nullptr;
+	}
+
+	const json* Element(const json& object, const char* key, size_t index)
+	{
+		const json* array = Find(object, key);
+		if (array == nullptr || !array->is_array() || index >= array->size())
+			return nullptr;
+		return &(*array)[index];
+	}
+
+	size_t GetSize(const json& object, const char* key, size_t defaultValue)
+	{
+		const json* value = Find(object, key);
+		return value != nullptr && value->is_number_unsigned() ? value->get<size_t>() : defaultValue;
+	}
+
+	const char* GetString(const json& object, const char* key, const char* defaultValue)
+	{
+		const json* value = Find(object, key);
+		return value != nullptr && value->is_string() ? value->get_ref<const std::string&>().c_str() : defaultValue;
+	}
+
+	const json* FindExtension(const json& object, const char* extension)
+	{
+		const json* extensions = Find(object, "extensions");
+		return extensions != nullptr ? Find(*extensions, extension) : nullptr;
+	}
+
+	size_t ComponentSize(int componentType)
+	{
+		switch (componentType)
+		{
+		case COMPONENT_BYTE:
+		case COMPONENT_UNSIGNED_BYTE: return 1;
+		case COMPONENT_SHORT:
+		case COMPONENT_UNSIGNED_SHORT: return 2;
+		case COMPONENT_UNSIGNED_INT:
+		case COMPONENT_FLOAT: return 4;
+		default: return 0;
+		}
+	}
+
+	//Maps the external buffers next to the gltf, the uri-less buffer is the BIN chunk of a glb
+	//The fallback buffers of EXT_meshopt_compression have no data at all
+	bool LoadBuffers(const char* path, Bytes bin, Document& document)
+	{
+		const json* buffers = Find(document.root, "buffers");
+		if (buffers == nullptr || !buffers->is_array())
+			return true;
+		std::string directory = path;
+		const size_t separator = directory.find_last_of("/\\");
+		directory = separator == std::string::npos ? std::string() : directory.substr(0, separator + 1);
+		for (const json& buffer : *buffers)
+		{
+			Bytes bytes;
+			const json* uri = Find(buffer, "uri");
+			if (uri == nullptr)
+			{
+				if (FindExtension(buffer, "EXT_meshopt_compression") == nullptr)
+					bytes = bin;
+			}
+			else if (uri->is_string() && uri->get_ref<const std::string&>().compare(0, 5, "data:") != 0)
+			{
+				const std::string bufferPath = directory + uri->get_ref<const std::string&>();
+				FileSystem::MappedFile file;
+				if (!FileSystem::Map(bufferPath.c_str(), file))
+				{
+					LOG("[GLTF] Error mapping buffer %s", bufferPath.c_str());
+					return false;
+				}
+				document.mappedBuffers.push_back(file);
+				bytes.data = file.data;
+				bytes.size = std::min(file.size, GetSize(buffer, "byteLength", file.size));
+			}
+			//data uris are left empty, the accessors using them fail to resolve
+			document.buffers.push_back(bytes);
+		}
+		return true;
+	}
+
+	//https://github.com/KhronosGroup/glTF/tree/main/extensions/2.0/Vendor/EXT_meshopt_compression
+	bool Decode(const Document& document, DecodedView& view)
+	{
+		PROFILE_ZONE("Decode");
+		const json* bufferView = Element(document.root, "bufferViews", view.bufferView);
+		const json* compression = bufferView != nullptr ? FindExtension(*bufferView, "EXT_meshopt_compression") : nullptr;
+		if (compression == nullptr)
+			return false;
+		const size_t bufferIndex = GetSize(*compression, "buffer", SIZE_MAX);
+		if (bufferIndex >= document.buffers.size())
+			return false;
+		const Bytes& buffer = document.buffers[bufferIndex];
+		const size_t offset = GetSize(*compression, "byteOffset", 0);
+		const size_t length = GetSize(*compression, "byteLength", 0);
+		const size_t stride = GetSize(*compression, "byteStride", 0);
+		const size_t count = GetSize(*compression, "count", 0);
+		if (buffer.data == nullptr || offset > buffer.size || length > buffer.size - offset || stride == 0 || count == 0)
+			return false;
+
+		view.size = count * stride;
+		//Decoded on several threads, tracked allocations instead of the (single thread) import arena
+		view.data = HostMemory::NewArray<unsigned char>(view.size, HostMemory::Tag::IMPORT_SCRATCH);
+		const unsigned char* source = buffer.data + offset;
+		const char* mode = GetString(*compression, "mode", "");
+		int result = -1;
+		if (strcmp(mode, "ATTRIBUTES") == 0)
+			result = meshopt_decodeVertexBuffer(view.data, count, stride, source, length);
+		else if (strcmp(mode, "TRIANGLES") == 0)
+			result = meshopt_decodeIndexBuffer(view.data, count, stride, source, length);
+		else if (strcmp(mode, "INDICES") == 0)
+			result = meshopt_decodeIndexSequence(view.data, count, stride, source, length);
+		if (result != 0)
+			return false;
+
+		const char* filter = GetString(*compression, "filter", "NONE");
+		if (strcmp(filter, "OCTAHEDRAL") == 0)
+			meshopt_decodeFilterOct(view.data, count, stride);
+		else if (strcmp(filter, "QUATERNION") == 0)
+			meshopt_decodeFilterQuat(view.data, count, stride);
+		else if (strcmp(filter, "EXPONENTIAL") == 0)
+			meshopt_decodeFilterExp(view.data, count, stride);
+		else if (strcmp(filter, "NONE") != 0)
+			return false;
+		return true;
+	}
+
+	//Every compressed buffer view the accessors use is decoded on its own thread
+	bool DecodeViews(Document& document, const json* accessors[], size_t accessorCount, ImporterMesh::ImportStats* stats)
+	{
+		PROFILE_ZONE("DecodeViews");
+		for (size_t i = 0; i < accessorCount; ++i)
+		{
+			if (!accessors[i]->is_number_unsigned())
+				continue;
+			const json* accessor = Element(document.root, "accessors", accessors[i]->get<size_t>());
+			if (accessor == nullptr)
+				continue;
+			const size_t bufferViewIndex = GetSize(*accessor, "bufferView", SIZE_MAX);
+			const json* bufferView = Element(document.root, "bufferViews", bufferViewIndex);
+			if (bufferView == nullptr || FindExtension(*bufferView, "EXT_meshopt_compression") == nullptr)
+				continue;
+			if (std::none_of(document.decodedViews.begin(), document.decodedViews.end(), [bufferViewIndex](const DecodedView& view) { return view.bufferView == bufferViewIndex; }))
+			{
+				DecodedView view;
+				view.bufferView = bufferViewIndex;
+				document.decodedViews.push_back(view);
+			}
+		}
+		if (document.decodedViews.empty())
+			return true;
+
+		const auto start = std::chrono::steady_clock::now();
+		std::vector<std::thread> workers;
+		for (size_t i = 1; i < document.decodedViews.size(); ++i)
+			workers.emplace_back([&document, i]() { document.decodedViews[i].decoded = Decode(document, document.decodedViews[i]); });
+		document.decodedViews[0].decoded = Decode(document, document.decodedViews[0]);
+		for (std::thread& worker : workers)
+			worker.join();
+
+		size_t decodedBytes = 0;
+		for (const DecodedView& view : document.decodedViews)
+		{
+			if (!view.decoded)
+			{
+				LOG("[GLTF] Error decoding the EXT_meshopt_compression buffer view %zu", view.bufferView);
+				return false;
+			}
+			decodedBytes += view.size;
+		}
+		if (stats != nullptr)
+		{
+			stats->decodedBytes += decodedBytes;
+			stats->decodeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+		return true;
+	}
+
+	Bytes GetBufferView(const Document& document, size_t bufferViewIndex, const json& bufferView)
+	{
+		for (const DecodedView& view : document.decodedViews)
+			if (view.bufferView == bufferViewIndex)
+				return { view.data, view.size };
+		const size_t bufferIndex = GetSize(bufferView, "buffer", SIZE_MAX);
+		if (bufferIndex >= document.buffers.size() || document.buffers[bufferIndex].data == nullptr)
+			return Bytes();
+		const Bytes& buffer = document.buffers[bufferIndex];
+		const size_t offset = GetSize(bufferView, "byteOffset", 0);
+		const size_t length = GetSize(bufferView, "byteLength", 0);
+		if (offset > buffer.size || length > buffer.size - offset)
+			return Bytes();
+		return { buffer.data + offset, length };
+	}
+
+	bool GetAccessorView(const Document& document, const json& accessorIndex, const char* type, AccessorView& view)
+	{
+		if (!accessorIndex.is_number_unsigned())
+			return false;
+		const json* accessor = Element(document.root, "accessors", accessorIndex.get<size_t>());
+		if (accessor == nullptr)
+			return false;
+		if (strcmp(GetString(*accessor, "type", ""), type) != 0)
+		{
+			LOG("[GLTF] Accessor %zu is not a %s", accessorIndex.get<size_t>(), type);
+			return false;
+		}
+		const size_t bufferViewIndex = GetSize(*accessor, "bufferView", SIZE_MAX);
+		const json* bufferView = Element(document.root, "bufferViews", bufferViewIndex);
+		if (bufferView == nullptr || Find(*accessor, "sparse") != nullptr)
+		{
+			LOG("[GLTF] Accessors without a buffer view or sparse are not supported");
+			return false;
+		}
+		const Bytes bytes = GetBufferView(document, bufferViewIndex, *bufferView);
+		if (bytes.data == nullptr)
+		{
+			LOG("[GLTF] The buffer view %zu of accessor %zu has no data", bufferViewIndex, accessorIndex.get<size_t>());
+			return false;
+		}
+
+		view.componentType = static_cast<int>(GetSize(*accessor, "componentType", 0));
+		const json* normalized = Find(*accessor, "normalized");
+		view.normalized = normalized != nullptr && normalized->is_boolean() && normalized->get<bool>();
+		const size_t components = strcmp(type, "VEC3") == 0 ? 3 : 1;
+		const size_t elementSize = ComponentSize(view.componentType) * components;
+		if (elementSize == 0)
+			return false;
+		view.count = GetSize(*accessor, "count", 0);
+		view.stride = GetSize(*bufferView, "byteStride", 0);
+		if (view.stride == 0)
+			view.stride = elementSize;
+		const size_t accessorOffset = GetSize(*accessor, "byteOffset", 0);
+		//Everything the view will read has to be inside the buffer view
+		if (view.count == 0 || accessorOffset + (view.count - 1) * view.stride + elementSize > bytes.size)
+		{
+			LOG("[GLTF] Accessor %zu is out of its buffer view", accessorIndex.get<size_t>());
+			return false;
+		}
+		view.data = bytes.data + accessorOffset;
+		view.viewEnd = bytes.data + bytes.size;
+		return true;
+	}
+
+	//Float3 attribute into the xyz of one of the Vertex float4, the w is zeroed (the padding is hashed by the meshlet cache)
+	void CopyVec3(const AccessorView& view, Vertex* vertices, size_t member)
+	{
+		const unsigned char* source = view.data;
+		unsigned char* destination = reinterpret_cast<unsigned char*>(vertices) + member;
+		size_t i = 0;
+#ifdef GLB_SSE2
+		const __m128 xyzMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+		if (view.stride == 3 * sizeof(float))
+		{
+			//Tightly packed: 3 loads hold 4 vertices [x0 y0 z0 x1] [y1 z1 x2 y2] [z2 x3 y3 z3]
+			for (; i + 4 <= view.count; i += 4, source += 12 * sizeof(float))
+			{
+				const __m128 a = _mm_loadu_ps(reinterpret_cast<const float*>(source));
+				const __m128 b = _mm_loadu_ps(reinterpret_cast<const float*>(source) + 4);
+				const __m128 c = _mm_loadu_ps(reinterpret_cast<const float*>(source) + 8);
+				const __m128 a3b0 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 3, 3));
+				_mm_storeu_ps(reinterpret_cast<float*>(destination + (i + 0) * sizeof(Vertex)), _mm_and_ps(a, xyzMask));
+				_mm_storeu_ps(reinterpret_cast<float*>(destination + (i + 1) * sizeof(Vertex)), _mm_and_ps(_mm_shuffle_ps(a3b0, b, _MM_SHUFFLE(1, 1, 2, 0)), xyzMask));
+				_mm_storeu_ps(reinterpret_cast<float*>(destination + (i + 2) * sizeof(Vertex)), _mm_and_ps(_mm_shuffle_ps(b, c, _MM_SHUFFLE(0, 0, 3, 2)), xyzMask));
+				_mm_storeu_ps(reinterpret_cast<float*>(destination + (i + 3) * sizeof(Vertex)), _mm_and_ps(_mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 2, 1)), xyzMask));
+			}
+		}
+		else
+		{
+			//Interleaved: one 16 byte load per vertex as long as it does not read past the view
+			for (; i < view.count && source + 4 * sizeof(float) <= view.viewEnd; ++i, source += view.stride)
+			{
+				_mm_storeu_ps(reinterpret_cast<float*>(destination + i * sizeof(Vertex)), _mm_and_ps(_mm_loadu_ps(reinterpret_cast<const float*>(source)), xyzMask));
+			}
+		}
+#endif // GLB_SSE2
+		for (; i < view.count; ++i, source += view.stride)
+		{
+			float* output = reinterpret_cast<float*>(destination + i * sizeof(Vertex));
+			memcpy(output, source, 3 * sizeof(float));
+			output[3] = 0.0f;
+		}
+	}
+
+	//KHR_mesh_quantization component to float, the normalized signed values clamp to -1 like the GPU does
+	float ReadComponent(const unsigned char* source, int componentType, bool normalized)
+	{
+		switch (componentType)
+		{
+		case COMPONENT_BYTE:
+		{
+			int8_t value;
+			memcpy(&value, source, sizeof(value));
+			return normalized ? std::max(value / 127.0f, -1.0f) : static_cast<float>(value);
+		}
+		case COMPONENT_UNSIGNED_BYTE:
+			return normalized ? source[0] / 255.0f : static_cast<float>(source[0]);
+		case COMPONENT_SHORT:
+		{
+			int16_t value;
+			memcpy(&value, source, sizeof(value));
+			return normalized ? std::max(value / 32767.0f, -1.0f) : static_cast<float>(value);
+		}
+		case COMPONENT_UNSIGNED_SHORT:
+		{
+			uint16_t value;
+			memcpy(&value, source, sizeof(value));
+			return normalized ? value / 65535.0f : static_cast<float>(value);
+		}
+		default:
+		{
+			float value;
+			memcpy(&value, source, sizeof(value));
+			return value;
+		}
+		}
+	}
+
+	void DequantizeVec3(const AccessorView& view, Vertex* vertices, size_t member)
+	{
+		const size_t componentSize = ComponentSize(view.componentType);
+		const unsigned char* source = view.data;
+		for (size_t i = 0; i < view.count; ++i, source += view.stride)
+		{
+			float* output = reinterpret_cast<float*>(reinterpret_cast<unsigned char*>(vertices + i) + member);
+			for (size_t c = 0; c < 3; ++c)
+				output[c] = ReadComponent(source + c * componentSize, view.componentType, view.normalized);
+			output[3] = 0.0f;
+		}
+	}
+
+	//Quantized positions are stored on a grid and the dequantization is the translation and scale of the node using the mesh
+	void ApplyNodeTransform(const json& root, size_t meshIndex, Vertex* vertices, size_t count)
+	{
+		const json* nodes = Find(root, "nodes");
+		if (nodes == nullptr || !nodes->is_array())
+			return;
+		for (const json& node : *nodes)
+		{
+			if (GetSize(node, "mesh", SIZE_MAX) != meshIndex)
+				continue;
+			float scale[3] = { 1.0f, 1.0f, 1.0f };
+			float translation[3] = { 0.0f, 0.0f, 0.0f };
+			const json* matrix = Find(node, "matrix");
+			const json* nodeScale = Find(node, "scale");
+			const json* nodeTranslation = Find(node, "translation");
+			if (matrix != nullptr && matrix->is_array() && matrix->size() == 16)
+			{
+				//column major, only the diagonal and translation are used
+				for (size_t c = 0; c < 3; ++c)
+				{
+					scale[c] = (*matrix)[c * 5].get<float>();
+					translation[c] = (*matrix)[12 + c].get<float>();
+				}
+			}
+			for (size_t c = 0; c < 3; ++c)
+			{
+				if (nodeScale != nullptr && nodeScale->is_array() && nodeScale->size() == 3)
+					scale[c] = (*nodeScale)[c].get<float>();
+				if (nodeTranslation != nullptr && nodeTranslation->is_array() && nodeTranslation->size() == 3)
+					translation[c] = (*nodeTranslation)[c].get<float>();
+			}
+			if (Find(node, "rotation") != nullptr)
+				LOG("[GLTF] The rotation of the quantized mesh node is ignored");
+			for (size_t i = 0; i < count; ++i)
+				for (size_t c = 0; c < 3; ++c)
+					vertices[i].position[c] = vertices[i].position[c] * scale[c] + translation[c];
+			return;
+		}
+	}
+
+	void CopyIndices(const AccessorView& view, unsigned int* indices)
+	{
+		size_t i = 0;
+		switch (view.componentType)
+		{
+		case COMPONENT_UNSIGNED_INT:
+			memcpy(indices, view.data, view.count * sizeof(uint32_t));
+			break;
+		case COMPONENT_UNSIGNED_SHORT:
+		{
+#ifdef GLB_SSE2
+			const __m128i zero = _mm_setzero_si128();
+			for (; i + 8 <= view.count; i += 8)
+			{
+				const __m128i source = _mm_loadu_si128(reinterpret_cast<const __m128i*>(view.data + i * sizeof(uint16_t)));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(indices + i), _mm_unpacklo_epi16(source, zero));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(indices + i + 4), _mm_unpackhi_epi16(source, zero));
+			}
+#endif // GLB_SSE2
+			for (; i < view.count; ++i)
+			{
+				uint16_t index;
+				memcpy(&index, view.data + i * sizeof(uint16_t), sizeof(index));
+				indices[i] = index;
+			}
+			break;
+		}
+		case COMPONENT_UNSIGNED_BYTE:
+			for (; i < view.count; ++i)
+				indices[i] = view.data[i];
+			break;
+		}
+	}
+
+	//Splits a glb in its JSON and BIN chunks, a gltf is all JSON
+	bool GetChunks(const FileSystem::MappedFile& file, const char* path, Bytes& jsonChunk, Bytes& bin)
+	{
+		if (!ImporterMesh::IsGlb(path))
+		{
+			jsonChunk = { file.data, file.size };
+			return true;
+		}
+		if (file.size < HEADER_SIZE + CHUNK_HEADER_SIZE || ReadU32(file.data) != GLB_MAGIC || ReadU32(file.data + 4) != GLB_VERSION)
+		{
+			LOG("[GLB] %s is not a glTF 2.0 binary", path);
+			return false;
+		}
+		const size_t length = ReadU32(file.data + 8);
+		if (length > file.size)
+		{
+			LOG("[GLB] %s is truncated", path);
+			return false;
+		}
+		jsonChunk.data = file.data + HEADER_SIZE + CHUNK_HEADER_SIZE;
+		jsonChunk.size = ReadU32(file.data + HEADER_SIZE);
+		if (ReadU32(file.data + HEADER_SIZE + 4) != CHUNK_JSON || jsonChunk.size > length - HEADER_SIZE - CHUNK_HEADER_SIZE)
+		{
+			LOG("[GLB] %s does not start with a JSON chunk", path);
+			return false;
+		}
+		const size_t binHeader = HEADER_SIZE + CHUNK_HEADER_SIZE + jsonChunk.size;
+		if (binHeader + CHUNK_HEADER_SIZE <= length && ReadU32(file.data + binHeader + 4) == CHUNK_BIN)
+		{
+			bin.size = ReadU32(file.data + binHeader);
+			bin.data = file.data + binHeader + CHUNK_HEADER_SIZE;
+			if (bin.size > length - binHeader - CHUNK_HEADER_SIZE)
+			{
+				LOG("[GLB] %s BIN chunk is truncated", path);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool ImportMapped(const FileSystem::MappedFile& file, const char* path, Mesh& mesh, ImporterMesh::ImportStats* stats)
+	{
+		Bytes jsonChunk, bin;
+		if (!GetChunks(file, path, jsonChunk, bin))
+			return false;
+
+		//Only the JSON is parsed, without exceptions
+		Document document;
+		{
+			PROFILE_ZONE("Parse JSON");
+			document.root = json::parse(jsonChunk.data, jsonChunk.data + jsonChunk.size, nullptr, false);
+		}
+		if (document.root.is_discarded())
+		{
+			LOG("[GLTF] %s has invalid JSON", path);
+			return false;
+		}
+		const json* gltfMesh = Element(document.root, "meshes", 0);
+		const json* primitive = gltfMesh != nullptr ? Element(*gltfMesh, "primitives", 0) : nullptr;
+		if (primitive == nullptr)
+		{
+			LOG("The gltf does not contain a mesh to import");
+			return false;
+		}
+		const json* attributes = Find(*primitive, "attributes");
+		const json* position = attributes != nullptr ? Find(*attributes, "POSITION") : nullptr;
+		const json* normal = attributes != nullptr ? Find(*attributes, "NORMAL") : nullptr;
+		const json* indices = Find(*primitive, "indices");
+		if (position == nullptr)
+		{
+			LOG("Error: The imported mesh does not have vertex positions");
+			return false;
+		}
+		if (normal == nullptr)
+		{
+			LOG("Error: The imported mesh does not have normals");
+			return false;
+		}
+		if (indices == nullptr)
+		{
+			LOG("Error: The imported mesh does not have indices");
+			return false;
+		}
+
+		const json* accessors[] = { position, normal, indices };
+		if (!LoadBuffers(path, bin, document) || !DecodeViews(document, accessors, 3, stats))
+			return false;
+		AccessorView positionView, normalView, indexView;
+		if (!GetAccessorView(document, *position, "VEC3", positionView) || !GetAccessorView(document, *normal, "VEC3", normalView)
+			|| !GetAccessorView(document, *indices, "SCALAR", indexView))
+			return false;
+		if (positionView.count != normalView.count)
+		{
+			LOG("Error importing the mesh, the mesh does not have the same number of position and normal attributes");
+			return false;
+		}
+		if (normalView.componentType == COMPONENT_UNSIGNED_BYTE || normalView.componentType == COMPONENT_UNSIGNED_SHORT || normalView.componentType == COMPONENT_UNSIGNED_INT
+			|| positionView.componentType == COMPONENT_UNSIGNED_INT)
+		{
+			LOG("Error: The imported mesh attributes have a component type KHR_mesh_quantization does not allow");
+			return false;
+		}
+		if (indexView.componentType != COMPONENT_UNSIGNED_INT && indexView.componentType != COMPONENT_UNSIGNED_SHORT && indexView.componentType != COMPONENT_UNSIGNED_BYTE)
+		{
+			LOG("Error: The imported mesh indices are not unsigned integers");
+			return false;
+		}
+
+		PROFILE_ZONE("Copy attributes");
+		mesh.numVertices = static_cast<unsigned int>(positionView.count);
+		LOG("NumVertices: %u", mesh.numVertices);
+		mesh.vertices = HostMemory::NewArray<Vertex>(mesh.numVertices, HostMemory::Tag::MESHES);
+		//The vertex format is float only, quantized attributes are expanded
+		if (positionView.componentType == COMPONENT_FLOAT)
+			CopyVec3(positionView, mesh.vertices, offsetof(Vertex, position));
+		else
+		{
+			DequantizeVec3(positionView, mesh.vertices, offsetof(Vertex, position));
+			ApplyNodeTransform(document.root, 0, mesh.vertices, mesh.numVertices);
+		}
+		if (normalView.componentType == COMPONENT_FLOAT)
+			CopyVec3(normalView, mesh.vertices, offsetof(Vertex, normal));
+		else
+			DequantizeVec3(normalView, mesh.vertices, offsetof(Vertex, normal));
+
+		mesh.numIndices = static_cast<unsigned int>(indexView.count);
+		LOG("Num Indices: %u", mesh.numIndices);
+		LOG("Num Triangles: %u", mesh.numIndices / 3);
+		mesh.indices = HostMemory::NewArray<unsigned int>(mesh.numIndices, HostMemory::Tag::MESHES);
+		CopyIndices(indexView, mesh.indices);
+		return true;
+	}
+}
+
+bool ImporterMesh::ImportFirstMapped(const char* path, Mesh& mesh, ImportStats* stats)
+{
+	PROFILE_ZONE("ImportFirstMapped");
+	FileSystem::MappedFile file;
+	if (!FileSystem::Map(path, file))
+	{
+		LOG("[GLTF] Error mapping %s", path);
+		return false;
+	}
+	const bool imported = ImportMapped(file, path, mesh, stats);
+	FileSystem::Unmap(file);
+	return imported;
+}
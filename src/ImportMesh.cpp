@@ -1,18 +1,32 @@
 #include "ImportMesh.h"
 #include "Globals.h"
+#include "Profiler.h"
 #define TINYGLTF_IMPLEMENTATION
 #define TINYGLTF_NO_STB_IMAGE_WRITE
 #define TINYGLTF_NO_STB_IMAGE
 #define TINYGLTF_NO_EXTERNAL_IMAGE
 #include "tiny_gltf.h"
+#include <string.h>
+
+bool ImporterMesh::IsGlb(const char* path)
+{
+	const char* extension = strrchr(path, '.');
+	return extension != nullptr && (strcmp(extension, ".glb") == 0 || strcmp(extension, ".GLB") == 0);
+}
 
 bool ImporterMesh::ImportFirst(const char* gltfPath, Mesh& outMesh)
 {
+	return ImportFirstMapped(gltfPath, outMesh);
+}
+
+bool ImporterMesh::ImportFirstTinyGltf(const char* gltfPath, Mesh& outMesh)
+{
+	PROFILE_ZONE("ImportFirstTinyGltf");
 	tinygltf::TinyGLTF gltfContext;
 	tinygltf::Model model;
 
 	std::string error, warning;
-	bool loadOk = gltfContext.LoadASCIIFromFile(&model, &error, &warning, gltfPath);
+	bool loadOk = IsGlb(gltfPath) ? gltfContext.LoadBinaryFromFile(&model, &error, &warning, gltfPath) : gltfContext.LoadASCIIFromFile(&model, &error, &warning, gltfPath);
 	if (!loadOk)
 	{
 		LOG("[MODEL] Error loading gltf %s: %s", gltfPath, error.c_str());
@@ -55,20 +69,24 @@ bool ImporterMesh::Import(const tinygltf::Model& model, const tinygltf::Primitiv
 	const tinygltf::Accessor& normAcc = model.accessors[itNorm->second];
 
 	assert(posAcc.type == TINYGLTF_TYPE_VEC3);
-	assert(posAcc.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
+	//quantized attributes are only supported by ImportFirstMapped
+	if (posAcc.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT || normAcc.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT)
+	{
+		LOG("Error: The imported mesh positions and normals are not float");
+		return false;
+	}
 	const tinygltf::BufferView& posView = model.bufferViews[posAcc.bufferView];
 	const tinygltf::Buffer& posBuffer = model.buffers[posView.buffer];
 	const float* bufferPos = reinterpret_cast<const float*>(&posBuffer.data[posView.byteOffset + posAcc.byteOffset]);
 	assert(normAcc.type == TINYGLTF_TYPE_VEC3);
-	assert(normAcc.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
 	const tinygltf::BufferView& normView = model.bufferViews[normAcc.bufferView];
 	const tinygltf::Buffer& normBuffer = model.buffers[normView.buffer];
 	const float* bufferNorm = reinterpret_cast<const float*>(&normBuffer.data[normView.byteOffset + normAcc.byteOffset]);
 
-	assert(posAcc.count == normAcc.count, "Error importing the mesh, the mesh does not have the same number of position and normal attributes");
+	assert(posAcc.count == normAcc.count && "Error importing the mesh, the mesh does not have the same number of position and normal attributes");
 	mesh.numVertices = posAcc.count;
 	LOG("NumVertices: %u", mesh.numVertices);
-	mesh.vertices = new Vertex[mesh.numVertices];
+	mesh.vertices = HostMemory::NewArray<Vertex>(mesh.numVertices, HostMemory::Tag::MESHES);
 
 	for (unsigned int i = 0; i < mesh.numVertices; ++i)
 	{
@@ -78,6 +96,8 @@ bool ImporterMesh::Import(const tinygltf::Model& model, const tinygltf::Primitiv
 		vertex.position[0] = bufferPos[0];
 		vertex.position[1] = bufferPos[1];
 		vertex.position[2] = bufferPos[2];
+		//the padding is hashed by the meshlet cache
+		vertex.position[3] = 0.0f;
 		if (posView.byteStride != 0) {
 			bufferPos = reinterpret_cast<const float*>(reinterpret_cast<const char*>(bufferPos) + posView.byteStride);
 		}
@@ -89,6 +109,7 @@ bool ImporterMesh::Import(const tinygltf::Model& model, const tinygltf::Primitiv
 		vertex.normal[0] = bufferNorm[0];
 		vertex.normal[1] = bufferNorm[1];
 		vertex.normal[2] = bufferNorm[2];
+		vertex.normal[3] = 0.0f;
 		if (normView.byteStride != 0)
 		{
 			bufferNorm = reinterpret_cast<const float*>(reinterpret_cast<const char*>(bufferNorm) + normView.byteStride);
@@ -107,7 +128,7 @@ bool ImporterMesh::Import(const tinygltf::Model& model, const tinygltf::Primitiv
 	const tinygltf::BufferView& indView = model.bufferViews[indAcc.bufferView];
 	const unsigned char* buffer = &(model.buffers[indView.buffer].data[indAcc.byteOffset + indView.byteOffset]);
 
-	mesh.indices = new unsigned int[mesh.numIndices];
+	mesh.indices = HostMemory::NewArray<unsigned int>(mesh.numIndices, HostMemory::Tag::MESHES);
 
 	switch (indAcc.componentType)
 	{
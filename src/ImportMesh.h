@@ -10,7 +10,20 @@ namespace tinygltf {
 
 namespace ImporterMesh
 {
+	struct ImportStats
+	{
+		//EXT_meshopt_compression buffer views, decoded size and wall time of the parallel decode
+		size_t decodedBytes = 0;
+		double decodeMs = 0.0;
+	};
+
+	//Goes through ImportFirstMapped, tinygltf is kept as the reference the import benchmark compares against
 	bool ImportFirst(const char* gltfPath, Mesh& mesh);
+	bool ImportFirstTinyGltf(const char* gltfPath, Mesh& mesh);
+	//Maps the gltf/glb and its buffers and only parses the JSON, the vertices are read straight from the mapped buffers (ImportMapped.cpp)
+	//EXT_meshopt_compression buffer views are decoded in parallel and KHR_mesh_quantization attributes expanded to the float vertex format
+	bool ImportFirstMapped(const char* path, Mesh& mesh, ImportStats* stats = nullptr);
+	bool IsGlb(const char* path);
 	bool Import(const tinygltf::Model& model, const tinygltf::Primitive& primitive, Mesh& mesh);
 }
 
@@ -0,0 +1,143 @@
+#include "Impostor.h"
+#include "glm/geometric.hpp"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+glm::vec2 Impostor::OctEncode(const glm::vec3& direction)
+{
+	const glm::vec3 n = direction / (fabsf(direction.x) + fabsf(direction.y) + fabsf(direction.z));
+	if (n.z >= 0.0f)
+		return glm::vec2(n.x, n.y);
+	//the lower half folds over the diagonals
+	return glm::vec2((1.0f - fabsf(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f), (1.0f - fabsf(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+}
+
+glm::vec3 Impostor::OctDecode(const glm::vec2& encoded)
+{
+	glm::vec3 n(encoded.x, encoded.y, 1.0f - fabsf(encoded.x) - fabsf(encoded.y));
+	if (n.z < 0.0f)
+	{
+		n.x = (1.0f - fabsf(encoded.y)) * (encoded.x >= 0.0f ? 1.0f : -1.0f);
+		n.y = (1.0f - fabsf(encoded.x)) * (encoded.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return glm::normalize(n);
+}
+
+glm::vec3 Impostor::FrameDirection(uint32_t frame)
+{
+	const float x = (static_cast<float>(frame % FRAMES) + 0.5f) / FRAMES * 2.0f - 1.0f;
+	const float y = (static_cast<float>(frame / FRAMES) + 0.5f) / FRAMES * 2.0f - 1.0f;
+	return OctDecode(glm::vec2(x, y));
+}
+
+uint32_t Impostor::NearestFrame(const glm::vec3& direction)
+{
+	const glm::vec2 encoded = OctEncode(direction);
+	const uint32_t x = std::min(static_cast<uint32_t>(std::max((encoded.x * 0.5f + 0.5f) * FRAMES, 0.0f)), FRAMES - 1);
+	const uint32_t y = std::min(static_cast<uint32_t>(std::max((encoded.y * 0.5f + 0.5f) * FRAMES, 0.0f)), FRAMES - 1);
+	return y * FRAMES + x;
+}
+
+void Impostor::FrameBasis(const glm::vec3& direction, glm::vec3& right, glm::vec3& up)
+{
+	const glm::vec3 reference = fabsf(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	right = glm::normalize(glm::cross(reference, direction));
+	up = glm::cross(direction, right);
+}
+
+void Impostor::RenderView(const Mesh& mesh, const glm::vec4& sphere, const glm::vec3& direction, uint32_t* cell)
+{
+	glm::vec3 right, up;
+	FrameBasis(direction, right, up);
+	const glm::vec3 center(sphere);
+	const float radius = std::max(sphere.w, 1e-6f);
+	const float toTexel = CELL_SIZE * 0.5f / radius;
+	float depths[CELL_TEXELS];
+	std::fill(depths, depths + CELL_TEXELS, -INFINITY);
+	memset(cell, 0, sizeof(uint32_t) * CELL_TEXELS);
+	auto edge = [](const glm::vec2& a, const glm::vec2& b, const glm::vec2& c) { return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x); };
+	for (unsigned int t = 0; t + 2 < mesh.numIndices; t += 3)
+	{
+		glm::vec2 points[3];
+		float z[3];
+		glm::vec3 normals[3];
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			const Vertex& vertex = mesh.vertices[mesh.indices[t + k]];
+			const glm::vec3 position = glm::vec3(vertex.position[0], vertex.position[1], vertex.position[2]) - center;
+			points[k] = glm::vec2(glm::dot(position, right), glm::dot(position, up)) * toTexel + CELL_SIZE * 0.5f;
+			z[k] = glm::dot(position, direction);
+			normals[k] = glm::vec3(vertex.normal[0], vertex.normal[1], vertex.normal[2]);
+		}
+		const float area = edge(points[0], points[1], points[2]);
+		if (area == 0.0f)
+			continue;
+		//texel centers inside the bounds
+		const glm::vec2 minBounds = glm::min(points[0], glm::min(points[1], points[2]));
+		const glm::vec2 maxBounds = glm::max(points[0], glm::max(points[1], points[2]));
+		const int x0 = std::max(static_cast<int>(ceilf(minBounds.x - 0.5f)), 0);
+		const int y0 = std::max(static_cast<int>(ceilf(minBounds.y - 0.5f)), 0);
+		const int x1 = std::min(static_cast<int>(floorf(maxBounds.x - 0.5f)), static_cast<int>(CELL_SIZE) - 1);
+		const int y1 = std::min(static_cast<int>(floorf(maxBounds.y - 0.5f)), static_cast<int>(CELL_SIZE) - 1);
+		for (int y = y0; y <= y1; ++y)
+		{
+			for (int x = x0; x <= x1; ++x)
+			{
+				//Over the signed area both windings are inside
+				const glm::vec2 sample(x + 0.5f, y + 0.5f);
+				const float w0 = edge(points[1], points[2], sample) / area;
+				const float w1 = edge(points[2], points[0], sample) / area;
+				const float w2 = 1.0f - w0 - w1;
+				if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+					continue;
+				const uint32_t index = y * CELL_SIZE + x;
+				const float depth = w0 * z[0] + w1 * z[1] + w2 * z[2];
+				if (depth <= depths[index])
+					continue;
+				depths[index] = depth;
+				glm::vec3 normal = w0 * normals[0] + w1 * normals[1] + w2 * normals[2];
+				const float length = glm::length(normal);
+				normal = length > 0.0f ? normal / length : direction;
+				if (glm::dot(normal, direction) < 0.0f)
+					normal = -normal;
+				const glm::vec2 encoded = OctEncode(normal) * 0.5f + 0.5f;
+				const float depthTexel = std::min(std::max(depth / radius * 0.5f + 0.5f, 0.0f), 1.0f);
+				cell[index] = static_cast<uint32_t>(encoded.x * 255.0f + 0.5f) | static_cast<uint32_t>(encoded.y * 255.0f + 0.5f) << 8 |
+					static_cast<uint32_t>(depthTexel * 255.0f + 0.5f) << DEPTH_SHIFT | 0xFFu << COVERAGE_SHIFT;
+			}
+		}
+	}
+}
+
+glm::vec4 Impostor::Bake(const Mesh& mesh, uint32_t* atlas)
+{
+	glm::vec3 minBounds(INFINITY);
+	glm::vec3 maxBounds(-INFINITY);
+	for (unsigned int i = 0; i < mesh.numVertices; ++i)
+	{
+		const glm::vec3 position(mesh.vertices[i].position[0], mesh.vertices[i].position[1], mesh.vertices[i].position[2]);
+		minBounds = glm::min(minBounds, position);
+		maxBounds = glm::max(maxBounds, position);
+	}
+	if (mesh.numVertices == 0)
+		minBounds = maxBounds = glm::vec3(0.0f);
+	const glm::vec4 sphere((minBounds + maxBounds) * 0.5f, glm::length(maxBounds - minBounds) * 0.5f);
+	for (uint32_t frame = 0; frame < FRAME_COUNT; ++frame)
+		RenderView(mesh, sphere, FrameDirection(frame), atlas + frame * CELL_TEXELS);
+	return sphere;
+}
+
+glm::vec3 Impostor::DecodeNormal(uint32_t texel)
+{
+	const glm::vec2 encoded(static_cast<float>(texel & 0xFF), static_cast<float>((texel >> 8) & 0xFF));
+	return OctDecode(encoded / 255.0f * 2.0f - 1.0f);
+}
+
+float Impostor::ProjectedDiameter(const glm::vec4& nearPlane, const glm::vec3& center, float radius, float projectionScale)
+{
+	const float minDepth = nearPlane.w - glm::dot(glm::vec3(nearPlane), center) - radius;
+	if (minDepth <= 0.0f)
+		return INFINITY;
+	return 2.0f * radius * projectionScale / minDepth;
+}
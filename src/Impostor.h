@@ -0,0 +1,59 @@
+#ifndef __IMPOSTOR_H__
+#define __IMPOSTOR_H__
+
+#include "ModuleVulkan.h"
+#include "glm/vec2.hpp"
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+#include <stdint.h>
+
+//Far field impostors: every mesh is baked at load into an octahedral atlas of FRAMES x FRAMES orthographic views around its bounding sphere. culling.comp
+//sends the instances whose sphere projects under the impostor threshold to Impostor.mesh instead of the meshlet commands, one quad per instance facing the
+//camera with the frame of the nearest view direction. Impostor.frag lights the baked normals, the meshlets of the far instances are never emitted
+//This is also the CPU reference of the frame selection of Impostor.mesh and the texel decode of Impostor.frag
+namespace Impostor
+{
+	//Same as Impostor.mesh and Impostor.frag
+	constexpr uint32_t FRAMES = 8;
+	constexpr uint32_t FRAME_COUNT = FRAMES * FRAMES;
+	constexpr uint32_t CELL_SIZE = 32;
+	constexpr uint32_t CELL_TEXELS = CELL_SIZE * CELL_SIZE;
+	constexpr uint32_t MESH_TEXELS = FRAME_COUNT * CELL_TEXELS;
+	//Same as culling.comp and Impostor.mesh: quads of a mesh shader workgroup
+	constexpr uint32_t GROUP_SIZE = 64;
+	//Projected diameter in pixels of the bounding sphere under which the instance is drawn as an impostor
+	constexpr float DEFAULT_THRESHOLD = 24.0f;
+	//Texel: octahedral normal (8 + 8 bits), depth along the view over the sphere diameter (8 bits), coverage (8 bits, 0 on the empty texels)
+	constexpr uint32_t COVERAGE_SHIFT = 24;
+	constexpr uint32_t DEPTH_SHIFT = 16;
+
+	//Same layout as ImpostorRecords on culling.comp and Impostor.mesh
+	struct Record
+	{
+		//object space bounding sphere the frames are centered on
+		glm::vec4 sphere;
+		//first texel of the mesh on the atlas, frame f starts at atlasOffset + f * CELL_TEXELS
+		uint32_t atlasOffset;
+		uint32_t padding[3];
+	};
+
+	//Octahedral mapping of the unit sphere on [-1, 1]^2
+	glm::vec2 OctEncode(const glm::vec3& direction);
+	glm::vec3 OctDecode(const glm::vec2& encoded);
+	//Unit direction from the sphere center toward the viewer of frame, the center of its cell on the octahedral grid
+	glm::vec3 FrameDirection(uint32_t frame);
+	//Frame whose cell holds the direction, the one Impostor.mesh picks for a camera on that side of the instance
+	uint32_t NearestFrame(const glm::vec3& direction);
+	//Screen axes of the frame seen from direction, right x up = direction
+	void FrameBasis(const glm::vec3& direction, glm::vec3& right, glm::vec3& up);
+	//Orthographic view of the mesh from direction over the sphere into CELL_TEXELS texels, row 0 at -up. Two sided, the nearest surface wins
+	void RenderView(const Mesh& mesh, const glm::vec4& sphere, const glm::vec3& direction, uint32_t* cell);
+	//Bounding sphere of the mesh box and its MESH_TEXELS atlas texels, one view per frame
+	glm::vec4 Bake(const Mesh& mesh, uint32_t* atlas);
+	glm::vec3 DecodeNormal(uint32_t texel);
+	//Same test as culling.comp: projected diameter in pixels of the sphere at its nearest depth past the near plane (Camera::GetPlanes order), infinite
+	//when it reaches the near plane. projectionScale is in pixels per world unit at depth 1
+	float ProjectedDiameter(const glm::vec4& nearPlane, const glm::vec3& center, float radius, float projectionScale);
+}
+
+#endif // !__IMPOSTOR_H__
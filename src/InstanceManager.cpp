@@ -0,0 +1,150 @@
+#include "InstanceManager.h"
+#include <string.h>
+#include <algorithm>
+#include <functional>
+
+void InstanceManager::Init(uint32_t capacity, uint32_t numMeshes)
+{
+	meshCount = numMeshes;
+	meshes.assign(capacity, DEAD_INSTANCE);
+	motions.assign(capacity, InstanceSimulation::Motion{});
+	generations.assign(capacity, 1);
+	//sorted is already a min heap
+	freeSlots.resize(capacity);
+	for (uint32_t i = 0; i < capacity; ++i)
+		freeSlots[i] = i;
+	dirtyQueue.assign(capacity, 0);
+	dirty.assign(capacity, false);
+	dirtyFirst = 0;
+	dirtyCount = 0;
+	liveCount = 0;
+	slotCount = 0;
+}
+
+uint32_t InstanceManager::Add(const uint32_t* newMeshes, const InstanceSimulation::Motion* newMotions, uint32_t count, InstanceHandle* handles)
+{
+	uint32_t added = 0;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		if (handles != nullptr)
+			handles[i] = InstanceHandle();
+		if (newMeshes[i] >= meshCount || freeSlots.empty())
+			continue;
+		std::pop_heap(freeSlots.begin(), freeSlots.end(), std::greater<uint32_t>());
+		const uint32_t slot = freeSlots.back();
+		freeSlots.pop_back();
+		meshes[slot] = newMeshes[i];
+		motions[slot] = newMotions[i];
+		slotCount = std::max(slotCount, slot + 1);
+		++liveCount;
+		MarkDirty(slot);
+		if (handles != nullptr)
+		{
+			handles[i].slot = slot;
+			handles[i].generation = generations[slot];
+		}
+		++added;
+	}
+	return added;
+}
+
+uint32_t InstanceManager::Remove(const InstanceHandle* handles, uint32_t count)
+{
+	uint32_t removed = 0;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		if (!IsAlive(handles[i]))
+			continue;
+		const uint32_t slot = handles[i].slot;
+		meshes[slot] = DEAD_INSTANCE;
+		//0 is the generation of the invalid handles
+		if (++generations[slot] == 0)
+			generations[slot] = 1;
+		freeSlots.push_back(slot);
+		std::push_heap(freeSlots.begin(), freeSlots.end(), std::greater<uint32_t>());
+		--liveCount;
+		MarkDirty(slot);
+		//Amortized O(1): the free list hands out the lowest slot, a dead slot is not walked over again until it is reused
+		while (slotCount != 0 && meshes[slotCount - 1] == DEAD_INSTANCE)
+			--slotCount;
+		++removed;
+	}
+	return removed;
+}
+
+uint32_t InstanceManager::Update(const InstanceHandle* handles, const InstanceSimulation::Motion* newMotions, uint32_t count)
+{
+	uint32_t updated = 0;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		if (!IsAlive(handles[i]))
+			continue;
+		motions[handles[i].slot] = newMotions[i];
+		MarkDirty(handles[i].slot);
+		++updated;
+	}
+	return updated;
+}
+
+void InstanceManager::MarkDirty(uint32_t slot)
+{
+	if (dirty[slot])
+		return;
+	dirty[slot] = true;
+	dirtyQueue[(dirtyFirst + dirtyCount) % dirtyQueue.size()] = slot;
+	++dirtyCount;
+}
+
+uint32_t InstanceManager::TakeDirtySlots(uint32_t* slots, uint32_t maxSlots)
+{
+	const uint32_t count = std::min(dirtyCount, maxSlots);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const uint32_t slot = dirtyQueue[dirtyFirst];
+		dirtyFirst = (dirtyFirst + 1) % static_cast<uint32_t>(dirtyQueue.size());
+		dirty[slot] = false;
+		if (slots != nullptr)
+			slots[i] = slot;
+	}
+	dirtyCount -= count;
+	return count;
+}
+
+bool InstanceManager::Validate() const
+{
+	const uint32_t capacity = GetCapacity();
+	uint32_t live = 0;
+	uint32_t highest = 0;
+	for (uint32_t slot = 0; slot < capacity; ++slot)
+	{
+		if (generations[slot] == 0)
+			return false;
+		if (meshes[slot] == DEAD_INSTANCE)
+			continue;
+		if (meshes[slot] >= meshCount)
+			return false;
+		++live;
+		highest = slot + 1;
+	}
+	if (live != liveCount || highest != slotCount || freeSlots.size() + live != capacity)
+		return false;
+	if (!std::is_heap(freeSlots.begin(), freeSlots.end(), std::greater<uint32_t>()))
+		return false;
+	std::vector<bool> listed(capacity, false);
+	for (uint32_t slot : freeSlots)
+	{
+		if (slot >= capacity || listed[slot] || meshes[slot] != DEAD_INSTANCE)
+			return false;
+		listed[slot] = true;
+	}
+	//every queued slot is flagged once and every flagged slot is queued
+	listed.assign(capacity, false);
+	for (uint32_t i = 0; i < dirtyCount; ++i)
+	{
+		const uint32_t slot = dirtyQueue[(dirtyFirst + i) % capacity];
+		if (listed[slot] || !dirty[slot])
+			return false;
+		listed[slot] = true;
+	}
+	return static_cast<uint32_t>(std::count(dirty.begin(), dirty.end(), true)) == dirtyCount;
+}
@@ -0,0 +1,68 @@
+#ifndef __INSTANCE_MANAGER_H__
+#define __INSTANCE_MANAGER_H__
+
+#include "InstanceSimulation.h"
+#include <stdint.h>
+#include <vector>
+
+//Stable reference to an instance: its slot and the generation of the slot when it was added. Removing the instance bumps the generation, the old handles go stale
+struct InstanceHandle
+{
+	uint32_t slot = ~0u;
+	uint32_t generation = 0;
+};
+
+//Slots of the GPU instance buffers (mesh index + motion of every slot). Adding, removing or updating an instance is O(1) (O(log slots) for the free list)
+//and marks the slot dirty, ModuleVulkan uploads only the dirty slots. The free slots are given lowest first so the live ones stay packed at the front:
+//the shaders only loop over the first GetSlotCount() slots and culling.comp skips the dead ones (DEAD_INSTANCE as mesh)
+class InstanceManager
+{
+public:
+	//Mesh of the dead slots, same as DEAD_INSTANCE on culling.comp
+	static constexpr uint32_t DEAD_INSTANCE = ~0u;
+	//Slots uploaded per frame, it bounds the staging memory of a frame. The rest stay dirty for the next frames
+	static constexpr uint32_t MAX_UPLOADS = 16384;
+
+	void Init(uint32_t capacity, uint32_t numMeshes);
+	//The batches return how many instances they changed. Add skips the meshes out of range and stops when the slots run out,
+	//the handles of the instances not added stay invalid. handles can be null
+	uint32_t Add(const uint32_t* meshes, const InstanceSimulation::Motion* motions, uint32_t count, InstanceHandle* handles);
+	//Stale handles are skipped
+	uint32_t Remove(const InstanceHandle* handles, uint32_t count);
+	uint32_t Update(const InstanceHandle* handles, const InstanceSimulation::Motion* motions, uint32_t count);
+	bool IsAlive(InstanceHandle handle) const { return handle.slot < meshes.size() && handle.generation != 0 && generations[handle.slot] == handle.generation && meshes[handle.slot] != DEAD_INSTANCE; }
+
+	uint32_t GetCapacity() const { return static_cast<uint32_t>(meshes.size()); }
+	uint32_t GetLiveCount() const { return liveCount; }
+	//One past the highest live slot
+	uint32_t GetSlotCount() const { return slotCount; }
+	//Same layout as the GPU buffers, every slot up to the capacity
+	const uint32_t* GetMeshes() const { return meshes.data(); }
+	const InstanceSimulation::Motion* GetMotions() const { return motions.data(); }
+	//A slot is listed once however many times it changed, in the order it first changed
+	uint32_t GetDirtyCount() const { return dirtyCount; }
+	bool IsDirty(uint32_t slot) const { return dirty[slot]; }
+	//Pops up to maxSlots dirty slots, slots can be null to drop them (the whole buffers were uploaded)
+	uint32_t TakeDirtySlots(uint32_t* slots, uint32_t maxSlots);
+	//Slots, free list, generations and dirty queue agree with each other, used by the churn simulation of MeshTool
+	bool Validate() const;
+
+private:
+	void MarkDirty(uint32_t slot);
+
+	std::vector<uint32_t> meshes;
+	std::vector<InstanceSimulation::Motion> motions;
+	std::vector<uint32_t> generations;
+	//min heap, the lowest free slot on top
+	std::vector<uint32_t> freeSlots;
+	//ring of the dirty slots, it never holds more than the capacity
+	std::vector<uint32_t> dirtyQueue;
+	std::vector<bool> dirty;
+	uint32_t dirtyFirst = 0;
+	uint32_t dirtyCount = 0;
+	uint32_t meshCount = 0;
+	uint32_t liveCount = 0;
+	uint32_t slotCount = 0;
+};
+
+#endif // !__INSTANCE_MANAGER_H__
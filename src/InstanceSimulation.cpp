@@ -0,0 +1,142 @@
+#include "InstanceSimulation.h"
+#include "glm/geometric.hpp"
+#include "glm/gtc/quaternion.hpp"
+#include <math.h>
+#include <algorithm>
+
+namespace
+{
+	constexpr float TWO_PI = 6.28318530718f;
+
+	//GLSL mod, the result has the sign of y
+	float Mod(float x, float y) { return x - y * floorf(x / y); }
+
+	glm::vec4 QuatMul(const glm::vec4& a, const glm::vec4& b)
+	{
+		const glm::vec3 av(a), bv(b);
+		return glm::vec4(a.w * bv + b.w * av + glm::cross(av, bv), a.w * b.w - glm::dot(av, bv));
+	}
+
+	glm::vec4 AxisAngle(const glm::vec3& axis, float angle)
+	{
+		return glm::vec4(axis * sinf(angle * 0.5f), cosf(angle * 0.5f));
+	}
+
+	//xorshift, the scene motions only need to be different and repeatable
+	float Random(uint32_t& state)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return static_cast<float>(state & 0xFFFFFF) / static_cast<float>(0xFFFFFF);
+	}
+}
+
+glm::mat4 InstanceSimulation::Evaluate(const Motion& motion, const Keyframe* keyframes, float time)
+{
+	glm::vec3 position(motion.position);
+	if (motion.orbit.w != 0.0f)
+	{
+		const float angle = Mod(motion.orbit.w * time, TWO_PI);
+		const float c = cosf(angle);
+		const float s = sinf(angle);
+		const glm::vec3 center(motion.orbit);
+		const glm::vec3 d = position - center;
+		position = center + glm::vec3(c * d.x + s * d.z, d.y, c * d.z - s * d.x);
+	}
+	position += glm::vec3(motion.velocity) * time;
+	if (motion.velocity.w > 0.0f)
+	{
+		const float extent = motion.velocity.w;
+		position = glm::vec3(Mod(position.x + extent, 2.0f * extent), Mod(position.y + extent, 2.0f * extent), Mod(position.z + extent, 2.0f * extent)) - extent;
+	}
+	glm::vec4 rotation = motion.rotation;
+	if (motion.angularVelocity.w != 0.0f)
+		rotation = QuatMul(AxisAngle(glm::vec3(motion.angularVelocity), Mod(motion.angularVelocity.w * time, TWO_PI)), rotation);
+	if (motion.keyframeCount != 0)
+	{
+		const float local = Mod(time + motion.keyframePhase, motion.keyframePeriod) / motion.keyframePeriod * static_cast<float>(motion.keyframeCount);
+		const uint32_t key0 = std::min(static_cast<uint32_t>(local), motion.keyframeCount - 1);
+		const uint32_t key1 = key0 + 1 == motion.keyframeCount ? 0 : key0 + 1;
+		const float blend = local - static_cast<float>(key0);
+		const Keyframe& a = keyframes[motion.keyframeOffset + key0];
+		const Keyframe& b = keyframes[motion.keyframeOffset + key1];
+		position += glm::mix(glm::vec3(a.position), glm::vec3(b.position), blend);
+		//shortest path
+		const glm::vec4 rotationB = glm::dot(a.rotation, b.rotation) < 0.0f ? -b.rotation : b.rotation;
+		rotation = QuatMul(glm::normalize(glm::mix(a.rotation, rotationB, blend)), rotation);
+	}
+	rotation = glm::normalize(rotation);
+
+	const float scale = motion.position.w;
+	const float x = rotation.x, y = rotation.y, z = rotation.z, w = rotation.w;
+	glm::mat4 transform;
+	transform[0] = glm::vec4(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y), 0.0f) * scale;
+	transform[1] = glm::vec4(2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x), 0.0f) * scale;
+	transform[2] = glm::vec4(2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y), 0.0f) * scale;
+	transform[3] = glm::vec4(position, 1.0f);
+	return transform;
+}
+
+void InstanceSimulation::Simulate(const Motion* motions, uint32_t count, const Keyframe* keyframes, float time, glm::mat4* transforms)
+{
+	for (uint32_t i = 0; i < count; ++i)
+		transforms[i] = Evaluate(motions[i], keyframes, time);
+}
+
+float InstanceSimulation::TransformError(const glm::mat4& a, const glm::mat4& b)
+{
+	float error = 0.0f;
+	for (int column = 0; column < 3; ++column)
+		for (int row = 0; row < 4; ++row)
+			error = std::max(error, fabsf(a[column][row] - b[column][row]));
+	//float positions thousands of units away only keep a few decimals
+	const float distance = std::max(1.0f, glm::length(glm::vec3(a[3])));
+	return std::max(error, glm::length(glm::vec3(a[3]) - glm::vec3(b[3])) / distance);
+}
+
+void InstanceSimulation::InitSceneKeyframes(Keyframe* keyframes)
+{
+	//A loop around the base position bobbing twice per lap and turning once on y
+	for (uint32_t i = 0; i < SCENE_KEYFRAMES; ++i)
+	{
+		const float angle = TWO_PI * static_cast<float>(i) / static_cast<float>(SCENE_KEYFRAMES);
+		keyframes[i].position = glm::vec4(200.0f * cosf(angle), 150.0f * sinf(2.0f * angle), 200.0f * sinf(angle), 0.0f);
+		keyframes[i].rotation = AxisAngle(glm::vec3(0.0f, 1.0f, 0.0f), angle);
+	}
+}
+
+InstanceSimulation::Motion InstanceSimulation::MakeSceneMotion(uint32_t index, const glm::mat4& placement)
+{
+	Motion motion{};
+	motion.position = glm::vec4(glm::vec3(placement[3]), 1.0f);
+	const glm::quat rotation = glm::quat_cast(glm::mat3(placement));
+	motion.rotation = glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+	uint32_t state = index * 2654435761u + 1;
+	const float sign = Random(state) < 0.5f ? -1.0f : 1.0f;
+	const glm::vec3 direction = glm::normalize(glm::vec3(Random(state), Random(state), Random(state)) * 2.0f - 1.0f);
+	//3/8 static, 2/8 spinning and one orbiting, drifting and following the keyframe track each
+	switch (index % 8)
+	{
+		case 3:
+		case 4:
+			motion.angularVelocity = glm::vec4(direction, sign * (0.2f + 1.3f * Random(state)));
+			break;
+		case 5:
+			motion.orbit = glm::vec4(0.0f, motion.position.y, 0.0f, sign * (0.01f + 0.04f * Random(state)));
+			break;
+		case 6:
+			motion.velocity = glm::vec4(direction * (20.0f + 100.0f * Random(state)), SCENE_WRAP_EXTENT);
+			motion.angularVelocity = glm::vec4(direction, 0.3f * sign);
+			break;
+		case 7:
+			motion.keyframeOffset = 0;
+			motion.keyframeCount = SCENE_KEYFRAMES;
+			motion.keyframePeriod = 4.0f + 8.0f * Random(state);
+			motion.keyframePhase = motion.keyframePeriod * Random(state);
+			break;
+		default:
+			break;
+	}
+	return motion;
+}
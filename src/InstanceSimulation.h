@@ -0,0 +1,59 @@
+#ifndef __INSTANCE_SIMULATION_H__
+#define __INSTANCE_SIMULATION_H__
+
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+#include "glm/mat4x4.hpp"
+#include <stdint.h>
+
+//GPU driven instance motion. The motion of every instance lives on a device buffer uploaded once, InstanceSim.comp writes the model matrices
+//culling.comp and the mesh shaders read from it every frame, the only per frame input is the simulation time on the cull uniform
+//This is the CPU reference of InstanceSim.comp, same operations in the same order so both can be compared
+namespace InstanceSimulation
+{
+	//Same as local_size_x on InstanceSim.comp
+	constexpr uint32_t WORKGROUP_SIZE = 64;
+
+	//Same layout as Motion on InstanceSim.comp (std430). The quaternions are (x, y, z, w)
+	//transform = translate(orbit(position) + velocity * t + keyframe offset) * rotate(keyframe * spin * rotation) * scale
+	struct Motion
+	{
+		//xyz base position, w uniform scale
+		glm::vec4 position;
+		glm::vec4 rotation;
+		//xyz units per second, w half size of the cube around the origin the position wraps in (0 does not wrap)
+		glm::vec4 velocity;
+		//xyz normalized spin axis, w radians per second
+		glm::vec4 angularVelocity;
+		//xyz center the position turns around on the world y axis, w radians per second
+		glm::vec4 orbit;
+		//keyframe track of the instance, keyframeCount 0 has no track. The keys are uniformly spaced on the period and loop, the phase (seconds) offsets the time
+		uint32_t keyframeOffset;
+		uint32_t keyframeCount;
+		float keyframePeriod;
+		float keyframePhase;
+	};
+	static_assert(sizeof(Motion) == 96, "Motion must match the std430 layout of InstanceSim.comp");
+
+	//Same layout as Keyframe on InstanceSim.comp, offset and rotation applied on top of the rest of the motion
+	struct Keyframe
+	{
+		//xyz offset, w unused
+		glm::vec4 position;
+		glm::vec4 rotation;
+	};
+
+	glm::mat4 Evaluate(const Motion& motion, const Keyframe* keyframes, float time);
+	void Simulate(const Motion* motions, uint32_t count, const Keyframe* keyframes, float time, glm::mat4* transforms);
+	//Largest absolute difference of the elements, the translations are relative to the distance from the origin
+	float TransformError(const glm::mat4& a, const glm::mat4& b);
+
+	//Procedural scene: the instances keep their random placement and the index picks the motion (static, spin, orbit, drift or a keyframe track)
+	constexpr uint32_t SCENE_KEYFRAMES = 8;
+	//Position wrap of the drifting instances, the scene cube (6000 units) rotated by the random base rotations fits inside
+	constexpr float SCENE_WRAP_EXTENT = 10400.0f;
+	void InitSceneKeyframes(Keyframe* keyframes);
+	Motion MakeSceneMotion(uint32_t index, const glm::mat4& placement);
+}
+
+#endif // !__INSTANCE_SIMULATION_H__
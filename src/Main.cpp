@@ -3,19 +3,26 @@
 
 int main(int argc, char* argv[])
 {
-	Application* app = new Application();
-	UpdateStatus appStatus = UpdateStatus::UPDATE_ERROR;
-	if (app->Init())
+	//The benchmark meshlet size sweep runs the whole engine once per configuration
+	const unsigned int runCount = Application::GetRunCount(argc, argv);
+	for (unsigned int run = 0; run < runCount; ++run)
 	{
-		do
+		Application* app = new Application(argc, argv, run);
+		UpdateStatus appStatus = UpdateStatus::UPDATE_ERROR;
+		if (app->Init())
 		{
-			appStatus = app->Update();
-		} while (appStatus == UpdateStatus::UPDATE_CONTINUE);
+			do
+			{
+				appStatus = app->Update();
+			} while (appStatus == UpdateStatus::UPDATE_CONTINUE);
+		}
+		if (appStatus != UpdateStatus::UPDATE_ERROR)
+			app->CleanUp();
+		else
+			LOG("App closing with errors :(");
+		delete app;
+		if (appStatus == UpdateStatus::UPDATE_ERROR)
+			break;
 	}
-	if (appStatus != UpdateStatus::UPDATE_ERROR)
-		app->CleanUp();
-	else
-		LOG("App closing with errors :(");
-	delete app;
 	return 0;
 }
\ No newline at end of file
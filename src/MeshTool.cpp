@@ -0,0 +1,866 @@
+#include "ImportMesh.h"
+#include "OptimizeMesh.h"
+#include "GeometryStreaming.h"
+#include "MeshletCompression.h"
+#include "VisibilityBuffer.h"
+#include "SoftwareRaster.h"
+#include "PrimitiveCulling.h"
+#include "InstanceSimulation.h"
+#include "InstanceManager.h"
+#include "MultiView.h"
+#include "Impostor.h"
+#include "Simulations.h"
+#include "meshoptimizer.h"
+#include "glm/gtc/matrix_transform.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <algorithm>
+#include <vector>
+#include <initializer_list>
+#include <limits>
+
+static bool ImportMapped(const char* path, Mesh& mesh, ImporterMesh::ImportStats* stats)
+{
+	return ImporterMesh::ImportFirstMapped(path, mesh, stats);
+}
+
+static bool ImportTinyGltf(const char* path, Mesh& mesh, ImporterMesh::ImportStats*)
+{
+	return ImporterMesh::ImportFirstTinyGltf(path, mesh);
+}
+
+//Milliseconds per import of the model, the last import is kept in mesh
+static double TimeImport(bool (*import)(const char*, Mesh&, ImporterMesh::ImportStats*), const char* path, int iterations, Mesh& mesh, ImporterMesh::ImportStats* stats)
+{
+	double total = 0.0;
+	for (int i = 0; i < iterations; ++i)
+	{
+		mesh.Free();
+		const auto start = std::chrono::steady_clock::now();
+		if (!import(path, mesh, stats))
+			return -1.0;
+		total += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+	return total / iterations;
+}
+
+//Load throughput of the mapped path against tinygltf, both have to produce the same mesh
+//tinygltf can not read the compressed and quantized files, those only report the mapped path and the meshopt decode throughput
+static int ImportBenchmark(int iterations, int first, int argc, char* argv[])
+{
+	int failed = 0;
+	printf("%-40s %10s %12s %12s %12s %12s %8s %12s %12s\n", "model", "MB", "tinygltf ms", "MB/s", "mapped ms", "MB/s", "speedup", "decoded MB", "decode MB/s");
+	for (int i = first; i < argc; ++i)
+	{
+		FILE* file = fopen(argv[i], "rb");
+		if (file == NULL)
+		{
+			printf("%-40s could not be opened\n", argv[i]);
+			++failed;
+			continue;
+		}
+		fseek(file, 0, SEEK_END);
+		const double megabytes = static_cast<double>(ftell(file)) / (1024.0 * 1024.0);
+		fclose(file);
+
+		Mesh reference = {}, mapped = {};
+		ImporterMesh::ImportStats stats;
+		const double mappedMs = TimeImport(ImportMapped, argv[i], iterations, mapped, &stats);
+		if (mappedMs < 0.0)
+		{
+			printf("%-40s could not be imported\n", argv[i]);
+			++failed;
+			continue;
+		}
+		const double decodedMegabytes = static_cast<double>(stats.decodedBytes) / (1024.0 * 1024.0);
+		const double decodeThroughput = stats.decodeMs > 0.0 ? decodedMegabytes * 1000.0 / stats.decodeMs : 0.0;
+		const double tinyGltfMs = TimeImport(ImportTinyGltf, argv[i], iterations, reference, nullptr);
+		if (tinyGltfMs < 0.0)
+		{
+			printf("%-40s %10.2f %12s %12s %12.3f %12.1f %8s %12.2f %12.1f\n", argv[i], megabytes, "-", "-", mappedMs, megabytes * 1000.0 / mappedMs, "-", decodedMegabytes / iterations, decodeThroughput);
+			mapped.Free();
+			continue;
+		}
+		const bool same = reference.numVertices == mapped.numVertices && reference.numIndices == mapped.numIndices
+			&& memcmp(reference.vertices, mapped.vertices, sizeof(Vertex) * mapped.numVertices) == 0
+			&& memcmp(reference.indices, mapped.indices, sizeof(unsigned int) * mapped.numIndices) == 0;
+		if (same)
+			printf("%-40s %10.2f %12.3f %12.1f %12.3f %12.1f %7.2fx %12.2f %12.1f\n", argv[i], megabytes, tinyGltfMs, megabytes * 1000.0 / tinyGltfMs, mappedMs, megabytes * 1000.0 / mappedMs, tinyGltfMs / mappedMs, decodedMegabytes / iterations, decodeThroughput);
+		else
+		{
+			printf("%-40s the two importers do not produce the same mesh\n", argv[i]);
+			++failed;
+		}
+		reference.Free();
+		mapped.Free();
+	}
+	return failed;
+}
+
+//One run per value of the member, the rest of the params keep their defaults
+template<typename Params, typename Value> static std::vector<Params> Sweep(Value Params::*member, std::initializer_list<Value> values)
+{
+	std::vector<Params> runs;
+	for (Value value : values)
+	{
+		runs.emplace_back();
+		runs.back().*member = value;
+	}
+	return runs;
+}
+
+//Runs the simulation once per params, printRow writes the columns of the table the caller started and the row ends with the valid column. The failed
+//runs that count their errors print the count under their row. Returns the failed runs
+template<typename Params, typename Result, typename PrintRow> static int RunSimulation(const std::vector<Params>& runs, Result (*simulate)(const Params&), const PrintRow& printRow)
+{
+	int failed = 0;
+	for (const Params& params : runs)
+	{
+		const Result result = simulate(params);
+		printRow(params, result);
+		printf(" %8s\n", result.valid ? "yes" : "NO");
+		if (!result.valid)
+		{
+			if (result.errors != 0)
+				printf("%u errors\n", result.errors);
+			++failed;
+		}
+	}
+	return failed;
+}
+
+//CPU simulation of the streaming eviction policy (GeometryStreaming::ResidencyManager) for slot budgets from the whole scene to less than the working set
+//Fails when an invariant breaks or when a budget that holds the whole scene still evicts
+static int StreamingSimulation()
+{
+	const Simulations::StreamingParams params;
+	const uint32_t pinnedPages = params.groupCount;
+	const uint32_t workingSet = params.visibleGroups * params.pagesPerGroup;
+	const uint32_t allPages = params.groupCount * params.pagesPerGroup + pinnedPages;
+	printf("%u groups of %u pages, %u visible groups (%u pages), %u pinned fallback pages, %u frames\n", params.groupCount, params.pagesPerGroup, params.visibleGroups, workingSet, pinnedPages, params.frames);
+	printf("%10s %10s %10s %10s %12s %10s %8s\n", "slots", "hit rate", "uploads", "evictions", "fallbacks", "refused", "valid");
+	return RunSimulation(Sweep(&Simulations::StreamingParams::slotCount, { allPages, pinnedPages + workingSet * 2, pinnedPages + workingSet + params.pagesPerGroup, pinnedPages + workingSet / 2 }),
+		Simulations::SimulateStreaming, [](const Simulations::StreamingParams& run, const Simulations::StreamingResult& result)
+	{
+		printf("%10u %10.3f %10llu %10llu %12llu %10llu", run.slotCount, static_cast<double>(result.residentUses) / static_cast<double>(result.pageUses),
+			static_cast<unsigned long long>(result.uploads), static_cast<unsigned long long>(result.evictions), static_cast<unsigned long long>(result.fallbackFrames),
+			static_cast<unsigned long long>(result.refusedRequests));
+	});
+}
+
+//CPU run of the instance motions (InstanceSimulation, the reference of InstanceSim.comp) on the procedural scene: checks that the rotations stay orthonormal,
+//the drifting instances stay inside the wrap, time 0 is the base placement and the keyframe tracks loop without a jump, then times the matrices per second
+static int InstanceSimulationTest()
+{
+	constexpr uint32_t count = 100000;
+	constexpr int frames = 600;
+	constexpr float step = 1.0f / 60.0f;
+	constexpr float tolerance = 1e-3f;
+	InstanceSimulation::Keyframe keyframes[InstanceSimulation::SCENE_KEYFRAMES];
+	InstanceSimulation::InitSceneKeyframes(keyframes);
+	InstanceSimulation::Motion* motions = new InstanceSimulation::Motion[count];
+	glm::mat4* placements = new glm::mat4[count];
+	glm::mat4* transforms = new glm::mat4[count];
+	srand(1);
+	auto random = []() { return static_cast<float>(rand() % 10001) / 10001.0f * 2.0f - 1.0f; };
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		glm::vec3 axis(random(), random(), random());
+		if (glm::length(axis) < 1e-3f)
+			axis = glm::vec3(0.0f, 1.0f, 0.0f);
+		const glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), glm::radians(static_cast<float>(rand() % 360)), axis);
+		placements[i] = glm::translate(rotation, glm::vec3(6000.0f * random(), 6000.0f * random(), 6000.0f * random()));
+		motions[i] = InstanceSimulation::MakeSceneMotion(i, placements[i]);
+	}
+
+	uint32_t baseErrors = 0, orthonormalErrors = 0, wrapErrors = 0, loopErrors = 0;
+	float maxBaseError = 0.0f, maxLoopError = 0.0f;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const InstanceSimulation::Motion& motion = motions[i];
+		if (motion.keyframeCount == 0)
+		{
+			const float error = InstanceSimulation::TransformError(InstanceSimulation::Evaluate(motion, keyframes, 0.0f), placements[i]);
+			maxBaseError = std::max(maxBaseError, error);
+			if (error > tolerance)
+				++baseErrors;
+		}
+		else
+		{
+			//the track goes back to the first key when time + phase reaches the period
+			float seam = motion.keyframePeriod - motion.keyframePhase;
+			if (seam < 0.01f)
+				seam += motion.keyframePeriod;
+			const float error = InstanceSimulation::TransformError(InstanceSimulation::Evaluate(motion, keyframes, seam - 1e-3f), InstanceSimulation::Evaluate(motion, keyframes, seam + 1e-3f));
+			maxLoopError = std::max(maxLoopError, error);
+			if (error > 1e-2f)
+				++loopErrors;
+		}
+	}
+
+	double totalMs = 0.0;
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		const float time = static_cast<float>(frame) * step;
+		const auto start = std::chrono::steady_clock::now();
+		InstanceSimulation::Simulate(motions, count, keyframes, time, transforms);
+		totalMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const glm::vec3 x(transforms[i][0]), y(transforms[i][1]), z(transforms[i][2]);
+			const float scale = motions[i].position.w;
+			if (fabsf(glm::length(x) - scale) > tolerance || fabsf(glm::length(y) - scale) > tolerance || fabsf(glm::length(z) - scale) > tolerance
+				|| fabsf(glm::dot(x, y)) > tolerance || fabsf(glm::dot(y, z)) > tolerance || fabsf(glm::dot(z, x)) > tolerance)
+				++orthonormalErrors;
+			const float extent = motions[i].velocity.w;
+			if (extent > 0.0f && (fabsf(transforms[i][3].x) > extent || fabsf(transforms[i][3].y) > extent || fabsf(transforms[i][3].z) > extent))
+				++wrapErrors;
+		}
+	}
+
+	const int failed = (baseErrors != 0) + (orthonormalErrors != 0) + (wrapErrors != 0) + (loopErrors != 0);
+	printf("%u instances, %d frames of %.4f s\n", count, frames, step);
+	printf("%12s %12s %12s %12s %12s %12s %14s %8s\n", "base errors", "max base", "orthonormal", "wrap", "loop errors", "max seam", "matrices/s", "valid");
+	printf("%12u %12f %12u %12u %12u %12f %14.0f %8s\n", baseErrors, maxBaseError, orthonormalErrors, wrapErrors, loopErrors, maxLoopError,
+		static_cast<double>(count) * frames * 1000.0 / totalMs, failed == 0 ? "yes" : "NO");
+	delete[] transforms;
+	delete[] placements;
+	delete[] motions;
+	return failed;
+}
+
+//CPU simulation of the instance churn (InstanceManager): adds, removes and moves instances every frame and uploads the dirty slots under the per frame limit,
+//fails when a stale handle changes a slot, the slots outgrow the live instances or the uploaded copy does not match
+static int InstanceChurnSimulation()
+{
+	const Simulations::InstanceChurnParams params;
+	printf("%u slots, %u initial instances, %u added + removed and %u moved per frame, %u frames, %u uploads per frame\n", params.capacity, params.initialInstances,
+		params.churn, params.updates, params.frames, InstanceManager::MAX_UPLOADS);
+	printf("%10s %10s %10s %12s %10s %12s %14s %8s\n", "added", "removed", "moved", "uploads", "max slots", "max backlog", "changes/s", "valid");
+	return RunSimulation(std::vector<Simulations::InstanceChurnParams>(1, params), Simulations::SimulateInstanceChurn,
+		[](const Simulations::InstanceChurnParams&, const Simulations::InstanceChurnResult& result)
+	{
+		const uint64_t changes = result.added + result.removed + result.updated;
+		printf("%10llu %10llu %10llu %12llu %10u %12u %14.0f", static_cast<unsigned long long>(result.added), static_cast<unsigned long long>(result.removed),
+			static_cast<unsigned long long>(result.updated), static_cast<unsigned long long>(result.uploads), result.maxSlotCount, result.maxBacklog,
+			result.changeMs > 0.0 ? static_cast<double>(changes) * 1000.0 / result.changeMs : 0.0);
+	});
+}
+
+//CPU masked occlusion culling on the procedural 100k and 1M instance scenes: rejection rate and time of the occluder raster and of the instance tests,
+//fails when an instance is rejected that the per pixel reference does not reject or when the AVX2 and scalar paths disagree
+static int OcclusionBenchmark()
+{
+	printf("%10s %10s %10s %10s %10s %10s %10s %10s %10s %6s %8s\n", "instances", "on screen", "triangles", "occluded", "reference", "rejected", "raster ms", "test ms", "threads", "avx2", "valid");
+	return RunSimulation(Sweep(&Simulations::OcclusionParams::instanceCount, { 100000u, 1000000u }), Simulations::SimulateOcclusion,
+		[](const Simulations::OcclusionParams& run, const Simulations::OcclusionResult& result)
+	{
+		printf("%10u %10u %10u %10u %10u %9.1f%% %10.3f %10.3f %10u %6s", run.instanceCount, result.onScreen, result.occluderTriangles, result.occluded, result.referenceOccluded,
+			result.onScreen != 0 ? 100.0 * result.occluded / result.onScreen : 0.0, result.rasterMs, result.testMs, result.threadCount, result.avx2 ? "yes" : "no");
+	});
+}
+
+//CPU reference of the GPU depth sort (DepthSort, the passes of RadixSort.comp) on the survivors of the procedural 100k and 1M instance scenes: time
+//against std::stable_sort and the early Z overdraw estimate in cull order and sorted, fails when the order differs from std::stable_sort
+static int DepthSortBenchmark()
+{
+	printf("%10s %10s %10s %10s %12s %12s %8s\n", "instances", "sorted", "sort ms", "std ms", "overdraw", "sorted", "valid");
+	return RunSimulation(Sweep(&Simulations::DepthSortParams::instanceCount, { 100000u, 1000000u }), Simulations::SimulateDepthSort,
+		[](const Simulations::DepthSortParams& run, const Simulations::DepthSortResult& result)
+	{
+		printf("%10u %10u %10.3f %10.3f %12.2f %12.2f", run.instanceCount, result.sorted, result.sortMs, result.referenceMs, result.unsortedOverdraw, result.sortedOverdraw);
+	});
+}
+
+//CPU reference of the visibility cache (VisibilityCache, the cached tests of culling.comp and the task shader) on the procedural 100k instance scene seen
+//from the slow fly-through, with epochs started on demand and with a rotating refresh: tests left per frame and time, fails on any cached error
+static int VisibilityCacheBenchmark()
+{
+	printf("%8s %10s %10s %10s %12s %12s %8s %10s %10s %8s\n", "refresh", "boxes", "cached", "max", "spheres", "cached", "epochs", "full ms", "cached ms", "valid");
+	return RunSimulation(Sweep(&Simulations::VisibilityCacheParams::refreshFrames, { 0u, 8u }), Simulations::SimulateVisibilityCache,
+		[](const Simulations::VisibilityCacheParams& run, const Simulations::VisibilityCacheResult& result)
+	{
+		printf("%8u %10.0f %10.0f %10u %12.0f %12.0f %8u %10.3f %10.3f", run.refreshFrames, result.boxTests, result.cachedBoxTests, result.maxCachedBoxTests, result.sphereTests,
+			result.cachedSphereTests, result.epochs, result.fullMs, result.cachedMs);
+	});
+}
+
+//CPU reference of the multi-view shadow cull (MultiView, the view masks of ShadowCull.comp) on the procedural 100k instance scene seen from the fly-through:
+//the cascades culled in one pass with view masks against one pass per cascade, fails when a mask differs from the separate passes
+static int MultiViewBenchmark()
+{
+	std::vector<Simulations::MultiViewParams> runs(MultiView::MAX_VIEWS);
+	for (uint32_t views = 1; views <= MultiView::MAX_VIEWS; ++views)
+		runs[views - 1].viewCount = views;
+	printf("%6s %12s %12s %12s %12s %12s %12s %8s\n", "views", "fetches", "multi", "draws", "multi", "separate ms", "multi ms", "valid");
+	return RunSimulation(runs, Simulations::SimulateMultiView,
+		[](const Simulations::MultiViewParams& run, const Simulations::MultiViewResult& result)
+	{
+		printf("%6u %12.0f %12.0f %12.0f %12.0f %12.3f %12.3f", run.viewCount, result.separateFetches, result.multiFetches, result.separateDraws, result.multiDraws,
+			result.separateMs, result.multiMs);
+	});
+}
+
+//CPU reference of the far field impostors (Impostor, the routing of culling.comp and the frame of Impostor.mesh): the silhouette error of the nearest frame
+//against the exact view, then the instances of the fly-through drawn as impostors and the meshlets they save per threshold
+static int ImpostorBenchmark()
+{
+	printf("%10s %10s %10s %10s %12s %12s %10s %10s %10s %8s\n", "threshold", "bake ms", "visible", "impostors", "meshlets", "impostor", "saved", "mean err", "max err", "valid");
+	return RunSimulation(Sweep(&Simulations::ImpostorParams::threshold, { 8.0f, Impostor::DEFAULT_THRESHOLD, 64.0f }), Simulations::SimulateImpostors,
+		[](const Simulations::ImpostorParams& run, const Simulations::ImpostorResult& result)
+	{
+		printf("%10.1f %10.2f %10.0f %10.0f %12.0f %12.0f %9.1f%% %10.3f %10.3f", run.threshold, result.bakeMs, result.visibleInstances, result.impostorInstances, result.meshletsWithout,
+			result.meshletsWith, result.meshletsWithout > 0.0 ? 100.0 * (1.0 - result.meshletsWith / result.meshletsWithout) : 0.0, result.meanCoverageError, result.maxCoverageError);
+	});
+}
+
+//CPU reference of the clustered lights (ClusteredLighting, the binning of ClusterLights.comp and the loop of Shader.frag): the light lists of the grid against
+//the per cluster loop of the GPU, the lights the sampled fragments walk against all of them, per light count
+static int ClusteredLightingBenchmark()
+{
+	printf("%8s %10s %12s %10s %10s %10s %10s %10s %8s\n", "lights", "bin ms", "cluster ms", "avg/clust", "max/clust", "overflow", "walked", "missed", "valid");
+	return RunSimulation(Sweep(&Simulations::ClusteredLightingParams::lightCount, { 1024u, 4096u, 16384u }), Simulations::SimulateClusteredLighting,
+		[](const Simulations::ClusteredLightingParams& run, const Simulations::ClusteredLightingResult& result)
+	{
+		printf("%8u %10.3f %12.3f %10.2f %10u %10.1f %10.2f %10u", run.lightCount, result.binMs, result.perClusterMs, result.avgLightsPerCluster, result.maxLightsPerCluster,
+			result.overflowClusters, result.walkedPerPoint, result.missedLights);
+	});
+}
+
+//One line per case of the CPU reference checks, 1 when the case fails
+static int CheckCase(const char* name, bool passed)
+{
+	printf("%-72s %8s\n", name, passed ? "yes" : "NO");
+	return passed ? 0 : 1;
+}
+
+//CPU reference of the visibility buffer ids (VisibilityBuffer, written by Visibility.frag and SoftwareRaster.comp and read by VisibilityShade.comp): the ids
+//round trip at the field limits, the atomicMin keeps the nearest depth and an empty pixel loses to any depth, the barycentrics are perspective correct
+static int VisibilityBufferTest()
+{
+	int failed = 0;
+	printf("%-72s %8s\n", "case", "valid");
+	bool roundTrip = true;
+	const float depths[] = { 0.0f, std::numeric_limits<float>::denorm_min(), 0.5f, 1.0f };
+	const uint32_t clusters[] = { 0, 1, VisibilityBuffer::MAX_CLUSTERS - 1 };
+	const uint32_t triangles[] = { 0, 1, VisibilityBuffer::TRIANGLE_MASK };
+	for (float depth : depths)
+	{
+		for (uint32_t cluster : clusters)
+		{
+			for (uint32_t triangle : triangles)
+			{
+				const uint64_t value = VisibilityBuffer::Pack(depth, cluster, triangle);
+				float unpackedDepth;
+				uint32_t unpackedCluster, unpackedTriangle;
+				VisibilityBuffer::Unpack(value, unpackedDepth, unpackedCluster, unpackedTriangle);
+				roundTrip = roundTrip && unpackedDepth == depth && unpackedCluster == cluster && unpackedTriangle == triangle && !VisibilityBuffer::IsEmpty(value);
+			}
+		}
+	}
+	failed += CheckCase("pack/unpack round trip at the field limits", roundTrip);
+
+	const uint64_t nearer = VisibilityBuffer::Pack(0.25f, VisibilityBuffer::MAX_CLUSTERS - 1, VisibilityBuffer::TRIANGLE_MASK);
+	const uint64_t farther = VisibilityBuffer::Pack(0.75f, 0, 0);
+	uint64_t nearFirst = VisibilityBuffer::EMPTY;
+	VisibilityBuffer::Write(nearFirst, nearer);
+	VisibilityBuffer::Write(nearFirst, farther);
+	uint64_t farFirst = VisibilityBuffer::EMPTY;
+	VisibilityBuffer::Write(farFirst, farther);
+	VisibilityBuffer::Write(farFirst, nearer);
+	failed += CheckCase("the nearer depth wins the atomicMin in both orders, whatever the ids", nearFirst == nearer && farFirst == nearer);
+
+	uint64_t pixel = VisibilityBuffer::EMPTY;
+	const bool emptyBefore = VisibilityBuffer::IsEmpty(pixel);
+	const uint64_t farthest = VisibilityBuffer::Pack(1.0f, VisibilityBuffer::MAX_CLUSTERS - 1, VisibilityBuffer::TRIANGLE_MASK);
+	VisibilityBuffer::Write(pixel, farthest);
+	failed += CheckCase("EMPTY loses to the farthest depth with the largest ids", emptyBefore && pixel == farthest && !VisibilityBuffer::IsEmpty(pixel));
+
+	//Vertices at different w, the screen space barycentrics are not the perspective correct ones
+	const glm::vec2 ndcs[3] = { glm::vec2(-0.6f, -0.5f), glm::vec2(0.7f, -0.4f), glm::vec2(0.1f, 0.8f) };
+	const float ws[3] = { 1.0f, 4.0f, 10.0f };
+	glm::vec4 clip[3];
+	for (int i = 0; i < 3; ++i)
+		clip[i] = glm::vec4(ndcs[i].x * ws[i], ndcs[i].y * ws[i], 0.5f * ws[i], ws[i]);
+	bool corners = true;
+	for (int i = 0; i < 3; ++i)
+	{
+		const glm::vec3 bary = VisibilityBuffer::PerspectiveBarycentrics(clip[0], clip[1], clip[2], ndcs[i]);
+		for (int j = 0; j < 3; ++j)
+			corners = corners && fabsf(bary[j] - (i == j ? 1.0f : 0.0f)) < 1e-5f;
+	}
+	failed += CheckCase("barycentrics at the vertices are (1,0,0), (0,1,0) and (0,0,1)", corners);
+	//The point with these weights in clip space (attribute space) projects to ndc, the reconstruction must give the weights back
+	const glm::vec3 weights(0.2f, 0.3f, 0.5f);
+	const glm::vec4 point = clip[0] * weights.x + clip[1] * weights.y + clip[2] * weights.z;
+	const glm::vec3 bary = VisibilityBuffer::PerspectiveBarycentrics(clip[0], clip[1], clip[2], glm::vec2(point.x / point.w, point.y / point.w));
+	const bool interior = fabsf(bary.x - weights.x) < 1e-4f && fabsf(bary.y - weights.y) < 1e-4f && fabsf(bary.z - weights.z) < 1e-4f &&
+		fabsf(bary.x + bary.y + bary.z - 1.0f) < 1e-5f;
+	failed += CheckCase("interior barycentrics are perspective correct and sum to 1", interior);
+	return failed;
+}
+
+//Fixed point vertex at a framebuffer position in pixels
+static SoftwareRaster::ScreenVertex PixelVertex(float x, float y, float z)
+{
+	SoftwareRaster::ScreenVertex vertex;
+	vertex.x = static_cast<int32_t>(floorf(x * SoftwareRaster::SUBPIXEL_SCALE + 0.5f));
+	vertex.y = static_cast<int32_t>(floorf(y * SoftwareRaster::SUBPIXEL_SCALE + 0.5f));
+	vertex.z = z;
+	return vertex;
+}
+
+//Pixel center test with 64 bit edge functions, independent of the bounds and biases of RasterizeTriangle. Only the negative area (front) triangles cover
+//pixels, a center on an edge is inside when the triangle is right of it or below it when the edge is horizontal (top-left rule)
+static bool BruteForceCovers(const SoftwareRaster::ScreenVertex& v0, const SoftwareRaster::ScreenVertex& v1, const SoftwareRaster::ScreenVertex& v2, int32_t x, int32_t y)
+{
+	const SoftwareRaster::ScreenVertex* vertices[3] = { &v0, &v1, &v2 };
+	const int64_t px = static_cast<int64_t>(x) * SoftwareRaster::SUBPIXEL_SCALE + SoftwareRaster::SUBPIXEL_SCALE / 2;
+	const int64_t py = static_cast<int64_t>(y) * SoftwareRaster::SUBPIXEL_SCALE + SoftwareRaster::SUBPIXEL_SCALE / 2;
+	const int64_t area = static_cast<int64_t>(v1.x - v0.x) * (v2.y - v0.y) - static_cast<int64_t>(v1.y - v0.y) * (v2.x - v0.x);
+	if (area >= 0)
+		return false;
+	for (int i = 0; i < 3; ++i)
+	{
+		const SoftwareRaster::ScreenVertex& a = *vertices[i];
+		const SoftwareRaster::ScreenVertex& b = *vertices[(i + 1) % 3];
+		const int64_t edge = static_cast<int64_t>(b.x - a.x) * (py - a.y) - static_cast<int64_t>(b.y - a.y) * (px - a.x);
+		//the inside is negative like the area
+		if (edge > 0)
+			return false;
+		if (edge == 0)
+		{
+			const int64_t gradientX = -(b.y - a.y);
+			const int64_t gradientY = b.x - a.x;
+			if (gradientX != 0 ? gradientX > 0 : gradientY > 0)
+				return false;
+		}
+	}
+	return true;
+}
+
+//Rasterizes the triangle on the cleared buffer and adds the pixels it wrote to coverage, countMatches is cleared when the returned count is not the pixels written
+static uint32_t RasterizeCounted(const SoftwareRaster::ScreenVertex& v0, const SoftwareRaster::ScreenVertex& v1, const SoftwareRaster::ScreenVertex& v2, uint32_t width, uint32_t height,
+	std::vector<uint64_t>& visibility, std::vector<uint32_t>& coverage, bool& countMatches)
+{
+	std::fill(visibility.begin(), visibility.end(), VisibilityBuffer::EMPTY);
+	const uint32_t covered = SoftwareRaster::RasterizeTriangle(v0, v1, v2, 1, 0, width, height, visibility.data());
+	uint32_t written = 0;
+	for (size_t i = 0; i < visibility.size(); ++i)
+	{
+		if (!VisibilityBuffer::IsEmpty(visibility[i]))
+		{
+			++coverage[i];
+			++written;
+		}
+	}
+	countMatches = countMatches && written == covered;
+	return covered;
+}
+
+//CPU reference of the software rasterizer (SoftwareRaster, SoftwareRaster.comp): with the top-left rule the pixels on an edge shared by two triangles or on
+//the spokes of a fan around a pixel center are written once, back facing, zero area and too large triangles write nothing and the coverage of random
+//triangles crossing the borders matches a per pixel edge test
+static int SoftwareRasterTest()
+{
+	constexpr uint32_t width = 48;
+	constexpr uint32_t height = 40;
+	int failed = 0;
+	bool countMatches = true;
+	std::vector<uint64_t> visibility(width * height);
+	std::vector<uint32_t> coverage(width * height);
+	printf("%-72s %8s\n", "case", "valid");
+	//Every pixel is covered at most once and the ones with their center strictly inside [first, last] once
+	auto coveredOnce = [&](int32_t first, int32_t last)
+	{
+		bool once = true;
+		for (int32_t y = 0; y < static_cast<int32_t>(height); ++y)
+		{
+			for (int32_t x = 0; x < static_cast<int32_t>(width); ++x)
+			{
+				const uint32_t times = coverage[y * width + x];
+				const bool inside = x > first && x < last && y > first && y < last;
+				once = once && times <= 1 && (!inside || times == 1);
+			}
+		}
+		return once;
+	};
+
+	//Square with its corners on pixel centers cut along the diagonal, the centers (i + 0.5, i + 0.5) are on the shared edge
+	const SoftwareRaster::ScreenVertex a = PixelVertex(1.5f, 1.5f, 0.5f);
+	const SoftwareRaster::ScreenVertex b = PixelVertex(9.5f, 1.5f, 0.5f);
+	const SoftwareRaster::ScreenVertex c = PixelVertex(9.5f, 9.5f, 0.5f);
+	const SoftwareRaster::ScreenVertex d = PixelVertex(1.5f, 9.5f, 0.5f);
+	std::fill(coverage.begin(), coverage.end(), 0);
+	RasterizeCounted(a, d, c, width, height, visibility, coverage, countMatches);
+	RasterizeCounted(a, c, b, width, height, visibility, coverage, countMatches);
+	failed += CheckCase("two triangles sharing an edge write its pixels once", coveredOnce(1, 9));
+
+	//8 triangles around the center of pixel (20, 20), their spokes go through the pixel centers of the row, the column and the diagonals
+	const float center = 20.5f;
+	const float spokes[8][2] = { { 4.0f, 0.0f }, { 4.0f, 4.0f }, { 0.0f, 4.0f }, { -4.0f, 4.0f }, { -4.0f, 0.0f }, { -4.0f, -4.0f }, { 0.0f, -4.0f }, { 4.0f, -4.0f } };
+	std::fill(coverage.begin(), coverage.end(), 0);
+	for (int i = 0; i < 8; ++i)
+	{
+		const int next = (i + 1) % 8;
+		RasterizeCounted(PixelVertex(center, center, 0.5f), PixelVertex(center + spokes[next][0], center + spokes[next][1], 0.5f),
+			PixelVertex(center + spokes[i][0], center + spokes[i][1], 0.5f), width, height, visibility, coverage, countMatches);
+	}
+	failed += CheckCase("a fan around a pixel center writes its pixels once", coveredOnce(16, 24) && coverage[20 * width + 20] == 1);
+
+	std::fill(coverage.begin(), coverage.end(), 0);
+	const uint32_t backFacing = RasterizeCounted(a, c, d, width, height, visibility, coverage, countMatches);
+	const uint32_t collinear = RasterizeCounted(a, c, PixelVertex(5.5f, 5.5f, 0.5f), width, height, visibility, coverage, countMatches);
+	const uint32_t repeated = RasterizeCounted(a, a, c, width, height, visibility, coverage, countMatches);
+	//Flat on a row of pixel centers, going right and left
+	const uint32_t right = RasterizeCounted(a, PixelVertex(5.5f, 1.5f, 0.5f), b, width, height, visibility, coverage, countMatches);
+	const uint32_t left = RasterizeCounted(b, PixelVertex(5.5f, 1.5f, 0.5f), a, width, height, visibility, coverage, countMatches);
+	const bool nothingWritten = std::all_of(coverage.begin(), coverage.end(), [](uint32_t times) { return times == 0; });
+	failed += CheckCase("back facing and zero area triangles write nothing", backFacing == 0 && collinear == 0 && repeated == 0 && right == 0 && left == 0 && nothingWritten);
+
+	//One subpixel past the limit is refused
+	const float extent = static_cast<float>(SoftwareRaster::MAX_TRIANGLE_EXTENT);
+	const float subpixel = 1.0f / SoftwareRaster::SUBPIXEL_SCALE;
+	const uint32_t atExtent = RasterizeCounted(PixelVertex(2.0f, 2.0f, 0.5f), PixelVertex(2.0f, 10.0f, 0.5f), PixelVertex(2.0f + extent, 10.0f, 0.5f), width, height, visibility, coverage, countMatches);
+	const uint32_t overX = RasterizeCounted(PixelVertex(2.0f, 2.0f, 0.5f), PixelVertex(2.0f, 10.0f, 0.5f), PixelVertex(2.0f + extent + subpixel, 10.0f, 0.5f), width, height, visibility, coverage, countMatches);
+	const uint32_t overY = RasterizeCounted(PixelVertex(2.0f, 2.0f, 0.5f), PixelVertex(2.0f, 2.0f + extent + subpixel, 0.5f), PixelVertex(10.0f, 2.0f + extent + subpixel, 0.5f), width, height, visibility, coverage, countMatches);
+	failed += CheckCase("triangles over MAX_TRIANGLE_EXTENT are refused, the ones at it drawn", atExtent > 0 && overX == 0 && overY == 0);
+
+	//Random front and back facing triangles up to 60 pixels wide, some of them cross the borders. Half have subpixel vertices and the other half
+	//their vertices on pixel centers, so many centers fall on the edges and the fill rule decides
+	srand(1);
+	auto random = [](float range) { return static_cast<float>(rand() % 10001) / 10000.0f * range; };
+	bool matches = true;
+	for (int i = 0; i < 4000; ++i)
+	{
+		const float x = random(width + 16.0f) - 8.0f;
+		const float y = random(height + 16.0f) - 8.0f;
+		SoftwareRaster::ScreenVertex v[3];
+		for (int j = 0; j < 3; ++j)
+		{
+			float vertexX = x + random(60.0f) - 30.0f;
+			float vertexY = y + random(60.0f) - 30.0f;
+			if (i % 2 == 1)
+			{
+				vertexX = floorf(vertexX) + 0.5f;
+				vertexY = floorf(vertexY) + 0.5f;
+			}
+			v[j] = PixelVertex(vertexX, vertexY, 0.1f + random(0.8f));
+		}
+		std::fill(coverage.begin(), coverage.end(), 0);
+		RasterizeCounted(v[0], v[1], v[2], width, height, visibility, coverage, countMatches);
+		for (int32_t py = 0; py < static_cast<int32_t>(height); ++py)
+		{
+			for (int32_t px = 0; px < static_cast<int32_t>(width); ++px)
+				matches = matches && (coverage[py * width + px] == 1) == BruteForceCovers(v[0], v[1], v[2], px, py);
+		}
+	}
+	failed += CheckCase("coverage of random triangles matches the per pixel edge test", matches);
+	failed += CheckCase("the returned counts are the pixels written", countMatches);
+	return failed;
+}
+
+//CPU reference of the per triangle culling (PrimitiveCulling, the mesh shaders with SetPrimitiveCulling): every result on hand made triangles, the
+//untestable ones (behind the camera, past the guard band, too large) kept for the hardware, and Classify consistent with itself on random triangles
+static int PrimitiveCullingTest()
+{
+	constexpr uint32_t width = 64;
+	constexpr uint32_t height = 64;
+	//The common subpixel precision, the one the hand made triangles are built for
+	constexpr uint32_t subPixelBits = 8;
+	using PrimitiveCulling::Result;
+	int failed = 0;
+	printf("%-72s %8s\n", "case", "valid");
+	//Clip position of a framebuffer position in pixels at the given w, the power of 2 target keeps the round trip exact
+	auto pixelClip = [](float x, float y, float w)
+	{
+		return glm::vec4((x / width * 2.0f - 1.0f) * w, (y / height * 2.0f - 1.0f) * w, 0.5f * w, w);
+	};
+	auto check = [&](const char* name, const glm::vec4& clip0, const glm::vec4& clip1, const glm::vec4& clip2, Result expected)
+	{
+		return CheckCase(name, PrimitiveCulling::Classify(clip0, clip1, clip2, width, height, subPixelBits) == expected);
+	};
+
+	//Counter clockwise on the y down framebuffer, the area is negative
+	failed += check("counter clockwise front face is KEPT", pixelClip(10.0f, 10.0f, 1.0f), pixelClip(10.0f, 20.0f, 2.0f), pixelClip(20.0f, 20.0f, 4.0f), Result::KEPT);
+	failed += check("its mirror is BACK_FACING", pixelClip(10.0f, 10.0f, 1.0f), pixelClip(20.0f, 20.0f, 4.0f), pixelClip(10.0f, 20.0f, 2.0f), Result::BACK_FACING);
+	failed += check("collinear vertices are ZERO_AREA", pixelClip(10.0f, 10.0f, 1.0f), pixelClip(15.0f, 15.0f, 2.0f), pixelClip(20.0f, 20.0f, 4.0f), Result::ZERO_AREA);
+	//Pixel centers are at x + 0.5, the slivers fit between 10.5 and 11.5
+	failed += check("vertical sliver between pixel centers is NO_SAMPLES", pixelClip(10.625f, 10.0f, 1.0f), pixelClip(11.0f, 20.0f, 1.0f), pixelClip(11.375f, 10.0f, 1.0f), Result::NO_SAMPLES);
+	failed += check("horizontal sliver between pixel centers is NO_SAMPLES", pixelClip(10.0f, 10.625f, 1.0f), pixelClip(10.0f, 11.375f, 1.0f), pixelClip(20.0f, 11.0f, 1.0f), Result::NO_SAMPLES);
+	failed += check("sliver touching a pixel center is KEPT", pixelClip(10.5f, 10.0f, 1.0f), pixelClip(11.0f, 20.0f, 1.0f), pixelClip(11.375f, 10.0f, 1.0f), Result::KEPT);
+	//The untestable triangles are back facing or degenerate, the hardware has to see them
+	failed += check("back face with a vertex at w < 0 is KEPT", pixelClip(10.0f, 10.0f, 1.0f), pixelClip(20.0f, 20.0f, -1.0f), pixelClip(10.0f, 20.0f, 2.0f), Result::KEPT);
+	failed += check("back face with a vertex at w = 0 is KEPT", pixelClip(10.0f, 10.0f, 1.0f), glm::vec4(0.5f, 0.5f, 0.0f, 0.0f), pixelClip(10.0f, 20.0f, 2.0f), Result::KEPT);
+	const float far = PrimitiveCulling::GUARD_BAND / (1 << subPixelBits) * 2.0f;
+	failed += check("collinear vertices past GUARD_BAND are KEPT", pixelClip(far, 10.0f, 1.0f), pixelClip(far + 1.0f, 11.0f, 1.0f), pixelClip(far + 2.0f, 12.0f, 1.0f), Result::KEPT);
+	const float extent = static_cast<float>(PrimitiveCulling::MAX_EXTENT >> subPixelBits);
+	failed += check("back face at MAX_EXTENT is BACK_FACING", pixelClip(0.0f, 0.0f, 1.0f), pixelClip(extent, 10.0f, 1.0f), pixelClip(0.0f, 10.0f, 1.0f), Result::BACK_FACING);
+	failed += check("back face over MAX_EXTENT is KEPT", pixelClip(0.0f, 0.0f, 1.0f), pixelClip(extent + 1.0f, 10.0f, 1.0f), pixelClip(0.0f, 10.0f, 1.0f), Result::KEPT);
+
+	//The snapping follows the precision of the device: at 4 bits the middle vertex falls on the line
+	const glm::vec4 nearlyCollinear[] = { pixelClip(10.0f, 10.0f, 1.0f), pixelClip(15.0f, 15.01f, 1.0f), pixelClip(20.0f, 20.0f, 1.0f) };
+	failed += check("nearly collinear front face is KEPT", nearlyCollinear[0], nearlyCollinear[1], nearlyCollinear[2], Result::KEPT);
+	failed += CheckCase("and ZERO_AREA with 4 subpixel bits", PrimitiveCulling::Classify(nearlyCollinear[0], nearlyCollinear[1], nearlyCollinear[2], width, height, 4) == Result::ZERO_AREA);
+
+	//Random triangles from subpixel to over the extent, some crossing the borders, behind the camera or past the guard band
+	srand(1);
+	auto random = [](float range) { return static_cast<float>(rand() % 10001) / 10000.0f * range; };
+	const float sizes[] = { 1.0f, 4.0f, 16.0f, 80.0f };
+	bool rotationKeeps = true;
+	bool windingFlips = true;
+	for (int i = 0; i < 20000; ++i)
+	{
+		const float x = random(width + 64.0f) - 32.0f;
+		const float y = random(height + 64.0f) - 32.0f;
+		const float size = sizes[i % 4];
+		glm::vec4 clip[3];
+		for (int j = 0; j < 3; ++j)
+		{
+			const float w = (rand() % 50 == 0) ? -random(1.0f) : 0.1f + random(4.0f);
+			const float offset = (rand() % 200 == 0) ? far : 0.0f;
+			clip[j] = pixelClip(x + offset + random(size) - size / 2, y + random(size) - size / 2, w);
+		}
+		//Rotating the vertices keeps the result, reversing the winding swaps the front and back faces of the testable triangles
+		const uint32_t bits = (i % 3 == 0) ? 4 : subPixelBits;
+		const Result result = PrimitiveCulling::Classify(clip[0], clip[1], clip[2], width, height, bits);
+		const Result rotated = PrimitiveCulling::Classify(clip[1], clip[2], clip[0], width, height, bits);
+		const Result reversed = PrimitiveCulling::Classify(clip[0], clip[2], clip[1], width, height, bits);
+		rotationKeeps = rotationKeeps && rotated == result;
+		switch (result)
+		{
+		case Result::KEPT: windingFlips = windingFlips && (reversed == Result::KEPT || reversed == Result::BACK_FACING); break;
+		case Result::BACK_FACING: windingFlips = windingFlips && (reversed == Result::KEPT || reversed == Result::NO_SAMPLES); break;
+		case Result::ZERO_AREA: windingFlips = windingFlips && reversed == Result::ZERO_AREA; break;
+		case Result::NO_SAMPLES: windingFlips = windingFlips && reversed == Result::BACK_FACING; break;
+		}
+	}
+	failed += CheckCase("the same result with the vertices rotated", rotationKeeps);
+	failed += CheckCase("front and back faces swapped with the winding reversed", windingFlips);
+	return failed;
+}
+
+//Wavy grid of size x size quads, the model of the meshlet compression check when none is given
+static void BuildGridMesh(unsigned int size, Mesh& mesh)
+{
+	mesh.numVertices = (size + 1) * (size + 1);
+	mesh.numIndices = size * size * 6;
+	mesh.vertices = HostMemory::NewArray<Vertex>(mesh.numVertices, HostMemory::Tag::MESHES);
+	mesh.indices = HostMemory::NewArray<unsigned int>(mesh.numIndices, HostMemory::Tag::MESHES);
+	for (unsigned int y = 0; y <= size; ++y)
+	{
+		for (unsigned int x = 0; x <= size; ++x)
+		{
+			Vertex& vertex = mesh.vertices[y * (size + 1) + x];
+			vertex = Vertex{ { static_cast<float>(x), sinf(x * 0.3f) * cosf(y * 0.2f), static_cast<float>(y), 1.0f }, { 0.0f, 1.0f, 0.0f, 0.0f } };
+		}
+	}
+	unsigned int* index = mesh.indices;
+	for (unsigned int y = 0; y < size; ++y)
+	{
+		for (unsigned int x = 0; x < size; ++x)
+		{
+			const unsigned int corner = y * (size + 1) + x;
+			const unsigned int quad[6] = { corner, corner + size + 1, corner + 1, corner + 1, corner + size + 1, corner + size + 2 };
+			memcpy(index, quad, sizeof(quad));
+			index += 6;
+		}
+	}
+}
+
+//Round trip of the compressed meshlet streams (MeshletCompression) through the page builder and ExpandPage for every MESHLET_LIMITS pair: the vertices and
+//triangles decoded like the shaders do against the meshlets they come from, and the bytes per triangle of the meshlet pools (records, vertex references and
+//triangles, the vertices do not change) with a 32 bit word per reference and triangle index against the compressed streams
+//MeshTool --meshlet-compression [<model.gltf> ...], a generated grid without models
+static int MeshletCompressionTest(int first, int argc, char* argv[])
+{
+	const uint32_t limits[][2] = { { 64, 124 }, { 128, 128 }, { 256, 256 } };
+	//the pages go to slot 1 so the rebased offsets are checked
+	const uint32_t slot = 1;
+	int failed = 0;
+	OptimizeMesh::TrackAllocations();
+	HostMemory::Arena scratch(HostMemory::Tag::IMPORT_SCRATCH);
+	printf("%-32s %8s %10s %10s %12s %12s %8s %12s %12s %8s\n", "model", "limits", "meshlets", "triangles", "B/tri before", "B/tri after", "ratio", "slot KB bef", "slot KB aft", "valid");
+	const int models = std::max(argc - first, 1);
+	for (int model = 0; model < models; ++model)
+	{
+		const char* name = first < argc ? argv[first + model] : "grid 256x256";
+		for (const uint32_t (&limit)[2] : limits)
+		{
+			scratch.Reset();
+			Mesh mesh{};
+			if (first >= argc)
+				BuildGridMesh(256, mesh);
+			else if (!ImporterMesh::ImportFirst(name, mesh))
+			{
+				printf("%-32s could not be imported\n", name);
+				++failed;
+				break;
+			}
+			//Same build as ModuleVulkan::ImportScene
+			OptimizeMesh::Optimize(mesh, &scratch);
+			MeshletMesh meshletMesh{};
+			OptimizeMesh::BuildMeshlets(mesh, meshletMesh, limit[0], limit[1], &scratch);
+			OptimizeMesh::ReorderVertices(meshletMesh, &scratch);
+
+			const GeometryStreaming::PageLayout layout{ limit[0], limit[1] };
+			std::vector<unsigned char> page(layout.PageSize());
+			std::vector<unsigned char> expanded(layout.SlotSize());
+			//slot 0 and the slot of the pages, the decoders read the whole pools
+			std::vector<uint32_t> references(2 * layout.ReferenceCapacity());
+			std::vector<uint32_t> triangles(2 * layout.TriangleCapacity());
+			std::vector<Vertex> vertices(2 * layout.VertexCapacity());
+			std::vector<uint32_t> vertexRemap(meshletMesh.mesh.numVertices, GeometryStreaming::NOT_RESIDENT);
+			uint64_t triangleCount = 0, meshletVertexCount = 0, referenceWords = 0, triangleWords = 0, errors = 0;
+			for (size_t pageFirst = 0; pageFirst < meshletMesh.meshletCount; pageFirst += GeometryStreaming::PAGE_MESHLETS)
+			{
+				std::fill(page.begin(), page.end(), static_cast<unsigned char>(0));
+				if (!GeometryStreaming::BuildPage(meshletMesh, pageFirst, layout, vertexRemap, page.data()))
+					++errors;
+				const GeometryStreaming::PageUpload upload = GeometryStreaming::ExpandPage(page.data(), layout, slot, expanded.data());
+				//The copies of ModuleVulkan::StagePage
+				const unsigned char* slotData = expanded.data();
+				const MeshletCompression::Record* records = reinterpret_cast<const MeshletCompression::Record*>(slotData);
+				slotData += layout.SlotMeshletsSize();
+				memcpy(&references[slot * layout.ReferenceCapacity()], slotData, sizeof(uint32_t) * upload.referenceWords);
+				slotData += layout.SlotMeshletVerticesSize();
+				memcpy(&triangles[slot * layout.TriangleCapacity()], slotData, sizeof(uint32_t) * upload.triangleWords);
+				slotData += layout.SlotTrianglesSize();
+				memcpy(&vertices[slot * layout.VertexCapacity()], slotData, sizeof(Vertex) * upload.vertexCount);
+				referenceWords += upload.referenceWords;
+				triangleWords += upload.triangleWords;
+				if (upload.referenceWords > layout.ReferenceCapacity() || upload.triangleWords > layout.TriangleCapacity())
+					++errors;
+
+				for (uint32_t i = 0; i < upload.meshletCount; ++i)
+				{
+					const meshopt_Meshlet& meshlet = meshletMesh.meshlets[pageFirst + i];
+					const MeshletCompression::Record& record = records[i];
+					if (MeshletCompression::GetVertexCount(record) != meshlet.vertex_count || MeshletCompression::GetTriangleCount(record) != meshlet.triangle_count)
+					{
+						++errors;
+						continue;
+					}
+					for (uint32_t v = 0; v < meshlet.vertex_count; ++v)
+					{
+						const uint32_t vertex = MeshletCompression::DecodeVertex(record, references.data(), v);
+						const Vertex& expected = meshletMesh.mesh.vertices[meshletMesh.meshletVertices[meshlet.vertex_offset + v]];
+						if (vertex < slot * layout.VertexCapacity() || vertex >= slot * layout.VertexCapacity() + upload.vertexCount || memcmp(&vertices[vertex], &expected, sizeof(Vertex)) != 0)
+							++errors;
+					}
+					for (uint32_t t = 0; t < meshlet.triangle_count; ++t)
+					{
+						uint32_t indices[3];
+						MeshletCompression::DecodeTriangle(record, triangles.data(), t, indices);
+						for (uint32_t c = 0; c < 3; ++c)
+							errors += indices[c] != meshletMesh.meshletTriangles[meshlet.triangle_offset + t * 3 + c] ? 1 : 0;
+					}
+					triangleCount += meshlet.triangle_count;
+					meshletVertexCount += meshlet.vertex_count;
+				}
+			}
+			const double recordBytes = static_cast<double>(sizeof(MeshletCompression::Record) * meshletMesh.meshletCount);
+			const double before = (recordBytes + sizeof(uint32_t) * (meshletVertexCount + 3 * triangleCount)) / static_cast<double>(triangleCount);
+			const double after = (recordBytes + sizeof(uint32_t) * (referenceWords + triangleWords)) / static_cast<double>(triangleCount);
+			//the slot of the same page with the uncompressed pools
+			const size_t slotBefore = layout.SlotMeshletsSize() + sizeof(uint32_t) * layout.VertexCapacity() + sizeof(uint32_t) * 3 * GeometryStreaming::PAGE_MESHLETS * limit[1] +
+				layout.SlotVerticesSize();
+			char limitsName[16];
+			snprintf(limitsName, sizeof(limitsName), "%u:%u", limit[0], limit[1]);
+			printf("%-32s %8s %10zu %10llu %12.2f %12.2f %7.2fx %12.1f %12.1f %8s\n", name, limitsName, meshletMesh.meshletCount, static_cast<unsigned long long>(triangleCount), before, after,
+				before / after, slotBefore / 1024.0, layout.SlotSize() / 1024.0, errors == 0 ? "yes" : "NO");
+			if (errors != 0)
+			{
+				printf("%llu decode errors\n", static_cast<unsigned long long>(errors));
+				++failed;
+			}
+			meshletMesh.Free();
+		}
+	}
+	return failed;
+}
+
+//Reports what the import time optimization (OptimizeMesh) does to each model: MeshTool <model.gltf> [<model.gltf> ...]
+//MeshTool --import-bench <iterations> <model> [...] times the import paths instead, MeshTool --stream-sim simulates the geometry streaming eviction
+//MeshTool --instance-sim checks and times the CPU reference of the instance motions, MeshTool --instance-churn simulates the instance slots and their uploads
+//MeshTool --occlusion-bench checks and times the CPU occlusion culling, MeshTool --depth-sort checks the depth sort order and estimates the overdraw it saves
+//MeshTool --visibility-cache checks the cached frustum tests and counts the tests they save, MeshTool --multi-view checks and times the single pass cascade cull
+//MeshTool --impostors checks the impostor frames and counts the meshlets the far field impostors save, MeshTool --clustered-lights checks the light grid
+//MeshTool --meshlet-compression [<model.gltf> ...] checks the compressed meshlet streams round trip and reports their bytes per triangle
+//MeshTool --visibility-buffer checks the visibility buffer ids and barycentrics
+//MeshTool --software-raster checks the fill rules, the culling and the coverage of the software rasterizer
+//MeshTool --primitive-culling checks the per triangle culling results and their consistency under vertex rotation and winding reversal
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		printf("Usage: MeshTool <model.gltf> [<model.gltf> ...]\n       MeshTool --import-bench <iterations> <model.gltf|glb> [...]\n       MeshTool --stream-sim\n       MeshTool --instance-sim\n       MeshTool --instance-churn\n       MeshTool --occlusion-bench\n       MeshTool --depth-sort\n       MeshTool --visibility-cache\n       MeshTool --multi-view\n       MeshTool --impostors\n       MeshTool --clustered-lights\n       MeshTool --meshlet-compression [<model.gltf> ...]\n       MeshTool --visibility-buffer\n       MeshTool --software-raster\n       MeshTool --primitive-culling\n");
+		return 1;
+	}
+	if (strcmp(argv[1], "--import-bench") == 0)
+	{
+		const int iterations = argc > 2 ? atoi(argv[2]) : 0;
+		if (iterations <= 0 || argc < 4)
+		{
+			printf("Usage: MeshTool --import-bench <iterations> <model.gltf|glb> [...]\n");
+			return 1;
+		}
+		return ImportBenchmark(iterations, 3, argc, argv);
+	}
+	if (strcmp(argv[1], "--stream-sim") == 0)
+		return StreamingSimulation();
+	if (strcmp(argv[1], "--instance-sim") == 0)
+		return InstanceSimulationTest();
+	if (strcmp(argv[1], "--instance-churn") == 0)
+		return InstanceChurnSimulation();
+	if (strcmp(argv[1], "--occlusion-bench") == 0)
+		return OcclusionBenchmark();
+	if (strcmp(argv[1], "--depth-sort") == 0)
+		return DepthSortBenchmark();
+	if (strcmp(argv[1], "--visibility-cache") == 0)
+		return VisibilityCacheBenchmark();
+	if (strcmp(argv[1], "--multi-view") == 0)
+		return MultiViewBenchmark();
+	if (strcmp(argv[1], "--impostors") == 0)
+		return ImpostorBenchmark();
+	if (strcmp(argv[1], "--clustered-lights") == 0)
+		return ClusteredLightingBenchmark();
+	if (strcmp(argv[1], "--meshlet-compression") == 0)
+		return MeshletCompressionTest(2, argc, argv);
+	if (strcmp(argv[1], "--visibility-buffer") == 0)
+		return VisibilityBufferTest();
+	if (strcmp(argv[1], "--software-raster") == 0)
+		return SoftwareRasterTest();
+	if (strcmp(argv[1], "--primitive-culling") == 0)
+		return PrimitiveCullingTest();
+	int failed = 0;
+	//Like ModuleVulkan::ImportScene: the temporaries on one arena reset per model. Heap calls and peak of the tracked host memory of each import
+	OptimizeMesh::TrackAllocations();
+	HostMemory::Arena scratch(HostMemory::Tag::IMPORT_SCRATCH);
+	printf("%-40s %10s %10s %10s %10s %10s %10s %10s %10s %10s\n", "model", "vertices", "unique", "optimized", "acmr", "acmr opt", "overfetch", "opt", "heap calls", "peak MB");
+	for (int i = 1; i < argc; ++i)
+	{
+		scratch.Reset();
+		HostMemory::ResetPeaks();
+		const uint64_t allocations = HostMemory::GetTotalStats().allocations;
+		Mesh mesh{};
+		if (!ImporterMesh::ImportFirst(argv[i], mesh))
+		{
+			printf("%-40s could not be imported\n", argv[i]);
+			++failed;
+			continue;
+		}
+		const OptimizeMesh::Metrics before = OptimizeMesh::Analyze(mesh, &scratch);
+		OptimizeMesh::Optimize(mesh, &scratch);
+		const OptimizeMesh::Metrics after = OptimizeMesh::Analyze(mesh, &scratch);
+		const HostMemory::TagStats memory = HostMemory::GetTotalStats();
+		printf("%-40s %10u %10u %10u %10.3f %10.3f %10.3f %10.3f %10llu %10.2f\n", argv[i], before.vertexCount, before.uniqueVertices, after.vertexCount, before.acmr, after.acmr,
+			before.overfetch, after.overfetch, static_cast<unsigned long long>(memory.allocations - allocations), memory.peakBytes / (1024.0 * 1024.0));
+		mesh.Free();
+	}
+	HostMemory::LogStats();
+	return failed;
+}
@@ -0,0 +1,123 @@
+#include "MeshletCache.h"
+#include "FileSystem.h"
+#include "Globals.h"
+#include "Profiler.h"
+#include "meshoptimizer.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+namespace
+{
+	//"MLTC"
+	constexpr uint32_t MAGIC = 0x43544C4D;
+	//Bump it when the meshlet generation changes (OptimizeMesh::BuildMeshlets)
+	constexpr uint32_t VERSION = 2;
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t maxVertices;
+		uint32_t maxPrimitives;
+		//FNV-1a of the source indices and vertices
+		uint32_t meshHash;
+		uint32_t meshletCount;
+		uint32_t meshletVerticesCount;
+		uint32_t meshletTrianglesSize;
+	};
+
+	std::string CachePath(const char* meshPath, uint32_t maxVertices, uint32_t maxPrimitives)
+	{
+		return std::string(meshPath) + "." + std::to_string(maxVertices) + "_" + std::to_string(maxPrimitives) + ".meshlets";
+	}
+
+	uint32_t Hash(const void* data, size_t size, uint32_t hash)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; ++i)
+			hash = (hash ^ bytes[i]) * 16777619u;
+		return hash;
+	}
+
+	uint32_t MeshHash(const Mesh& mesh)
+	{
+		uint32_t hash = Hash(mesh.indices, sizeof(unsigned int) * mesh.numIndices, 2166136261u);
+		return Hash(mesh.vertices, sizeof(Vertex) * mesh.numVertices, hash);
+	}
+}
+
+bool MeshletCache::Load(const char* meshPath, uint32_t maxVertices, uint32_t maxPrimitives, const Mesh& mesh, MeshletMesh& meshletMesh)
+{
+	PROFILE_ZONE("MeshletCache::Load");
+	const std::string path = CachePath(meshPath, maxVertices, maxPrimitives);
+	char* buffer = nullptr;
+	const long size = FileSystem::ReadToBuffer(path.c_str(), buffer, "rb");
+	if (size == 0)
+		return false;
+	Header header;
+	bool valid = static_cast<size_t>(size) >= sizeof(Header);
+	if (valid)
+	{
+		memcpy(&header, buffer, sizeof(Header));
+		valid = header.magic == MAGIC && header.version == VERSION && header.maxVertices == maxVertices && header.maxPrimitives == maxPrimitives && header.meshletCount != 0 &&
+			static_cast<size_t>(size) == sizeof(Header) + (sizeof(meshopt_Meshlet) + sizeof(meshopt_Bounds)) * header.meshletCount + sizeof(unsigned int) * header.meshletVerticesCount + header.meshletTrianglesSize &&
+			header.meshHash == MeshHash(mesh);
+	}
+	if (!valid)
+	{
+		LOG("The meshlet cache %s is outdated, the meshlets are rebuilt", path.c_str());
+		delete[] buffer;
+		return false;
+	}
+	const char* data = buffer + sizeof(Header);
+	meshletMesh.meshletCount = header.meshletCount;
+	meshletMesh.maxMeshlets = header.meshletCount;
+	meshletMesh.meshlets = HostMemory::NewArray<meshopt_Meshlet>(header.meshletCount, HostMemory::Tag::MESHLETS);
+	memcpy(meshletMesh.meshlets, data, sizeof(meshopt_Meshlet) * header.meshletCount);
+	data += sizeof(meshopt_Meshlet) * header.meshletCount;
+	meshletMesh.meshletBounds = HostMemory::NewArray<meshopt_Bounds>(header.meshletCount, HostMemory::Tag::MESHLETS);
+	memcpy(meshletMesh.meshletBounds, data, sizeof(meshopt_Bounds) * header.meshletCount);
+	data += sizeof(meshopt_Bounds) * header.meshletCount;
+	meshletMesh.meshletVertices = HostMemory::NewArray<unsigned int>(header.meshletVerticesCount, HostMemory::Tag::MESHLETS);
+	memcpy(meshletMesh.meshletVertices, data, sizeof(unsigned int) * header.meshletVerticesCount);
+	data += sizeof(unsigned int) * header.meshletVerticesCount;
+	meshletMesh.meshletTriangles = HostMemory::NewArray<unsigned char>(header.meshletTrianglesSize, HostMemory::Tag::MESHLETS);
+	memcpy(meshletMesh.meshletTriangles, data, header.meshletTrianglesSize);
+	delete[] buffer;
+	return true;
+}
+
+bool MeshletCache::Save(const char* meshPath, uint32_t maxVertices, uint32_t maxPrimitives, const MeshletMesh& meshletMesh)
+{
+	PROFILE_ZONE("MeshletCache::Save");
+	const std::string path = CachePath(meshPath, maxVertices, maxPrimitives);
+	FILE* file = fopen(path.c_str(), "wb");
+	if (file == nullptr)
+	{
+		LOG("Warning: could not write the meshlet cache %s", path.c_str());
+		return false;
+	}
+	const meshopt_Meshlet& last = meshletMesh.meshlets[meshletMesh.meshletCount - 1];
+	Header header;
+	header.magic = MAGIC;
+	header.version = VERSION;
+	header.maxVertices = maxVertices;
+	header.maxPrimitives = maxPrimitives;
+	header.meshHash = MeshHash(meshletMesh.mesh);
+	header.meshletCount = static_cast<uint32_t>(meshletMesh.meshletCount);
+	header.meshletVerticesCount = last.vertex_offset + last.vertex_count;
+	header.meshletTrianglesSize = last.triangle_offset + last.triangle_count * 3;
+	const bool written = fwrite(&header, sizeof(Header), 1, file) == 1 &&
+		fwrite(meshletMesh.meshlets, sizeof(meshopt_Meshlet), header.meshletCount, file) == header.meshletCount &&
+		fwrite(meshletMesh.meshletBounds, sizeof(meshopt_Bounds), header.meshletCount, file) == header.meshletCount &&
+		fwrite(meshletMesh.meshletVertices, sizeof(unsigned int), header.meshletVerticesCount, file) == header.meshletVerticesCount &&
+		fwrite(meshletMesh.meshletTriangles, 1, header.meshletTrianglesSize, file) == header.meshletTrianglesSize;
+	fclose(file);
+	if (!written)
+	{
+		LOG("Warning: could not write the meshlet cache %s", path.c_str());
+		remove(path.c_str());
+	}
+	return written;
+}
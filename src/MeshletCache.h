@@ -0,0 +1,15 @@
+#ifndef __MESHLET_CACHE_H__
+#define __MESHLET_CACHE_H__
+
+#include "ModuleVulkan.h"
+
+//Meshlets built for a mesh and a pair of meshlet limits, stored next to the source as <mesh path>.<max vertices>_<max primitives>.meshlets
+//Building the meshlets is the slowest part of the import, the meshlet size sweep rebuilds every mesh for each pair without it
+namespace MeshletCache
+{
+	//Fills the meshlet arrays of meshletMesh (not its mesh), false when the file is missing or was built from a different mesh
+	bool Load(const char* meshPath, uint32_t maxVertices, uint32_t maxPrimitives, const Mesh& mesh, MeshletMesh& meshletMesh);
+	bool Save(const char* meshPath, uint32_t maxVertices, uint32_t maxPrimitives, const MeshletMesh& meshletMesh);
+}
+
+#endif // !__MESHLET_CACHE_H__
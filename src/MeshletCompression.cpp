@@ -0,0 +1,137 @@
+#include "MeshletCompression.h"
+
+namespace
+{
+	//Appends the low bits of value at bitOffset, the words have to be zeroed
+	void WriteBits(uint32_t* words, uint32_t bitOffset, uint32_t value, uint32_t bits)
+	{
+		if (bits == 0)
+			return;
+		const uint32_t word = bitOffset >> 5;
+		const uint32_t shift = bitOffset & 31;
+		words[word] |= value << shift;
+		if (shift + bits > 32)
+			words[word + 1] |= value >> (32 - shift);
+	}
+
+	//bits < 32, the word after is only read when the value crosses into it
+	uint32_t ReadBits(const uint32_t* words, uint32_t bitOffset, uint32_t bits)
+	{
+		if (bits == 0)
+			return 0;
+		const uint32_t word = bitOffset >> 5;
+		const uint32_t shift = bitOffset & 31;
+		uint32_t value = words[word] >> shift;
+		if (shift + bits > 32)
+			value |= words[word + 1] << (32 - shift);
+		return value & ((1u << bits) - 1);
+	}
+
+	uint32_t PopCount(uint32_t value)
+	{
+		uint32_t count = 0;
+		for (; value != 0; value &= value - 1)
+			++count;
+		return count;
+	}
+
+	uint32_t IndexBits(uint32_t vertexCount)
+	{
+		const uint32_t bits = MeshletCompression::BitsFor(vertexCount > 0 ? vertexCount - 1 : 0);
+		return bits > 0 ? bits : 1;
+	}
+}
+
+uint32_t MeshletCompression::BitsFor(uint32_t value)
+{
+	uint32_t bits = 0;
+	for (; value != 0; value >>= 1)
+		++bits;
+	return bits;
+}
+
+uint32_t MeshletCompression::MaxVertexWords(uint32_t maxVertices, uint32_t vertexCapacity)
+{
+	//every vertex can be an old one, the deltas are below the vertices of the page
+	return (maxVertices + 31) / 32 + (maxVertices * BitsFor(vertexCapacity - 1) + 31) / 32;
+}
+
+uint32_t MeshletCompression::MaxTriangleWords(uint32_t maxVertices, uint32_t maxPrimitives)
+{
+	return (maxPrimitives * 3 * IndexBits(maxVertices) + 31) / 32;
+}
+
+bool MeshletCompression::Encode(const uint32_t* references, uint32_t vertexCount, const unsigned char* triangles, uint32_t triangleCount, uint32_t firstNewVertex,
+	Record& record, uint32_t* vertexStream, uint32_t& vertexWords, uint32_t* triangleStream, uint32_t& triangleWords)
+{
+	const uint32_t maskWords = (vertexCount + 31) / 32;
+	uint32_t nextNew = firstNewVertex;
+	uint32_t largestDelta = 0;
+	uint32_t oldVertices = 0;
+	for (uint32_t i = 0; i < vertexCount; ++i)
+	{
+		if (references[i] == nextNew)
+			++nextNew;
+		else if (references[i] < firstNewVertex)
+		{
+			const uint32_t delta = firstNewVertex - 1 - references[i];
+			largestDelta = delta > largestDelta ? delta : largestDelta;
+			++oldVertices;
+		}
+		else
+			return false;
+	}
+	const uint32_t deltaBits = BitsFor(largestDelta);
+	vertexWords = maskWords + (oldVertices * deltaBits + 31) / 32;
+	for (uint32_t i = 0; i < vertexWords; ++i)
+		vertexStream[i] = 0;
+	uint32_t old = 0;
+	for (uint32_t i = 0; i < vertexCount; ++i)
+	{
+		if (references[i] >= firstNewVertex)
+			continue;
+		vertexStream[i >> 5] |= 1u << (i & 31);
+		WriteBits(vertexStream + maskWords, old++ * deltaBits, firstNewVertex - 1 - references[i], deltaBits);
+	}
+
+	const uint32_t indexBits = IndexBits(vertexCount);
+	triangleWords = (triangleCount * 3 * indexBits + 31) / 32;
+	for (uint32_t i = 0; i < triangleWords; ++i)
+		triangleStream[i] = 0;
+	for (uint32_t i = 0; i < triangleCount * 3; ++i)
+		WriteBits(triangleStream, i * indexBits, triangles[i], indexBits);
+
+	record.vertexStream = 0;
+	record.triangleStream = 0;
+	record.counts = vertexCount | (triangleCount << TRIANGLE_COUNT_SHIFT) | (deltaBits << DELTA_BITS_SHIFT) | (indexBits << INDEX_BITS_SHIFT);
+	record.vertexBase = firstNewVertex;
+	return true;
+}
+
+uint32_t MeshletCompression::DecodeVertex(const Record& record, const uint32_t* vertexStreams, uint32_t index)
+{
+	const uint32_t* stream = vertexStreams + record.vertexStream;
+	//old vertices before index: the mask words before its own and the bits below it
+	uint32_t oldBefore = 0;
+	for (uint32_t word = 0; word < (index >> 5); ++word)
+		oldBefore += PopCount(stream[word]);
+	const uint32_t mask = stream[index >> 5];
+	const uint32_t bit = 1u << (index & 31);
+	oldBefore += PopCount(mask & (bit - 1));
+	if ((mask & bit) == 0)
+		return record.vertexBase + index - oldBefore;
+	const uint32_t deltaBits = GetDeltaBits(record);
+	const uint32_t maskWords = (GetVertexCount(record) + 31) / 32;
+	return record.vertexBase - 1 - ReadBits(stream + maskWords, oldBefore * deltaBits, deltaBits);
+}
+
+void MeshletCompression::DecodeTriangle(const Record& record, const uint32_t* triangleStreams, uint32_t triangle, uint32_t (&indices)[3])
+{
+	const uint32_t indexBits = GetIndexBits(record);
+	//the 3 indices are at most 24 bits, read at once
+	const uint32_t packed = ReadBits(triangleStreams + record.triangleStream, triangle * 3 * indexBits, 3 * indexBits);
+	const uint32_t mask = (1u << indexBits) - 1;
+	indices[0] = packed & mask;
+	indices[1] = (packed >> indexBits) & mask;
+	indices[2] = (packed >> (2 * indexBits)) & mask;
+}
@@ -0,0 +1,56 @@
+#ifndef __MESHLET_COMPRESSION_H__
+#define __MESHLET_COMPRESSION_H__
+
+#include <stdint.h>
+
+//Compressed vertex references and triangles of the meshlets on the geometry pages and pools, decoded by Shader.mesh, Visibility.mesh, Shadow.mesh and
+//SoftwareRaster.comp on shared memory and by VisibilityShade.comp per pixel. Both streams are random access, a triangle or a vertex never needs the ones before it
+//Vertex references are delta coded against the next new vertex: a page numbers its vertices on first use, so the vertices a meshlet uses first are the
+//run vertexBase, vertexBase + 1... and cost one mask bit. The ones an earlier meshlet of the page used set their mask bit and store vertexBase - 1 - reference
+//with the bits of the largest one of the meshlet
+//Triangles are packed, the 3 local indices of a triangle with the bits of the meshlet vertex count (6 for 64 vertices) instead of a 32 bit word each
+namespace MeshletCompression
+{
+	//Same layout as Meshlet on the shaders
+	struct Record
+	{
+		//first word of the vertex stream on the references pool: the mask words and then the packed deltas
+		uint32_t vertexStream;
+		//first word of the packed triangles on the triangles pool
+		uint32_t triangleStream;
+		//vertex count, triangle count, delta bits and index bits, see the shifts
+		uint32_t counts;
+		//vertex on the vertex pool of the first new vertex of the meshlet
+		uint32_t vertexBase;
+	};
+
+	//Same as the shifts and masks of shaders/MeshletCompression.glsl, the counts go up to 256 (ModuleVulkan::MAX_MESHLET_OUTPUTS)
+	constexpr uint32_t TRIANGLE_COUNT_SHIFT = 9;
+	constexpr uint32_t DELTA_BITS_SHIFT = 18;
+	constexpr uint32_t INDEX_BITS_SHIFT = 23;
+	constexpr uint32_t COUNT_MASK = 0x1ff;
+	constexpr uint32_t DELTA_BITS_MASK = 0x1f;
+	constexpr uint32_t INDEX_BITS_MASK = 0xf;
+
+	inline uint32_t GetVertexCount(const Record& record) { return record.counts & COUNT_MASK; }
+	inline uint32_t GetTriangleCount(const Record& record) { return (record.counts >> TRIANGLE_COUNT_SHIFT) & COUNT_MASK; }
+	inline uint32_t GetDeltaBits(const Record& record) { return (record.counts >> DELTA_BITS_SHIFT) & DELTA_BITS_MASK; }
+	inline uint32_t GetIndexBits(const Record& record) { return (record.counts >> INDEX_BITS_SHIFT) & INDEX_BITS_MASK; }
+	//Bits of value, 0 for 0
+	uint32_t BitsFor(uint32_t value);
+
+	//Words of the streams of the worst meshlet of the limits, vertexCapacity is the most vertices of a page (the largest delta)
+	uint32_t MaxVertexWords(uint32_t maxVertices, uint32_t vertexCapacity);
+	uint32_t MaxTriangleWords(uint32_t maxVertices, uint32_t maxPrimitives);
+
+	//references are page vertex numbers, the ones >= firstNewVertex have to come as firstNewVertex, firstNewVertex + 1... (first use order). The streams are
+	//written from their first word and the record offsets are 0 (relative to the caller position), vertexWords and triangleWords get the words written
+	//false when the references are not on first use order
+	bool Encode(const uint32_t* references, uint32_t vertexCount, const unsigned char* triangles, uint32_t triangleCount, uint32_t firstNewVertex, Record& record,
+		uint32_t* vertexStream, uint32_t& vertexWords, uint32_t* triangleStream, uint32_t& triangleWords);
+	//Same math as shaders/MeshletCompression.glsl, the streams are the whole pools and the record offsets absolute
+	uint32_t DecodeVertex(const Record& record, const uint32_t* vertexStreams, uint32_t index);
+	void DecodeTriangle(const Record& record, const uint32_t* triangleStreams, uint32_t triangle, uint32_t (&indices)[3]);
+}
+
+#endif // !__MESHLET_COMPRESSION_H__
@@ -12,6 +12,8 @@ public:
 	virtual UpdateStatus Update(float dt) { return UpdateStatus::UPDATE_CONTINUE; }
 	virtual UpdateStatus PostUpdate(float dt) { return UpdateStatus::UPDATE_CONTINUE; }
 	virtual bool CleanUp() { return true; }
+	//Zone names of the profiler
+	virtual const char* GetName() const { return "Module"; }
 };
 
 #endif // __MODULE_H__
\ No newline at end of file
@@ -0,0 +1,677 @@
+#include "ModuleBenchmark.h"
+#include "ModuleEditorCamera.h"
+#include "ModuleVulkan.h"
+#include "InstanceSimulation.h"
+#include "Profiler.h"
+#include "glm/glm.hpp"
+#include "glm/gtc/constants.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include <algorithm>
+#include <string>
+#include <string.h>
+#include <stdlib.h>
+
+ModuleBenchmark::ModuleBenchmark(ModuleEditorCamera* camera, ModuleVulkan* vulkan, const BenchmarkConfig& config) : mCamera(camera), mVulkan(vulkan), config(config)
+{
+}
+
+ModuleBenchmark::~ModuleBenchmark()
+{
+}
+
+BenchmarkConfig ModuleBenchmark::ParseArguments(int argc, char* argv[])
+{
+	BenchmarkConfig config;
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+		if (strcmp(arg, "--hidden") == 0)
+		{
+			config.hiddenWindow = true;
+			continue;
+		}
+		if (strcmp(arg, "--validate-instances") == 0)
+		{
+			config.validateInstances = true;
+			continue;
+		}
+		if (value == nullptr)
+		{
+			LOG("Benchmark argument %s requires a value", arg);
+			config.valid = false;
+			break;
+		}
+		++i;
+		if (strcmp(arg, "--path") == 0)
+		{
+			if (strcmp(value, "stationary") == 0)
+				config.path = CameraPath::STATIONARY;
+			else if (strcmp(value, "orbit") == 0)
+				config.path = CameraPath::ORBIT;
+			else if (strcmp(value, "flythrough") == 0)
+				config.path = CameraPath::FLY_THROUGH;
+			else if (strcmp(value, "slowflythrough") == 0)
+				config.path = CameraPath::SLOW_FLY_THROUGH;
+			else
+			{
+				config.path = CameraPath::RECORDED;
+				config.pathFile = value;
+			}
+		}
+		else if (strcmp(arg, "--warmup") == 0)
+			config.warmupFrames = static_cast<unsigned int>(strtoul(value, nullptr, 10));
+		else if (strcmp(arg, "--frames") == 0)
+			config.frameCount = static_cast<unsigned int>(strtoul(value, nullptr, 10));
+		else if (strcmp(arg, "--out") == 0)
+			config.outputPath = value;
+		else if (strcmp(arg, "--record") == 0)
+			config.recordFile = value;
+		else if (strcmp(arg, "--gpu") == 0)
+			config.gpuName = value;
+		else if (strcmp(arg, "--renderpath") == 0)
+		{
+			if (strcmp(value, "forward") == 0)
+				config.visibilityBuffer = false;
+			else if (strcmp(value, "visbuffer") == 0)
+				config.visibilityBuffer = true;
+			else
+			{
+				LOG("Unknown render path %s", value);
+				config.valid = false;
+			}
+		}
+		else if (strcmp(arg, "--swraster") == 0)
+			config.swRasterThreshold = static_cast<float>(atof(value));
+		else if (strcmp(arg, "--geometry-budget") == 0)
+			config.geometryBudgetMB = static_cast<unsigned int>(strtoul(value, nullptr, 10));
+		else if (strcmp(arg, "--meshlets") == 0)
+		{
+			//64:124,128:128,...
+			const char* cursor = value;
+			while (config.valid && *cursor != '\0')
+			{
+				char* end = nullptr;
+				MeshletLimits limits;
+				limits.maxVertices = static_cast<uint32_t>(strtoul(cursor, &end, 10));
+				if (*end != ':')
+				{
+					LOG("Invalid meshlet limits %s, expected max vertices:max primitives", value);
+					config.valid = false;
+					break;
+				}
+				limits.maxPrimitives = static_cast<uint32_t>(strtoul(end + 1, &end, 10));
+				config.meshletLimits.push_back(limits);
+				cursor = (*end == ',') ? end + 1 : end;
+				if (*end != ',' && *end != '\0')
+				{
+					LOG("Invalid meshlet limits %s, expected max vertices:max primitives", value);
+					config.valid = false;
+				}
+			}
+		}
+		else if (strcmp(arg, "--primcull") == 0)
+		{
+			if (strcmp(value, "on") == 0)
+				config.primitiveCulling = true;
+			else if (strcmp(value, "off") == 0)
+				config.primitiveCulling = false;
+			else
+			{
+				LOG("Unknown primitive culling mode %s", value);
+				config.valid = false;
+			}
+		}
+		else if (strcmp(arg, "--async-compute") == 0)
+		{
+			if (strcmp(value, "on") == 0)
+				config.asyncCompute = true;
+			else if (strcmp(value, "off") == 0)
+				config.asyncCompute = false;
+			else
+			{
+				LOG("Unknown async compute mode %s", value);
+				config.valid = false;
+			}
+		}
+		else if (strcmp(arg, "--occlusion") == 0)
+		{
+			if (strcmp(value, "on") == 0)
+				config.occlusionCulling = true;
+			else if (strcmp(value, "off") == 0)
+				config.occlusionCulling = false;
+			else
+			{
+				LOG("Unknown occlusion culling mode %s", value);
+				config.valid = false;
+			}
+		}
+		else if (strcmp(arg, "--depth-sort") == 0)
+		{
+			if (strcmp(value, "on") == 0)
+				config.depthSort = true;
+			else if (strcmp(value, "off") == 0)
+				config.depthSort = false;
+			else
+			{
+				LOG("Unknown depth sort mode %s", value);
+				config.valid = false;
+			}
+		}
+		else if (strcmp(arg, "--visibility-cache") == 0)
+		{
+			if (strcmp(value, "on") == 0)
+				config.visibilityCache = true;
+			else if (strcmp(value, "off") == 0)
+				config.visibilityCache = false;
+			else
+			{
+				LOG("Unknown visibility cache mode %s", value);
+				config.valid = false;
+			}
+		}
+		else if (strcmp(arg, "--meshlet-cache") == 0)
+		{
+			if (strcmp(value, "on") == 0)
+				config.meshletCache = true;
+			else if (strcmp(value, "off") == 0)
+				config.meshletCache = false;
+			else
+			{
+				LOG("Unknown meshlet cache mode %s", value);
+				config.valid = false;
+			}
+		}
+		else if (strcmp(arg, "--shadow-cascades") == 0)
+			config.shadowCascades = static_cast<unsigned int>(strtoul(value, nullptr, 10));
+		else if (strcmp(arg, "--shadow-mode") == 0)
+		{
+			if (strcmp(value, "multiview") == 0)
+				config.shadowMultiView = true;
+			else if (strcmp(value, "separate") == 0)
+				config.shadowMultiView = false;
+			else
+			{
+				LOG("Unknown shadow mode %s", value);
+				config.valid = false;
+			}
+		}
+		else if (strcmp(arg, "--impostor-threshold") == 0)
+			config.impostorThreshold = strtof(value, nullptr);
+		else if (strcmp(arg, "--lights") == 0)
+			config.lightCount = static_cast<unsigned int>(strtoul(value, nullptr, 10));
+		else if (strcmp(arg, "--cache-refresh") == 0)
+			config.visibilityCacheRefresh = static_cast<int>(strtol(value, nullptr, 10));
+		else if (strcmp(arg, "--present-mode") == 0)
+		{
+			if (strcmp(value, "fifo") == 0)
+				config.presentMode = static_cast<int>(PresentMode::FIFO);
+			else if (strcmp(value, "mailbox") == 0)
+				config.presentMode = static_cast<int>(PresentMode::MAILBOX);
+			else if (strcmp(value, "immediate") == 0)
+				config.presentMode = static_cast<int>(PresentMode::IMMEDIATE);
+			else
+			{
+				LOG("Unknown present mode %s", value);
+				config.valid = false;
+			}
+		}
+		else if (strcmp(arg, "--instance-churn") == 0)
+			config.instanceChurn = static_cast<unsigned int>(strtoul(value, nullptr, 10));
+		else if (strcmp(arg, "--frame-latency") == 0)
+			config.frameLatency = atoi(value);
+		else if (strcmp(arg, "--instance-motion") == 0)
+		{
+			if (strcmp(value, "on") == 0)
+				config.instanceMotion = true;
+			else if (strcmp(value, "off") == 0)
+				config.instanceMotion = false;
+			else
+			{
+				LOG("Unknown instance motion mode %s", value);
+				config.valid = false;
+			}
+		}
+		else
+		{
+			LOG("Unknown benchmark argument %s", arg);
+			config.valid = false;
+		}
+	}
+	if (config.frameCount < 2)
+	{
+		LOG("The benchmark needs at least 2 measured frames");
+		config.valid = false;
+	}
+	if (!config.valid)
+	{
+		LOG("Usage: EngineBenchmark [--path stationary|orbit|flythrough|slowflythrough|<keyframes file>] [--warmup N] [--frames N] [--out prefix] [--record file] [--gpu name] [--renderpath forward|visbuffer] [--swraster pixels] [--primcull on|off] [--meshlets v:p[,v:p...]] [--geometry-budget MB] [--async-compute on|off] [--occlusion on|off] [--depth-sort on|off] [--visibility-cache on|off] [--meshlet-cache on|off] [--cache-refresh N] [--shadow-cascades N] [--shadow-mode multiview|separate] [--impostor-threshold pixels] [--lights N] [--present-mode fifo|mailbox|immediate] [--frame-latency N] [--instance-motion on|off] [--instance-churn N] [--validate-instances] [--hidden]");
+		LOG("--hidden only hides the window, the swapchain still needs a display server");
+	}
+	return config;
+}
+
+bool ModuleBenchmark::Init()
+{
+	if (!config.valid)
+		return false;
+	if (config.recordFile != nullptr)
+	{
+		recordHandle = fopen(config.recordFile, "w");
+		if (recordHandle == nullptr)
+		{
+			LOG("Error opening the camera record file %s", config.recordFile);
+			return false;
+		}
+		return true;
+	}
+	if (config.path == CameraPath::RECORDED && !LoadKeyframes(config.pathFile))
+		return false;
+	samples.reserve(config.frameCount);
+	return true;
+}
+
+UpdateStatus ModuleBenchmark::PreUpdate(float dt)
+{
+	if (recordHandle != nullptr)
+	{
+		const glm::vec3& eye = mCamera->GetPosition();
+		const glm::vec3 target = eye + mCamera->GetFoward();
+		fprintf(recordHandle, "%f %f %f %f %f %f\n", eye.x, eye.y, eye.z, target.x, target.y, target.z);
+		return UpdateStatus::UPDATE_CONTINUE;
+	}
+
+	//dt is the duration of the previous frame, so the sample belongs to frame - 1
+	if (frame > config.warmupFrames)
+		SampleFrame(dt);
+
+	if (frame == config.warmupFrames + config.frameCount)
+	{
+		if (!WriteResults())
+			return UpdateStatus::UPDATE_ERROR;
+		return UpdateStatus::UPDATE_STOP;
+	}
+
+	const unsigned int measuredFrame = (frame < config.warmupFrames) ? 0 : frame - config.warmupFrames;
+	MoveCamera(static_cast<float>(measuredFrame) / static_cast<float>(config.frameCount - 1));
+	if (config.instanceChurn != 0)
+		ChurnInstances();
+	++frame;
+	return UpdateStatus::UPDATE_CONTINUE;
+}
+
+bool ModuleBenchmark::CleanUp()
+{
+	if (recordHandle != nullptr)
+	{
+		fclose(recordHandle);
+		recordHandle = nullptr;
+	}
+	return true;
+}
+
+bool ModuleBenchmark::LoadKeyframes(const char* path)
+{
+	FILE* fileHandle = fopen(path, "r");
+	if (fileHandle == nullptr)
+	{
+		LOG("Error opening the camera path file %s", path);
+		return false;
+	}
+	CameraKeyframe keyframe;
+	while (fscanf(fileHandle, "%f %f %f %f %f %f", &keyframe.eye.x, &keyframe.eye.y, &keyframe.eye.z, &keyframe.target.x, &keyframe.target.y, &keyframe.target.z) == 6)
+		keyframes.push_back(keyframe);
+	fclose(fileHandle);
+	if (keyframes.size() < 2)
+	{
+		LOG("The camera path file %s needs at least 2 keyframes", path);
+		return false;
+	}
+	return true;
+}
+
+void ModuleBenchmark::SampleFrame(float dt)
+{
+	BenchmarkSample sample{};
+	sample.cpuFrameMs = dt * 1000.0f;
+	//GPU results arrive MAX_FRAMES_IN_FLIGHT frames late, a frame that has not been retired yet keeps the sample cpu only
+	const FrameStats& gpuStats = mVulkan->GetFrameStats();
+	sample.presentWaitMs = gpuStats.presentWaitMs;
+	sample.occludedInstances = gpuStats.occludedInstances;
+	sample.occlusionMs = gpuStats.occlusionMs;
+	if (gpuStats.frameNumber != 0 && gpuStats.frameNumber != lastGpuFrame)
+	{
+		lastGpuFrame = gpuStats.frameNumber;
+		sample.gpuValid = true;
+		sample.gpuCullMs = gpuStats.gpuCullMs;
+		sample.gpuDrawMs = gpuStats.gpuDrawMs;
+		sample.visibleInstances = gpuStats.visibleInstances;
+		sample.visibleMeshlets = gpuStats.visibleMeshlets;
+		sample.meshletsTested = gpuStats.culling.meshletsTested;
+		sample.trianglesEmitted = gpuStats.culling.trianglesEmitted;
+		sample.meshletsSoftwareRaster = gpuStats.culling.meshletsSoftwareRaster;
+		sample.trianglesCulled = gpuStats.culling.trianglesCulled;
+		sample.clippingInvocations = gpuStats.clippingInvocations;
+		sample.clippingPrimitives = gpuStats.clippingPrimitives;
+		sample.residentPages = gpuStats.residentPages;
+		sample.pageUploads = gpuStats.pageUploads;
+		sample.cullOverlapMs = gpuStats.cullOverlapMs;
+		sample.gpuSortMs = gpuStats.gpuSortMs;
+		sample.fragmentInvocations = gpuStats.fragmentInvocations;
+		sample.depthOrderValidated = gpuStats.depthOrderValidated;
+		sample.depthOrderErrors = gpuStats.depthOrderErrors;
+		sample.instancesCached = gpuStats.culling.instancesCached;
+		sample.meshletsCached = gpuStats.culling.meshletsCached;
+		sample.validCacheEpochs = gpuStats.validCacheEpochs;
+		sample.cacheEpochStarted = gpuStats.cacheEpochStarted;
+		sample.gpuShadowCullMs = gpuStats.gpuShadowCullMs;
+		sample.gpuShadowDrawMs = gpuStats.gpuShadowDrawMs;
+		sample.shadowDraws = gpuStats.shadowDraws;
+		sample.impostorInstances = gpuStats.impostorInstances;
+		sample.instancesValidated = gpuStats.instancesValidated;
+		sample.instanceSimError = gpuStats.instanceSimError;
+		sample.liveInstances = gpuStats.liveInstances;
+		sample.instanceUploads = gpuStats.instanceUploads;
+	}
+	samples.push_back(sample);
+}
+
+void ModuleBenchmark::ChurnInstances()
+{
+	InstanceManager* instances = mVulkan->GetInstances();
+	//The churn of a second spread over 60 frames, the remainders carried so the rate is exact
+	const uint32_t count = static_cast<uint32_t>(static_cast<uint64_t>(config.instanceChurn) * (frame + 1) / 60 - static_cast<uint64_t>(config.instanceChurn) * frame / 60);
+	std::vector<InstanceHandle> handles;
+	while (churnHandles.size() + count > config.instanceChurn && !churnHandles.empty())
+	{
+		handles.push_back(churnHandles.front());
+		churnHandles.pop_front();
+	}
+	instances->Remove(handles.data(), static_cast<uint32_t>(handles.size()));
+	//Same cube and motions as the procedural scene
+	std::vector<uint32_t> meshes(count);
+	std::vector<InstanceSimulation::Motion> motions(count);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const uint32_t index = churnSpawned++;
+		uint32_t state = index * 747796405u + 2891336453u;
+		auto random = [&state]() { state = state * 1664525u + 1013904223u; return static_cast<float>(state >> 8) / 16777216.0f * 2.0f - 1.0f; };
+		const glm::vec3 position(6000.0f * random(), 6000.0f * random(), 6000.0f * random());
+		meshes[i] = index % mVulkan->GetMeshCount();
+		motions[i] = InstanceSimulation::MakeSceneMotion(index, glm::translate(glm::mat4(1.0f), position));
+	}
+	handles.resize(count);
+	instances->Add(meshes.data(), motions.data(), count, handles.data());
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		if (instances->IsAlive(handles[i]))
+			churnHandles.push_back(handles[i]);
+	}
+}
+
+void ModuleBenchmark::MoveCamera(float t)
+{
+	//The procedural scene spreads the instances inside a cube of 6000 units around the origin
+	const float pi = glm::pi<float>();
+	switch (config.path)
+	{
+		case CameraPath::STATIONARY:
+			//Whole cloud in front of the camera and inside the far plane, the most instances survive the frustum test
+			mCamera->LookAt(glm::vec3(0.0f, 0.0f, 7000.0f), glm::vec3(0.0f));
+			break;
+		case CameraPath::ORBIT:
+		{
+			const float angle = 2.0f * pi * t;
+			mCamera->LookAt(glm::vec3(7000.0f * glm::cos(angle), 2000.0f, 7000.0f * glm::sin(angle)), glm::vec3(0.0f));
+			break;
+		}
+		case CameraPath::FLY_THROUGH:
+		{
+			const glm::vec3 start(-6000.0f, 500.0f, -6000.0f);
+			const glm::vec3 end(6000.0f, 500.0f, 6000.0f);
+			const glm::vec3 eye = glm::mix(start, end, t);
+			mCamera->LookAt(eye, eye + glm::normalize(end - start));
+			break;
+		}
+		case CameraPath::RECORDED:
+		{
+			const float keyframePos = t * static_cast<float>(keyframes.size() - 1);
+			const size_t index = std::min(static_cast<size_t>(keyframePos), keyframes.size() - 2);
+			const float blend = keyframePos - static_cast<float>(index);
+			mCamera->LookAt(glm::mix(keyframes[index].eye, keyframes[index + 1].eye, blend), glm::mix(keyframes[index].target, keyframes[index + 1].target, blend));
+			break;
+		}
+		case CameraPath::SLOW_FLY_THROUGH:
+		{
+			//Same path as Simulations::SimulateVisibilityCache of MeshTool: a quarter of the fly-through line, the view sways 10 degrees around it once per run
+			const glm::vec3 start(-6000.0f, 500.0f, -6000.0f);
+			const glm::vec3 end(6000.0f, 500.0f, 6000.0f);
+			const glm::vec3 eye = glm::mix(start, end, 0.25f * t);
+			const glm::vec3 forward = glm::normalize(end - start);
+			const float yaw = glm::radians(10.0f) * glm::sin(2.0f * pi * t);
+			const glm::vec3 direction(glm::rotate(glm::mat4(1.0f), yaw, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::vec4(forward, 0.0f));
+			mCamera->LookAt(eye, eye + direction);
+			break;
+		}
+	}
+}
+
+struct Percentiles
+{
+	float min;
+	float mean;
+	float p50;
+	float p90;
+	float p95;
+	float p99;
+	float max;
+};
+
+static Percentiles ComputePercentiles(std::vector<float>& values)
+{
+	Percentiles ret{};
+	if (values.empty())
+		return ret;
+	std::sort(values.begin(), values.end());
+	double sum = 0.0;
+	for (float value : values)
+		sum += value;
+	//nearest rank
+	auto rank = [&values](float percentile) { return values[std::min(static_cast<size_t>(percentile * values.size()), values.size() - 1)]; };
+	ret.min = values.front();
+	ret.max = values.back();
+	ret.mean = static_cast<float>(sum / values.size());
+	ret.p50 = rank(0.50f);
+	ret.p90 = rank(0.90f);
+	ret.p95 = rank(0.95f);
+	ret.p99 = rank(0.99f);
+	return ret;
+}
+
+static void WriteJsonMetric(FILE* fileHandle, const char* name, std::vector<float>& values, bool last)
+{
+	const Percentiles p = ComputePercentiles(values);
+	fprintf(fileHandle, "\t\t\"%s\": { \"samples\": %zu, \"min\": %f, \"mean\": %f, \"p50\": %f, \"p90\": %f, \"p95\": %f, \"p99\": %f, \"max\": %f }%s\n",
+		name, values.size(), p.min, p.mean, p.p50, p.p90, p.p95, p.p99, p.max, last ? "" : ",");
+}
+
+bool ModuleBenchmark::WriteResults() const
+{
+	static const char* pathNames[] = { "stationary", "orbit", "flythrough", "recorded", "slowflythrough" };
+	std::string outputPath = config.outputPath;
+	if (GetRunCount(config) > 1)
+		outputPath += "_" + std::to_string(config.meshletLimits[config.run].maxVertices) + "_" + std::to_string(config.meshletLimits[config.run].maxPrimitives);
+	std::string csvPath = outputPath + ".csv";
+	std::string jsonPath = outputPath + ".json";
+#ifdef ENGINE_PROFILER
+	//Every zone since the start of the process, the warmup and the load included
+	Profiler::WriteChromeTrace((outputPath + ".trace.json").c_str());
+#endif // ENGINE_PROFILER
+
+	FILE* csv = fopen(csvPath.c_str(), "w");
+	if (csv == nullptr)
+	{
+		LOG("Error writing the benchmark results to %s", csvPath.c_str());
+		return false;
+	}
+	fprintf(csv, "frame,cpu_frame_ms,gpu_cull_ms,gpu_draw_ms,visible_instances,visible_meshlets,meshlets_tested,triangles,sw_meshlets,triangles_culled,clipper_in,clipper_out,resident_pages,page_uploads,cull_overlap_ms,present_wait_ms,live_instances,instance_uploads,occluded_instances,occlusion_ms,gpu_sort_ms,fragment_invocations,instances_cached,meshlets_cached,valid_cache_epochs,cache_epoch_started,gpu_shadow_cull_ms,gpu_shadow_draw_ms,shadow_draws,impostor_instances,instance_sim_error\n");
+	std::vector<float> cpuFrame, presentWait, instancesCached, meshletsCached, validCacheEpochs, cacheEpochsStarted, gpuShadowCull, gpuShadowDraw, shadowDraws, impostorInstances, occludedInstances, occlusionMs, gpuSort, fragmentInvocations, depthOrderErrors, gpuCull, gpuDraw, cullOverlap, instanceSimError, liveInstances, instanceUploads, visibleInstances, visibleMeshlets, meshletsTested, triangles, swMeshlets, trianglesCulled, clipperIn, clipperOut, trianglesPerMs;
+	for (size_t i = 0; i < samples.size(); ++i)
+	{
+		const BenchmarkSample& sample = samples[i];
+		cpuFrame.push_back(sample.cpuFrameMs);
+		presentWait.push_back(sample.presentWaitMs);
+		occludedInstances.push_back(static_cast<float>(sample.occludedInstances));
+		occlusionMs.push_back(sample.occlusionMs);
+		if (sample.gpuValid)
+		{
+			fprintf(csv, "%zu,%f,%f,%f,%u,%u,%u,%u,%u,%u,%llu,%llu,%u,%u,", i, sample.cpuFrameMs, sample.gpuCullMs, sample.gpuDrawMs, sample.visibleInstances, sample.visibleMeshlets,
+				sample.meshletsTested, sample.trianglesEmitted, sample.meshletsSoftwareRaster, sample.trianglesCulled,
+				static_cast<unsigned long long>(sample.clippingInvocations), static_cast<unsigned long long>(sample.clippingPrimitives), sample.residentPages, sample.pageUploads);
+			//Empty when the queues do not share a clock
+			if (sample.cullOverlapMs >= 0.0f)
+			{
+				fprintf(csv, "%f", sample.cullOverlapMs);
+				cullOverlap.push_back(sample.cullOverlapMs);
+			}
+			fprintf(csv, ",%f,%u,%u,%u,%f,%f,%llu,%u,%u,%u,%u,%f,%f,%u,%u,", sample.presentWaitMs,
+				sample.liveInstances, sample.instanceUploads, sample.occludedInstances, sample.occlusionMs, sample.gpuSortMs, static_cast<unsigned long long>(sample.fragmentInvocations),
+				sample.instancesCached, sample.meshletsCached, sample.validCacheEpochs, sample.cacheEpochStarted ? 1 : 0, sample.gpuShadowCullMs, sample.gpuShadowDrawMs, sample.shadowDraws,
+				sample.impostorInstances);
+			if (sample.instancesValidated)
+			{
+				fprintf(csv, "%f", sample.instanceSimError);
+				instanceSimError.push_back(sample.instanceSimError);
+			}
+			fprintf(csv, "\n");
+			gpuCull.push_back(sample.gpuCullMs);
+			gpuSort.push_back(sample.gpuSortMs);
+			instancesCached.push_back(static_cast<float>(sample.instancesCached));
+			meshletsCached.push_back(static_cast<float>(sample.meshletsCached));
+			validCacheEpochs.push_back(static_cast<float>(sample.validCacheEpochs));
+			cacheEpochsStarted.push_back(sample.cacheEpochStarted ? 1.0f : 0.0f);
+			gpuShadowCull.push_back(sample.gpuShadowCullMs);
+			gpuShadowDraw.push_back(sample.gpuShadowDrawMs);
+			shadowDraws.push_back(static_cast<float>(sample.shadowDraws));
+			impostorInstances.push_back(static_cast<float>(sample.impostorInstances));
+			fragmentInvocations.push_back(static_cast<float>(sample.fragmentInvocations));
+			if (sample.depthOrderValidated)
+				depthOrderErrors.push_back(static_cast<float>(sample.depthOrderErrors));
+			gpuDraw.push_back(sample.gpuDrawMs);
+			liveInstances.push_back(static_cast<float>(sample.liveInstances));
+			instanceUploads.push_back(static_cast<float>(sample.instanceUploads));
+			visibleInstances.push_back(static_cast<float>(sample.visibleInstances));
+			visibleMeshlets.push_back(static_cast<float>(sample.visibleMeshlets));
+			meshletsTested.push_back(static_cast<float>(sample.meshletsTested));
+			triangles.push_back(static_cast<float>(sample.trianglesEmitted));
+			swMeshlets.push_back(static_cast<float>(sample.meshletsSoftwareRaster));
+			trianglesCulled.push_back(static_cast<float>(sample.trianglesCulled));
+			clipperIn.push_back(static_cast<float>(sample.clippingInvocations));
+			clipperOut.push_back(static_cast<float>(sample.clippingPrimitives));
+			//raster throughput
+			if (sample.gpuDrawMs > 0.0f)
+				trianglesPerMs.push_back(static_cast<float>(sample.trianglesEmitted) / sample.gpuDrawMs);
+		}
+		else
+			fprintf(csv, "%zu,%f,,,,,,,,,,,,,,%f,,,%u,%f,,,,,,,,,,,\n", i, sample.cpuFrameMs, sample.presentWaitMs, sample.occludedInstances, sample.occlusionMs);
+	}
+	fclose(csv);
+
+	FILE* json = fopen(jsonPath.c_str(), "w");
+	if (json == nullptr)
+	{
+		LOG("Error writing the benchmark results to %s", jsonPath.c_str());
+		return false;
+	}
+	fprintf(json, "{\n");
+	fprintf(json, "\t\"path\": \"%s\",\n", pathNames[static_cast<unsigned char>(config.path)]);
+	fprintf(json, "\t\"render_path\": \"%s\",\n", config.visibilityBuffer ? "visbuffer" : "forward");
+	fprintf(json, "\t\"sw_raster_threshold\": %f,\n", mVulkan->GetSoftwareRasterThreshold());
+	fprintf(json, "\t\"primitive_culling\": %s,\n", mVulkan->GetPrimitiveCulling() ? "true" : "false");
+	fprintf(json, "\t\"async_compute\": %s,\n", mVulkan->GetAsyncCompute() ? "true" : "false");
+	fprintf(json, "\t\"occlusion_culling\": %s,\n", mVulkan->GetOcclusionCulling() ? "true" : "false");
+	fprintf(json, "\t\"depth_sort\": %s,\n", mVulkan->GetDepthSort() ? "true" : "false");
+	fprintf(json, "\t\"visibility_cache\": { \"enabled\": %s, \"meshlets\": %s, \"refresh_frames\": %u },\n", mVulkan->GetVisibilityCache() ? "true" : "false",
+		mVulkan->GetMeshletCache() ? "true" : "false", mVulkan->GetVisibilityCacheRefresh());
+	fprintf(json, "\t\"shadows\": { \"cascades\": %u, \"mode\": \"%s\", \"multiview_supported\": %s },\n", mVulkan->GetShadowCascades(), mVulkan->GetShadowMultiView() ? "multiview" : "separate",
+		mVulkan->IsMultiViewSupported() ? "true" : "false");
+	fprintf(json, "\t\"impostors\": { \"threshold\": %f, \"baked\": %s },\n", mVulkan->GetImpostorThreshold(), mVulkan->AreImpostorsBaked() ? "true" : "false");
+	fprintf(json, "\t\"lights\": %u,\n", mVulkan->GetLightCount());
+	static const char* presentModeNames[] = { "fifo", "mailbox", "immediate" };
+	fprintf(json, "\t\"present_mode\": \"%s\",\n", presentModeNames[static_cast<unsigned char>(mVulkan->GetPresentMode())]);
+	fprintf(json, "\t\"frame_latency\": %u,\n", mVulkan->IsPresentWaitSupported() ? mVulkan->GetFrameLatency() : 0);
+	fprintf(json, "\t\"instance_motion\": %s,\n", mVulkan->GetInstanceMotion() ? "true" : "false");
+	fprintf(json, "\t\"instance_validation\": %s,\n", mVulkan->GetInstanceValidation() ? "true" : "false");
+	fprintf(json, "\t\"instance_churn\": %u,\n", config.instanceChurn);
+	const MeshletStats& meshletStats = mVulkan->GetMeshletStats();
+	fprintf(json, "\t\"meshlets\": { \"max_vertices\": %u, \"max_primitives\": %u, \"count\": %u, \"vertex_occupancy\": %f, \"triangle_occupancy\": %f },\n",
+		meshletStats.maxVertices, meshletStats.maxPrimitives, meshletStats.meshletCount, meshletStats.vertexOccupancy, meshletStats.triangleOccupancy);
+	//Since the start of the process, the import included
+	fprintf(json, "\t\"host_memory\": {\n");
+	for (size_t i = 0; i <= static_cast<size_t>(HostMemory::Tag::COUNT); ++i)
+	{
+		const bool total = i == static_cast<size_t>(HostMemory::Tag::COUNT);
+		const HostMemory::TagStats stats = total ? HostMemory::GetTotalStats() : HostMemory::GetStats(static_cast<HostMemory::Tag>(i));
+		fprintf(json, "\t\t\"%s\": { \"bytes\": %zu, \"peak_bytes\": %zu, \"allocations\": %llu, \"frees\": %llu }%s\n", total ? "total" : HostMemory::GetTagName(static_cast<HostMemory::Tag>(i)),
+			stats.bytes, stats.peakBytes, static_cast<unsigned long long>(stats.allocations), static_cast<unsigned long long>(stats.frees), total ? "" : ",");
+	}
+	fprintf(json, "\t},\n");
+	fprintf(json, "\t\"warmup_frames\": %u,\n", config.warmupFrames);
+	fprintf(json, "\t\"frames\": %u,\n", config.frameCount);
+	fprintf(json, "\t\"metrics\": {\n");
+	WriteJsonMetric(json, "cpu_frame_ms", cpuFrame, false);
+	WriteJsonMetric(json, "present_wait_ms", presentWait, false);
+	WriteJsonMetric(json, "gpu_cull_ms", gpuCull, false);
+	WriteJsonMetric(json, "gpu_draw_ms", gpuDraw, false);
+	WriteJsonMetric(json, "cull_overlap_ms", cullOverlap, false);
+	WriteJsonMetric(json, "gpu_sort_ms", gpuSort, false);
+	WriteJsonMetric(json, "fragment_invocations", fragmentInvocations, false);
+	WriteJsonMetric(json, "instances_cached", instancesCached, false);
+	WriteJsonMetric(json, "meshlets_cached", meshletsCached, false);
+	WriteJsonMetric(json, "valid_cache_epochs", validCacheEpochs, false);
+	WriteJsonMetric(json, "cache_epochs_started", cacheEpochsStarted, false);
+	WriteJsonMetric(json, "depth_order_errors", depthOrderErrors, false);
+	WriteJsonMetric(json, "gpu_shadow_cull_ms", gpuShadowCull, false);
+	WriteJsonMetric(json, "gpu_shadow_draw_ms", gpuShadowDraw, false);
+	WriteJsonMetric(json, "shadow_draws", shadowDraws, false);
+	WriteJsonMetric(json, "impostor_instances", impostorInstances, false);
+	WriteJsonMetric(json, "occlusion_ms", occlusionMs, false);
+	WriteJsonMetric(json, "occluded_instances", occludedInstances, false);
+	WriteJsonMetric(json, "instance_sim_error", instanceSimError, false);
+	WriteJsonMetric(json, "live_instances", liveInstances, false);
+	WriteJsonMetric(json, "instance_uploads", instanceUploads, false);
+	WriteJsonMetric(json, "visible_instances", visibleInstances, false);
+	WriteJsonMetric(json, "visible_meshlets", visibleMeshlets, false);
+	WriteJsonMetric(json, "meshlets_tested", meshletsTested, false);
+	WriteJsonMetric(json, "triangles", triangles, false);
+	WriteJsonMetric(json, "sw_meshlets", swMeshlets, false);
+	WriteJsonMetric(json, "triangles_culled", trianglesCulled, false);
+	WriteJsonMetric(json, "clipper_in", clipperIn, false);
+	WriteJsonMetric(json, "clipper_out", clipperOut, false);
+	WriteJsonMetric(json, "triangles_per_ms", trianglesPerMs, true);
+	fprintf(json, "\t}\n}\n");
+	fclose(json);
+	LOG("Benchmark results written to %s and %s", jsonPath.c_str(), csvPath.c_str());
+	return GetRunCount(config) == 1 || WriteSweepSummary(gpuDraw, trianglesPerMs);
+}
+
+bool ModuleBenchmark::WriteSweepSummary(std::vector<float>& gpuDraw, std::vector<float>& trianglesPerMs) const
+{
+	//One row per run, the first run starts the file
+	const std::string summaryPath = std::string(config.outputPath) + "_sweep.csv";
+	FILE* summary = fopen(summaryPath.c_str(), config.run == 0 ? "w" : "a");
+	if (summary == nullptr)
+	{
+		LOG("Error writing the meshlet sweep summary to %s", summaryPath.c_str());
+		return false;
+	}
+	if (config.run == 0)
+		fprintf(summary, "max_vertices,max_primitives,meshlets,vertex_occupancy,triangle_occupancy,gpu_draw_ms_mean,gpu_draw_ms_p95,triangles_per_ms_mean\n");
+	const MeshletStats& meshletStats = mVulkan->GetMeshletStats();
+	const Percentiles draw = ComputePercentiles(gpuDraw);
+	const Percentiles throughput = ComputePercentiles(trianglesPerMs);
+	fprintf(summary, "%u,%u,%u,%f,%f,%f,%f,%f\n", meshletStats.maxVertices, meshletStats.maxPrimitives, meshletStats.meshletCount, meshletStats.vertexOccupancy, meshletStats.triangleOccupancy,
+		draw.mean, draw.p95, throughput.mean);
+	fclose(summary);
+	return true;
+}
@@ -0,0 +1,161 @@
+#ifndef __MODULE_BENCHMARK_H__
+#define __MODULE_BENCHMARK_H__
+
+#include "Module.h"
+#include "InstanceManager.h"
+#include "glm/vec3.hpp"
+#include <deque>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+
+class ModuleEditorCamera;
+class ModuleVulkan;
+
+enum class CameraPath : unsigned char
+{
+	STATIONARY,
+	ORBIT,
+	FLY_THROUGH,
+	RECORDED,
+	//Fly-through line at a quarter of the speed with the view turning slowly, the camera motion the visibility cache absorbs
+	SLOW_FLY_THROUGH
+};
+
+struct MeshletLimits
+{
+	uint32_t maxVertices;
+	uint32_t maxPrimitives;
+};
+
+struct BenchmarkConfig
+{
+	CameraPath path = CameraPath::FLY_THROUGH;
+	unsigned int warmupFrames = 120;
+	unsigned int frameCount = 1000;
+	//Prefix of the output files, the module writes <outputPath>.json and <outputPath>.csv
+	const char* outputPath = "benchmark";
+	//Keyframe file used by CameraPath::RECORDED (one "eyeX eyeY eyeZ targetX targetY targetZ" per line)
+	const char* pathFile = nullptr;
+	//When set the camera is not driven, the user flies with the editor camera and the keyframes are written to this file
+	const char* recordFile = nullptr;
+	//Substring of the VkPhysicalDevice name to run on (ex: "llvmpipe" for the software rasterizer)
+	const char* gpuName = nullptr;
+	bool visibilityBuffer = false;
+	//Projected meshlet size in pixels for the software rasterizer of the visibility buffer path, negative keeps the ModuleVulkan default
+	float swRasterThreshold = -1.0f;
+	bool primitiveCulling = false;
+	//Device memory of the streamed geometry pools in MB, 0 keeps the ModuleVulkan default (a share of the memory budget)
+	unsigned int geometryBudgetMB = 0;
+	//Cull on the async compute queue when the device has one
+	bool asyncCompute = true;
+	//CPU masked occlusion culling ahead of the GPU cull
+	bool occlusionCulling = false;
+	//Front to back GPU sort of the culled commands
+	bool depthSort = false;
+	//Temporal visibility cache of the frustum tests (instances and meshlet states), refresh frames negative keeps the ModuleVulkan default
+	bool visibilityCache = false;
+	bool meshletCache = true;
+	int visibilityCacheRefresh = -1;
+	//Shadow cascades of the light (0 disables them), culled and drawn in a single multiview pass or in one pass per cascade
+	unsigned int shadowCascades = 0;
+	bool shadowMultiView = true;
+	//Projected size in pixels under which the instances are impostors (0 disables them and skips the bake)
+	float impostorThreshold = 0.0f;
+	//Point lights of the clustered forward shading (0 disables them and skips the binning)
+	unsigned int lightCount = 0;
+	//PresentMode value and presents queued with VK_KHR_present_wait, negative keeps the ModuleVulkan default
+	int presentMode = -1;
+	int frameLatency = -1;
+	//Instances moved by InstanceSim.comp (one fixed step per frame so the runs are repeatable), validated against the CPU reference every frame
+	bool instanceMotion = true;
+	bool validateInstances = false;
+	//Instances added and removed per second through the InstanceManager, each one lives a second (one fixed step per frame too)
+	unsigned int instanceChurn = 0;
+	//Empty keeps the ModuleVulkan default. More than one is a sweep: the whole engine runs once per pair (run is the index) and writes <outputPath>_<v>_<p>.json/csv + <outputPath>_sweep.csv
+	std::vector<MeshletLimits> meshletLimits;
+	unsigned int run = 0;
+	bool hiddenWindow = false;
+	bool valid = true;
+};
+
+struct BenchmarkSample
+{
+	float cpuFrameMs;
+	float gpuCullMs;
+	float gpuDrawMs;
+	uint32_t visibleInstances;
+	uint32_t visibleMeshlets;
+	uint32_t meshletsTested;
+	uint32_t trianglesEmitted;
+	uint32_t meshletsSoftwareRaster;
+	uint32_t trianglesCulled;
+	uint64_t clippingInvocations;
+	uint64_t clippingPrimitives;
+	uint32_t residentPages;
+	uint32_t pageUploads;
+	float cullOverlapMs;
+	float gpuSortMs;
+	uint64_t fragmentInvocations;
+	bool depthOrderValidated;
+	uint32_t depthOrderErrors;
+	uint32_t instancesCached;
+	uint32_t meshletsCached;
+	uint32_t validCacheEpochs;
+	bool cacheEpochStarted;
+	float presentWaitMs;
+	float gpuShadowCullMs;
+	float gpuShadowDrawMs;
+	uint32_t shadowDraws;
+	uint32_t impostorInstances;
+	//CPU side, sampled every frame
+	uint32_t occludedInstances;
+	float occlusionMs;
+	float instanceSimError;
+	bool instancesValidated;
+	uint32_t liveInstances;
+	uint32_t instanceUploads;
+	bool gpuValid;
+};
+
+struct CameraKeyframe
+{
+	glm::vec3 eye;
+	glm::vec3 target;
+};
+
+class ModuleBenchmark final : public Module
+{
+public:
+	ModuleBenchmark(ModuleEditorCamera* mCamera, ModuleVulkan* mVulkan, const BenchmarkConfig& config);
+	~ModuleBenchmark();
+
+	bool Init() override;
+	UpdateStatus PreUpdate(float dt) override;
+	bool CleanUp() override;
+	const char* GetName() const override { return "ModuleBenchmark"; }
+
+	static BenchmarkConfig ParseArguments(int argc, char* argv[]);
+	static unsigned int GetRunCount(const BenchmarkConfig& config) { return config.meshletLimits.size() > 1 ? static_cast<unsigned int>(config.meshletLimits.size()) : 1; }
+private:
+	bool LoadKeyframes(const char* path);
+	void SampleFrame(float dt);
+	void MoveCamera(float t);
+	void ChurnInstances();
+	bool WriteResults() const;
+	bool WriteSweepSummary(std::vector<float>& gpuDraw, std::vector<float>& trianglesPerMs) const;
+
+	ModuleEditorCamera* mCamera;
+	ModuleVulkan* mVulkan;
+	BenchmarkConfig config;
+	std::vector<CameraKeyframe> keyframes;
+	std::vector<BenchmarkSample> samples;
+	unsigned int frame = 0;
+	uint64_t lastGpuFrame = 0;
+	FILE* recordHandle = nullptr;
+	//Instances added by ChurnInstances, oldest first
+	std::deque<InstanceHandle> churnHandles;
+	uint32_t churnSpawned = 0;
+};
+
+#endif // !__MODULE_BENCHMARK_H__
@@ -25,13 +25,15 @@ public:
 	const glm::vec3& GetPosition() const { return pos; }
 	const glm::mat4& GetViewMatrix() const { return view; }
 	const glm::mat4& GetProjectionMatrix() const { return proj; }
+	float GetNearDistance() const { return nearPlane; }
+	float GetFarDistance() const { return farPlane; }
 	void GetPlanes(glm::vec4(&planes)[6]) const;
-	glm::vec4 Camera::NearPlane() const;
-	glm::vec4 Camera::FarPlane() const;
-	glm::vec4 Camera::LeftPlane() const;
-	glm::vec4 Camera::RightPlane() const;
-	glm::vec4 Camera::TopPlane() const;
-	glm::vec4 Camera::BottomPlane() const;
+	glm::vec4 NearPlane() const;
+	glm::vec4 FarPlane() const;
+	glm::vec4 LeftPlane() const;
+	glm::vec4 RightPlane() const;
+	glm::vec4 TopPlane() const;
+	glm::vec4 BottomPlane() const;
 private:
 
 	glm::vec3 pos;
@@ -50,9 +52,14 @@ public:
 
 	bool Init() override;
 	UpdateStatus PreUpdate(float dt) override;
+	const char* GetName() const override { return "ModuleEditorCamera"; }
 	
 	const glm::vec3& GetPosition() const { return camera.GetPosition(); }
+	glm::vec3 GetFoward() const { return camera.GetFoward(); }
+	void LookAt(const glm::vec3& position, const glm::vec3& target) { camera.LookAt(position, target); }
 	void GetFrustumPlanes(glm::vec4(&planes)[6]) { camera.GetPlanes(planes); }
+	float GetNearDistance() const { return camera.GetNearDistance(); }
+	float GetFarDistance() const { return camera.GetFarDistance(); }
 	void ChangeAspectRatio(float aspectRatio) { camera.SetPerspective(glm::radians(45.0f), aspectRatio, 0.1f, 10000.0f); }
 	const glm::mat4& GetView() { return camera.GetViewMatrix(); }
 	const glm::mat4& GetProj() { return camera.GetProjectionMatrix(); }
@@ -33,6 +33,7 @@ public:
 	bool Init() override;
 	UpdateStatus PreUpdate(float dt) override;
 	bool CleanUp() override;
+	const char* GetName() const override { return "ModuleInput"; }
 	KeyState GetKey(SDL_Scancode scancode) { return keyboard[scancode]; }
 	KeyState GetMouseKey(MouseKey key) { return mouseButtons[static_cast<unsigned char>(key)]; }
 	bool MouseMotion() { return mouseMotion; }
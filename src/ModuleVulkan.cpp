@@ -1,16 +1,58 @@
 #include "ModuleVulkan.h"
 #include "ModuleWindow.h"
 #include "ModuleEditorCamera.h"
-#include "FileSystem.h"
 #include "vulkan/vulkan.h"
 #include "SDL3/SDL_vulkan.h"
 #include "meshoptimizer.h"
 #include "ImportMesh.h"
+#include "SDL3/SDL_video.h"
+#include "VisibilityBuffer.h"
+#include "SoftwareRaster.h"
+#include "PrimitiveCulling.h"
+#include "MeshletCache.h"
+#include "OptimizeMesh.h"
+#include "GeometryStreaming.h"
+#include "InstanceSimulation.h"
+#include "InstanceManager.h"
+#include "OcclusionCulling.h"
+#include "DepthSort.h"
+#include "VisibilityCache.h"
+#include "MultiView.h"
+#include "Impostor.h"
+#include "ClusteredLighting.h"
+#include "Profiler.h"
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <random>
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+#include <stdio.h>
+
+//Every mesh is stored on the same geometry pools, the instances pick one of them by index (instance i uses SCENE_MESHES[i % count])
+static const char* SCENE_MESHES[] = { "assets/Duck/Duck.gltf", "assets/BoxTextured/BoxTextured.gltf" };
+
+//shaders/<name>_<max vertices>_<max primitives>.spv, the unsuffixed shader is the 256/256 variant
+static AsyncIO::Handle ReadMeshShader(AsyncIO& asyncIO, const char* name, uint32_t maxVertices, uint32_t maxPrimitives)
+{
+	char path[64];
+	snprintf(path, sizeof(path), "shaders/%s_%u_%u.spv", name, maxVertices, maxPrimitives);
+	return asyncIO.Read(path);
+}
+
+static long WaitMeshShader(AsyncIO& asyncIO, AsyncIO::Handle read, const char* name, uint32_t maxVertices, uint32_t maxPrimitives, char*& buffer)
+{
+	long size = asyncIO.Wait(read, buffer);
+	if (size == 0 && maxVertices == 256 && maxPrimitives == 256)
+	{
+		char path[64];
+		snprintf(path, sizeof(path), "shaders/%s.spv", name);
+		size = asyncIO.Wait(asyncIO.Read(path), buffer);
+	}
+	return size;
+}
 
 ModuleVulkan::ModuleVulkan(ModuleWindow* mWin, ModuleEditorCamera* camera) : mWindow(mWin), mCamera(camera)
 {
@@ -18,6 +60,37 @@ ModuleVulkan::ModuleVulkan(ModuleWindow* mWin, ModuleEditorCamera* camera) : mWi
 
 ModuleVulkan::~ModuleVulkan()
 {
+	WaitSceneImport();
+}
+
+//Import and optimization of the scene meshes, it does not need the device and runs while it is created
+void ModuleVulkan::ImportScene()
+{
+	PROFILE_THREAD("Import");
+	PROFILE_ZONE("ImportScene");
+	for (unsigned int i = 0; i < numMeshes; ++i)
+	{
+		Mesh& mesh = importedMeshes[i];
+		importScratch.Reset();
+		if (!ImporterMesh::ImportFirst(SCENE_MESHES[i], mesh))
+		{
+			LOG("Error loading the model %s", SCENE_MESHES[i]);
+			sceneImported = false;
+			return;
+		}
+		PROFILE_ZONE("OptimizeMesh");
+		const OptimizeMesh::Metrics before = OptimizeMesh::Analyze(mesh, &importScratch);
+		OptimizeMesh::Optimize(mesh, &importScratch);
+		const OptimizeMesh::Metrics after = OptimizeMesh::Analyze(mesh, &importScratch);
+		LOG("%s: %u -> %u vertices, ACMR %.3f -> %.3f, overfetch %.3f -> %.3f", SCENE_MESHES[i], before.vertexCount, after.vertexCount, before.acmr, after.acmr, before.overfetch, after.overfetch);
+	}
+	sceneImported = true;
+}
+
+void ModuleVulkan::WaitSceneImport()
+{
+	if (importThread.joinable())
+		importThread.join();
 }
 
 static VKAPI_ATTR VkBool32 VKAPI_CALL VulkanDebugCallback(
@@ -33,6 +106,31 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL VulkanDebugCallback(
 
 bool ModuleVulkan::Init()
 {
+	//The shaders that do not depend on the device are read and the scene imported while the instance and the device are created
+	asyncIO.Init();
+	const AsyncIO::Handle taskRead = asyncIO.Read("shaders/task.spv");
+	const AsyncIO::Handle fragmentRead = asyncIO.Read("shaders/fragment.spv");
+	const AsyncIO::Handle cullRead = asyncIO.Read("shaders/cull.spv");
+	const AsyncIO::Handle instanceSimRead = asyncIO.Read("shaders/instancesim.spv");
+	const AsyncIO::Handle radixSortRead = asyncIO.Read("shaders/radixsort.spv");
+	const AsyncIO::Handle clusterLightsRead = asyncIO.Read("shaders/clusterlights.spv");
+	const AsyncIO::Handle visShadeRead = asyncIO.Read("shaders/visshade.spv");
+	const AsyncIO::Handle visFragmentRead = asyncIO.Read("shaders/visfragment.spv");
+	const AsyncIO::Handle swRasterRead = asyncIO.Read("shaders/swraster.spv");
+	shadowCascades = std::min(shadowCascades, MAX_SHADOW_CASCADES);
+	const AsyncIO::Handle shadowCullRead = shadowCascades != 0 ? asyncIO.Read("shaders/shadowcull.spv") : AsyncIO::INVALID_HANDLE;
+	const AsyncIO::Handle shadowTaskRead = shadowCascades != 0 ? asyncIO.Read("shaders/shadowtask.spv") : AsyncIO::INVALID_HANDLE;
+	//The impostor atlases are only baked when a threshold is set before the scene is loaded
+	impostorsBaked = impostorThreshold > 0.0f;
+	const AsyncIO::Handle impostorMeshRead = impostorsBaked ? asyncIO.Read("shaders/impostormesh.spv") : AsyncIO::INVALID_HANDLE;
+	const AsyncIO::Handle impostorFragmentRead = impostorsBaked ? asyncIO.Read("shaders/impostorfragment.spv") : AsyncIO::INVALID_HANDLE;
+	asyncIO.Submit();
+	LOG("Reading the shaders with %s", asyncIO.GetBackendName());
+	numMeshes = sizeof(SCENE_MESHES) / sizeof(SCENE_MESHES[0]);
+	importedMeshes = new Mesh[numMeshes]{};
+	OptimizeMesh::TrackAllocations();
+	importThread = std::thread(&ModuleVulkan::ImportScene, this);
+
 	VkApplicationInfo appInfo{};
 	appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
 	appInfo.pApplicationName = "Vulkan Meshlets";
@@ -45,16 +143,24 @@ bool ModuleVulkan::Init()
 	createInfo.pApplicationInfo = &appInfo;
 	Uint32 extensionCount = 0;
 	const char* const* extensions = SDL_Vulkan_GetInstanceExtensions(&extensionCount);
-	createInfo.enabledExtensionCount = extensionCount;
-	createInfo.ppEnabledExtensionNames = extensions;
-	if (!CheckVulkanExtensionsSupport(createInfo.ppEnabledExtensionNames, createInfo.enabledExtensionCount))
+	if (!CheckVulkanExtensionsSupport(extensions, extensionCount))
 	{
 		LOG("Error: All required extensions not present");
 		return false;
 	}
+	std::vector<const char*> instanceExtensions(extensions, extensions + extensionCount);
+	//Needed by VK_EXT_swapchain_maintenance1, the present fences tell when the semaphores of a retired swapchain are free
+	const char* surfaceMaintenanceExtensions[] = { VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME, VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME };
+	surfaceMaintenanceSupported = CheckVulkanExtensionsSupport(surfaceMaintenanceExtensions, 2);
+	for (unsigned int i = 0; surfaceMaintenanceSupported && i < 2; ++i)
+	{
+		if (std::find_if(instanceExtensions.begin(), instanceExtensions.end(), [&](const char* name) { return strcmp(name, surfaceMaintenanceExtensions[i]) == 0; }) == instanceExtensions.end())
+			instanceExtensions.push_back(surfaceMaintenanceExtensions[i]);
+	}
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(instanceExtensions.size());
+	createInfo.ppEnabledExtensionNames = instanceExtensions.data();
 
 #ifndef NDEBUG
-	const char** extensionsWithLayers = nullptr;
 	const char* validationLayers[] = { "VK_LAYER_KHRONOS_validation" };
 	if (CheckVulkanLayersSupport(validationLayers, sizeof(validationLayers) / sizeof(const char*)))
 	{
@@ -63,12 +169,9 @@ bool ModuleVulkan::Init()
 		createInfo.ppEnabledLayerNames = validationLayers;
 
 		//Add the message extension needed to output the validation layer errors
-		extensionsWithLayers = new const char* [extensionCount + 1];
-		for (int i = 0; i < extensionCount; ++i)
-			extensionsWithLayers[i] = extensions[i];
-		extensionsWithLayers[extensionCount] = VK_EXT_DEBUG_UTILS_EXTENSION_NAME;
-		createInfo.enabledExtensionCount = extensionCount + 1;
-		createInfo.ppEnabledExtensionNames = extensionsWithLayers;
+		instanceExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+		createInfo.enabledExtensionCount = static_cast<uint32_t>(instanceExtensions.size());
+		createInfo.ppEnabledExtensionNames = instanceExtensions.data();
 
 		//To callback my VulkanDebugCallback on the calls to vkCreateInstance and vkDestroyInstance
 		VkDebugUtilsMessengerCreateInfoEXT debugMsgCreateInfo;
@@ -95,7 +198,6 @@ bool ModuleVulkan::Init()
 #ifndef NDEBUG
 	if (layersEnabled)
 	{
-		delete[] extensionsWithLayers;
 		VkDebugUtilsMessengerCreateInfoEXT msgCreateInfo{};
 		msgCreateInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
 		msgCreateInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
@@ -122,6 +224,10 @@ bool ModuleVulkan::Init()
 	const char* requiredDeviceExtensions[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME, VK_EXT_MESH_SHADER_EXTENSION_NAME, VK_KHR_SPIRV_1_4_EXTENSION_NAME, VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME };
 	VkFormat depthFormats[] = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT };
 	VkPhysicalDeviceFeatures2 deviceFeatures{};
+	//The feature chain is passed to vkCreateDevice (every supported feature is enabled), it must outlive the loop
+	VkPhysicalDeviceMeshShaderFeaturesEXT meshShadingFeatures{};
+	VkPhysicalDeviceVulkan11Features onePointOneFeatures{};
+	VkPhysicalDeviceVulkan12Features onePointTwoFeatures{};
 	for (int physicalDeviceIndex = 0; physicalDeviceIndex < deviceCount; ++physicalDeviceIndex)
 	{
 		VkPhysicalDevice& device = physicalDevices[physicalDeviceIndex];
@@ -131,10 +237,13 @@ bool ModuleVulkan::Init()
 			continue;
 
 		//Mesh shader support
-		VkPhysicalDeviceMeshShaderFeaturesEXT meshShadingFeatures{};
+		meshShadingFeatures = {};
 		meshShadingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
-		VkPhysicalDeviceVulkan11Features onePointOneFeatures{};
-		onePointOneFeatures.pNext = &meshShadingFeatures;
+		onePointTwoFeatures = {};
+		onePointTwoFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		onePointTwoFeatures.pNext = &meshShadingFeatures;
+		onePointOneFeatures = {};
+		onePointOneFeatures.pNext = &onePointTwoFeatures;
 		onePointOneFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
 		deviceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
 		deviceFeatures.pNext = &onePointOneFeatures;
@@ -155,12 +264,23 @@ bool ModuleVulkan::Init()
 		deviceProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
 		deviceProperties.pNext = &meshShadingProperties;
 		vkGetPhysicalDeviceProperties2(device, &deviceProperties);
+		if (preferredDeviceName != nullptr && strstr(deviceProperties.properties.deviceName, preferredDeviceName) == nullptr)
+		{
+			LOG("PhysicalDevice %d (%s) skipped, it does not match the requested device %s", physicalDeviceIndex, deviceProperties.properties.deviceName, preferredDeviceName);
+			continue;
+		}
 		minStorageBufferOffsetAlignment = deviceProperties.properties.limits.minStorageBufferOffsetAlignment;
 		minUniformBufferOffsetAlignment = deviceProperties.properties.limits.minUniformBufferOffsetAlignment;
+		maxStorageBufferRange = deviceProperties.properties.limits.maxStorageBufferRange;
+		subPixelPrecisionBits = deviceProperties.properties.limits.subPixelPrecisionBits;
 		meshletMaxOutputVertices = meshShadingProperties.maxMeshOutputVertices;
 		meshletMaxOutputPrimitives = meshShadingProperties.maxMeshOutputPrimitives;
 		maxPreferredTaskWorkGroupInvocations = meshShadingProperties.maxPreferredTaskWorkGroupInvocations;
 		maxPreferredMeshWorkGroupInvocations = meshShadingProperties.maxPreferredMeshWorkGroupInvocations;
+		//The queries of a frame are written by the graphics and the compute queues, they are reset on the host once the frame fence is signaled
+		timestampsSupported = deviceProperties.properties.limits.timestampComputeAndGraphics == VK_TRUE && onePointTwoFeatures.hostQueryReset == VK_TRUE;
+		timestampPeriod = deviceProperties.properties.limits.timestampPeriod;
+		pipelineStatisticsSupported = deviceFeatures.features.pipelineStatisticsQuery == VK_TRUE;
 
 		//SwapChain Support
 		uint32_t formatCount;
@@ -186,9 +306,8 @@ bool ModuleVulkan::Init()
 		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevices[physicalDeviceIndex], &queueFamilyCount, queueFamilies);
 		graphicsQueueFamilyIndex = 0;
 		bool foundQueueFamily = false;
-		for (; physicalDeviceIndex < queueFamilyCount; ++graphicsQueueFamilyIndex)
+		for (; graphicsQueueFamilyIndex < static_cast<int>(queueFamilyCount); ++graphicsQueueFamilyIndex)
 		{
-			//TODO: compute queue aparte?
 			if (queueFamilies[graphicsQueueFamilyIndex].queueFlags & VK_QUEUE_GRAPHICS_BIT && queueFamilies[graphicsQueueFamilyIndex].queueFlags & VK_QUEUE_COMPUTE_BIT)
 			{
 				//TODO: the graphics and the present queues can be different!!
@@ -205,6 +324,17 @@ bool ModuleVulkan::Init()
 				}
 			}
 		}
+		//Async compute queue: a family without graphics, its queues run apart from the graphics work on most GPUs
+		computeQueueFamilyIndex = -1;
+		for (int i = 0; foundQueueFamily && i < static_cast<int>(queueFamilyCount); ++i)
+		{
+			if ((queueFamilies[i].queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+				&& (!timestampsSupported || queueFamilies[i].timestampValidBits != 0))
+			{
+				computeQueueFamilyIndex = i;
+				break;
+			}
+		}
 		delete[] queueFamilies;
 		if (foundQueueFamily)
 		{
@@ -218,6 +348,13 @@ bool ModuleVulkan::Init()
 		LOG("Error: no suitable physical device found");
 		return false;
 	}
+	//meshopt_buildMeshlets needs at least a triangle and a multiple of 4 primitives
+	const uint32_t maxMeshletOutputs = MAX_MESHLET_OUTPUTS;
+	meshletMaxVertices = std::max(3u, std::min(meshletMaxVertices, std::min(meshletMaxOutputVertices, maxMeshletOutputs)));
+	meshletMaxPrimitives = std::max(4u, std::min(meshletMaxPrimitives, std::min(meshletMaxOutputPrimitives, maxMeshletOutputs)) & ~3u);
+	//The mesh shader variant is known now, it is read while the swapchain and the render passes are created
+	const AsyncIO::Handle meshRead = ReadMeshShader(asyncIO, "mesh", meshletMaxVertices, meshletMaxPrimitives);
+	asyncIO.Submit();
 
 	vkCmdDrawMeshTasksEXT = (PFN_vkCmdDrawMeshTasksEXT)vkGetInstanceProcAddr(instance, "vkCmdDrawMeshTasksEXT");
 	vkCmdDrawMeshTasksIndirectEXT = (PFN_vkCmdDrawMeshTasksIndirectEXT)vkGetInstanceProcAddr(instance, "vkCmdDrawMeshTasksIndirectEXT");
@@ -228,20 +365,111 @@ bool ModuleVulkan::Init()
 		return false;
 	}
 
-	VkDeviceQueueCreateInfo queueCreateInfo{};
-	queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-	queueCreateInfo.queueFamilyIndex = graphicsQueueFamilyIndex;
-	queueCreateInfo.queueCount = 1;
+	asyncCompute = false;
+	if (asyncComputeRequested)
+	{
+		if (computeQueueFamilyIndex < 0)
+			LOG("Warning: the device has no compute only queue family, the cull runs on the graphics queue");
+		else if (onePointTwoFeatures.timelineSemaphore == VK_FALSE)
+			LOG("Warning: the device does not support timeline semaphores, the cull runs on the graphics queue");
+		else
+			asyncCompute = true;
+	}
+	VkDeviceQueueCreateInfo queueCreateInfos[2]{};
 	float queuePriority = 1.0f;
-	queueCreateInfo.pQueuePriorities = &queuePriority;
+	queueCreateInfos[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+	queueCreateInfos[0].queueFamilyIndex = graphicsQueueFamilyIndex;
+	queueCreateInfos[0].queueCount = 1;
+	queueCreateInfos[0].pQueuePriorities = &queuePriority;
+	queueCreateInfos[1].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+	queueCreateInfos[1].queueFamilyIndex = computeQueueFamilyIndex;
+	queueCreateInfos[1].queueCount = 1;
+	queueCreateInfos[1].pQueuePriorities = &queuePriority;
 	VkDeviceCreateInfo deviceCreateInfo{};
 	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-	deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
-	deviceCreateInfo.queueCreateInfoCount = 1;
-	deviceCreateInfo.enabledExtensionCount = sizeof(requiredDeviceExtensions)/sizeof(const char*);
-	deviceCreateInfo.ppEnabledExtensionNames = requiredDeviceExtensions;
+	deviceCreateInfo.pQueueCreateInfos = queueCreateInfos;
+	deviceCreateInfo.queueCreateInfoCount = asyncCompute ? 2 : 1;
+	//Optional extensions after the required ones
+	const unsigned int requiredExtensionCount = sizeof(requiredDeviceExtensions) / sizeof(const char*);
+	const char* deviceExtensions[requiredExtensionCount + 5];
+	memcpy(deviceExtensions, requiredDeviceExtensions, sizeof(requiredDeviceExtensions));
+	unsigned int deviceExtensionCount = requiredExtensionCount;
+	//The geometry streaming budget, the heap size is used without it
+	const char* memoryBudgetExtension[] = { VK_EXT_MEMORY_BUDGET_EXTENSION_NAME };
+	memoryBudgetSupported = CheckDeviceExtensionSupport(physicalDevice, memoryBudgetExtension, 1);
+	if (memoryBudgetSupported)
+		deviceExtensions[deviceExtensionCount++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+	deviceCreateInfo.enabledExtensionCount = deviceExtensionCount;
+	deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions;
 	deviceCreateInfo.pEnabledFeatures = nullptr;
 	deviceCreateInfo.pNext = &deviceFeatures;
+	//Frame pacing, the presents get an id and the CPU waits for the older ones to reach the display
+	const char* presentWaitExtensions[] = { VK_KHR_PRESENT_ID_EXTENSION_NAME, VK_KHR_PRESENT_WAIT_EXTENSION_NAME };
+	VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+	presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+	VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+	presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+	presentWaitSupported = CheckDeviceExtensionSupport(physicalDevice, presentWaitExtensions, 2);
+	if (presentWaitSupported)
+	{
+		VkPhysicalDeviceFeatures2 presentFeatures{};
+		presentFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		presentFeatures.pNext = &presentIdFeatures;
+		presentIdFeatures.pNext = &presentWaitFeatures;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &presentFeatures);
+		presentWaitSupported = presentIdFeatures.presentId == VK_TRUE && presentWaitFeatures.presentWait == VK_TRUE;
+	}
+	if (presentWaitSupported)
+	{
+		deviceExtensions[deviceExtensionCount++] = VK_KHR_PRESENT_ID_EXTENSION_NAME;
+		deviceExtensions[deviceExtensionCount++] = VK_KHR_PRESENT_WAIT_EXTENSION_NAME;
+		deviceCreateInfo.enabledExtensionCount = deviceExtensionCount;
+		presentWaitFeatures.pNext = &deviceFeatures;
+		deviceCreateInfo.pNext = &presentIdFeatures;
+	}
+	else
+		LOG("Warning: the device does not support VK_KHR_present_wait, the frame latency is not limited");
+	//The device time domain is the clock of vkCmdWriteTimestamp on every queue: with it the timestamps of the compute queue and of the graphics queue
+	//can be compared. Without it each queue only measures its own spans
+	const char* calibratedTimestampsExtension[] = { VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME };
+	calibratedTimestampsSupported = false;
+	if (timestampsSupported && CheckDeviceExtensionSupport(physicalDevice, calibratedTimestampsExtension, 1))
+	{
+		PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT getTimeDomains = (PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT");
+		uint32_t timeDomainCount = 0;
+		if (getTimeDomains != nullptr && getTimeDomains(physicalDevice, &timeDomainCount, nullptr) == VK_SUCCESS)
+		{
+			std::vector<VkTimeDomainEXT> timeDomains(timeDomainCount);
+			getTimeDomains(physicalDevice, &timeDomainCount, timeDomains.data());
+			timeDomains.resize(timeDomainCount);
+			calibratedTimestampsSupported = std::find(timeDomains.begin(), timeDomains.end(), VK_TIME_DOMAIN_DEVICE_EXT) != timeDomains.end();
+		}
+	}
+	if (calibratedTimestampsSupported)
+	{
+		deviceExtensions[deviceExtensionCount++] = VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME;
+		deviceCreateInfo.enabledExtensionCount = deviceExtensionCount;
+	}
+	//Present fences: signaled once the present waited its semaphore, without them a retired swapchain is kept until the new one acquired every image
+	const char* swapChainMaintenanceExtension[] = { VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME };
+	VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT swapChainMaintenanceFeatures{};
+	swapChainMaintenanceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT;
+	swapChainMaintenanceSupported = surfaceMaintenanceSupported && CheckDeviceExtensionSupport(physicalDevice, swapChainMaintenanceExtension, 1);
+	if (swapChainMaintenanceSupported)
+	{
+		VkPhysicalDeviceFeatures2 maintenanceFeatures{};
+		maintenanceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		maintenanceFeatures.pNext = &swapChainMaintenanceFeatures;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &maintenanceFeatures);
+		swapChainMaintenanceSupported = swapChainMaintenanceFeatures.swapchainMaintenance1 == VK_TRUE;
+	}
+	if (swapChainMaintenanceSupported)
+	{
+		deviceExtensions[deviceExtensionCount++] = VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME;
+		deviceCreateInfo.enabledExtensionCount = deviceExtensionCount;
+		swapChainMaintenanceFeatures.pNext = const_cast<void*>(deviceCreateInfo.pNext);
+		deviceCreateInfo.pNext = &swapChainMaintenanceFeatures;
+	}
 	if (vkCreateDevice(physicalDevice, &deviceCreateInfo, nullptr, &device) != VK_SUCCESS)
 	{
 		LOG("Error creating logical device");
@@ -249,6 +477,15 @@ bool ModuleVulkan::Init()
 	}
 	delete[] physicalDevices;
 	vkGetDeviceQueue(device, graphicsQueueFamilyIndex, 0, &graphicsQueue);
+	if (presentWaitSupported)
+		vkWaitForPresentKHR = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(device, "vkWaitForPresentKHR");
+	presentWaitSupported = vkWaitForPresentKHR != nullptr;
+	if (calibratedTimestampsSupported)
+		vkGetCalibratedTimestampsEXT = (PFN_vkGetCalibratedTimestampsEXT)vkGetDeviceProcAddr(device, "vkGetCalibratedTimestampsEXT");
+	calibratedTimestampsSupported = vkGetCalibratedTimestampsEXT != nullptr;
+	if (asyncCompute)
+		vkGetDeviceQueue(device, computeQueueFamilyIndex, 0, &computeQueue);
+	LOG("Culling on the %s queue", asyncCompute ? "async compute" : "graphics");
 
 	//Swapchain basics setup
 	uint32_t formatCount;
@@ -265,18 +502,35 @@ bool ModuleVulkan::Init()
 		}
 	}
 	delete[] formats;
+	//The visibility buffer path shades on a storage image and blits it to the swapchain
+	VkFormatProperties swapChainFormatProperties;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, swapChainSurfaceFormat.format, &swapChainFormatProperties);
+	visibilityBufferSupported = (swapChainFormatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT) != 0;
+	if (!visibilityBufferSupported)
+		LOG("Warning: the swapchain format can not be a blit destination, the visibility buffer path is disabled");
+	//The ids are written with 64 bit atomics by the fragment shader and SoftwareRaster.comp
+	else if (onePointTwoFeatures.shaderBufferInt64Atomics == VK_FALSE || deviceFeatures.features.shaderInt64 == VK_FALSE || deviceFeatures.features.fragmentStoresAndAtomics == VK_FALSE)
+	{
+		LOG("Warning: the device does not support 64 bit buffer atomics on the fragment shader, the visibility buffer path is disabled");
+		visibilityBufferSupported = false;
+	}
+	//The cascades are the views of a single render pass only when the mesh shaders can run on it (the feature chain enabled both)
+	multiViewSupported = onePointOneFeatures.multiview == VK_TRUE && meshShadingFeatures.multiviewMeshShader == VK_TRUE;
+	if (shadowCascades != 0 && !multiViewSupported)
+		LOG("Warning: the device does not support multiview mesh shaders, the shadow cascades are culled and drawn one by one");
+	//The mesh shaders snap the vertices like the rasterizer of the device, a finer precision does not fit their fixed point math
+	if (subPixelPrecisionBits > PrimitiveCulling::MAX_SUBPIXEL_BITS)
+		LOG("Warning: the device rasterizer has %u subpixel bits, the primitive culling is disabled", subPixelPrecisionBits);
 	uint32_t presentModeCount;
 	vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, nullptr);
 	VkPresentModeKHR* presentModes = new VkPresentModeKHR[presentModeCount];
 	vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, presentModes);
-	swapChainPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+	supportedPresentModes = 0;
 	for (int i = 0; i < presentModeCount; ++i)
 	{
-		if (presentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR)
-		{
-			swapChainPresentMode = presentModes[i];
-			break;
-		}
+		//the extension modes have large values and are never chosen
+		if (presentModes[i] < 32)
+			supportedPresentModes |= 1u << presentModes[i];
 	}
 	delete[] presentModes;
 
@@ -343,15 +597,124 @@ bool ModuleVulkan::Init()
 		return false;
 	}
 
+	//Visibility buffer render pass, depth only: the ids go to a storage buffer with atomics (synchronized on RecordCommandBuffer)
+	VkAttachmentReference visDepthAttachmentRef{};
+	visDepthAttachmentRef.attachment = 0;
+	visDepthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	subpass.colorAttachmentCount = 0;
+	subpass.pColorAttachments = nullptr;
+	subpass.pDepthStencilAttachment = &visDepthAttachmentRef;
+	renderPassInfo.attachmentCount = 1;
+	renderPassInfo.pAttachments = &attachments[1];
+	if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &visRenderPass) != VK_SUCCESS) {
+		LOG("Error creating the visibility buffer renderpass object");
+		return false;
+	}
+
+	//Shadow cascades, depth only and kept for the shading. The separate passes render a layer each, the multiview one every layer of the array
+	if (shadowCascades != 0)
+	{
+		static_assert(MAX_SHADOW_CASCADES == MultiView::MAX_VIEWS, "The shadow cascades are the views of the multi-view cull");
+		VkAttachmentDescription shadowAttachment = attachments[1];
+		shadowAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		renderPassInfo.pAttachments = &shadowAttachment;
+		if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &shadowRenderPass) != VK_SUCCESS)
+		{
+			LOG("Error creating the shadow renderpass object");
+			return false;
+		}
+		const uint32_t viewMask = (1u << shadowCascades) - 1;
+		VkRenderPassMultiviewCreateInfo multiViewInfo{};
+		multiViewInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO;
+		multiViewInfo.subpassCount = 1;
+		multiViewInfo.pViewMasks = &viewMask;
+		//The cascades see overlapping geometry, the implementation may render them concurrently
+		multiViewInfo.correlationMaskCount = 1;
+		multiViewInfo.pCorrelationMasks = &viewMask;
+		renderPassInfo.pNext = &multiViewInfo;
+		if (multiViewSupported && vkCreateRenderPass(device, &renderPassInfo, nullptr, &shadowMultiViewRenderPass) != VK_SUCCESS)
+		{
+			LOG("Error creating the multiview shadow renderpass object");
+			return false;
+		}
+		renderPassInfo.pNext = nullptr;
+
+		const uint32_t resolution = MultiView::DEFAULT_RESOLUTION;
+		if (!CreateImage(resolution, resolution, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, shadowImage, shadowImageMemory, shadowCascades))
+		{
+			LOG("Error creating the shadow cascades image");
+			return false;
+		}
+		VkImageViewCreateInfo shadowViewInfo{};
+		shadowViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		shadowViewInfo.image = shadowImage;
+		shadowViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+		shadowViewInfo.format = depthFormat;
+		shadowViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		shadowViewInfo.subresourceRange.baseMipLevel = 0;
+		shadowViewInfo.subresourceRange.levelCount = 1;
+		shadowViewInfo.subresourceRange.baseArrayLayer = 0;
+		shadowViewInfo.subresourceRange.layerCount = shadowCascades;
+		if (vkCreateImageView(device, &shadowViewInfo, nullptr, &shadowArrayView) != VK_SUCCESS)
+		{
+			LOG("Error creating the shadow cascades image view");
+			return false;
+		}
+		VkFramebufferCreateInfo shadowFramebufferInfo{};
+		shadowFramebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		shadowFramebufferInfo.attachmentCount = 1;
+		shadowFramebufferInfo.width = resolution;
+		shadowFramebufferInfo.height = resolution;
+		//With multiview the layers come from the view mask
+		shadowFramebufferInfo.layers = 1;
+		if (multiViewSupported)
+		{
+			shadowFramebufferInfo.renderPass = shadowMultiViewRenderPass;
+			shadowFramebufferInfo.pAttachments = &shadowArrayView;
+			if (vkCreateFramebuffer(device, &shadowFramebufferInfo, nullptr, &shadowMultiViewFramebuffer) != VK_SUCCESS)
+			{
+				LOG("Error creating the multiview shadow framebuffer");
+				return false;
+			}
+		}
+		shadowViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		shadowViewInfo.subresourceRange.layerCount = 1;
+		shadowFramebufferInfo.renderPass = shadowRenderPass;
+		for (uint32_t i = 0; i < shadowCascades; ++i)
+		{
+			shadowViewInfo.subresourceRange.baseArrayLayer = i;
+			shadowFramebufferInfo.pAttachments = &shadowLayerViews[i];
+			if (vkCreateImageView(device, &shadowViewInfo, nullptr, &shadowLayerViews[i]) != VK_SUCCESS ||
+				vkCreateFramebuffer(device, &shadowFramebufferInfo, nullptr, &shadowFramebuffers[i]) != VK_SUCCESS)
+			{
+				LOG("Error creating the shadow cascade %u framebuffer", i);
+				return false;
+			}
+		}
+	}
+
 	if (!CreateFrameBuffers())
 		return false;
 
 	char* taskSource = nullptr;
 	char* meshSource = nullptr;
 	char* fragmentSource = nullptr;
-	long taskSourceSize = FileSystem::ReadToBuffer("shaders/task.spv", taskSource, "rb");
-	long meshSourceSize = FileSystem::ReadToBuffer("shaders/mesh.spv", meshSource, "rb");
-	long fragmentSourceSize = FileSystem::ReadToBuffer("shaders/fragment.spv", fragmentSource, "rb");
+	long taskSourceSize = asyncIO.Wait(taskRead, taskSource);
+	long meshSourceSize = WaitMeshShader(asyncIO, meshRead, "mesh", meshletMaxVertices, meshletMaxPrimitives, meshSource);
+	if (meshSourceSize == 0)
+	{
+		//every device supports 256/256 (minimum of maxMeshOutputVertices and maxMeshOutputPrimitives)
+		LOG("Warning: there is no mesh shader variant for %u vertices and %u primitives (MESHLET_LIMITS cmake option), using 256/256", meshletMaxVertices, meshletMaxPrimitives);
+		meshletMaxVertices = 256;
+		meshletMaxPrimitives = 256;
+		meshSourceSize = WaitMeshShader(asyncIO, ReadMeshShader(asyncIO, "mesh", meshletMaxVertices, meshletMaxPrimitives), "mesh", meshletMaxVertices, meshletMaxPrimitives, meshSource);
+	}
+	//Read while the forward pipeline is created
+	const AsyncIO::Handle visMeshRead = ReadMeshShader(asyncIO, "vismesh", meshletMaxVertices, meshletMaxPrimitives);
+	const AsyncIO::Handle shadowMeshRead = shadowCascades != 0 ? ReadMeshShader(asyncIO, "shadowmesh", meshletMaxVertices, meshletMaxPrimitives) : AsyncIO::INVALID_HANDLE;
+	const AsyncIO::Handle shadowMultiViewMeshRead = shadowCascades != 0 && multiViewSupported ? ReadMeshShader(asyncIO, "shadowmvmesh", meshletMaxVertices, meshletMaxPrimitives) : AsyncIO::INVALID_HANDLE;
+	asyncIO.Submit();
+	long fragmentSourceSize = asyncIO.Wait(fragmentRead, fragmentSource);
 	if (!(meshSourceSize && fragmentSourceSize && taskSource))
 	{
 		LOG("Error loading the shaders from a file");
@@ -376,9 +739,9 @@ bool ModuleVulkan::Init()
 		LOG("Error crating the shader Modules");
 		return false;
 	}
-	delete[] taskSource;
-	delete[] meshSource;
-	delete[] fragmentSource;
+	asyncIO.Release(taskSource);
+	asyncIO.Release(meshSource);
+	asyncIO.Release(fragmentSource);
 
 	VkSpecializationMapEntry taskMapEntry{};
 	taskMapEntry.constantID = 1;
@@ -393,12 +756,7 @@ bool ModuleVulkan::Init()
 	meshMapEntry[0].constantID = 0;
 	meshMapEntry[0].offset = 0;
 	meshMapEntry[0].size = sizeof(maxPreferredMeshWorkGroupInvocations);
-	//meshMapEntry[1].constantID = 1;
-	//meshMapEntry[1].offset = 0;
-	//meshMapEntry[1].size = sizeof(meshletMaxOutputVertices);
-	//meshMapEntry[2].constantID = 2;
-	//meshMapEntry[2].offset = 0;
-	//meshMapEntry[2].size = sizeof(meshletMaxOutputPrimitives);
+	//The meshlet limits are not specialization constants, ReadMeshShader picks the variant built for them
 	uint32_t meshletData[] = { maxPreferredMeshWorkGroupInvocations, maxPreferredMeshWorkGroupInvocations, maxPreferredMeshWorkGroupInvocations };
 	VkSpecializationInfo meshSpecializationInfo{};
 	meshSpecializationInfo.dataSize = sizeof(maxPreferredMeshWorkGroupInvocations);
@@ -513,7 +871,7 @@ bool ModuleVulkan::Init()
 	depthStencil.front = {}; // Optional
 	depthStencil.back = {}; // Optional
 
-	VkDescriptorSetLayoutBinding layoutBindings[8]{};
+	VkDescriptorSetLayoutBinding layoutBindings[25]{};
 	layoutBindings[0].binding = 0;
 	layoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 	layoutBindings[0].descriptorCount = 1;
@@ -547,7 +905,7 @@ bool ModuleVulkan::Init()
 	layoutBindings[5].binding = 5;
 	layoutBindings[5].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 	layoutBindings[5].descriptorCount = 1;
-	layoutBindings[5].stageFlags = VK_SHADER_STAGE_MESH_BIT_EXT;
+	layoutBindings[5].stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
 	layoutBindings[5].pImmutableSamplers = nullptr; // Optional
 
 	layoutBindings[6].binding = 6;
@@ -562,6 +920,98 @@ bool ModuleVulkan::Init()
 	layoutBindings[7].stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT;
 	layoutBindings[7].pImmutableSamplers = nullptr; // Optional
 
+	//frustum planes, the task shader culls the meshlets. The visibility fragment shader needs the screen width
+	layoutBindings[8].binding = 8;
+	layoutBindings[8].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	layoutBindings[8].descriptorCount = 1;
+	layoutBindings[8].stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	layoutBindings[8].pImmutableSamplers = nullptr; // Optional
+
+	//culling statistics
+	layoutBindings[9].binding = 9;
+	layoutBindings[9].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	layoutBindings[9].descriptorCount = 1;
+	layoutBindings[9].stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+	layoutBindings[9].pImmutableSamplers = nullptr; // Optional
+
+	//mesh records, the task shader finds the meshlets of the record culling.comp picked for the instance
+	layoutBindings[10].binding = 11;
+	layoutBindings[10].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	layoutBindings[10].descriptorCount = 1;
+	layoutBindings[10].stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT;
+	layoutBindings[10].pImmutableSamplers = nullptr; // Optional
+
+	//visibility buffer path: 64 bit depth + id target, visible clusters, software raster clusters
+	layoutBindings[11].binding = 12;
+	layoutBindings[11].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	layoutBindings[11].descriptorCount = 1;
+	layoutBindings[11].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	layoutBindings[11].pImmutableSamplers = nullptr; // Optional
+
+	layoutBindings[12].binding = 13;
+	layoutBindings[12].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	layoutBindings[12].descriptorCount = 1;
+	layoutBindings[12].stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT;
+	layoutBindings[12].pImmutableSamplers = nullptr; // Optional
+
+	layoutBindings[13].binding = 14;
+	layoutBindings[13].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	layoutBindings[13].descriptorCount = 1;
+	layoutBindings[13].stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT;
+	layoutBindings[13].pImmutableSamplers = nullptr; // Optional
+	//page table + page feedback
+	layoutBindings[14].binding = 15;
+	layoutBindings[14].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	layoutBindings[14].descriptorCount = 1;
+	layoutBindings[14].stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT;
+	layoutBindings[14].pImmutableSamplers = nullptr; // Optional
+
+	layoutBindings[15].binding = 16;
+	layoutBindings[15].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	layoutBindings[15].descriptorCount = 1;
+	layoutBindings[15].stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT;
+	layoutBindings[15].pImmutableSamplers = nullptr; // Optional
+	//visibility cache entries + meshlet states
+	layoutBindings[16].binding = 17;
+	layoutBindings[16].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	layoutBindings[16].descriptorCount = 1;
+	layoutBindings[16].stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT;
+	layoutBindings[16].pImmutableSamplers = nullptr; // Optional
+
+	layoutBindings[17].binding = 18;
+	layoutBindings[17].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	layoutBindings[17].descriptorCount = 1;
+	layoutBindings[17].stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT;
+	layoutBindings[17].pImmutableSamplers = nullptr; // Optional
+	//impostor counts, draws and records read by Impostor.mesh, atlas read by Impostor.frag
+	for (uint32_t i = 18; i < 21; ++i)
+	{
+		layoutBindings[i].binding = i + 1;
+		layoutBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		layoutBindings[i].descriptorCount = 1;
+		layoutBindings[i].stageFlags = VK_SHADER_STAGE_MESH_BIT_EXT;
+		layoutBindings[i].pImmutableSamplers = nullptr; // Optional
+	}
+	layoutBindings[21].binding = 22;
+	layoutBindings[21].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	layoutBindings[21].descriptorCount = 1;
+	layoutBindings[21].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	layoutBindings[21].pImmutableSamplers = nullptr; // Optional
+	//clustered lights: grid parameters, lights and the light lists of the clusters built by ClusterLights.comp
+	layoutBindings[22].binding = 23;
+	layoutBindings[22].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	layoutBindings[22].descriptorCount = 1;
+	layoutBindings[22].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	layoutBindings[22].pImmutableSamplers = nullptr; // Optional
+	for (uint32_t i = 23; i < 25; ++i)
+	{
+		layoutBindings[i].binding = i + 1;
+		layoutBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		layoutBindings[i].descriptorCount = 1;
+		layoutBindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		layoutBindings[i].pImmutableSamplers = nullptr; // Optional
+	}
+
 	VkDescriptorSetLayoutCreateInfo layoutInfo{};
 	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 	layoutInfo.bindingCount = sizeof(layoutBindings) / sizeof(VkDescriptorSetLayoutBinding);
@@ -611,12 +1061,208 @@ bool ModuleVulkan::Init()
 		return false;
 	}
 	
-	vkDestroyShaderModule(device, taskModule, nullptr);
 	vkDestroyShaderModule(device, meshModule, nullptr);
 	vkDestroyShaderModule(device, fragmentModule, nullptr);
 
+	//Impostor pipeline, same layout and render pass as the forward one. Mesh and fragment shaders only, the quads are drawn from both sides
+	if (impostorsBaked)
+	{
+		char* impostorMeshSource = nullptr;
+		char* impostorFragmentSource = nullptr;
+		const long impostorMeshSourceSize = asyncIO.Wait(impostorMeshRead, impostorMeshSource);
+		const long impostorFragmentSourceSize = asyncIO.Wait(impostorFragmentRead, impostorFragmentSource);
+		if (!(impostorMeshSourceSize && impostorFragmentSourceSize))
+		{
+			LOG("Error loading the impostor shaders from a file");
+			return false;
+		}
+		shaderModuleCreateInfo.codeSize = impostorMeshSourceSize;
+		shaderModuleCreateInfo.pCode = reinterpret_cast<uint32_t*>(impostorMeshSource);
+		meshResult = vkCreateShaderModule(device, &shaderModuleCreateInfo, nullptr, &meshModule);
+		shaderModuleCreateInfo.codeSize = impostorFragmentSourceSize;
+		shaderModuleCreateInfo.pCode = reinterpret_cast<uint32_t*>(impostorFragmentSource);
+		fragmentResult = vkCreateShaderModule(device, &shaderModuleCreateInfo, nullptr, &fragmentModule);
+		asyncIO.Release(impostorMeshSource);
+		asyncIO.Release(impostorFragmentSource);
+		if (meshResult != VK_SUCCESS || fragmentResult != VK_SUCCESS)
+		{
+			LOG("Error crating the impostor shader Modules");
+			return false;
+		}
+		VkPipelineShaderStageCreateInfo impostorStagesInfo[2]{ shaderStagesInfo[1], shaderStagesInfo[2] };
+		impostorStagesInfo[0].module = meshModule;
+		impostorStagesInfo[0].pSpecializationInfo = nullptr;
+		impostorStagesInfo[1].module = fragmentModule;
+		VkPipelineRasterizationStateCreateInfo impostorRasterizer = rasterizer;
+		impostorRasterizer.cullMode = VK_CULL_MODE_NONE;
+		pipelineInfo.stageCount = sizeof(impostorStagesInfo) / sizeof(VkPipelineShaderStageCreateInfo);
+		pipelineInfo.pStages = impostorStagesInfo;
+		pipelineInfo.pRasterizationState = &impostorRasterizer;
+		const VkResult impostorResult = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &impostorPipeline);
+		pipelineInfo.stageCount = sizeof(shaderStagesInfo) / sizeof(VkPipelineShaderStageCreateInfo);
+		pipelineInfo.pStages = shaderStagesInfo;
+		pipelineInfo.pRasterizationState = &rasterizer;
+		vkDestroyShaderModule(device, meshModule, nullptr);
+		vkDestroyShaderModule(device, fragmentModule, nullptr);
+		if (impostorResult != VK_SUCCESS) {
+			LOG("Error creating the impostor pipeline");
+			return false;
+		}
+	}
+
+	//Visibility buffer pipeline, same task shader and layout with the id only mesh and fragment shaders
+	//Without 64 bit atomics the fragment shader can not be used
+	if (visibilityBufferSupported)
+	{
+		char* visMeshSource = nullptr;
+		char* visFragmentSource = nullptr;
+		long visMeshSourceSize = WaitMeshShader(asyncIO, visMeshRead, "vismesh", meshletMaxVertices, meshletMaxPrimitives, visMeshSource);
+		long visFragmentSourceSize = asyncIO.Wait(visFragmentRead, visFragmentSource);
+		if (!(visMeshSourceSize && visFragmentSourceSize))
+		{
+			LOG("Error loading the visibility buffer shaders from a file");
+			return false;
+		}
+		shaderModuleCreateInfo.codeSize = visMeshSourceSize;
+		shaderModuleCreateInfo.pCode = reinterpret_cast<uint32_t*>(visMeshSource);
+		meshResult = vkCreateShaderModule(device, &shaderModuleCreateInfo, nullptr, &meshModule);
+		shaderModuleCreateInfo.codeSize = visFragmentSourceSize;
+		shaderModuleCreateInfo.pCode = reinterpret_cast<uint32_t*>(visFragmentSource);
+		fragmentResult = vkCreateShaderModule(device, &shaderModuleCreateInfo, nullptr, &fragmentModule);
+		asyncIO.Release(visMeshSource);
+		asyncIO.Release(visFragmentSource);
+		if (meshResult != VK_SUCCESS || fragmentResult != VK_SUCCESS)
+		{
+			LOG("Error crating the visibility buffer shader Modules");
+			return false;
+		}
+		//The task shader also fills the visible cluster list and picks the software rasterizer (VISIBILITY_PATH)
+		VkSpecializationMapEntry visTaskMapEntries[2]{ taskMapEntry };
+		visTaskMapEntries[1].constantID = 2;
+		visTaskMapEntries[1].offset = sizeof(uint32_t);
+		visTaskMapEntries[1].size = sizeof(VkBool32);
+		const uint32_t visTaskData[] = { maxPreferredTaskWorkGroupInvocations, VK_TRUE };
+		VkSpecializationInfo visTaskSpecializationInfo{};
+		visTaskSpecializationInfo.dataSize = sizeof(visTaskData);
+		visTaskSpecializationInfo.pData = visTaskData;
+		visTaskSpecializationInfo.mapEntryCount = sizeof(visTaskMapEntries) / sizeof(VkSpecializationMapEntry);
+		visTaskSpecializationInfo.pMapEntries = visTaskMapEntries;
+		shaderStagesInfo[0].pSpecializationInfo = &visTaskSpecializationInfo;
+		shaderStagesInfo[1].module = meshModule;
+		shaderStagesInfo[2].module = fragmentModule;
+		//no color targets
+		colorBlending.attachmentCount = 0;
+		pipelineInfo.renderPass = visRenderPass;
+		if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &visPipeline) != VK_SUCCESS) {
+			LOG("Error creating the visibility buffer pipeline");
+			return false;
+		}
+		vkDestroyShaderModule(device, meshModule, nullptr);
+		vkDestroyShaderModule(device, fragmentModule, nullptr);
+	}
+	vkDestroyShaderModule(device, taskModule, nullptr);
+
+	//Shadow cascade pipelines: Shadow.task culls the meshlets against the views of the draw, the depth only mesh shader has a multiview variant
+	//meshlets, meshlet vertices, meshlet triangles, vertices, shadow views, model matrices, shadow draws, cull infos, mesh records, page table, page feedback
+	VkDescriptorSetLayout shadowSetLayout = VK_NULL_HANDLE;
+	if (shadowCascades != 0)
+	{
+		char* shadowTaskSource = nullptr;
+		char* shadowMeshSource = nullptr;
+		char* shadowMultiViewMeshSource = nullptr;
+		const long shadowTaskSourceSize = asyncIO.Wait(shadowTaskRead, shadowTaskSource);
+		const long shadowMeshSourceSize = WaitMeshShader(asyncIO, shadowMeshRead, "shadowmesh", meshletMaxVertices, meshletMaxPrimitives, shadowMeshSource);
+		const long shadowMultiViewMeshSourceSize = multiViewSupported ? WaitMeshShader(asyncIO, shadowMultiViewMeshRead, "shadowmvmesh", meshletMaxVertices, meshletMaxPrimitives, shadowMultiViewMeshSource) : 0;
+		if (!(shadowTaskSourceSize && shadowMeshSourceSize && (shadowMultiViewMeshSourceSize || !multiViewSupported)))
+		{
+			LOG("Error loading the shadow shaders from a file");
+			return false;
+		}
+		VkShaderModule shadowMultiViewMeshModule = VK_NULL_HANDLE;
+		shaderModuleCreateInfo.codeSize = shadowTaskSourceSize;
+		shaderModuleCreateInfo.pCode = reinterpret_cast<uint32_t*>(shadowTaskSource);
+		taskResult = vkCreateShaderModule(device, &shaderModuleCreateInfo, nullptr, &taskModule);
+		shaderModuleCreateInfo.codeSize = shadowMeshSourceSize;
+		shaderModuleCreateInfo.pCode = reinterpret_cast<uint32_t*>(shadowMeshSource);
+		meshResult = vkCreateShaderModule(device, &shaderModuleCreateInfo, nullptr, &meshModule);
+		if (multiViewSupported)
+		{
+			shaderModuleCreateInfo.codeSize = shadowMultiViewMeshSourceSize;
+			shaderModuleCreateInfo.pCode = reinterpret_cast<uint32_t*>(shadowMultiViewMeshSource);
+			if (vkCreateShaderModule(device, &shaderModuleCreateInfo, nullptr, &shadowMultiViewMeshModule) != VK_SUCCESS)
+				meshResult = VK_ERROR_INITIALIZATION_FAILED;
+			asyncIO.Release(shadowMultiViewMeshSource);
+		}
+		asyncIO.Release(shadowTaskSource);
+		asyncIO.Release(shadowMeshSource);
+		if (taskResult != VK_SUCCESS || meshResult != VK_SUCCESS)
+		{
+			LOG("Error crating the shadow shader Modules");
+			return false;
+		}
+		VkDescriptorSetLayoutBinding shadowSetLayoutBindings[11]{};
+		for (uint32_t i = 0; i < 11; ++i)
+		{
+			shadowSetLayoutBindings[i].binding = i;
+			shadowSetLayoutBindings[i].descriptorCount = 1;
+			shadowSetLayoutBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			shadowSetLayoutBindings[i].stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+		}
+		shadowSetLayoutBindings[4].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		VkDescriptorSetLayoutCreateInfo shadowSetLayoutInfo{};
+		shadowSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		shadowSetLayoutInfo.bindingCount = sizeof(shadowSetLayoutBindings) / sizeof(VkDescriptorSetLayoutBinding);
+		shadowSetLayoutInfo.pBindings = shadowSetLayoutBindings;
+		vkCreateDescriptorSetLayout(device, &shadowSetLayoutInfo, nullptr, &shadowSetLayout);
+		//view base, view count, partition
+		VkPushConstantRange shadowPushConstantRange{};
+		shadowPushConstantRange.stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+		shadowPushConstantRange.offset = 0;
+		shadowPushConstantRange.size = sizeof(uint32_t) * 3;
+		VkPipelineLayoutCreateInfo shadowPipelineLayoutInfo{};
+		shadowPipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		shadowPipelineLayoutInfo.setLayoutCount = 1;
+		shadowPipelineLayoutInfo.pSetLayouts = &shadowSetLayout;
+		shadowPipelineLayoutInfo.pushConstantRangeCount = 1;
+		shadowPipelineLayoutInfo.pPushConstantRanges = &shadowPushConstantRange;
+		vkCreatePipelineLayout(device, &shadowPipelineLayoutInfo, nullptr, &shadowPipelineLayout);
+		//No back face culling, the light also sees the back of the casters. The bias keeps the lit surfaces from shadowing themselves
+		VkPipelineRasterizationStateCreateInfo shadowRasterizer = rasterizer;
+		shadowRasterizer.cullMode = VK_CULL_MODE_NONE;
+		shadowRasterizer.depthBiasEnable = VK_TRUE;
+		shadowRasterizer.depthBiasConstantFactor = SHADOW_DEPTH_BIAS_CONSTANT;
+		shadowRasterizer.depthBiasSlopeFactor = SHADOW_DEPTH_BIAS_SLOPE;
+		shaderStagesInfo[0].module = taskModule;
+		shaderStagesInfo[0].pSpecializationInfo = &taskSpecializationInfo;
+		shaderStagesInfo[1].module = meshModule;
+		colorBlending.attachmentCount = 0;
+		//task + mesh, no fragment shader
+		pipelineInfo.stageCount = 2;
+		pipelineInfo.pRasterizationState = &shadowRasterizer;
+		pipelineInfo.layout = shadowPipelineLayout;
+		pipelineInfo.renderPass = shadowRenderPass;
+		if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &shadowPipeline) != VK_SUCCESS)
+		{
+			LOG("Error creating the shadow pipeline");
+			return false;
+		}
+		if (multiViewSupported)
+		{
+			shaderStagesInfo[1].module = shadowMultiViewMeshModule;
+			pipelineInfo.renderPass = shadowMultiViewRenderPass;
+			if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &shadowMultiViewPipeline) != VK_SUCCESS)
+			{
+				LOG("Error creating the multiview shadow pipeline");
+				return false;
+			}
+			vkDestroyShaderModule(device, shadowMultiViewMeshModule, nullptr);
+		}
+		vkDestroyShaderModule(device, taskModule, nullptr);
+		vkDestroyShaderModule(device, meshModule, nullptr);
+	}
+
 	char* cullSource = nullptr;
-	long cullSourceSize = FileSystem::ReadToBuffer("shaders/cull.spv", cullSource, "rb");
+	long cullSourceSize = asyncIO.Wait(cullRead, cullSource);
 	if (cullSourceSize == 0)
 	{
 		LOG("Error loading the shaders from a file");
@@ -638,7 +1284,7 @@ bool ModuleVulkan::Init()
 	cullStageInfo.module = cullModule;
 	cullStageInfo.pName = "main";
 
-	VkDescriptorSetLayoutBinding cullDescriptorSetLayoutBindings[7]{};
+	VkDescriptorSetLayoutBinding cullDescriptorSetLayoutBindings[26]{};
 	cullDescriptorSetLayoutBindings[0].binding = 0;
 	cullDescriptorSetLayoutBindings[0].descriptorCount = 1;
 	cullDescriptorSetLayoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
@@ -667,6 +1313,57 @@ bool ModuleVulkan::Init()
 	cullDescriptorSetLayoutBindings[6].descriptorCount = 1;
 	cullDescriptorSetLayoutBindings[6].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 	cullDescriptorSetLayoutBindings[6].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	cullDescriptorSetLayoutBindings[7].binding = 7;
+	cullDescriptorSetLayoutBindings[7].descriptorCount = 1;
+	cullDescriptorSetLayoutBindings[7].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	cullDescriptorSetLayoutBindings[7].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	cullDescriptorSetLayoutBindings[8].binding = 8;
+	cullDescriptorSetLayoutBindings[8].descriptorCount = 1;
+	cullDescriptorSetLayoutBindings[8].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	cullDescriptorSetLayoutBindings[8].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	//record residency, page table, page feedback
+	cullDescriptorSetLayoutBindings[9].binding = 9;
+	cullDescriptorSetLayoutBindings[9].descriptorCount = 1;
+	cullDescriptorSetLayoutBindings[9].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	cullDescriptorSetLayoutBindings[9].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	cullDescriptorSetLayoutBindings[10].binding = 10;
+	cullDescriptorSetLayoutBindings[10].descriptorCount = 1;
+	cullDescriptorSetLayoutBindings[10].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	cullDescriptorSetLayoutBindings[10].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	cullDescriptorSetLayoutBindings[11].binding = 11;
+	cullDescriptorSetLayoutBindings[11].descriptorCount = 1;
+	cullDescriptorSetLayoutBindings[11].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	cullDescriptorSetLayoutBindings[11].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	//occluded instance bits of the CPU occlusion culling
+	cullDescriptorSetLayoutBindings[12].binding = 12;
+	cullDescriptorSetLayoutBindings[12].descriptorCount = 1;
+	cullDescriptorSetLayoutBindings[12].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	cullDescriptorSetLayoutBindings[12].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	//depth sort keys and values
+	cullDescriptorSetLayoutBindings[13].binding = 13;
+	cullDescriptorSetLayoutBindings[13].descriptorCount = 1;
+	cullDescriptorSetLayoutBindings[13].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	cullDescriptorSetLayoutBindings[13].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	cullDescriptorSetLayoutBindings[14].binding = 14;
+	cullDescriptorSetLayoutBindings[14].descriptorCount = 1;
+	cullDescriptorSetLayoutBindings[14].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	cullDescriptorSetLayoutBindings[14].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	//visibility cache entries, meshlet states, invalid slot bits, instance motions and meshlet culling info, impostor counts, draws and records
+	for (uint32_t i = 15; i < 23; ++i)
+	{
+		cullDescriptorSetLayoutBindings[i].binding = i;
+		cullDescriptorSetLayoutBindings[i].descriptorCount = 1;
+		cullDescriptorSetLayoutBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		cullDescriptorSetLayoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	//cluster grid parameters, lights and cluster grid of ClusterLights.comp, same set and layout as the cull
+	for (uint32_t i = 23; i < 26; ++i)
+	{
+		cullDescriptorSetLayoutBindings[i].binding = i;
+		cullDescriptorSetLayoutBindings[i].descriptorCount = 1;
+		cullDescriptorSetLayoutBindings[i].descriptorType = i == 23 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		cullDescriptorSetLayoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
 	VkDescriptorSetLayoutCreateInfo cullDescriptorSetLayoutInfo{};
 	cullDescriptorSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 	cullDescriptorSetLayoutInfo.bindingCount = sizeof(cullDescriptorSetLayoutBindings) / sizeof(VkDescriptorSetLayoutBinding);
@@ -690,7 +1387,311 @@ bool ModuleVulkan::Init()
 		return false;
 	}
 	vkDestroyShaderModule(device, cullModule, nullptr);
-	delete[] cullSource;
+	asyncIO.Release(cullSource);
+
+	char* clusterLightsSource = nullptr;
+	long clusterLightsSourceSize = asyncIO.Wait(clusterLightsRead, clusterLightsSource);
+	if (clusterLightsSourceSize == 0)
+	{
+		LOG("Error loading the light binning shader from a file");
+		return false;
+	}
+	VkShaderModuleCreateInfo clusterLightsModuleCreateInfo{};
+	clusterLightsModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	clusterLightsModuleCreateInfo.codeSize = clusterLightsSourceSize;
+	clusterLightsModuleCreateInfo.pCode = reinterpret_cast<uint32_t*>(clusterLightsSource);
+	VkShaderModule clusterLightsModule;
+	if (vkCreateShaderModule(device, &clusterLightsModuleCreateInfo, nullptr, &clusterLightsModule) != VK_SUCCESS)
+	{
+		LOG("Error loading the light binning shader module");
+		return false;
+	}
+	asyncIO.Release(clusterLightsSource);
+	computePipelineInfo.stage.module = clusterLightsModule;
+	if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &computePipelineInfo, nullptr, &clusterLightsPipeline) != VK_SUCCESS)
+	{
+		LOG("Error creating the light binning pipeline");
+		return false;
+	}
+	vkDestroyShaderModule(device, clusterLightsModule, nullptr);
+
+	char* instanceSimSource = nullptr;
+	long instanceSimSourceSize = asyncIO.Wait(instanceSimRead, instanceSimSource);
+	if (instanceSimSourceSize == 0)
+	{
+		LOG("Error loading the instance simulation shader from a file");
+		return false;
+	}
+	VkShaderModuleCreateInfo instanceSimModuleCreateInfo{};
+	instanceSimModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	instanceSimModuleCreateInfo.codeSize = instanceSimSourceSize;
+	instanceSimModuleCreateInfo.pCode = reinterpret_cast<uint32_t*>(instanceSimSource);
+	VkShaderModule instanceSimModule;
+	if (vkCreateShaderModule(device, &instanceSimModuleCreateInfo, nullptr, &instanceSimModule) != VK_SUCCESS)
+	{
+		LOG("Error loading the instance simulation shader module");
+		return false;
+	}
+	asyncIO.Release(instanceSimSource);
+	//frustum ubo (instance count + simulation time), motions, keyframes, model matrices
+	VkDescriptorSetLayoutBinding instanceSimSetLayoutBindings[4]{};
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		instanceSimSetLayoutBindings[i].binding = i;
+		instanceSimSetLayoutBindings[i].descriptorCount = 1;
+		instanceSimSetLayoutBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		instanceSimSetLayoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	instanceSimSetLayoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	VkDescriptorSetLayoutCreateInfo instanceSimSetLayoutInfo{};
+	instanceSimSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	instanceSimSetLayoutInfo.bindingCount = sizeof(instanceSimSetLayoutBindings) / sizeof(VkDescriptorSetLayoutBinding);
+	instanceSimSetLayoutInfo.pBindings = instanceSimSetLayoutBindings;
+	VkDescriptorSetLayout instanceSimSetLayout;
+	vkCreateDescriptorSetLayout(device, &instanceSimSetLayoutInfo, nullptr, &instanceSimSetLayout);
+	VkPipelineLayoutCreateInfo instanceSimPipelineLayoutInfo{};
+	instanceSimPipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	instanceSimPipelineLayoutInfo.setLayoutCount = 1;
+	instanceSimPipelineLayoutInfo.pSetLayouts = &instanceSimSetLayout;
+	vkCreatePipelineLayout(device, &instanceSimPipelineLayoutInfo, nullptr, &instanceSimPipelineLayout);
+	computePipelineInfo.layout = instanceSimPipelineLayout;
+	computePipelineInfo.stage.module = instanceSimModule;
+	if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &computePipelineInfo, nullptr, &instanceSimPipeline) != VK_SUCCESS)
+	{
+		LOG("Error creating the instance simulation pipeline");
+		return false;
+	}
+	vkDestroyShaderModule(device, instanceSimModule, nullptr);
+
+	char* radixSortSource = nullptr;
+	long radixSortSourceSize = asyncIO.Wait(radixSortRead, radixSortSource);
+	if (radixSortSourceSize == 0)
+	{
+		LOG("Error loading the radix sort shader from a file");
+		return false;
+	}
+	VkShaderModuleCreateInfo radixSortModuleCreateInfo{};
+	radixSortModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	radixSortModuleCreateInfo.codeSize = radixSortSourceSize;
+	radixSortModuleCreateInfo.pCode = reinterpret_cast<uint32_t*>(radixSortSource);
+	VkShaderModule radixSortModule;
+	if (vkCreateShaderModule(device, &radixSortModuleCreateInfo, nullptr, &radixSortModule) != VK_SUCCESS)
+	{
+		LOG("Error loading the radix sort shader module");
+		return false;
+	}
+	asyncIO.Release(radixSortSource);
+	//sort count, keys, values, block counts, mesh records, indirect commands, model ids
+	VkDescriptorSetLayoutBinding sortSetLayoutBindings[7]{};
+	for (uint32_t i = 0; i < 7; ++i)
+	{
+		sortSetLayoutBindings[i].binding = i;
+		sortSetLayoutBindings[i].descriptorCount = 1;
+		sortSetLayoutBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		sortSetLayoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	VkDescriptorSetLayoutCreateInfo sortSetLayoutInfo{};
+	sortSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	sortSetLayoutInfo.bindingCount = sizeof(sortSetLayoutBindings) / sizeof(VkDescriptorSetLayoutBinding);
+	sortSetLayoutInfo.pBindings = sortSetLayoutBindings;
+	VkDescriptorSetLayout sortSetLayout;
+	vkCreateDescriptorSetLayout(device, &sortSetLayoutInfo, nullptr, &sortSetLayout);
+	//pass, block count, capacity of a half
+	VkPushConstantRange sortPushConstantRange{};
+	sortPushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	sortPushConstantRange.offset = 0;
+	sortPushConstantRange.size = sizeof(uint32_t) * 3;
+	VkPipelineLayoutCreateInfo sortPipelineLayoutInfo{};
+	sortPipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	sortPipelineLayoutInfo.setLayoutCount = 1;
+	sortPipelineLayoutInfo.pSetLayouts = &sortSetLayout;
+	sortPipelineLayoutInfo.pushConstantRangeCount = 1;
+	sortPipelineLayoutInfo.pPushConstantRanges = &sortPushConstantRange;
+	vkCreatePipelineLayout(device, &sortPipelineLayoutInfo, nullptr, &sortPipelineLayout);
+	computePipelineInfo.layout = sortPipelineLayout;
+	computePipelineInfo.stage.module = radixSortModule;
+	//STAGE specialization constant: histogram, scan, scatter
+	VkSpecializationMapEntry sortMapEntry{};
+	sortMapEntry.constantID = 0;
+	sortMapEntry.offset = 0;
+	sortMapEntry.size = sizeof(uint32_t);
+	for (uint32_t stage = 0; stage < 3; ++stage)
+	{
+		VkSpecializationInfo sortSpecializationInfo{};
+		sortSpecializationInfo.dataSize = sizeof(stage);
+		sortSpecializationInfo.pData = &stage;
+		sortSpecializationInfo.mapEntryCount = 1;
+		sortSpecializationInfo.pMapEntries = &sortMapEntry;
+		computePipelineInfo.stage.pSpecializationInfo = &sortSpecializationInfo;
+		if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &computePipelineInfo, nullptr, &sortPipelines[stage]) != VK_SUCCESS)
+		{
+			LOG("Error creating the radix sort pipelines");
+			return false;
+		}
+	}
+	computePipelineInfo.stage.pSpecializationInfo = nullptr;
+	vkDestroyShaderModule(device, radixSortModule, nullptr);
+
+	char* visShadeSource = nullptr;
+	long visShadeSourceSize = asyncIO.Wait(visShadeRead, visShadeSource);
+	if (visShadeSourceSize == 0)
+	{
+		LOG("Error loading the shaders from a file");
+		return false;
+	}
+	VkShaderModuleCreateInfo visShadeModuleCreateInfo{};
+	visShadeModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	visShadeModuleCreateInfo.codeSize = visShadeSourceSize;
+	visShadeModuleCreateInfo.pCode = reinterpret_cast<uint32_t*>(visShadeSource);
+	VkShaderModule visShadeModule;
+	if (vkCreateShaderModule(device, &visShadeModuleCreateInfo, nullptr, &visShadeModule) != VK_SUCCESS)
+	{
+		LOG("Error loading the visibility buffer shade shader module");
+		return false;
+	}
+	asyncIO.Release(visShadeSource);
+	//visibility buffer, shaded output, camera, meshlets, meshlet vertices, meshlet triangles, vertices, model matrices, visible clusters, cluster grid
+	//parameters, lights, cluster grid
+	VkDescriptorSetLayoutBinding visShadeSetLayoutBindings[12]{};
+	for (uint32_t i = 0; i < 12; ++i)
+	{
+		visShadeSetLayoutBindings[i].binding = i;
+		visShadeSetLayoutBindings[i].descriptorCount = 1;
+		visShadeSetLayoutBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		visShadeSetLayoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	visShadeSetLayoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	visShadeSetLayoutBindings[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	visShadeSetLayoutBindings[9].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	VkDescriptorSetLayoutCreateInfo visShadeSetLayoutInfo{};
+	visShadeSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	visShadeSetLayoutInfo.bindingCount = sizeof(visShadeSetLayoutBindings) / sizeof(VkDescriptorSetLayoutBinding);
+	visShadeSetLayoutInfo.pBindings = visShadeSetLayoutBindings;
+	VkDescriptorSetLayout visShadeSetLayout;
+	vkCreateDescriptorSetLayout(device, &visShadeSetLayoutInfo, nullptr, &visShadeSetLayout);
+	VkPipelineLayoutCreateInfo visShadePipelineLayoutInfo{};
+	visShadePipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	visShadePipelineLayoutInfo.setLayoutCount = 1;
+	visShadePipelineLayoutInfo.pSetLayouts = &visShadeSetLayout;
+	vkCreatePipelineLayout(device, &visShadePipelineLayoutInfo, nullptr, &visShadePipelineLayout);
+	computePipelineInfo.layout = visShadePipelineLayout;
+	computePipelineInfo.stage.module = visShadeModule;
+	if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &computePipelineInfo, nullptr, &visShadePipeline) != VK_SUCCESS)
+	{
+		LOG("Error creating the visibility buffer shade pipeline");
+		return false;
+	}
+	vkDestroyShaderModule(device, visShadeModule, nullptr);
+
+	//camera, frustum ubo (screen size), meshlets, meshlet vertices, meshlet triangles, vertices, model matrices, visible clusters, software clusters, visibility buffer
+	VkDescriptorSetLayoutBinding swRasterSetLayoutBindings[10]{};
+	for (uint32_t i = 0; i < 10; ++i)
+	{
+		swRasterSetLayoutBindings[i].binding = i;
+		swRasterSetLayoutBindings[i].descriptorCount = 1;
+		swRasterSetLayoutBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		swRasterSetLayoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	swRasterSetLayoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	swRasterSetLayoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	VkDescriptorSetLayoutCreateInfo swRasterSetLayoutInfo{};
+	swRasterSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	swRasterSetLayoutInfo.bindingCount = sizeof(swRasterSetLayoutBindings) / sizeof(VkDescriptorSetLayoutBinding);
+	swRasterSetLayoutInfo.pBindings = swRasterSetLayoutBindings;
+	VkDescriptorSetLayout swRasterSetLayout;
+	vkCreateDescriptorSetLayout(device, &swRasterSetLayoutInfo, nullptr, &swRasterSetLayout);
+	VkPipelineLayoutCreateInfo swRasterPipelineLayoutInfo{};
+	swRasterPipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	swRasterPipelineLayoutInfo.setLayoutCount = 1;
+	swRasterPipelineLayoutInfo.pSetLayouts = &swRasterSetLayout;
+	vkCreatePipelineLayout(device, &swRasterPipelineLayoutInfo, nullptr, &swRasterPipelineLayout);
+	if (visibilityBufferSupported)
+	{
+		char* swRasterSource = nullptr;
+		long swRasterSourceSize = asyncIO.Wait(swRasterRead, swRasterSource);
+		if (swRasterSourceSize == 0)
+		{
+			LOG("Error loading the software raster shader from a file");
+			return false;
+		}
+		VkShaderModuleCreateInfo swRasterModuleCreateInfo{};
+		swRasterModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		swRasterModuleCreateInfo.codeSize = swRasterSourceSize;
+		swRasterModuleCreateInfo.pCode = reinterpret_cast<uint32_t*>(swRasterSource);
+		VkShaderModule swRasterModule;
+		if (vkCreateShaderModule(device, &swRasterModuleCreateInfo, nullptr, &swRasterModule) != VK_SUCCESS)
+		{
+			LOG("Error loading the software raster shader module");
+			return false;
+		}
+		asyncIO.Release(swRasterSource);
+		computePipelineInfo.layout = swRasterPipelineLayout;
+		computePipelineInfo.stage.module = swRasterModule;
+		if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &computePipelineInfo, nullptr, &swRasterPipeline) != VK_SUCCESS)
+		{
+			LOG("Error creating the software raster pipeline");
+			return false;
+		}
+		vkDestroyShaderModule(device, swRasterModule, nullptr);
+	}
+
+	//shadow views, instance meshes, OBBs, model matrices, mesh records, record residency, shadow commands, shadow draws, shadow draw counts
+	VkDescriptorSetLayout shadowCullSetLayout = VK_NULL_HANDLE;
+	if (shadowCascades != 0)
+	{
+		char* shadowCullSource = nullptr;
+		long shadowCullSourceSize = asyncIO.Wait(shadowCullRead, shadowCullSource);
+		if (shadowCullSourceSize == 0)
+		{
+			LOG("Error loading the shadow cull shader from a file");
+			return false;
+		}
+		VkShaderModuleCreateInfo shadowCullModuleCreateInfo{};
+		shadowCullModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		shadowCullModuleCreateInfo.codeSize = shadowCullSourceSize;
+		shadowCullModuleCreateInfo.pCode = reinterpret_cast<uint32_t*>(shadowCullSource);
+		VkShaderModule shadowCullModule;
+		if (vkCreateShaderModule(device, &shadowCullModuleCreateInfo, nullptr, &shadowCullModule) != VK_SUCCESS)
+		{
+			LOG("Error loading the shadow cull shader module");
+			return false;
+		}
+		asyncIO.Release(shadowCullSource);
+		VkDescriptorSetLayoutBinding shadowCullSetLayoutBindings[9]{};
+		for (uint32_t i = 0; i < 9; ++i)
+		{
+			shadowCullSetLayoutBindings[i].binding = i;
+			shadowCullSetLayoutBindings[i].descriptorCount = 1;
+			shadowCullSetLayoutBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			shadowCullSetLayoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+		shadowCullSetLayoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		VkDescriptorSetLayoutCreateInfo shadowCullSetLayoutInfo{};
+		shadowCullSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		shadowCullSetLayoutInfo.bindingCount = sizeof(shadowCullSetLayoutBindings) / sizeof(VkDescriptorSetLayoutBinding);
+		shadowCullSetLayoutInfo.pBindings = shadowCullSetLayoutBindings;
+		vkCreateDescriptorSetLayout(device, &shadowCullSetLayoutInfo, nullptr, &shadowCullSetLayout);
+		//view base, view count, partition, slot count
+		VkPushConstantRange shadowCullPushConstantRange{};
+		shadowCullPushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		shadowCullPushConstantRange.offset = 0;
+		shadowCullPushConstantRange.size = sizeof(uint32_t) * 4;
+		VkPipelineLayoutCreateInfo shadowCullPipelineLayoutInfo{};
+		shadowCullPipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		shadowCullPipelineLayoutInfo.setLayoutCount = 1;
+		shadowCullPipelineLayoutInfo.pSetLayouts = &shadowCullSetLayout;
+		shadowCullPipelineLayoutInfo.pushConstantRangeCount = 1;
+		shadowCullPipelineLayoutInfo.pPushConstantRanges = &shadowCullPushConstantRange;
+		vkCreatePipelineLayout(device, &shadowCullPipelineLayoutInfo, nullptr, &shadowCullPipelineLayout);
+		computePipelineInfo.layout = shadowCullPipelineLayout;
+		computePipelineInfo.stage.module = shadowCullModule;
+		if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &computePipelineInfo, nullptr, &shadowCullPipeline) != VK_SUCCESS)
+		{
+			LOG("Error creating the shadow cull pipeline");
+			return false;
+		}
+		vkDestroyShaderModule(device, shadowCullModule, nullptr);
+	}
 
 	VkCommandPoolCreateInfo poolInfo{};
 	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -710,7 +1711,59 @@ bool ModuleVulkan::Init()
 		LOG("failed to allocate command buffers!");
 		return false;
 	}
+	if (asyncCompute)
+	{
+		poolInfo.queueFamilyIndex = computeQueueFamilyIndex;
+		if (vkCreateCommandPool(device, &poolInfo, nullptr, &computeCommandPool) != VK_SUCCESS)
+		{
+			LOG("Error creating the compute command pool");
+			return false;
+		}
+		allocInfo.commandPool = computeCommandPool;
+		if (vkAllocateCommandBuffers(device, &allocInfo, computeCommandBuffers) != VK_SUCCESS)
+		{
+			LOG("Error allocating the compute command buffers");
+			return false;
+		}
+	}
 	
+	if (timestampsSupported)
+	{
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = TIMESTAMPS_PER_FRAME * MAX_FRAMES_IN_FLIGHT;
+		if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, &timestampQueryPool) != VK_SUCCESS)
+		{
+			LOG("Warning: could not create the timestamp query pool, gpu pass times will not be available");
+			timestampsSupported = false;
+		}
+		else
+			vkResetQueryPool(device, timestampQueryPool, 0, TIMESTAMPS_PER_FRAME * MAX_FRAMES_IN_FLIGHT);
+	}
+	else
+	{
+		LOG("Warning: the device does not support timestamps on every queue or the host query reset, gpu pass times will not be available");
+	}
+	if (pipelineStatisticsSupported)
+	{
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		//Same order as the results
+		queryPoolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+		queryPoolInfo.queryCount = MAX_FRAMES_IN_FLIGHT;
+		if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, &pipelineStatisticsQueryPool) != VK_SUCCESS)
+		{
+			LOG("Warning: could not create the pipeline statistics query pool, the clipped primitives will not be available");
+			pipelineStatisticsSupported = false;
+		}
+	}
+	else
+	{
+		LOG("Warning: the device does not support pipeline statistics queries");
+	}
+
 	VkSemaphoreCreateInfo semaphoreCreateInfo{};
 	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
@@ -723,54 +1776,245 @@ bool ModuleVulkan::Init()
 			LOG("Error creating fences and semaphores");
 			return false;
 		}
+		if (swapChainMaintenanceSupported && vkCreateFence(device, &fenceCreateInfo, nullptr, &presentFences[i]) != VK_SUCCESS)
+		{
+			LOG("Error creating the present fences");
+			return false;
+		}
 	}
-	renderFinishedSemaphores = new VkSemaphore[swapChainImageCount];
-	for (int i = 0; i < swapChainImageCount; ++i)
+	if (asyncCompute)
 	{
-		if (vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS)
+		VkSemaphoreTypeCreateInfo timelineCreateInfo{};
+		timelineCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		timelineCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		timelineCreateInfo.initialValue = 0;
+		VkSemaphoreCreateInfo timelineSemaphoreInfo{};
+		timelineSemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		timelineSemaphoreInfo.pNext = &timelineCreateInfo;
+		if (vkCreateSemaphore(device, &timelineSemaphoreInfo, nullptr, &cullTimelineSemaphore) != VK_SUCCESS || vkCreateSemaphore(device, &timelineSemaphoreInfo, nullptr, &drawTimelineSemaphore) != VK_SUCCESS)
 		{
-			LOG("Error creating swap chain semaphores");
+			LOG("Error creating the timeline semaphores");
 			return false;
 		}
 	}
 
-	//Import the gltf model
-	Mesh mesh;
-	if (!ImporterMesh::ImportFirst("assets/Duck/Duck.gltf", mesh))
+	//The gltf models were imported and optimized by importThread
 	{
-		LOG("Error loading the model");
-		return false;
+		PROFILE_ZONE("WaitSceneImport");
+		WaitSceneImport();
 	}
-	GenerateMeshlet(mesh, meshletMesh);
-	modelAABB.Generate(meshletMesh.mesh);
-
-	const size_t transformsSize = sizeof(float) * 19;
-	const size_t frustumPlaneSize = sizeof(float) * 4 * 6 + sizeof(uint32_t);
-	const size_t modelMatricesSize = sizeof(float) * 16 * NUM_MODELS;
-	const size_t OBBsSize = sizeof(float) * 4 * 8 * NUM_MODELS; //one for padding
-	const size_t parameterSize = sizeof(uint32_t);
-	if (!CreateBuffer((transformsSize + GetInbetweenAlignmentSpace(transformsSize, minUniformBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT , VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, transformsBuffer, transformsBufferMemory) ||
-		!CreateBuffer((frustumPlaneSize + GetInbetweenAlignmentSpace(frustumPlaneSize, minUniformBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, frustumPlanesBuffer, frustumPlanesBufferMemory) ||
-		!CreateBuffer((modelMatricesSize + GetInbetweenAlignmentSpace(modelMatricesSize, minStorageBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, modelMatricesBuffer, modelMatricesBufferMemory) ||
-		!CreateBuffer((OBBsSize + GetInbetweenAlignmentSpace(OBBsSize, minStorageBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, OBBsBuffer, OBBsBufferMemory) ||
-		!CreateBuffer((parameterSize + GetInbetweenAlignmentSpace(parameterSize, minStorageBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, parameterBuffer, parameterBufferMemory))
-	{
-		LOG("Error creating the uniform and persistent buffers");
+	if (!sceneImported)
 		return false;
-	}
-	//map persistent buffers
-	vkMapMemory(device, transformsBufferMemory, 0, VK_WHOLE_SIZE, 0, &transformsBufferPtr[0]);
+	meshletMeshes = new MeshletMesh[numMeshes];
+	MeshletMesh* fallbackMeshes = new MeshletMesh[numMeshes];
+	meshAABBPoints = new glm::vec3[numMeshes][8];
+	occluderMeshes = new OcclusionCulling::OccluderMesh[numMeshes];
+	meshBoxes = new OcclusionCulling::Box[numMeshes];
+	numRecords = numMeshes * 2;
+	meshRecords = new MeshRecord[numRecords];
+	pageFiles = new FileSystem::MappedFile[numMeshes];
+	const GeometryStreaming::PageLayout pageLayout{ meshletMaxVertices, meshletMaxPrimitives };
+	uint32_t totalMeshlets = 0;
+	uint32_t totalMeshletVertices = 0;
+	uint32_t totalMeshletTriangles = 0;
+	//culling infos and pages of both LODs
+	uint32_t totalCullInfos = 0;
+	uint32_t fallbackPages = 0;
+	pageCount = 0;
+	//One atlas texel when the impostors are not baked, the descriptors still need a buffer
+	std::vector<Impostor::Record> impostorRecords(numMeshes, Impostor::Record{});
+	std::vector<uint32_t> impostorAtlas(impostorsBaked ? numMeshes * Impostor::MESH_TEXELS : 1, 0);
+	float impostorBakeMs = 0.0f;
+	for (unsigned int i = 0; i < numMeshes; ++i)
+	{
+		PROFILE_ZONE("Meshlets");
+		importScratch.Reset();
+		Mesh& mesh = importedMeshes[i];
+		//The cached meshlets skip the build, the mesh is moved like GenerateMeshlet does
+		if (MeshletCache::Load(SCENE_MESHES[i], meshletMaxVertices, meshletMaxPrimitives, mesh, meshletMeshes[i]))
+		{
+			memcpy(&meshletMeshes[i].mesh, &mesh, sizeof(Mesh));
+			mesh = Mesh{};
+		}
+		else
+		{
+			GenerateMeshlet(mesh, meshletMeshes[i], importScratch);
+			MeshletCache::Save(SCENE_MESHES[i], meshletMaxVertices, meshletMaxPrimitives, meshletMeshes[i]);
+		}
+		//After the cache, it stores the meshlets with the vertex indices of the optimized mesh
+		OptimizeMesh::ReorderVertices(meshletMeshes[i], &importScratch);
+		AABB meshAABB(meshletMeshes[i].mesh);
+		meshAABB.GetPoints(meshAABBPoints[i]);
+		meshBoxes[i].min = meshAABB.GetMin();
+		meshBoxes[i].max = meshAABB.GetMax();
+		if (impostorsBaked)
+		{
+			PROFILE_ZONE("Impostor::Bake");
+			const auto bakeStart = std::chrono::steady_clock::now();
+			impostorRecords[i].atlasOffset = i * Impostor::MESH_TEXELS;
+			impostorRecords[i].sphere = Impostor::Bake(meshletMeshes[i].mesh, impostorAtlas.data() + impostorRecords[i].atlasOffset);
+			impostorBakeMs += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - bakeStart).count();
+		}
+		meshRecords[i].meshletOffset = totalMeshlets;
+		meshRecords[i].meshletCount = static_cast<uint32_t>(meshletMeshes[i].meshletCount);
+		maxMeshletsPerMesh = std::max(maxMeshletsPerMesh, meshRecords[i].meshletCount);
+		totalMeshlets += meshRecords[i].meshletCount;
+		totalMeshletVertices += meshletMeshes[i].GetMeshletsVerticeCount();
+		totalMeshletTriangles += meshletMeshes[i].GetMeshletsTriangleCount();
+
+		//The coarse LOD drawn while the full detail pages are streamed, its pages are always resident
+		Mesh fallback;
+		GeometryStreaming::BuildFallbackMesh(meshletMeshes[i].mesh, fallback);
+		GenerateMeshlet(fallback, fallbackMeshes[i], importScratch);
+		//The same coarse LOD is the occluder of the mesh, it only loses a few pixels of the silhouette
+		const Mesh& occluder = fallbackMeshes[i].mesh;
+		occluderMeshes[i].positions.resize(occluder.numVertices);
+		for (unsigned int v = 0; v < occluder.numVertices; ++v)
+			occluderMeshes[i].positions[v] = glm::vec3(occluder.vertices[v].position[0], occluder.vertices[v].position[1], occluder.vertices[v].position[2]);
+		occluderMeshes[i].indices.assign(occluder.indices, occluder.indices + occluder.numIndices);
+		MeshRecord& fallbackRecord = meshRecords[numMeshes + i];
+		fallbackRecord.meshletCount = static_cast<uint32_t>(fallbackMeshes[i].meshletCount);
+		fallbackRecord.fallbackRecord = numMeshes + i;
+		meshRecords[i].fallbackRecord = numMeshes + i;
+
+		//The pages of both LODs are consecutive on the page file and on the page table
+		if (!GeometryStreaming::WritePageFile(SCENE_MESHES[i], pageLayout, meshletMeshes[i], fallbackMeshes[i]))
+			return false;
+		char pagePath[512];
+		GeometryStreaming::GetPageFilePath(SCENE_MESHES[i], pageLayout, pagePath, sizeof(pagePath));
+		const uint32_t meshPages = GeometryStreaming::PageCount(meshletMeshes[i].meshletCount) + GeometryStreaming::PageCount(fallbackMeshes[i].meshletCount);
+		if (!FileSystem::Map(pagePath, pageFiles[i]) || pageFiles[i].size != GeometryStreaming::PAGE_FILE_HEADER_SIZE + meshPages * pageLayout.PageSize())
+		{
+			LOG("Error mapping the page file %s", pagePath);
+			return false;
+		}
+		meshRecords[i].pageOffset = pageCount;
+		fallbackRecord.pageOffset = pageCount + GeometryStreaming::PageCount(meshletMeshes[i].meshletCount);
+		pageCount += meshPages;
+		fallbackPages += GeometryStreaming::PageCount(fallbackMeshes[i].meshletCount);
+	}
+	//The culling infos of each record are contiguous, full detail records first
+	for (unsigned int r = 0; r < numRecords; ++r)
+	{
+		meshRecords[r].meshletOffset = totalCullInfos;
+		totalCullInfos += meshRecords[r].meshletCount;
+	}
+	pageData = new const unsigned char*[pageCount];
+	std::vector<uint32_t> pageRecords(pageCount);
+	for (unsigned int i = 0; i < numMeshes; ++i)
+	{
+		const uint32_t meshPages = static_cast<uint32_t>((pageFiles[i].size - GeometryStreaming::PAGE_FILE_HEADER_SIZE) / pageLayout.PageSize());
+		for (uint32_t p = 0; p < meshPages; ++p)
+		{
+			const uint32_t page = meshRecords[i].pageOffset + p;
+			pageData[page] = pageFiles[i].data + GeometryStreaming::PAGE_FILE_HEADER_SIZE + p * pageLayout.PageSize();
+			pageRecords[page] = page < meshRecords[numMeshes + i].pageOffset ? i : numMeshes + i;
+		}
+	}
+	//the meshes were moved to meshletMeshes
+	delete[] importedMeshes;
+	importedMeshes = nullptr;
+	meshletStats.maxVertices = meshletMaxVertices;
+	meshletStats.maxPrimitives = meshletMaxPrimitives;
+	meshletStats.meshletCount = totalMeshlets;
+	meshletStats.vertexOccupancy = static_cast<float>(totalMeshletVertices) / static_cast<float>(totalMeshlets * meshletMaxVertices);
+	meshletStats.triangleOccupancy = static_cast<float>(totalMeshletTriangles / 3) / static_cast<float>(totalMeshlets * meshletMaxPrimitives);
+	LOG("%u meshlets of %u vertices and %u primitives, %.1f%% vertex and %.1f%% triangle occupancy", totalMeshlets, meshletMaxVertices, meshletMaxPrimitives,
+		meshletStats.vertexOccupancy * 100.0f, meshletStats.triangleOccupancy * 100.0f);
+	if (impostorsBaked)
+		LOG("Impostors of %u meshes baked in %.1f ms, drawn under %.1f pixels", numMeshes, impostorBakeMs, impostorThreshold);
+	LOG("Import scratch: %llu allocations served from %llu heap blocks, %.2f MB reserved", static_cast<unsigned long long>(importScratch.GetAllocations()),
+		static_cast<unsigned long long>(importScratch.GetBlockAllocations()), importScratch.GetCapacity() / (1024.0 * 1024.0));
+	importScratch.Release();
+	static_assert(MAX_VISIBLE_CLUSTERS <= VisibilityBuffer::MAX_CLUSTERS, "The visible clusters do not fit on the visibility buffer ids");
+	//Random placement of the instances, InstanceSimulation::MakeSceneMotion picks how each one moves from there
+	uint32_t* sceneMeshes = new uint32_t[NUM_MODELS];
+	InstanceSimulation::Motion* sceneMotions = new InstanceSimulation::Motion[NUM_MODELS];
+	instanceKeyframes = new InstanceSimulation::Keyframe[InstanceSimulation::SCENE_KEYFRAMES];
+	InstanceSimulation::InitSceneKeyframes(instanceKeyframes);
+	int randomNumber1 = 0;
+	int randomNumber2 = 1000;
+	int randomNumber3 = 200;
+	int randomNumber4 = 45;
+	int randomNumber5 = 200;
+	int randomNumber6 = 4;
+	int randomNumber7 = 70;
+	for (int i = 0; i < NUM_MODELS; ++i)
+	{
+		glm::mat4 model(1.0f);//glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+		srand(randomNumber1);
+		randomNumber1 = rand() % 10001;
+		float randomNum1 = (static_cast<float>(randomNumber1) / 10001.f) * 2.f - 1.f;
+		srand(randomNumber2);
+		randomNumber2 = rand() % 10001;
+		float randomNum2 = (static_cast<float>(randomNumber2) / 10001.f) * 2.f - 1.f;
+		srand(randomNumber3);
+		randomNumber3 = rand() % 10001;
+		float randomNum3 = (static_cast<float>(randomNumber3) / 10001.f) * 2.f - 1.f;
+		srand(randomNumber4);
+		randomNumber4 = rand() % 360;
+		srand(randomNumber5);
+		randomNumber5 = rand() % 10001;
+		float randomNum5 = (static_cast<float>(randomNumber5) / 10001.f) * 2.f - 1.f;
+		srand(randomNumber6);
+		randomNumber6 = rand() % 10001;
+		float randomNum6 = (static_cast<float>(randomNumber6) / 10001.f) * 2.f - 1.f;
+		srand(randomNumber7);
+		randomNumber7 = rand() % 10001;
+		float randomNum7 = (static_cast<float>(randomNumber7) / 10001.f) * 2.f - 1.f;
+		model = glm::rotate(model, glm::radians(static_cast<float>(randomNumber4)), glm::vec3(randomNum5, randomNum6, randomNum7));
+		sceneMeshes[i] = i % numMeshes;
+		sceneMotions[i] = InstanceSimulation::MakeSceneMotion(i, glm::translate(model, glm::vec3(6000.f * randomNum1, 6000.f * randomNum2, 6000.f * randomNum3)));
+	}
+	instances = new InstanceManager();
+	instances->Init(MAX_INSTANCES, numMeshes);
+	instances->Add(sceneMeshes, sceneMotions, NUM_MODELS, nullptr);
+	occlusionBuffer = new OcclusionCulling::MaskedDepthBuffer();
+	occlusionBuffer->Init(OcclusionCulling::DEFAULT_WIDTH, OcclusionCulling::DEFAULT_HEIGHT, 0);
+	LOG("Occlusion culling buffer of %ux%u, %u threads%s", occlusionBuffer->GetWidth(), occlusionBuffer->GetHeight(), occlusionBuffer->GetThreadCount(), occlusionBuffer->IsUsingAVX2() ? ", AVX2" : "");
+	delete[] sceneMeshes;
+	delete[] sceneMotions;
+
+	const size_t transformsSize = sizeof(float) * 19;
+	const size_t frustumPlaneSize = sizeof(CullUniform);
+	modelMatricesSize = sizeof(float) * 16 * MAX_INSTANCES;
+	const size_t OBBsSize = sizeof(float) * 4 * 8 * numMeshes; //one for padding
+	const size_t parameterSize = sizeof(uint32_t);
+	const size_t statsSize = sizeof(CullingStats);
+	const size_t occlusionBitsSize = sizeof(uint32_t) * MAX_INSTANCES / 32;
+	const size_t cacheInvalidBitsSize = sizeof(uint32_t) * MAX_INSTANCES / 32;
+	if (!CreateBuffer((transformsSize + GetInbetweenAlignmentSpace(transformsSize, minUniformBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT , VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, transformsBuffer, transformsBufferMemory) ||
+		!CreateBuffer((frustumPlaneSize + GetInbetweenAlignmentSpace(frustumPlaneSize, minUniformBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, frustumPlanesBuffer, frustumPlanesBufferMemory) ||
+		!CreateBuffer((modelMatricesSize + GetInbetweenAlignmentSpace(modelMatricesSize, minStorageBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, modelMatricesBuffer, modelMatricesBufferMemory) ||
+		!CreateBuffer((parameterSize + GetInbetweenAlignmentSpace(parameterSize, minStorageBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, parameterBuffer, parameterBufferMemory) ||
+		!CreateBuffer((statsSize + GetInbetweenAlignmentSpace(statsSize, minStorageBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, statsBuffer, statsBufferMemory) ||
+		!CreateBuffer((occlusionBitsSize + GetInbetweenAlignmentSpace(occlusionBitsSize, minStorageBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, occlusionBitsBuffer, occlusionBitsBufferMemory) ||
+		!CreateBuffer((cacheInvalidBitsSize + GetInbetweenAlignmentSpace(cacheInvalidBitsSize, minStorageBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, cacheInvalidBitsBuffer, cacheInvalidBitsBufferMemory))
+	{
+		LOG("Error creating the uniform and persistent buffers");
+		return false;
+	}
+	//map persistent buffers
+	vkMapMemory(device, transformsBufferMemory, 0, VK_WHOLE_SIZE, 0, &transformsBufferPtr[0]);
 	vkMapMemory(device, frustumPlanesBufferMemory, 0, VK_WHOLE_SIZE, 0, &frustumPlanesBufferPtr[0]);
-	vkMapMemory(device, modelMatricesBufferMemory, 0, VK_WHOLE_SIZE, 0, &modelMatricesBufferPtr[0]);
-	vkMapMemory(device, OBBsBufferMemory, 0, VK_WHOLE_SIZE, 0, &OBBsBufferPtr[0]);
 	vkMapMemory(device, parameterBufferMemory, 0, VK_WHOLE_SIZE, 0, &parameterBufferPtr[0]);
+	vkMapMemory(device, statsBufferMemory, 0, VK_WHOLE_SIZE, 0, &statsBufferPtr[0]);
+	vkMapMemory(device, occlusionBitsBufferMemory, 0, VK_WHOLE_SIZE, 0, &occlusionBitsBufferPtr[0]);
+	vkMapMemory(device, cacheInvalidBitsBufferMemory, 0, VK_WHOLE_SIZE, 0, &cacheInvalidBitsBufferPtr[0]);
 	for (int i = 1; i < MAX_FRAMES_IN_FLIGHT; ++i)
 	{
 		transformsBufferPtr[i] = static_cast<char*>(transformsBufferPtr[0]) + (transformsSize + GetInbetweenAlignmentSpace(transformsSize, minUniformBufferOffsetAlignment)) * i;
 		frustumPlanesBufferPtr[i] = static_cast<char*>(frustumPlanesBufferPtr[0]) + (frustumPlaneSize + GetInbetweenAlignmentSpace(frustumPlaneSize, minUniformBufferOffsetAlignment)) * i;
-		modelMatricesBufferPtr[i] = static_cast<char*>(modelMatricesBufferPtr[0]) + (modelMatricesSize + GetInbetweenAlignmentSpace(modelMatricesSize, minStorageBufferOffsetAlignment)) * i;
-		OBBsBufferPtr[i] = static_cast<char*>(OBBsBufferPtr[0]) + (OBBsSize + GetInbetweenAlignmentSpace(OBBsSize, minStorageBufferOffsetAlignment)) * i;
 		parameterBufferPtr[i] = static_cast<char*>(parameterBufferPtr[0]) + (parameterSize + GetInbetweenAlignmentSpace(parameterSize, minStorageBufferOffsetAlignment)) * i;
+		statsBufferPtr[i] = static_cast<char*>(statsBufferPtr[0]) + (statsSize + GetInbetweenAlignmentSpace(statsSize, minStorageBufferOffsetAlignment)) * i;
+		occlusionBitsBufferPtr[i] = static_cast<char*>(occlusionBitsBufferPtr[0]) + (occlusionBitsSize + GetInbetweenAlignmentSpace(occlusionBitsSize, minStorageBufferOffsetAlignment)) * i;
+		cacheInvalidBitsBufferPtr[i] = static_cast<char*>(cacheInvalidBitsBufferPtr[0]) + (cacheInvalidBitsSize + GetInbetweenAlignmentSpace(cacheInvalidBitsSize, minStorageBufferOffsetAlignment)) * i;
+	}
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+	{
+		memset(statsBufferPtr[i], 0, statsSize);
+		memset(occlusionBitsBufferPtr[i], 0, occlusionBitsSize);
+		memset(cacheInvalidBitsBufferPtr[i], 0, cacheInvalidBitsSize);
 	}
 
 	//initialize uniform buffers
@@ -778,18 +2022,181 @@ bool ModuleVulkan::Init()
 	{
 		glm::mat4 model(1.0f);//glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
 		memcpy(transformsBufferPtr[i], &model, sizeof(float) * 16);
-		const uint32_t numCommands = NUM_MODELS;
-		memcpy(static_cast<float*>(frustumPlanesBufferPtr[i]) + 6 * 4, &numCommands, sizeof(numCommands));
+		frameUniforms[i].numCommands = instances->GetSlotCount();
+		memcpy(frustumPlanesBufferPtr[i], &frameUniforms[i], sizeof(CullUniform));
 	}
 
+	//Pool slots under the budget: the fallback pages are pinned and the uploads of a frame always find a slot, more slots than pages are never used
+	const VkDeviceSize slotSize = pageLayout.SlotSize();
+	const VkDeviceSize budget = geometryBudget != 0 ? geometryBudget : GetMemoryBudget();
+	uint64_t slotCount = std::max<uint64_t>(budget / slotSize, fallbackPages + GeometryStreaming::MAX_PAGE_UPLOADS);
+	//every pool is a single storage buffer binding
+	const VkDeviceSize largestSlot = std::max({ pageLayout.SlotMeshletVerticesSize(), pageLayout.SlotTrianglesSize(), pageLayout.SlotVerticesSize() });
+	slotCount = std::min<uint64_t>(slotCount, std::min<uint64_t>(pageCount, maxStorageBufferRange / largestSlot));
+	if (slotCount < fallbackPages)
+	{
+		LOG("Error: the %u fallback pages do not fit on the geometry pools", fallbackPages);
+		return false;
+	}
+	residency = new GeometryStreaming::ResidencyManager();
+	residency->Init(pageRecords, numRecords, static_cast<uint32_t>(slotCount));
+	LOG("Geometry streaming: %u pages (%u fallback) of %u meshlets, %u slots of %.1f KB (%.1f MB budget%s)", pageCount, fallbackPages, GeometryStreaming::PAGE_MESHLETS,
+		static_cast<uint32_t>(slotCount), static_cast<float>(slotSize) / 1024.0f, static_cast<float>(budget) / (1024.0f * 1024.0f),
+		geometryBudget != 0 ? "" : memoryBudgetSupported ? " from VK_EXT_memory_budget" : " from the heap size");
+
+	const size_t cullInfoSize = sizeof(float) * 12; //sphere center + radius, cone apex + cutoff, cone axis + padding
+	//request count + requests + requested and used bits of every page
+	pageFeedbackSize = sizeof(uint32_t) * (1 + GeometryStreaming::MAX_PAGE_REQUESTS + 2 * ((pageCount + 31) / 32));
+	streamingStagingSize = GeometryStreaming::MAX_PAGE_UPLOADS * slotSize + sizeof(uint32_t) * (pageCount + numRecords) +
+		(sizeof(uint32_t) + sizeof(InstanceSimulation::Motion)) * InstanceManager::MAX_UPLOADS;
+	dispatchIndirectSize = sizeof(uint32_t) * 3 * MAX_INSTANCES;
+	modelIDsSize = sizeof(uint32_t) * 2 * MAX_INSTANCES;
+	sortKeysSize = sizeof(uint32_t) * 2 * MAX_INSTANCES;
+	sortValuesSize = sizeof(uint32_t) * 2 * 2 * MAX_INSTANCES;
+	sortBlockCountsSize = sizeof(uint32_t) * DepthSort::RADIX * DepthSort::BlockCount(MAX_INSTANCES);
+	//2 bits per meshlet of the largest mesh for every slot, the meshlet cache is not available past the budget
+	meshletStateWords = (maxMeshletsPerMesh + VisibilityCache::MESHLETS_PER_WORD - 1) / VisibilityCache::MESHLETS_PER_WORD;
+	if (sizeof(uint32_t) * static_cast<VkDeviceSize>(meshletStateWords) * MAX_INSTANCES > MAX_MESHLET_STATE_BYTES)
+	{
+		LOG("The meshlet visibility cache needs %u words per instance, over the budget. Only the instances are cached", meshletStateWords);
+		meshletStateWords = 0;
+	}
+	visibilityTracker = new VisibilityCache::Tracker();
+	if (!CreateBuffer(slotCount * pageLayout.SlotMeshletsSize(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, meshletBuffer, meshletBufferMemory) ||
+		!CreateBuffer(totalCullInfos * cullInfoSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, meshletCullInfoBuffer, meshletCullInfoBufferMemory) ||
+		!CreateBuffer(slotCount * pageLayout.SlotMeshletVerticesSize(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, meshletVerticesBuffer, meshletVerticesBufferMemory) ||
+		!CreateBuffer(slotCount * pageLayout.SlotTrianglesSize(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, meshletTrianglesBuffer, meshletTrianglesBufferMemory) ||
+		!CreateBuffer(slotCount * pageLayout.SlotVerticesSize(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory) ||
+		!CreateBuffer(sizeof(uint32_t) * MAX_INSTANCES, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, instanceMeshesBuffer, instanceMeshesBufferMemory) ||
+		!CreateBuffer(sizeof(MeshRecord) * numRecords, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, meshRecordsBuffer, meshRecordsBufferMemory) ||
+		!CreateBuffer(OBBsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, OBBsBuffer, OBBsBufferMemory) ||
+		!CreateBuffer(sizeof(InstanceSimulation::Motion) * MAX_INSTANCES, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, instanceMotionsBuffer, instanceMotionsBufferMemory) ||
+		!CreateBuffer(sizeof(InstanceSimulation::Keyframe) * InstanceSimulation::SCENE_KEYFRAMES, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, instanceKeyframesBuffer, instanceKeyframesBufferMemory) ||
+		!CreateBuffer(sizeof(uint32_t) * pageCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, pageTableBuffer, pageTableBufferMemory) ||
+		!CreateBuffer(sizeof(uint32_t) * numRecords, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, recordResidencyBuffer, recordResidencyBufferMemory) ||
+		!CreateBuffer((pageFeedbackSize + GetInbetweenAlignmentSpace(pageFeedbackSize, minStorageBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, pageFeedbackBuffer, pageFeedbackBufferMemory) ||
+		!CreateBuffer(streamingStagingSize * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, streamingStagingBuffer, streamingStagingBufferMemory) ||
+		!CreateBuffer((dispatchIndirectSize + GetInbetweenAlignmentSpace(dispatchIndirectSize, minStorageBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, dispatchIndirectBuffer, dispatchIndirectBufferMemory) ||
+		!CreateBuffer((modelIDsSize + GetInbetweenAlignmentSpace(modelIDsSize, minStorageBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, modelIDsBuffer, modelIDsBufferMemory) ||
+		!CreateBuffer((sortKeysSize + GetInbetweenAlignmentSpace(sortKeysSize, minStorageBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sortKeysBuffer, sortKeysBufferMemory) ||
+		!CreateBuffer((sortValuesSize + GetInbetweenAlignmentSpace(sortValuesSize, minStorageBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sortValuesBuffer, sortValuesBufferMemory) ||
+		!CreateBuffer((sortBlockCountsSize + GetInbetweenAlignmentSpace(sortBlockCountsSize, minStorageBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sortBlockCountsBuffer, sortBlockCountsBufferMemory) ||
+		!CreateBuffer(sizeof(uint32_t) * 2 + sizeof(uint32_t) * 2 * MAX_VISIBLE_CLUSTERS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, visibleClustersBuffer, visibleClustersBufferMemory) ||
+		!CreateBuffer(sizeof(uint32_t) * MAX_VISIBLE_CLUSTERS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, swClustersBuffer, swClustersBufferMemory) ||
+		!CreateBuffer(sizeof(uint32_t) * MAX_INSTANCES, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, cacheEntriesBuffer, cacheEntriesBufferMemory) ||
+		!CreateBuffer(sizeof(uint32_t) * std::max(meshletStateWords, 1u) * MAX_INSTANCES, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, meshletStatesBuffer, meshletStatesBufferMemory))
+	{
+		LOG("Error creating the device buffers");
+		return false;
+	}
+	vkMapMemory(device, pageFeedbackBufferMemory, 0, VK_WHOLE_SIZE, 0, &pageFeedbackBufferPtr[0]);
+	vkMapMemory(device, streamingStagingBufferMemory, 0, VK_WHOLE_SIZE, 0, &streamingStagingBufferPtr[0]);
+	for (int i = 1; i < MAX_FRAMES_IN_FLIGHT; ++i)
+	{
+		pageFeedbackBufferPtr[i] = static_cast<char*>(pageFeedbackBufferPtr[0]) + (pageFeedbackSize + GetInbetweenAlignmentSpace(pageFeedbackSize, minStorageBufferOffsetAlignment)) * i;
+		streamingStagingBufferPtr[i] = static_cast<char*>(streamingStagingBufferPtr[0]) + streamingStagingSize * i;
+	}
+	//view projections + planes of every cascade, draw counts of every partition
+	const size_t shadowViewsSize = sizeof(glm::mat4) * MAX_SHADOW_CASCADES + sizeof(glm::vec4) * 6 * MAX_SHADOW_CASCADES;
+	const size_t shadowCountsSize = sizeof(uint32_t) * MAX_SHADOW_CASCADES;
+	if (shadowCascades != 0)
+	{
+		//A partition per cascade for the separate passes, the multiview pass only uses the first one
+		shadowCommandsSize = sizeof(uint32_t) * 3 * MAX_INSTANCES * MAX_SHADOW_CASCADES;
+		shadowDrawsSize = sizeof(uint32_t) * 2 * MAX_INSTANCES * MAX_SHADOW_CASCADES;
+		if (!CreateBuffer((shadowViewsSize + GetInbetweenAlignmentSpace(shadowViewsSize, minUniformBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, shadowViewsBuffer, shadowViewsBufferMemory) ||
+			!CreateBuffer((shadowCountsSize + GetInbetweenAlignmentSpace(shadowCountsSize, minStorageBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, shadowCountsBuffer, shadowCountsBufferMemory) ||
+			!CreateBuffer((shadowCommandsSize + GetInbetweenAlignmentSpace(shadowCommandsSize, minStorageBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, shadowCommandsBuffer, shadowCommandsBufferMemory) ||
+			!CreateBuffer((shadowDrawsSize + GetInbetweenAlignmentSpace(shadowDrawsSize, minStorageBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, shadowDrawsBuffer, shadowDrawsBufferMemory))
+		{
+			LOG("Error creating the shadow cascade buffers");
+			return false;
+		}
+		vkMapMemory(device, shadowViewsBufferMemory, 0, VK_WHOLE_SIZE, 0, &shadowViewsBufferPtr[0]);
+		vkMapMemory(device, shadowCountsBufferMemory, 0, VK_WHOLE_SIZE, 0, &shadowCountsBufferPtr[0]);
+		for (int i = 1; i < MAX_FRAMES_IN_FLIGHT; ++i)
+		{
+			shadowViewsBufferPtr[i] = static_cast<char*>(shadowViewsBufferPtr[0]) + (shadowViewsSize + GetInbetweenAlignmentSpace(shadowViewsSize, minUniformBufferOffsetAlignment)) * i;
+			shadowCountsBufferPtr[i] = static_cast<char*>(shadowCountsBufferPtr[0]) + (shadowCountsSize + GetInbetweenAlignmentSpace(shadowCountsSize, minStorageBufferOffsetAlignment)) * i;
+		}
+		for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+		{
+			memset(shadowViewsBufferPtr[i], 0, shadowViewsSize);
+			memset(shadowCountsBufferPtr[i], 0, shadowCountsSize);
+		}
+		LOG("Shadow cascades: %u of %ux%u, %s", shadowCascades, MultiView::DEFAULT_RESOLUTION, MultiView::DEFAULT_RESOLUTION, multiViewSupported ? "multiview supported" : "separate passes only");
+	}
+	//Impostor buffers are always bound, without the bake they only hold a dummy texel and nothing is routed to them
+	const size_t impostorCountsSize = sizeof(uint32_t) * 4;
+	impostorDrawsSize = sizeof(uint32_t) * 2 * MAX_INSTANCES;
+	if (!CreateBuffer(sizeof(Impostor::Record) * impostorRecords.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, impostorRecordsBuffer, impostorRecordsBufferMemory) ||
+		!CreateBuffer(sizeof(uint32_t) * impostorAtlas.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, impostorAtlasBuffer, impostorAtlasBufferMemory) ||
+		!CreateBuffer((impostorCountsSize + GetInbetweenAlignmentSpace(impostorCountsSize, minStorageBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, impostorCountsBuffer, impostorCountsBufferMemory) ||
+		!CreateBuffer((impostorDrawsSize + GetInbetweenAlignmentSpace(impostorDrawsSize, minStorageBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, impostorDrawsBuffer, impostorDrawsBufferMemory))
+	{
+		LOG("Error creating the impostor buffers");
+		return false;
+	}
+	vkMapMemory(device, impostorCountsBufferMemory, 0, VK_WHOLE_SIZE, 0, &impostorCountsBufferPtr[0]);
+	for (int i = 1; i < MAX_FRAMES_IN_FLIGHT; ++i)
+		impostorCountsBufferPtr[i] = static_cast<char*>(impostorCountsBufferPtr[0]) + (impostorCountsSize + GetInbetweenAlignmentSpace(impostorCountsSize, minStorageBufferOffsetAlignment)) * i;
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+		memset(impostorCountsBufferPtr[i], 0, impostorCountsSize);
+	//Clustered light buffers are always bound, without lights the shading never reads them (the light count of the parameters is 0)
+	lightCount = std::min(lightCount, ClusteredLighting::MAX_LIGHTS);
+	std::vector<ClusteredLighting::Light> sceneLights(std::max(lightCount, 1u), ClusteredLighting::Light{});
+	ClusteredLighting::SceneLights(lightCount, ClusteredLighting::DEFAULT_MIN_RADIUS, ClusteredLighting::DEFAULT_MAX_RADIUS, sceneLights.data());
+	const size_t lightsSize = sizeof(ClusteredLighting::Light) * sceneLights.size();
+	const size_t clusterParamsSize = sizeof(ClusteredLighting::Params);
+	const size_t clusterGridSize = sizeof(uint32_t) * (lightCount != 0 ? ClusteredLighting::GRID_WORDS : 1);
+	if (!CreateBuffer(lightsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, lightsBuffer, lightsBufferMemory) ||
+		!CreateBuffer((clusterParamsSize + GetInbetweenAlignmentSpace(clusterParamsSize, minUniformBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, clusterParamsBuffer, clusterParamsBufferMemory) ||
+		!CreateBuffer((clusterGridSize + GetInbetweenAlignmentSpace(clusterGridSize, minStorageBufferOffsetAlignment)) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, clusterGridBuffer, clusterGridBufferMemory))
+	{
+		LOG("Error creating the clustered light buffers");
+		return false;
+	}
+	vkMapMemory(device, clusterParamsBufferMemory, 0, VK_WHOLE_SIZE, 0, &clusterParamsBufferPtr[0]);
+	for (int i = 1; i < MAX_FRAMES_IN_FLIGHT; ++i)
+		clusterParamsBufferPtr[i] = static_cast<char*>(clusterParamsBufferPtr[0]) + (clusterParamsSize + GetInbetweenAlignmentSpace(clusterParamsSize, minUniformBufferOffsetAlignment)) * i;
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+		memset(clusterParamsBufferPtr[i], 0, clusterParamsSize);
+	if (lightCount != 0)
+		LOG("Clustered lights: %u lights, %ux%ux%u clusters of up to %u lights", lightCount, ClusteredLighting::CLUSTERS_X, ClusteredLighting::CLUSTERS_Y, ClusteredLighting::CLUSTERS_Z,
+			ClusteredLighting::MAX_LIGHTS_PER_CLUSTER);
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+		memset(pageFeedbackBufferPtr[i], 0, pageFeedbackSize);
+	if (instanceValidation)
+	{
+		if (!CreateBuffer(modelMatricesSize * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, instanceReadbackBuffer, instanceReadbackBufferMemory))
+		{
+			LOG("Error creating the instance validation buffer");
+			return false;
+		}
+		vkMapMemory(device, instanceReadbackBufferMemory, 0, VK_WHOLE_SIZE, 0, &instanceReadbackBufferPtr[0]);
+		for (int i = 1; i < MAX_FRAMES_IN_FLIGHT; ++i)
+			instanceReadbackBufferPtr[i] = static_cast<char*>(instanceReadbackBufferPtr[0]) + modelMatricesSize * i;
+		instanceUploadFrames = new uint64_t[MAX_INSTANCES]();
+		if (!CreateBuffer(modelIDsSize * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, depthOrderReadbackBuffer, depthOrderReadbackBufferMemory))
+		{
+			LOG("Error creating the depth order validation buffer");
+			return false;
+		}
+		vkMapMemory(device, depthOrderReadbackBufferMemory, 0, VK_WHOLE_SIZE, 0, &depthOrderReadbackBufferPtr[0]);
+		for (int i = 1; i < MAX_FRAMES_IN_FLIGHT; ++i)
+			depthOrderReadbackBufferPtr[i] = static_cast<char*>(depthOrderReadbackBufferPtr[0]) + modelIDsSize * i;
+	}
+
+	//Only the culling infos, the records and the fallback pages are uploaded now, the full detail pages are streamed when the GPU asks for them
 	VkBuffer stagingBuffer;
 	VkDeviceMemory stagingBufferMemory;
-	size_t stagingBufferSize = meshletMesh.meshletCount * sizeof(meshopt_Meshlet) +
-		meshletMesh.meshletCount * sizeof(float) * 8 + //meshopt_Bounds
-		meshletMesh.GetMeshletsVerticeCount() * sizeof(unsigned int) +
-		meshletMesh.GetMeshletsTriangleCount() * sizeof(unsigned int) +
-		meshletMesh.mesh.numVertices * sizeof(Vertex) +
-		sizeof(uint32_t) * NUM_MODELS;
+	size_t stagingBufferSize = totalCullInfos * cullInfoSize + //meshopt_Bounds
+		sizeof(uint32_t) * MAX_INSTANCES +
+		sizeof(MeshRecord) * numRecords +
+		OBBsSize + sizeof(InstanceSimulation::Motion) * MAX_INSTANCES + sizeof(InstanceSimulation::Keyframe) * InstanceSimulation::SCENE_KEYFRAMES +
+		sizeof(Impostor::Record) * impostorRecords.size() + sizeof(uint32_t) * impostorAtlas.size() + lightsSize +
+		fallbackPages * slotSize +
+		sizeof(uint32_t) * (pageCount + numRecords);
 	if (!CreateBuffer(stagingBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory))
 	{
 		LOG("Error creating the staging buffer");
@@ -797,42 +2204,71 @@ bool ModuleVulkan::Init()
 	}
 	void* stagingBufferPtr;
 	vkMapMemory(device, stagingBufferMemory, 0, stagingBufferSize, 0, &stagingBufferPtr);
-	unsigned int offset = 0;
-	memcpy(stagingBufferPtr, meshletMesh.meshlets, meshletMesh.meshletCount * sizeof(meshopt_Meshlet));
-	offset += meshletMesh.meshletCount * sizeof(meshopt_Meshlet);
-	for (int i = 0; i < meshletMesh.meshletCount; ++i)
-	{
-		memcpy(static_cast<char*>(stagingBufferPtr) + offset, meshletMesh.meshletBounds[i].cone_apex, sizeof(meshletMesh.meshletBounds->cone_apex));
-		offset += sizeof(float) * 3;
-		memcpy(static_cast<char*>(stagingBufferPtr) + offset, &meshletMesh.meshletBounds[i].cone_cutoff, sizeof(meshletMesh.meshletBounds->cone_cutoff));
-		offset += sizeof(float);
-		memcpy(static_cast<char*>(stagingBufferPtr) + offset, meshletMesh.meshletBounds[i].cone_axis, sizeof(meshletMesh.meshletBounds->cone_axis));
-		offset += sizeof(float) * 4;
-	}
-	memcpy(static_cast<char*>(stagingBufferPtr) + offset, meshletMesh.meshletVertices, meshletMesh.GetMeshletsVerticeCount() * sizeof(unsigned int));
-	offset += meshletMesh.GetMeshletsVerticeCount() * sizeof(unsigned int);
-	for (int i = 0; i < meshletMesh.GetMeshletsTriangleCount(); ++i)
-		reinterpret_cast<unsigned int*>(static_cast<char*>(stagingBufferPtr) + offset)[i] = meshletMesh.meshletTriangles[i];
-	//memcpy(static_cast<char*>(stagingBufferPtr) + offset, meshletMesh.meshletTriangles, meshletMesh.GetMeshletsTriangleCount() * sizeof(unsigned int));
-	offset += meshletMesh.GetMeshletsTriangleCount() * sizeof(unsigned int);
-	memcpy(static_cast<char*>(stagingBufferPtr) + offset, meshletMesh.mesh.vertices, meshletMesh.mesh.numVertices * sizeof(Vertex));
-	offset += meshletMesh.mesh.numVertices * sizeof(Vertex);
-	for(int i = 0; i < NUM_MODELS; ++i)
-		*reinterpret_cast<uint32_t*>(static_cast<char*>(stagingBufferPtr) + offset + sizeof(uint32_t) * i) = meshletMesh.meshletCount;
+	char* cullInfoDst = static_cast<char*>(stagingBufferPtr);
+	uint32_t* instanceMeshesDst = reinterpret_cast<uint32_t*>(cullInfoDst + totalCullInfos * cullInfoSize);
+	MeshRecord* meshRecordsDst = reinterpret_cast<MeshRecord*>(instanceMeshesDst + MAX_INSTANCES);
+	float* OBBsDst = reinterpret_cast<float*>(meshRecordsDst + numRecords);
+	InstanceSimulation::Motion* motionsDst = reinterpret_cast<InstanceSimulation::Motion*>(reinterpret_cast<char*>(OBBsDst) + OBBsSize);
+	InstanceSimulation::Keyframe* keyframesDst = reinterpret_cast<InstanceSimulation::Keyframe*>(motionsDst + MAX_INSTANCES);
+	Impostor::Record* impostorRecordsDst = reinterpret_cast<Impostor::Record*>(keyframesDst + InstanceSimulation::SCENE_KEYFRAMES);
+	uint32_t* impostorAtlasDst = reinterpret_cast<uint32_t*>(impostorRecordsDst + impostorRecords.size());
+	ClusteredLighting::Light* lightsDst = reinterpret_cast<ClusteredLighting::Light*>(impostorAtlasDst + impostorAtlas.size());
+	unsigned char* pagesDst = reinterpret_cast<unsigned char*>(lightsDst + sceneLights.size());
+	for (unsigned int r = 0; r < numRecords; ++r)
+	{
+		const MeshletMesh& meshletMesh = r < numMeshes ? meshletMeshes[r] : fallbackMeshes[r - numMeshes];
+		for (int i = 0; i < meshletMesh.meshletCount; ++i)
+		{
+			float* cullInfo = reinterpret_cast<float*>(cullInfoDst);
+			memcpy(&cullInfo[0], meshletMesh.meshletBounds[i].center, sizeof(meshletMesh.meshletBounds->center));
+			cullInfo[3] = meshletMesh.meshletBounds[i].radius;
+			memcpy(&cullInfo[4], meshletMesh.meshletBounds[i].cone_apex, sizeof(meshletMesh.meshletBounds->cone_apex));
+			cullInfo[7] = meshletMesh.meshletBounds[i].cone_cutoff;
+			memcpy(&cullInfo[8], meshletMesh.meshletBounds[i].cone_axis, sizeof(meshletMesh.meshletBounds->cone_axis));
+			cullInfo[11] = 0.0f;
+			cullInfoDst += cullInfoSize;
+		}
+	}
+	//Every slot, the free ones dead. From now on only the dirty slots are uploaded
+	memcpy(instanceMeshesDst, instances->GetMeshes(), sizeof(uint32_t) * MAX_INSTANCES);
+	memcpy(meshRecordsDst, meshRecords, sizeof(MeshRecord) * numRecords);
+	//Local bounding box of every mesh (vec4 stride), culling.comp transforms the one of the instance mesh with the simulated matrix
+	memset(OBBsDst, 0, OBBsSize);
+	for (unsigned int j = 0; j < numMeshes; ++j)
+	{
+		for (int i = 0; i < 8; ++i)
+			memcpy(OBBsDst + (4 * 8 * j) + 4 * i, &meshAABBPoints[j][i], sizeof(glm::vec3));
+	}
+	memcpy(motionsDst, instances->GetMotions(), sizeof(InstanceSimulation::Motion) * MAX_INSTANCES);
+	instances->TakeDirtySlots(nullptr, MAX_INSTANCES);
+	memcpy(keyframesDst, instanceKeyframes, sizeof(InstanceSimulation::Keyframe) * InstanceSimulation::SCENE_KEYFRAMES);
+	memcpy(impostorRecordsDst, impostorRecords.data(), sizeof(Impostor::Record) * impostorRecords.size());
+	memcpy(impostorAtlasDst, impostorAtlas.data(), sizeof(uint32_t) * impostorAtlas.size());
+	memcpy(lightsDst, sceneLights.data(), lightsSize);
+	//The fallback pages get the first slots and never leave them
+	VkDeviceSize pagesOffset = reinterpret_cast<char*>(pagesDst) - static_cast<char*>(stagingBufferPtr);
+	for (unsigned int i = 0; i < numMeshes; ++i)
+	{
+		const MeshRecord& fallbackRecord = meshRecords[numMeshes + i];
+		for (uint32_t p = 0; p < GeometryStreaming::PageCount(fallbackRecord.meshletCount); ++p)
+		{
+			const uint32_t page = fallbackRecord.pageOffset + p;
+			StagePage(page, residency->Pin(page), static_cast<unsigned char*>(stagingBufferPtr), pagesOffset);
+			pagesOffset += slotSize;
+		}
+	}
+	StageTables(static_cast<unsigned char*>(stagingBufferPtr), pagesOffset);
 	vkUnmapMemory(device, stagingBufferMemory);
-
-	if (!CreateBuffer(meshletMesh.meshletCount * sizeof(meshopt_Meshlet), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, meshletBuffer, meshletBufferMemory) ||
-		!CreateBuffer(meshletMesh.meshletCount * sizeof(float) * 8, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, meshletCullInfoBuffer, meshletCullInfoBufferMemory) ||
-		!CreateBuffer(meshletMesh.GetMeshletsVerticeCount() * sizeof(unsigned int), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, meshletVerticesBuffer, meshletVerticesBufferMemory) ||
-		!CreateBuffer(meshletMesh.GetMeshletsTriangleCount() * sizeof(unsigned int), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, meshletTrianglesBuffer, meshletTrianglesBufferMemory) ||
-		!CreateBuffer(meshletMesh.mesh.numVertices * sizeof(Vertex), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory) ||
-		!CreateBuffer(sizeof(uint32_t) * NUM_MODELS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, numMeshletsBuffer, numMeshletsBufferMemory) ||
-		!CreateBuffer(sizeof(uint32_t) * 3 * NUM_MODELS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, dispatchIndirectBuffer, dispatchIndirectBufferMemory) ||
-		!CreateBuffer(sizeof(uint32_t) * NUM_MODELS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, modelIDsBuffer, modelIDsBufferMemory))
+	//The pages are read from the page files from now on
+	for (unsigned int i = 0; i < numMeshes; ++i)
 	{
-		LOG("Error creating the device buffers");
-		return false;
+		meshletMeshes[i].Free();
+		fallbackMeshes[i].Free();
 	}
+	delete[] meshletMeshes;
+	meshletMeshes = nullptr;
+	delete[] fallbackMeshes;
+	HostMemory::LogStats();
 
 	VkCommandPool tmpCommandPool;
 	VkCommandPoolCreateInfo tmpCommandPoolInfo{};
@@ -866,33 +2302,48 @@ bool ModuleVulkan::Init()
 			return false;
 	}
 
-	offset = 0;
+	VkDeviceSize offset = 0;
 	VkBufferCopy bufferCopyRegion{};
-	bufferCopyRegion.size = meshletMesh.meshletCount * sizeof(meshopt_Meshlet);
+	bufferCopyRegion.size = totalCullInfos * cullInfoSize;
 	bufferCopyRegion.dstOffset = 0;
 	bufferCopyRegion.srcOffset = 0;
-	vkCmdCopyBuffer(tmpCmdBuffer, stagingBuffer, meshletBuffer, 1, &bufferCopyRegion);
+	vkCmdCopyBuffer(tmpCmdBuffer, stagingBuffer, meshletCullInfoBuffer, 1, &bufferCopyRegion);
 	offset += bufferCopyRegion.size;
-	bufferCopyRegion.size = meshletMesh.meshletCount * sizeof(float) * 8;
-	bufferCopyRegion.dstOffset = 0;
+	bufferCopyRegion.size = sizeof(uint32_t) * MAX_INSTANCES;
 	bufferCopyRegion.srcOffset = offset;
-	vkCmdCopyBuffer(tmpCmdBuffer, stagingBuffer, meshletCullInfoBuffer, 1, &bufferCopyRegion);
+	vkCmdCopyBuffer(tmpCmdBuffer, stagingBuffer, instanceMeshesBuffer, 1, &bufferCopyRegion);
+	offset += bufferCopyRegion.size;
+	bufferCopyRegion.size = sizeof(MeshRecord) * numRecords;
+	bufferCopyRegion.srcOffset = offset;
+	vkCmdCopyBuffer(tmpCmdBuffer, stagingBuffer, meshRecordsBuffer, 1, &bufferCopyRegion);
+	offset += bufferCopyRegion.size;
+	bufferCopyRegion.size = OBBsSize;
+	bufferCopyRegion.srcOffset = offset;
+	vkCmdCopyBuffer(tmpCmdBuffer, stagingBuffer, OBBsBuffer, 1, &bufferCopyRegion);
+	offset += bufferCopyRegion.size;
+	bufferCopyRegion.size = sizeof(InstanceSimulation::Motion) * MAX_INSTANCES;
+	bufferCopyRegion.srcOffset = offset;
+	vkCmdCopyBuffer(tmpCmdBuffer, stagingBuffer, instanceMotionsBuffer, 1, &bufferCopyRegion);
 	offset += bufferCopyRegion.size;
-	bufferCopyRegion.size = meshletMesh.GetMeshletsVerticeCount() * sizeof(uint32_t);
+	bufferCopyRegion.size = sizeof(InstanceSimulation::Keyframe) * InstanceSimulation::SCENE_KEYFRAMES;
 	bufferCopyRegion.srcOffset = offset;
-	vkCmdCopyBuffer(tmpCmdBuffer, stagingBuffer, meshletVerticesBuffer, 1, &bufferCopyRegion);
+	vkCmdCopyBuffer(tmpCmdBuffer, stagingBuffer, instanceKeyframesBuffer, 1, &bufferCopyRegion);
 	offset += bufferCopyRegion.size;
-	bufferCopyRegion.size = meshletMesh.GetMeshletsTriangleCount() * sizeof(uint32_t);
+	bufferCopyRegion.size = sizeof(Impostor::Record) * impostorRecords.size();
 	bufferCopyRegion.srcOffset = offset;
-	vkCmdCopyBuffer(tmpCmdBuffer, stagingBuffer, meshletTrianglesBuffer, 1, &bufferCopyRegion);
+	vkCmdCopyBuffer(tmpCmdBuffer, stagingBuffer, impostorRecordsBuffer, 1, &bufferCopyRegion);
 	offset += bufferCopyRegion.size;
-	bufferCopyRegion.size = meshletMesh.mesh.numVertices * sizeof(Vertex);
+	bufferCopyRegion.size = sizeof(uint32_t) * impostorAtlas.size();
 	bufferCopyRegion.srcOffset = offset;
-	vkCmdCopyBuffer(tmpCmdBuffer, stagingBuffer, vertexBuffer, 1, &bufferCopyRegion);
+	vkCmdCopyBuffer(tmpCmdBuffer, stagingBuffer, impostorAtlasBuffer, 1, &bufferCopyRegion);
 	offset += bufferCopyRegion.size;
-	bufferCopyRegion.size = sizeof(uint32_t) * NUM_MODELS;
+	bufferCopyRegion.size = lightsSize;
 	bufferCopyRegion.srcOffset = offset;
-	vkCmdCopyBuffer(tmpCmdBuffer, stagingBuffer, numMeshletsBuffer, 1, &bufferCopyRegion);
+	vkCmdCopyBuffer(tmpCmdBuffer, stagingBuffer, lightsBuffer, 1, &bufferCopyRegion);
+	//every entry uncached, the meshlet states are only read with a valid entry
+	vkCmdFillBuffer(tmpCmdBuffer, cacheEntriesBuffer, 0, VK_WHOLE_SIZE, 0);
+	//fallback pages + page table + record residency
+	RecordStreamingCopies(tmpCmdBuffer, stagingBuffer);
 
 	vkEndCommandBuffer(tmpCmdBuffer);
 	VkSubmitInfo submitInfo{};
@@ -907,39 +2358,80 @@ bool ModuleVulkan::Init()
 	vkDestroyBuffer(device, stagingBuffer, nullptr);
 
 
-	VkDescriptorPoolSize poolSize[4]{};
+	VkDescriptorPoolSize poolSize[16]{};
 	//graphics descriptors
 	poolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSize[0].descriptorCount = 1 * MAX_FRAMES_IN_FLIGHT;
+	poolSize[0].descriptorCount = 3 * MAX_FRAMES_IN_FLIGHT;
 	poolSize[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-	poolSize[1].descriptorCount = 6 * MAX_FRAMES_IN_FLIGHT;
+	poolSize[1].descriptorCount = 22 * MAX_FRAMES_IN_FLIGHT;
 	//cull descriptors
 	poolSize[2].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSize[2].descriptorCount = 1 * MAX_FRAMES_IN_FLIGHT;
+	poolSize[2].descriptorCount = 2 * MAX_FRAMES_IN_FLIGHT;
 	poolSize[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-	poolSize[3].descriptorCount = 7 * MAX_FRAMES_IN_FLIGHT;
+	poolSize[3].descriptorCount = 24 * MAX_FRAMES_IN_FLIGHT;
+	//visibility buffer shade descriptors
+	poolSize[4].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSize[4].descriptorCount = 1 * MAX_FRAMES_IN_FLIGHT;
+	poolSize[5].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	poolSize[5].descriptorCount = 2 * MAX_FRAMES_IN_FLIGHT;
+	poolSize[6].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize[6].descriptorCount = 9 * MAX_FRAMES_IN_FLIGHT;
+	//software raster descriptors
+	poolSize[7].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	poolSize[7].descriptorCount = 2 * MAX_FRAMES_IN_FLIGHT;
+	poolSize[8].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize[8].descriptorCount = 8 * MAX_FRAMES_IN_FLIGHT;
+	//instance simulation descriptors
+	poolSize[9].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	poolSize[9].descriptorCount = 1 * MAX_FRAMES_IN_FLIGHT;
+	poolSize[10].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize[10].descriptorCount = 3 * MAX_FRAMES_IN_FLIGHT;
+	//depth sort descriptors
+	poolSize[11].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize[11].descriptorCount = 7 * MAX_FRAMES_IN_FLIGHT;
+	//shadow cull and shadow draw descriptors, only with the cascades
+	poolSize[12].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	poolSize[12].descriptorCount = 1 * MAX_FRAMES_IN_FLIGHT;
+	poolSize[13].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize[13].descriptorCount = 8 * MAX_FRAMES_IN_FLIGHT;
+	poolSize[14].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	poolSize[14].descriptorCount = 1 * MAX_FRAMES_IN_FLIGHT;
+	poolSize[15].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize[15].descriptorCount = 10 * MAX_FRAMES_IN_FLIGHT;
+	const uint32_t setKinds = shadowCascades != 0 ? 8 : 6;
 	VkDescriptorPoolCreateInfo dPoolInfo{};
 	dPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	dPoolInfo.poolSizeCount = sizeof(poolSize) / sizeof(VkDescriptorPoolSize);
+	dPoolInfo.poolSizeCount = shadowCascades != 0 ? sizeof(poolSize) / sizeof(VkDescriptorPoolSize) : 12;
 	dPoolInfo.pPoolSizes = poolSize;
-	dPoolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * 2;
+	dPoolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * setKinds;
 	if (vkCreateDescriptorPool(device, &dPoolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
 		LOG("Error creating the descriptor pool");
 		return false;
 	}
 
-	VkDescriptorSetLayout dSetLayouts[MAX_FRAMES_IN_FLIGHT * 2];
+	VkDescriptorSetLayout dSetLayouts[MAX_FRAMES_IN_FLIGHT * 8];
 	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
 	{
 		//Graphics
 		dSetLayouts[i] = descriptorSetLayout;
 		//Compute
 		dSetLayouts[i + MAX_FRAMES_IN_FLIGHT] = cullSetLayout;
+		//Visibility buffer shading
+		dSetLayouts[i + MAX_FRAMES_IN_FLIGHT * 2] = visShadeSetLayout;
+		//Software raster
+		dSetLayouts[i + MAX_FRAMES_IN_FLIGHT * 3] = swRasterSetLayout;
+		//Instance simulation
+		dSetLayouts[i + MAX_FRAMES_IN_FLIGHT * 4] = instanceSimSetLayout;
+		//Depth sort
+		dSetLayouts[i + MAX_FRAMES_IN_FLIGHT * 5] = sortSetLayout;
+		//Shadow cull and shadow draw
+		dSetLayouts[i + MAX_FRAMES_IN_FLIGHT * 6] = shadowCullSetLayout;
+		dSetLayouts[i + MAX_FRAMES_IN_FLIGHT * 7] = shadowSetLayout;
 	}
 	VkDescriptorSetAllocateInfo dSetAllocInfo{};
 	dSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	dSetAllocInfo.descriptorPool = descriptorPool;
-	dSetAllocInfo.descriptorSetCount = sizeof(dSetLayouts) / sizeof(VkDescriptorSetLayout);
+	dSetAllocInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT * setKinds;
 	dSetAllocInfo.pSetLayouts = dSetLayouts;
 	descriptorSets = new VkDescriptorSet[dSetAllocInfo.descriptorSetCount];
 	if (vkAllocateDescriptorSets(device, &dSetAllocInfo, descriptorSets) != VK_SUCCESS) {
@@ -970,13 +2462,72 @@ bool ModuleVulkan::Init()
 		ssBufferInfo[4].offset = (modelMatricesSize + GetInbetweenAlignmentSpace(modelMatricesSize, minStorageBufferOffsetAlignment)) * i;
 		ssBufferInfo[4].range = modelMatricesSize;
 		ssBufferInfo[5].buffer = modelIDsBuffer;
-		ssBufferInfo[5].offset = 0;
-		ssBufferInfo[5].range = VK_WHOLE_SIZE;
+		ssBufferInfo[5].offset = (modelIDsSize + GetInbetweenAlignmentSpace(modelIDsSize, minStorageBufferOffsetAlignment)) * i;
+		ssBufferInfo[5].range = modelIDsSize;
 		ssBufferInfo[6].buffer = meshletCullInfoBuffer;
 		ssBufferInfo[6].offset = 0;
 		ssBufferInfo[6].range = VK_WHOLE_SIZE;
 
-		VkWriteDescriptorSet descriptorWrite[5]{};
+		VkDescriptorBufferInfo frustumBufferInfo{};
+		frustumBufferInfo.buffer = frustumPlanesBuffer;
+		frustumBufferInfo.offset = (frustumPlaneSize + GetInbetweenAlignmentSpace(frustumPlaneSize, minUniformBufferOffsetAlignment)) * i;
+		frustumBufferInfo.range = frustumPlaneSize;
+		VkDescriptorBufferInfo statsBufferInfo{};
+		statsBufferInfo.buffer = statsBuffer;
+		statsBufferInfo.offset = (statsSize + GetInbetweenAlignmentSpace(statsSize, minStorageBufferOffsetAlignment)) * i;
+		statsBufferInfo.range = statsSize;
+		VkDescriptorBufferInfo meshBufferInfo{};
+		meshBufferInfo.buffer = meshRecordsBuffer;
+		meshBufferInfo.offset = 0;
+		meshBufferInfo.range = VK_WHOLE_SIZE;
+		//the visibility buffer (binding 12) is written by UpdateVisibilityDescriptors
+		VkDescriptorBufferInfo clusterBufferInfo[2]{};
+		clusterBufferInfo[0].buffer = visibleClustersBuffer;
+		clusterBufferInfo[0].offset = 0;
+		clusterBufferInfo[0].range = VK_WHOLE_SIZE;
+		clusterBufferInfo[1].buffer = swClustersBuffer;
+		clusterBufferInfo[1].offset = 0;
+		clusterBufferInfo[1].range = VK_WHOLE_SIZE;
+		VkDescriptorBufferInfo streamingBufferInfo[2]{};
+		streamingBufferInfo[0].buffer = pageTableBuffer;
+		streamingBufferInfo[0].offset = 0;
+		streamingBufferInfo[0].range = VK_WHOLE_SIZE;
+		streamingBufferInfo[1].buffer = pageFeedbackBuffer;
+		streamingBufferInfo[1].offset = (pageFeedbackSize + GetInbetweenAlignmentSpace(pageFeedbackSize, minStorageBufferOffsetAlignment)) * i;
+		streamingBufferInfo[1].range = pageFeedbackSize;
+		VkDescriptorBufferInfo cacheBufferInfo[2]{};
+		cacheBufferInfo[0].buffer = cacheEntriesBuffer;
+		cacheBufferInfo[0].offset = 0;
+		cacheBufferInfo[0].range = VK_WHOLE_SIZE;
+		cacheBufferInfo[1].buffer = meshletStatesBuffer;
+		cacheBufferInfo[1].offset = 0;
+		cacheBufferInfo[1].range = VK_WHOLE_SIZE;
+		VkDescriptorBufferInfo impostorBufferInfo[4]{};
+		impostorBufferInfo[0].buffer = impostorCountsBuffer;
+		impostorBufferInfo[0].offset = (impostorCountsSize + GetInbetweenAlignmentSpace(impostorCountsSize, minStorageBufferOffsetAlignment)) * i;
+		impostorBufferInfo[0].range = impostorCountsSize;
+		impostorBufferInfo[1].buffer = impostorDrawsBuffer;
+		impostorBufferInfo[1].offset = (impostorDrawsSize + GetInbetweenAlignmentSpace(impostorDrawsSize, minStorageBufferOffsetAlignment)) * i;
+		impostorBufferInfo[1].range = impostorDrawsSize;
+		impostorBufferInfo[2].buffer = impostorRecordsBuffer;
+		impostorBufferInfo[2].offset = 0;
+		impostorBufferInfo[2].range = VK_WHOLE_SIZE;
+		impostorBufferInfo[3].buffer = impostorAtlasBuffer;
+		impostorBufferInfo[3].offset = 0;
+		impostorBufferInfo[3].range = VK_WHOLE_SIZE;
+		//clustered lights: grid parameters, lights and cluster grid of the frame
+		VkDescriptorBufferInfo lightBufferInfo[3]{};
+		lightBufferInfo[0].buffer = clusterParamsBuffer;
+		lightBufferInfo[0].offset = (clusterParamsSize + GetInbetweenAlignmentSpace(clusterParamsSize, minUniformBufferOffsetAlignment)) * i;
+		lightBufferInfo[0].range = clusterParamsSize;
+		lightBufferInfo[1].buffer = lightsBuffer;
+		lightBufferInfo[1].offset = 0;
+		lightBufferInfo[1].range = VK_WHOLE_SIZE;
+		lightBufferInfo[2].buffer = clusterGridBuffer;
+		lightBufferInfo[2].offset = (clusterGridSize + GetInbetweenAlignmentSpace(clusterGridSize, minStorageBufferOffsetAlignment)) * i;
+		lightBufferInfo[2].range = clusterGridSize;
+
+		VkWriteDescriptorSet descriptorWrite[14]{};
 		descriptorWrite[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 		descriptorWrite[0].dstSet = descriptorSets[i];
 		descriptorWrite[0].dstBinding = 1;
@@ -1027,6 +2578,78 @@ bool ModuleVulkan::Init()
 		descriptorWrite[4].pImageInfo = nullptr; // Optional
 		descriptorWrite[4].pTexelBufferView = nullptr; // Optional
 
+		descriptorWrite[5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite[5].dstSet = descriptorSets[i];
+		descriptorWrite[5].dstBinding = 8;
+		descriptorWrite[5].dstArrayElement = 0;
+		descriptorWrite[5].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		descriptorWrite[5].descriptorCount = 1;
+		descriptorWrite[5].pBufferInfo = &frustumBufferInfo;
+
+		descriptorWrite[6].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite[6].dstSet = descriptorSets[i];
+		descriptorWrite[6].dstBinding = 9;
+		descriptorWrite[6].dstArrayElement = 0;
+		descriptorWrite[6].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrite[6].descriptorCount = 1;
+		descriptorWrite[6].pBufferInfo = &statsBufferInfo;
+
+		descriptorWrite[7].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite[7].dstSet = descriptorSets[i];
+		descriptorWrite[7].dstBinding = 11;
+		descriptorWrite[7].dstArrayElement = 0;
+		descriptorWrite[7].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrite[7].descriptorCount = 1;
+		descriptorWrite[7].pBufferInfo = &meshBufferInfo;
+
+		descriptorWrite[8].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite[8].dstSet = descriptorSets[i];
+		descriptorWrite[8].dstBinding = 13;
+		descriptorWrite[8].dstArrayElement = 0;
+		descriptorWrite[8].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrite[8].descriptorCount = 2;
+		descriptorWrite[8].pBufferInfo = clusterBufferInfo;
+
+		descriptorWrite[9].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite[9].dstSet = descriptorSets[i];
+		descriptorWrite[9].dstBinding = 15;
+		descriptorWrite[9].dstArrayElement = 0;
+		descriptorWrite[9].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrite[9].descriptorCount = 2;
+		descriptorWrite[9].pBufferInfo = streamingBufferInfo;
+
+		descriptorWrite[10].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite[10].dstSet = descriptorSets[i];
+		descriptorWrite[10].dstBinding = 17;
+		descriptorWrite[10].dstArrayElement = 0;
+		descriptorWrite[10].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrite[10].descriptorCount = 2;
+		descriptorWrite[10].pBufferInfo = cacheBufferInfo;
+
+		descriptorWrite[11].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite[11].dstSet = descriptorSets[i];
+		descriptorWrite[11].dstBinding = 19;
+		descriptorWrite[11].dstArrayElement = 0;
+		descriptorWrite[11].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrite[11].descriptorCount = 4;
+		descriptorWrite[11].pBufferInfo = impostorBufferInfo;
+
+		descriptorWrite[12].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite[12].dstSet = descriptorSets[i];
+		descriptorWrite[12].dstBinding = 23;
+		descriptorWrite[12].dstArrayElement = 0;
+		descriptorWrite[12].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		descriptorWrite[12].descriptorCount = 1;
+		descriptorWrite[12].pBufferInfo = &lightBufferInfo[0];
+
+		descriptorWrite[13].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite[13].dstSet = descriptorSets[i];
+		descriptorWrite[13].dstBinding = 24;
+		descriptorWrite[13].dstArrayElement = 0;
+		descriptorWrite[13].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrite[13].descriptorCount = 2;
+		descriptorWrite[13].pBufferInfo = &lightBufferInfo[1];
+
 		vkUpdateDescriptorSets(device, sizeof(descriptorWrite) / sizeof(VkWriteDescriptorSet), descriptorWrite, 0, nullptr);
 	}
 	//compute
@@ -1036,27 +2659,89 @@ bool ModuleVulkan::Init()
 		uBufferInfo[0].offset = (frustumPlaneSize + GetInbetweenAlignmentSpace(frustumPlaneSize, minUniformBufferOffsetAlignment)) * i;
 		uBufferInfo[0].range = frustumPlaneSize;
 	
-		VkDescriptorBufferInfo ssBufferInfo[6]{};
-		ssBufferInfo[0].buffer = numMeshletsBuffer;
+		VkDescriptorBufferInfo ssBufferInfo[22]{};
+		ssBufferInfo[0].buffer = instanceMeshesBuffer;
 		ssBufferInfo[0].offset = 0;
 		ssBufferInfo[0].range = VK_WHOLE_SIZE;
 		ssBufferInfo[1].buffer = dispatchIndirectBuffer;
-		ssBufferInfo[1].offset = 0;
-		ssBufferInfo[1].range = VK_WHOLE_SIZE;
+		ssBufferInfo[1].offset = (dispatchIndirectSize + GetInbetweenAlignmentSpace(dispatchIndirectSize, minStorageBufferOffsetAlignment)) * i;
+		ssBufferInfo[1].range = dispatchIndirectSize;
 		ssBufferInfo[2].buffer = parameterBuffer;
 		ssBufferInfo[2].offset = (parameterSize + GetInbetweenAlignmentSpace(parameterSize, minStorageBufferOffsetAlignment)) * i;
 		ssBufferInfo[2].range = parameterSize;
 		ssBufferInfo[3].buffer = OBBsBuffer;
-		ssBufferInfo[3].offset = (OBBsSize + GetInbetweenAlignmentSpace(OBBsSize, minStorageBufferOffsetAlignment)) * i;
+		ssBufferInfo[3].offset = 0;
 		ssBufferInfo[3].range = OBBsSize;
 		ssBufferInfo[4].buffer = modelMatricesBuffer;
 		ssBufferInfo[4].offset = (modelMatricesSize + GetInbetweenAlignmentSpace(modelMatricesSize, minStorageBufferOffsetAlignment)) * i;
 		ssBufferInfo[4].range = modelMatricesSize;
 		ssBufferInfo[5].buffer = modelIDsBuffer;
-		ssBufferInfo[5].offset = 0;
-		ssBufferInfo[5].range = VK_WHOLE_SIZE;
+		ssBufferInfo[5].offset = (modelIDsSize + GetInbetweenAlignmentSpace(modelIDsSize, minStorageBufferOffsetAlignment)) * i;
+		ssBufferInfo[5].range = modelIDsSize;
+		ssBufferInfo[6].buffer = statsBuffer;
+		ssBufferInfo[6].offset = (statsSize + GetInbetweenAlignmentSpace(statsSize, minStorageBufferOffsetAlignment)) * i;
+		ssBufferInfo[6].range = statsSize;
+		ssBufferInfo[7].buffer = meshRecordsBuffer;
+		ssBufferInfo[7].offset = 0;
+		ssBufferInfo[7].range = VK_WHOLE_SIZE;
+		ssBufferInfo[8].buffer = recordResidencyBuffer;
+		ssBufferInfo[8].offset = 0;
+		ssBufferInfo[8].range = VK_WHOLE_SIZE;
+		ssBufferInfo[9].buffer = pageTableBuffer;
+		ssBufferInfo[9].offset = 0;
+		ssBufferInfo[9].range = VK_WHOLE_SIZE;
+		ssBufferInfo[10].buffer = pageFeedbackBuffer;
+		ssBufferInfo[10].offset = (pageFeedbackSize + GetInbetweenAlignmentSpace(pageFeedbackSize, minStorageBufferOffsetAlignment)) * i;
+		ssBufferInfo[10].range = pageFeedbackSize;
+		ssBufferInfo[11].buffer = occlusionBitsBuffer;
+		ssBufferInfo[11].offset = (occlusionBitsSize + GetInbetweenAlignmentSpace(occlusionBitsSize, minStorageBufferOffsetAlignment)) * i;
+		ssBufferInfo[11].range = occlusionBitsSize;
+		//first half of the sort buffers
+		ssBufferInfo[12].buffer = sortKeysBuffer;
+		ssBufferInfo[12].offset = (sortKeysSize + GetInbetweenAlignmentSpace(sortKeysSize, minStorageBufferOffsetAlignment)) * i;
+		ssBufferInfo[12].range = sortKeysSize / 2;
+		ssBufferInfo[13].buffer = sortValuesBuffer;
+		ssBufferInfo[13].offset = (sortValuesSize + GetInbetweenAlignmentSpace(sortValuesSize, minStorageBufferOffsetAlignment)) * i;
+		ssBufferInfo[13].range = sortValuesSize / 2;
+		//visibility cache, kept across the frames. The invalid bits of the frame
+		ssBufferInfo[14].buffer = cacheEntriesBuffer;
+		ssBufferInfo[14].offset = 0;
+		ssBufferInfo[14].range = VK_WHOLE_SIZE;
+		ssBufferInfo[15].buffer = meshletStatesBuffer;
+		ssBufferInfo[15].offset = 0;
+		ssBufferInfo[15].range = VK_WHOLE_SIZE;
+		ssBufferInfo[16].buffer = cacheInvalidBitsBuffer;
+		ssBufferInfo[16].offset = (cacheInvalidBitsSize + GetInbetweenAlignmentSpace(cacheInvalidBitsSize, minStorageBufferOffsetAlignment)) * i;
+		ssBufferInfo[16].range = cacheInvalidBitsSize;
+		ssBufferInfo[17].buffer = instanceMotionsBuffer;
+		ssBufferInfo[17].offset = 0;
+		ssBufferInfo[17].range = VK_WHOLE_SIZE;
+		ssBufferInfo[18].buffer = meshletCullInfoBuffer;
+		ssBufferInfo[18].offset = 0;
+		ssBufferInfo[18].range = VK_WHOLE_SIZE;
+		//impostor counts and draws of the frame
+		ssBufferInfo[19].buffer = impostorCountsBuffer;
+		ssBufferInfo[19].offset = (impostorCountsSize + GetInbetweenAlignmentSpace(impostorCountsSize, minStorageBufferOffsetAlignment)) * i;
+		ssBufferInfo[19].range = impostorCountsSize;
+		ssBufferInfo[20].buffer = impostorDrawsBuffer;
+		ssBufferInfo[20].offset = (impostorDrawsSize + GetInbetweenAlignmentSpace(impostorDrawsSize, minStorageBufferOffsetAlignment)) * i;
+		ssBufferInfo[20].range = impostorDrawsSize;
+		ssBufferInfo[21].buffer = impostorRecordsBuffer;
+		ssBufferInfo[21].offset = 0;
+		ssBufferInfo[21].range = VK_WHOLE_SIZE;
+		//clustered lights: grid parameters, lights and cluster grid of the frame
+		VkDescriptorBufferInfo lightBufferInfo[3]{};
+		lightBufferInfo[0].buffer = clusterParamsBuffer;
+		lightBufferInfo[0].offset = (clusterParamsSize + GetInbetweenAlignmentSpace(clusterParamsSize, minUniformBufferOffsetAlignment)) * i;
+		lightBufferInfo[0].range = clusterParamsSize;
+		lightBufferInfo[1].buffer = lightsBuffer;
+		lightBufferInfo[1].offset = 0;
+		lightBufferInfo[1].range = VK_WHOLE_SIZE;
+		lightBufferInfo[2].buffer = clusterGridBuffer;
+		lightBufferInfo[2].offset = (clusterGridSize + GetInbetweenAlignmentSpace(clusterGridSize, minStorageBufferOffsetAlignment)) * i;
+		lightBufferInfo[2].range = clusterGridSize;
 	
-		VkWriteDescriptorSet descriptorWrite[2]{};
+		VkWriteDescriptorSet descriptorWrite[4]{};
 		descriptorWrite[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 		descriptorWrite[0].dstSet = descriptorSets[i + MAX_FRAMES_IN_FLIGHT];
 		descriptorWrite[0].dstBinding = 0;
@@ -1076,155 +2761,1061 @@ bool ModuleVulkan::Init()
 		descriptorWrite[1].pBufferInfo = ssBufferInfo;
 		descriptorWrite[1].pImageInfo = nullptr; // Optional
 		descriptorWrite[1].pTexelBufferView = nullptr; // Optional
+
+		descriptorWrite[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite[2].dstSet = descriptorSets[i + MAX_FRAMES_IN_FLIGHT];
+		descriptorWrite[2].dstBinding = 23;
+		descriptorWrite[2].dstArrayElement = 0;
+		descriptorWrite[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		descriptorWrite[2].descriptorCount = 1;
+		descriptorWrite[2].pBufferInfo = &lightBufferInfo[0];
+
+		descriptorWrite[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite[3].dstSet = descriptorSets[i + MAX_FRAMES_IN_FLIGHT];
+		descriptorWrite[3].dstBinding = 24;
+		descriptorWrite[3].dstArrayElement = 0;
+		descriptorWrite[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrite[3].descriptorCount = 2;
+		descriptorWrite[3].pBufferInfo = &lightBufferInfo[1];
 	
 		vkUpdateDescriptorSets(device, sizeof(descriptorWrite) / sizeof(VkWriteDescriptorSet), descriptorWrite, 0, nullptr);
 	}
+	//visibility buffer shading, the images are written by UpdateVisibilityDescriptors as they change with the swapchain
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		VkDescriptorBufferInfo uBufferInfo{};
+		uBufferInfo.buffer = transformsBuffer;
+		uBufferInfo.offset = (transformsSize + GetInbetweenAlignmentSpace(transformsSize, minUniformBufferOffsetAlignment)) * i;
+		uBufferInfo.range = transformsSize;
+
+		VkDescriptorBufferInfo ssBufferInfo[6]{};
+		ssBufferInfo[0].buffer = meshletBuffer;
+		ssBufferInfo[0].offset = 0;
+		ssBufferInfo[0].range = VK_WHOLE_SIZE;
+		ssBufferInfo[1].buffer = meshletVerticesBuffer;
+		ssBufferInfo[1].offset = 0;
+		ssBufferInfo[1].range = VK_WHOLE_SIZE;
+		ssBufferInfo[2].buffer = meshletTrianglesBuffer;
+		ssBufferInfo[2].offset = 0;
+		ssBufferInfo[2].range = VK_WHOLE_SIZE;
+		ssBufferInfo[3].buffer = vertexBuffer;
+		ssBufferInfo[3].offset = 0;
+		ssBufferInfo[3].range = VK_WHOLE_SIZE;
+		ssBufferInfo[4].buffer = modelMatricesBuffer;
+		ssBufferInfo[4].offset = (modelMatricesSize + GetInbetweenAlignmentSpace(modelMatricesSize, minStorageBufferOffsetAlignment)) * i;
+		ssBufferInfo[4].range = modelMatricesSize;
+		ssBufferInfo[5].buffer = visibleClustersBuffer;
+		ssBufferInfo[5].offset = 0;
+		ssBufferInfo[5].range = VK_WHOLE_SIZE;
+		//clustered lights: grid parameters, lights and cluster grid of the frame
+		VkDescriptorBufferInfo lightBufferInfo[3]{};
+		lightBufferInfo[0].buffer = clusterParamsBuffer;
+		lightBufferInfo[0].offset = (clusterParamsSize + GetInbetweenAlignmentSpace(clusterParamsSize, minUniformBufferOffsetAlignment)) * i;
+		lightBufferInfo[0].range = clusterParamsSize;
+		lightBufferInfo[1].buffer = lightsBuffer;
+		lightBufferInfo[1].offset = 0;
+		lightBufferInfo[1].range = VK_WHOLE_SIZE;
+		lightBufferInfo[2].buffer = clusterGridBuffer;
+		lightBufferInfo[2].offset = (clusterGridSize + GetInbetweenAlignmentSpace(clusterGridSize, minStorageBufferOffsetAlignment)) * i;
+		lightBufferInfo[2].range = clusterGridSize;
+
+		VkWriteDescriptorSet descriptorWrite[4]{};
+		descriptorWrite[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite[0].dstSet = descriptorSets[i + MAX_FRAMES_IN_FLIGHT * 2];
+		descriptorWrite[0].dstBinding = 2;
+		descriptorWrite[0].dstArrayElement = 0;
+		descriptorWrite[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		descriptorWrite[0].descriptorCount = 1;
+		descriptorWrite[0].pBufferInfo = &uBufferInfo;
+
+		descriptorWrite[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite[1].dstSet = descriptorSets[i + MAX_FRAMES_IN_FLIGHT * 2];
+		descriptorWrite[1].dstBinding = 3;
+		descriptorWrite[1].dstArrayElement = 0;
+		descriptorWrite[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrite[1].descriptorCount = sizeof(ssBufferInfo) / sizeof(VkDescriptorBufferInfo);
+		descriptorWrite[1].pBufferInfo = ssBufferInfo;
+
+		descriptorWrite[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite[2].dstSet = descriptorSets[i + MAX_FRAMES_IN_FLIGHT * 2];
+		descriptorWrite[2].dstBinding = 9;
+		descriptorWrite[2].dstArrayElement = 0;
+		descriptorWrite[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		descriptorWrite[2].descriptorCount = 1;
+		descriptorWrite[2].pBufferInfo = &lightBufferInfo[0];
+
+		descriptorWrite[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite[3].dstSet = descriptorSets[i + MAX_FRAMES_IN_FLIGHT * 2];
+		descriptorWrite[3].dstBinding = 10;
+		descriptorWrite[3].dstArrayElement = 0;
+		descriptorWrite[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrite[3].descriptorCount = 2;
+		descriptorWrite[3].pBufferInfo = &lightBufferInfo[1];
+
+		vkUpdateDescriptorSets(device, sizeof(descriptorWrite) / sizeof(VkWriteDescriptorSet), descriptorWrite, 0, nullptr);
+	}
+	//software raster, the visibility buffer is written by UpdateVisibilityDescriptors
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		VkDescriptorBufferInfo uBufferInfo[2]{};
+		uBufferInfo[0].buffer = transformsBuffer;
+		uBufferInfo[0].offset = (transformsSize + GetInbetweenAlignmentSpace(transformsSize, minUniformBufferOffsetAlignment)) * i;
+		uBufferInfo[0].range = transformsSize;
+		uBufferInfo[1].buffer = frustumPlanesBuffer;
+		uBufferInfo[1].offset = (frustumPlaneSize + GetInbetweenAlignmentSpace(frustumPlaneSize, minUniformBufferOffsetAlignment)) * i;
+		uBufferInfo[1].range = frustumPlaneSize;
 
-	modelMatrices = new glm::mat4[NUM_MODELS];
-	int randomNumber1 = 0;
-	int randomNumber2 = 1000;
-	int randomNumber3 = 200;
-	int randomNumber4 = 45;
-	int randomNumber5 = 200;
-	int randomNumber6 = 4;
-	int randomNumber7 = 70;
-	for (int i = 0; i < NUM_MODELS; ++i)
+		VkDescriptorBufferInfo ssBufferInfo[7]{};
+		ssBufferInfo[0].buffer = meshletBuffer;
+		ssBufferInfo[0].offset = 0;
+		ssBufferInfo[0].range = VK_WHOLE_SIZE;
+		ssBufferInfo[1].buffer = meshletVerticesBuffer;
+		ssBufferInfo[1].offset = 0;
+		ssBufferInfo[1].range = VK_WHOLE_SIZE;
+		ssBufferInfo[2].buffer = meshletTrianglesBuffer;
+		ssBufferInfo[2].offset = 0;
+		ssBufferInfo[2].range = VK_WHOLE_SIZE;
+		ssBufferInfo[3].buffer = vertexBuffer;
+		ssBufferInfo[3].offset = 0;
+		ssBufferInfo[3].range = VK_WHOLE_SIZE;
+		ssBufferInfo[4].buffer = modelMatricesBuffer;
+		ssBufferInfo[4].offset = (modelMatricesSize + GetInbetweenAlignmentSpace(modelMatricesSize, minStorageBufferOffsetAlignment)) * i;
+		ssBufferInfo[4].range = modelMatricesSize;
+		ssBufferInfo[5].buffer = visibleClustersBuffer;
+		ssBufferInfo[5].offset = 0;
+		ssBufferInfo[5].range = VK_WHOLE_SIZE;
+		ssBufferInfo[6].buffer = swClustersBuffer;
+		ssBufferInfo[6].offset = 0;
+		ssBufferInfo[6].range = VK_WHOLE_SIZE;
+
+		VkWriteDescriptorSet descriptorWrite[2]{};
+		descriptorWrite[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite[0].dstSet = descriptorSets[i + MAX_FRAMES_IN_FLIGHT * 3];
+		descriptorWrite[0].dstBinding = 0;
+		descriptorWrite[0].dstArrayElement = 0;
+		descriptorWrite[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		descriptorWrite[0].descriptorCount = sizeof(uBufferInfo) / sizeof(VkDescriptorBufferInfo);
+		descriptorWrite[0].pBufferInfo = uBufferInfo;
+
+		descriptorWrite[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite[1].dstSet = descriptorSets[i + MAX_FRAMES_IN_FLIGHT * 3];
+		descriptorWrite[1].dstBinding = 2;
+		descriptorWrite[1].dstArrayElement = 0;
+		descriptorWrite[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrite[1].descriptorCount = sizeof(ssBufferInfo) / sizeof(VkDescriptorBufferInfo);
+		descriptorWrite[1].pBufferInfo = ssBufferInfo;
+
+		vkUpdateDescriptorSets(device, sizeof(descriptorWrite) / sizeof(VkWriteDescriptorSet), descriptorWrite, 0, nullptr);
+	}
+	//instance simulation
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		VkDescriptorBufferInfo uBufferInfo{};
+		uBufferInfo.buffer = frustumPlanesBuffer;
+		uBufferInfo.offset = (frustumPlaneSize + GetInbetweenAlignmentSpace(frustumPlaneSize, minUniformBufferOffsetAlignment)) * i;
+		uBufferInfo.range = frustumPlaneSize;
+
+		VkDescriptorBufferInfo ssBufferInfo[3]{};
+		ssBufferInfo[0].buffer = instanceMotionsBuffer;
+		ssBufferInfo[0].offset = 0;
+		ssBufferInfo[0].range = VK_WHOLE_SIZE;
+		ssBufferInfo[1].buffer = instanceKeyframesBuffer;
+		ssBufferInfo[1].offset = 0;
+		ssBufferInfo[1].range = VK_WHOLE_SIZE;
+		ssBufferInfo[2].buffer = modelMatricesBuffer;
+		ssBufferInfo[2].offset = (modelMatricesSize + GetInbetweenAlignmentSpace(modelMatricesSize, minStorageBufferOffsetAlignment)) * i;
+		ssBufferInfo[2].range = modelMatricesSize;
+
+		VkWriteDescriptorSet descriptorWrite[2]{};
+		descriptorWrite[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite[0].dstSet = descriptorSets[i + MAX_FRAMES_IN_FLIGHT * 4];
+		descriptorWrite[0].dstBinding = 0;
+		descriptorWrite[0].dstArrayElement = 0;
+		descriptorWrite[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		descriptorWrite[0].descriptorCount = 1;
+		descriptorWrite[0].pBufferInfo = &uBufferInfo;
+
+		descriptorWrite[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite[1].dstSet = descriptorSets[i + MAX_FRAMES_IN_FLIGHT * 4];
+		descriptorWrite[1].dstBinding = 1;
+		descriptorWrite[1].dstArrayElement = 0;
+		descriptorWrite[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrite[1].descriptorCount = sizeof(ssBufferInfo) / sizeof(VkDescriptorBufferInfo);
+		descriptorWrite[1].pBufferInfo = ssBufferInfo;
+
+		vkUpdateDescriptorSets(device, sizeof(descriptorWrite) / sizeof(VkWriteDescriptorSet), descriptorWrite, 0, nullptr);
+	}
+	//depth sort, both halves of the sort buffers
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		VkDescriptorBufferInfo ssBufferInfo[7]{};
+		ssBufferInfo[0].buffer = parameterBuffer;
+		ssBufferInfo[0].offset = (parameterSize + GetInbetweenAlignmentSpace(parameterSize, minStorageBufferOffsetAlignment)) * i;
+		ssBufferInfo[0].range = parameterSize;
+		ssBufferInfo[1].buffer = sortKeysBuffer;
+		ssBufferInfo[1].offset = (sortKeysSize + GetInbetweenAlignmentSpace(sortKeysSize, minStorageBufferOffsetAlignment)) * i;
+		ssBufferInfo[1].range = sortKeysSize;
+		ssBufferInfo[2].buffer = sortValuesBuffer;
+		ssBufferInfo[2].offset = (sortValuesSize + GetInbetweenAlignmentSpace(sortValuesSize, minStorageBufferOffsetAlignment)) * i;
+		ssBufferInfo[2].range = sortValuesSize;
+		ssBufferInfo[3].buffer = sortBlockCountsBuffer;
+		ssBufferInfo[3].offset = (sortBlockCountsSize + GetInbetweenAlignmentSpace(sortBlockCountsSize, minStorageBufferOffsetAlignment)) * i;
+		ssBufferInfo[3].range = sortBlockCountsSize;
+		ssBufferInfo[4].buffer = meshRecordsBuffer;
+		ssBufferInfo[4].offset = 0;
+		ssBufferInfo[4].range = VK_WHOLE_SIZE;
+		ssBufferInfo[5].buffer = dispatchIndirectBuffer;
+		ssBufferInfo[5].offset = (dispatchIndirectSize + GetInbetweenAlignmentSpace(dispatchIndirectSize, minStorageBufferOffsetAlignment)) * i;
+		ssBufferInfo[5].range = dispatchIndirectSize;
+		ssBufferInfo[6].buffer = modelIDsBuffer;
+		ssBufferInfo[6].offset = (modelIDsSize + GetInbetweenAlignmentSpace(modelIDsSize, minStorageBufferOffsetAlignment)) * i;
+		ssBufferInfo[6].range = modelIDsSize;
+
+		VkWriteDescriptorSet descriptorWrite{};
+		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite.dstSet = descriptorSets[i + MAX_FRAMES_IN_FLIGHT * 5];
+		descriptorWrite.dstBinding = 0;
+		descriptorWrite.dstArrayElement = 0;
+		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrite.descriptorCount = sizeof(ssBufferInfo) / sizeof(VkDescriptorBufferInfo);
+		descriptorWrite.pBufferInfo = ssBufferInfo;
+		vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+	}
+	//shadow cull and shadow draw, the views and the partitions of the frame
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT && shadowCascades != 0; i++) {
+		VkDescriptorBufferInfo uBufferInfo{};
+		uBufferInfo.buffer = shadowViewsBuffer;
+		uBufferInfo.offset = (shadowViewsSize + GetInbetweenAlignmentSpace(shadowViewsSize, minUniformBufferOffsetAlignment)) * i;
+		uBufferInfo.range = shadowViewsSize;
+
+		VkDescriptorBufferInfo cullBufferInfo[8]{};
+		cullBufferInfo[0].buffer = instanceMeshesBuffer;
+		cullBufferInfo[0].offset = 0;
+		cullBufferInfo[0].range = VK_WHOLE_SIZE;
+		cullBufferInfo[1].buffer = OBBsBuffer;
+		cullBufferInfo[1].offset = 0;
+		cullBufferInfo[1].range = VK_WHOLE_SIZE;
+		cullBufferInfo[2].buffer = modelMatricesBuffer;
+		cullBufferInfo[2].offset = (modelMatricesSize + GetInbetweenAlignmentSpace(modelMatricesSize, minStorageBufferOffsetAlignment)) * i;
+		cullBufferInfo[2].range = modelMatricesSize;
+		cullBufferInfo[3].buffer = meshRecordsBuffer;
+		cullBufferInfo[3].offset = 0;
+		cullBufferInfo[3].range = VK_WHOLE_SIZE;
+		cullBufferInfo[4].buffer = recordResidencyBuffer;
+		cullBufferInfo[4].offset = 0;
+		cullBufferInfo[4].range = VK_WHOLE_SIZE;
+		cullBufferInfo[5].buffer = shadowCommandsBuffer;
+		cullBufferInfo[5].offset = (shadowCommandsSize + GetInbetweenAlignmentSpace(shadowCommandsSize, minStorageBufferOffsetAlignment)) * i;
+		cullBufferInfo[5].range = shadowCommandsSize;
+		cullBufferInfo[6].buffer = shadowDrawsBuffer;
+		cullBufferInfo[6].offset = (shadowDrawsSize + GetInbetweenAlignmentSpace(shadowDrawsSize, minStorageBufferOffsetAlignment)) * i;
+		cullBufferInfo[6].range = shadowDrawsSize;
+		cullBufferInfo[7].buffer = shadowCountsBuffer;
+		cullBufferInfo[7].offset = (shadowCountsSize + GetInbetweenAlignmentSpace(shadowCountsSize, minStorageBufferOffsetAlignment)) * i;
+		cullBufferInfo[7].range = shadowCountsSize;
+
+		VkDescriptorBufferInfo drawBufferInfo[10]{};
+		drawBufferInfo[0].buffer = meshletBuffer;
+		drawBufferInfo[0].offset = 0;
+		drawBufferInfo[0].range = VK_WHOLE_SIZE;
+		drawBufferInfo[1].buffer = meshletVerticesBuffer;
+		drawBufferInfo[1].offset = 0;
+		drawBufferInfo[1].range = VK_WHOLE_SIZE;
+		drawBufferInfo[2].buffer = meshletTrianglesBuffer;
+		drawBufferInfo[2].offset = 0;
+		drawBufferInfo[2].range = VK_WHOLE_SIZE;
+		drawBufferInfo[3].buffer = vertexBuffer;
+		drawBufferInfo[3].offset = 0;
+		drawBufferInfo[3].range = VK_WHOLE_SIZE;
+		//binding 4 is the views
+		drawBufferInfo[4] = cullBufferInfo[2];
+		drawBufferInfo[5] = cullBufferInfo[6];
+		drawBufferInfo[6].buffer = meshletCullInfoBuffer;
+		drawBufferInfo[6].offset = 0;
+		drawBufferInfo[6].range = VK_WHOLE_SIZE;
+		drawBufferInfo[7] = cullBufferInfo[3];
+		drawBufferInfo[8].buffer = pageTableBuffer;
+		drawBufferInfo[8].offset = 0;
+		drawBufferInfo[8].range = VK_WHOLE_SIZE;
+		drawBufferInfo[9].buffer = pageFeedbackBuffer;
+		drawBufferInfo[9].offset = (pageFeedbackSize + GetInbetweenAlignmentSpace(pageFeedbackSize, minStorageBufferOffsetAlignment)) * i;
+		drawBufferInfo[9].range = pageFeedbackSize;
+
+		VkWriteDescriptorSet descriptorWrite[5]{};
+		for (uint32_t k = 0; k < 5; ++k)
+		{
+			descriptorWrite[k].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrite[k].dstArrayElement = 0;
+			descriptorWrite[k].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		}
+		descriptorWrite[0].dstSet = descriptorSets[i + MAX_FRAMES_IN_FLIGHT * 6];
+		descriptorWrite[0].dstBinding = 0;
+		descriptorWrite[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		descriptorWrite[0].descriptorCount = 1;
+		descriptorWrite[0].pBufferInfo = &uBufferInfo;
+		descriptorWrite[1].dstSet = descriptorSets[i + MAX_FRAMES_IN_FLIGHT * 6];
+		descriptorWrite[1].dstBinding = 1;
+		descriptorWrite[1].descriptorCount = sizeof(cullBufferInfo) / sizeof(VkDescriptorBufferInfo);
+		descriptorWrite[1].pBufferInfo = cullBufferInfo;
+		descriptorWrite[2].dstSet = descriptorSets[i + MAX_FRAMES_IN_FLIGHT * 7];
+		descriptorWrite[2].dstBinding = 0;
+		descriptorWrite[2].descriptorCount = 4;
+		descriptorWrite[2].pBufferInfo = drawBufferInfo;
+		descriptorWrite[3].dstSet = descriptorSets[i + MAX_FRAMES_IN_FLIGHT * 7];
+		descriptorWrite[3].dstBinding = 4;
+		descriptorWrite[3].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		descriptorWrite[3].descriptorCount = 1;
+		descriptorWrite[3].pBufferInfo = &uBufferInfo;
+		descriptorWrite[4].dstSet = descriptorSets[i + MAX_FRAMES_IN_FLIGHT * 7];
+		descriptorWrite[4].dstBinding = 5;
+		descriptorWrite[4].descriptorCount = 6;
+		descriptorWrite[4].pBufferInfo = &drawBufferInfo[4];
+		vkUpdateDescriptorSets(device, sizeof(descriptorWrite) / sizeof(VkWriteDescriptorSet), descriptorWrite, 0, nullptr);
+	}
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+		UpdateVisibilityDescriptors(i);
+
+	return true;
+}
+
+UpdateStatus ModuleVulkan::PostUpdate(float dt)
+{
 	{
-		glm::mat4 model(1.0f);//glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-		srand(randomNumber1);
-		randomNumber1 = rand() % 10001;
-		float randomNum1 = (static_cast<float>(randomNumber1) / 10001.f) * 2.f - 1.f;
-		srand(randomNumber2);
-		randomNumber2 = rand() % 10001;
-		float randomNum2 = (static_cast<float>(randomNumber2) / 10001.f) * 2.f - 1.f;
-		srand(randomNumber3);
-		randomNumber3 = rand() % 10001;
-		float randomNum3 = (static_cast<float>(randomNumber3) / 10001.f) * 2.f - 1.f;
-		srand(randomNumber4);
-		randomNumber4 = rand() % 360;
-		srand(randomNumber5);
-		randomNumber5 = rand() % 10001;
-		float randomNum5 = (static_cast<float>(randomNumber5) / 10001.f) * 2.f - 1.f;
-		srand(randomNumber6);
-		randomNumber6 = rand() % 10001;
-		float randomNum6 = (static_cast<float>(randomNumber6) / 10001.f) * 2.f - 1.f;
-		srand(randomNumber7);
-		randomNumber7 = rand() % 10001;
-		float randomNum7 = (static_cast<float>(randomNumber7) / 10001.f) * 2.f - 1.f;
-		model = glm::rotate(model, glm::radians(static_cast<float>(randomNumber4)), glm::vec3(randomNum5, randomNum6, randomNum7));
-		modelMatrices[i] = glm::translate(model, glm::vec3(6000.f * randomNum1, 6000.f * randomNum2, 6000.f * randomNum3));
+		PROFILE_ZONE("WaitFrameFence");
+		vkWaitForFences(device, 1, &frameFences[currentFrame], VK_TRUE, UINT64_MAX);
+	}
+	//Nothing of the previous frame is kept on it, the GPU never reads it
+	frameScratch.Reset();
+	instanceUploadSlots = nullptr;
+	//The present of the frame waited its semaphore once its fence is signaled
+	if (swapChainMaintenanceSupported)
+	{
+		PROFILE_ZONE("WaitPresentFence");
+		vkWaitForFences(device, 1, &presentFences[currentFrame], VK_TRUE, UINT64_MAX);
+	}
+	//The fences also cover every frame submitted before this one. Without present fences the new swapchain acquiring each of its images is the sign
+	//that the presents queued before it waited their semaphores
+	DestroyRetiredSwapChains(frameNumbers[currentFrame], swapChainMaintenanceSupported || swapChainImagesAcquired == swapChainImageCount);
+	if (visibilityDescriptorsDirty[currentFrame])
+	{
+		UpdateVisibilityDescriptors(currentFrame);
+		visibilityDescriptorsDirty[currentFrame] = false;
+	}
+	//The fence guarantees the frame results are available, reading them now does not stall the pipeline
+	ReadFrameStats();
+	//Both queues write the timestamps of the frame, a reset recorded on one of them would not be ordered with the writes of the other
+	if (timestampsSupported)
+		vkResetQueryPool(device, timestampQueryPool, currentFrame * TIMESTAMPS_PER_FRAME, TIMESTAMPS_PER_FRAME);
+	ReportStats(dt);
+	//Before the uniforms, the camera aspect ratio and the screen size change with the swapchain
+	//The window size is checked too, some platforms never report the swapchain out of date on a resize
+	int windowWidth, windowHeight;
+	SDL_GetWindowSizeInPixels(mWindow->window, &windowWidth, &windowHeight);
+	if (static_cast<uint32_t>(windowWidth) != swapChainWindowSize.width || static_cast<uint32_t>(windowHeight) != swapChainWindowSize.height)
+		swapChainDirty = true;
+	if (swapChainDirty)
+	{
+		//Minimized, nothing is rendered until the window has a size again
+		if (windowWidth == 0 || windowHeight == 0)
+			return UpdateStatus::UPDATE_CONTINUE;
+		if (!RecreateSwapChain())
+			return UpdateStatus::UPDATE_ERROR;
+	}
+	//parameter buffer
+	*static_cast<uint32_t*>(parameterBufferPtr[currentFrame]) = 0;
+	SetCameraInfo(mCamera->GetProj() * mCamera->GetView(), mCamera->GetPosition());
+	//The model matrices and the bounding boxes never leave the device, InstanceSim.comp only needs the time
+	if (instanceMotion)
+		simulationTime += simulationStep > 0.0f ? simulationStep : dt;
+	frameSimulationTimes[currentFrame] = static_cast<float>(simulationTime);
+	//Built here and copied whole once the frame is going to be submitted, UpdateVisibilityCache fills the cache fields
+	CullUniform uniform{};
+	mCamera->GetFrustumPlanes(uniform.frustumPlanes);
+	const glm::vec4(&planes)[6] = uniform.frustumPlanes;
+	frameSlotCounts[currentFrame] = instances->GetSlotCount();
+	uniform.numCommands = frameSlotCounts[currentFrame];
+	uniform.statsEnabled = statsEnabled ? 1u : 0u;
+	uniform.swRasterThreshold = swRasterThreshold;
+	//pixels per world unit at depth 1, the task shader estimates the projected meshlet size with it
+	uniform.projectionScale = glm::abs(mCamera->GetProj()[1][1]) * static_cast<float>(swapChainExtent.height) * 0.5f;
+	uniform.screenWidth = swapChainExtent.width;
+	uniform.screenHeight = swapChainExtent.height;
+	uniform.primitiveCulling = primitiveCulling && subPixelPrecisionBits <= PrimitiveCulling::MAX_SUBPIXEL_BITS ? 1u : 0u;
+	uniform.simulationTime = frameSimulationTimes[currentFrame];
+	frameDepthSorted[currentFrame] = depthSort;
+	uniform.depthSort = depthSort ? 1u : 0u;
+	//The visibility buffer path keeps the meshlets of the far instances, it has no impostor pass
+	frameImpostors[currentFrame] = impostorsBaked && impostorThreshold > 0.0f && !(renderPath == RenderPath::VISIBILITY_BUFFER && visibilityBufferSupported);
+	uniform.impostorThreshold = frameImpostors[currentFrame] ? impostorThreshold : 0.0f;
+	uniform.subPixelBits = subPixelPrecisionBits;
+	//no groups, Impostor.mesh runs with one Y and Z group
+	const uint32_t impostorCounts[] = { 0, 1, 1, 0 };
+	memcpy(impostorCountsBufferPtr[currentFrame], impostorCounts, sizeof(impostorCounts));
+	//Cluster grid of the camera, ClusterLights.comp bins the lights with it and the shading finds the cluster of the fragment
+	ClusteredLighting::Params clusterParams;
+	ClusteredLighting::BuildParams(planes, mCamera->GetNearDistance(), mCamera->GetFarDistance(), lightCount, clusterParams);
+	memcpy(clusterParamsBufferPtr[currentFrame], &clusterParams, sizeof(clusterParams));
+	UpdateShadowViews();
+	VkResult result;
+	{
+		PROFILE_ZONE("AcquireNextImage");
+		result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &swapChainImageIndex);
+	}
+	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+		//The semaphore was not signaled, the next frame recreates the swapchain
+		swapChainDirty = true;
+		return UpdateStatus::UPDATE_CONTINUE;
+	}
+	//Reset the fence just if we know that we are going to submit work
+	else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+		LOG("Runtime error aquiring the next image to present");
+		return UpdateStatus::UPDATE_ERROR;
+	}
+	//Still presentable, recreated after this frame
+	if (result == VK_SUBOPTIMAL_KHR)
+		swapChainDirty = true;
+	if (!swapChainImageAcquired[swapChainImageIndex])
+	{
+		swapChainImageAcquired[swapChainImageIndex] = true;
+		++swapChainImagesAcquired;
+	}
+	//After a successful acquire: the feedback of the retired frame is consumed only when this frame is submitted
+	UpdateStreaming();
+	StageInstances();
+	UpdateOcclusion(mCamera->GetProj() * mCamera->GetView());
+	UpdateVisibilityCache(uniform);
+	frameUniforms[currentFrame] = uniform;
+	memcpy(frustumPlanesBufferPtr[currentFrame], &uniform, sizeof(CullUniform));
+	const uint64_t frameNumber = submittedFrames + 1;
+	if (asyncCompute)
+	{
+		//The frame fence is signaled by the graphics submit, which waits this one: the compute command buffer of the slot is free too
+		//The instance copies are only read by the compute passes, the queue barrier orders them
+		PROFILE_ZONE("RecordCompute");
+		const bool streamingCopies = HasPendingStreamingCopies(PAGE_COPY_TARGETS);
+		vkResetCommandBuffer(computeCommandBuffers[currentFrame], 0);
+		if (!RecordComputeCommandBuffer(computeCommandBuffers[currentFrame]))
+			return UpdateStatus::UPDATE_ERROR;
+		//The copies overwrite slots the previous frame may still be drawing, the cull alone overlaps it
+		//With the visibility cache the cull rewrites the meshlet states the previous draw reads, it waits the draw too
+		const bool waitDraw = streamingCopies || frameVisibilityCached[currentFrame];
+		const uint64_t previousDraw = frameNumber - 1;
+		const uint64_t cullSignal = frameNumber;
+		VkTimelineSemaphoreSubmitInfo computeTimelineInfo{};
+		computeTimelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		computeTimelineInfo.waitSemaphoreValueCount = waitDraw ? 1 : 0;
+		computeTimelineInfo.pWaitSemaphoreValues = &previousDraw;
+		computeTimelineInfo.signalSemaphoreValueCount = 1;
+		computeTimelineInfo.pSignalSemaphoreValues = &cullSignal;
+		const VkPipelineStageFlags computeWaitStages[] = { frameVisibilityCached[currentFrame] ? VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT };
+		VkSubmitInfo computeSubmitInfo{};
+		computeSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		computeSubmitInfo.pNext = &computeTimelineInfo;
+		computeSubmitInfo.waitSemaphoreCount = waitDraw ? 1 : 0;
+		computeSubmitInfo.pWaitSemaphores = &drawTimelineSemaphore;
+		computeSubmitInfo.pWaitDstStageMask = computeWaitStages;
+		computeSubmitInfo.commandBufferCount = 1;
+		computeSubmitInfo.pCommandBuffers = &computeCommandBuffers[currentFrame];
+		computeSubmitInfo.signalSemaphoreCount = 1;
+		computeSubmitInfo.pSignalSemaphores = &cullTimelineSemaphore;
+		if (vkQueueSubmit(computeQueue, 1, &computeSubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+		{
+			LOG("Error submitting the cull command buffer");
+			return UpdateStatus::UPDATE_ERROR;
+		}
+	}
+	vkResetFences(device, 1, &frameFences[currentFrame]);
+	{
+		PROFILE_ZONE("RecordCommandBuffer");
+		vkResetCommandBuffer(commandBuffers[currentFrame], 0);
+		RecordCommandBuffer(commandBuffers[currentFrame], swapChainImageIndex, maxMeshletsPerMesh);
+	}
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	//transfer: the visibility buffer path writes the swapchain image with a blit
+	//The cull results: indirect commands and count, instance ids, streamed pools and tables, stats and page feedback
+	const VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT | VK_PIPELINE_STAGE_MESH_SHADER_BIT_EXT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT };
+	const VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame], cullTimelineSemaphore };
+	const VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[swapChainImageIndex], drawTimelineSemaphore };
+	//The binary semaphores ignore their values
+	const uint64_t waitValues[] = { 0, frameNumber };
+	const uint64_t signalValues[] = { 0, frameNumber };
+	VkTimelineSemaphoreSubmitInfo timelineInfo{};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.waitSemaphoreValueCount = 2;
+	timelineInfo.pWaitSemaphoreValues = waitValues;
+	timelineInfo.signalSemaphoreValueCount = 2;
+	timelineInfo.pSignalSemaphoreValues = signalValues;
+	submitInfo.pNext = asyncCompute ? &timelineInfo : nullptr;
+	submitInfo.waitSemaphoreCount = asyncCompute ? 2 : 1;
+	submitInfo.pWaitSemaphores = waitSemaphores;
+	submitInfo.pWaitDstStageMask = waitStages;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+	submitInfo.signalSemaphoreCount = asyncCompute ? 2 : 1;
+	submitInfo.pSignalSemaphores = signalSemaphores;
+	PROFILE_ZONE("SubmitPresent");
+	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, frameFences[currentFrame]) != VK_SUCCESS) {
+		LOG("failed to submit draw command buffer!");
+		return UpdateStatus::UPDATE_ERROR;
+	}
+	frameNumbers[currentFrame] = ++submittedFrames;
+	VkPresentInfoKHR presentInfo{};
+	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+	presentInfo.waitSemaphoreCount = 1;
+	presentInfo.pWaitSemaphores = &renderFinishedSemaphores[swapChainImageIndex];
+	presentInfo.swapchainCount = 1;
+	presentInfo.pSwapchains = &swapChain;
+	presentInfo.pImageIndices = &swapChainImageIndex;
+	presentInfo.pResults = nullptr; // Optional
+	++presentId;
+	VkPresentIdKHR presentIdInfo{};
+	presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+	presentIdInfo.swapchainCount = 1;
+	presentIdInfo.pPresentIds = &presentId;
+	if (presentWaitSupported)
+		presentInfo.pNext = &presentIdInfo;
+	VkSwapchainPresentFenceInfoEXT presentFenceInfo{};
+	presentFenceInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_FENCE_INFO_EXT;
+	presentFenceInfo.swapchainCount = 1;
+	presentFenceInfo.pFences = &presentFences[currentFrame];
+	if (swapChainMaintenanceSupported)
+	{
+		//Waited by PostUpdate when the slot comes back, before then no present used it since the last wait
+		vkResetFences(device, 1, &presentFences[currentFrame]);
+		presentFenceInfo.pNext = presentInfo.pNext;
+		presentInfo.pNext = &presentFenceInfo;
+	}
+	result = vkQueuePresentKHR(graphicsQueue, &presentInfo);
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+		swapChainDirty = true;
+	else if (result != VK_SUCCESS)
+	{
+		LOG("Runtime error presenting the swapchain image");
+		return UpdateStatus::UPDATE_ERROR;
+	}
+	WaitForPresent();
+
+	currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+	return UpdateStatus::UPDATE_CONTINUE;
+}
+
+void ModuleVulkan::ReadFrameStats()
+{
+	PROFILE_ZONE("ReadFrameStats");
+	//Nothing submitted on this frame slot yet or the results were already read (the last acquire failed)
+	if (frameNumbers[currentFrame] == 0 || frameNumbers[currentFrame] == frameStats.frameNumber)
+		return;
+	frameStats.frameNumber = frameNumbers[currentFrame];
+	frameStats.asyncCompute = asyncCompute;
+	frameStats.simulationTime = frameSimulationTimes[currentFrame];
+	frameStats.visibleInstances = *static_cast<uint32_t*>(parameterBufferPtr[currentFrame]);
+	PROFILE_COUNTER("Visible instances", frameStats.visibleInstances);
+	frameStats.depthSorted = frameDepthSorted[currentFrame];
+	frameStats.depthOrderValidated = false;
+	frameStats.visibilityCached = frameVisibilityCached[currentFrame];
+	frameStats.cacheEpochStarted = frameCacheEpochStarted[currentFrame];
+	frameStats.validCacheEpochs = frameValidCacheEpochs[currentFrame];
+	frameStats.shadowViews = shadowCascades;
+	frameStats.shadowMultiView = frameShadowMultiView[currentFrame];
+	frameStats.shadowDraws = 0;
+	for (uint32_t v = 0; v < shadowCascades; ++v)
+		frameStats.shadowDraws += static_cast<uint32_t*>(shadowCountsBufferPtr[currentFrame])[v];
+	frameStats.impostorInstances = frameImpostors[currentFrame] ? static_cast<uint32_t*>(impostorCountsBufferPtr[currentFrame])[3] : 0;
+	if (instanceValidation)
+	{
+		ValidateInstances();
+		if (frameStats.depthSorted)
+			ValidateDepthOrder();
+	}
+	if (statsEnabled)
+	{
+		memcpy(&frameStats.culling, statsBufferPtr[currentFrame], sizeof(CullingStats));
+		memset(statsBufferPtr[currentFrame], 0, sizeof(CullingStats));
+		frameStats.visibleMeshlets = frameStats.culling.meshletsPassed;
+	}
+	else
+	{
+		//Upper bound, the meshlets culled by the task shader are not known
+		frameStats.culling = CullingStats{};
+		frameStats.visibleMeshlets = frameStats.visibleInstances * maxMeshletsPerMesh;
+	}
+	if (timestampsSupported)
+	{
+		uint64_t timestamps[TIMESTAMPS_PER_FRAME];
+		if (vkGetQueryPoolResults(device, timestampQueryPool, currentFrame * TIMESTAMPS_PER_FRAME, TIMESTAMPS_PER_FRAME, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+		{
+			//timestampPeriod is in nanoseconds per tick. Every span is measured on a single queue: with async compute the cull, the sort and the shadow
+			//cull are on the compute queue, the draw and the shadow draw on the graphics queue
+			frameStats.gpuCullMs = static_cast<float>(timestamps[1] - timestamps[0]) * timestampPeriod / 1000000.0f;
+			frameStats.gpuSortMs = frameStats.depthSorted ? static_cast<float>(timestamps[1] - timestamps[4]) * timestampPeriod / 1000000.0f : 0.0f;
+			frameStats.gpuShadowCullMs = static_cast<float>(timestamps[6] - timestamps[5]) * timestampPeriod / 1000000.0f;
+			frameStats.gpuShadowDrawMs = static_cast<float>(timestamps[8] - timestamps[7]) * timestampPeriod / 1000000.0f;
+			//The timestamps of both queues are on one clock without async compute or with the device time domain
+			const bool sameClock = !asyncCompute || calibratedTimestampsSupported;
+			//With async compute the graphics work can start before the cull ends, the draw waits it. Without a common clock the wait is part of the draw
+			const uint64_t drawBegin = sameClock ? std::max(timestamps[1], timestamps[2]) : timestamps[2];
+			frameStats.gpuDrawMs = static_cast<float>(timestamps[3] - drawBegin) * timestampPeriod / 1000000.0f;
+			//Cull time hidden behind the previous frame draw, only when that frame was the last one read
+			frameStats.cullOverlapMs = sameClock ? 0.0f : -1.0f;
+			if (sameClock && lastDrawFrame != 0 && lastDrawFrame + 1 == frameStats.frameNumber)
+			{
+				const uint64_t overlapBegin = std::max(timestamps[0], lastDrawTimestamps[0]);
+				const uint64_t overlapEnd = std::min(timestamps[1], lastDrawTimestamps[1]);
+				if (overlapEnd > overlapBegin)
+					frameStats.cullOverlapMs = static_cast<float>(overlapEnd - overlapBegin) * timestampPeriod / 1000000.0f;
+			}
+			lastDrawTimestamps[0] = drawBegin;
+			lastDrawTimestamps[1] = timestamps[3];
+			lastDrawFrame = frameStats.frameNumber;
+#ifdef ENGINE_PROFILER
+			const double tickNs = static_cast<double>(timestampPeriod);
+			//The device time domain is read now, otherwise the fence of the frame is signaled and the draw already ended on the graphics queue clock
+			uint64_t calibrationTimestamp = timestamps[3];
+			if (calibratedTimestampsSupported)
+			{
+				VkCalibratedTimestampInfoEXT calibrationInfo{};
+				calibrationInfo.sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+				calibrationInfo.timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+				uint64_t maxDeviation = 0;
+				if (vkGetCalibratedTimestampsEXT(device, 1, &calibrationInfo, &calibrationTimestamp, &maxDeviation) != VK_SUCCESS)
+					calibrationTimestamp = timestamps[3];
+			}
+			Profiler::CalibrateGpu(static_cast<uint64_t>(calibrationTimestamp * tickNs));
+			//The compute queue zones are only placed when they share the clock the calibration used
+			if (sameClock)
+				Profiler::RecordGpuZone(frameStats.depthSorted ? "GPU cull + sort" : "GPU cull", static_cast<uint64_t>(timestamps[0] * tickNs), static_cast<uint64_t>(timestamps[1] * tickNs));
+			if (shadowCascades != 0)
+			{
+				if (sameClock)
+					Profiler::RecordGpuZone("GPU shadow cull", static_cast<uint64_t>(timestamps[5] * tickNs), static_cast<uint64_t>(timestamps[6] * tickNs));
+				Profiler::RecordGpuZone("GPU shadow draw", static_cast<uint64_t>(timestamps[7] * tickNs), static_cast<uint64_t>(timestamps[8] * tickNs));
+			}
+			Profiler::RecordGpuZone("GPU draw", static_cast<uint64_t>(drawBegin * tickNs), static_cast<uint64_t>(timestamps[3] * tickNs));
+#endif // ENGINE_PROFILER
+		}
+	}
+	if (pipelineStatisticsSupported)
+	{
+		//clipping invocations, clipping primitives, fragment shader invocations
+		uint64_t statistics[3];
+		if (vkGetQueryPoolResults(device, pipelineStatisticsQueryPool, currentFrame, 1, sizeof(statistics), statistics, sizeof(statistics), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+		{
+			frameStats.clippingInvocations = statistics[0];
+			frameStats.clippingPrimitives = statistics[1];
+			frameStats.fragmentInvocations = statistics[2];
+		}
+	}
+}
+
+void ModuleVulkan::ReportStats(float dt)
+{
+	statsReportTimer += dt;
+	if (statsReportTimer < STATS_REPORT_INTERVAL || frameStats.frameNumber == 0)
+		return;
+	statsReportTimer = 0.0f;
+	const CullingStats& culling = frameStats.culling;
+	char overlap[32] = "n/a";
+	if (frameStats.cullOverlapMs >= 0.0f)
+		snprintf(overlap, sizeof(overlap), "%.2f ms", frameStats.cullOverlapMs);
+	char title[512];
+	snprintf(title, sizeof(title), "Engine | %.2f ms cull (%s overlap%s%s) %.2f ms draw | %llu fragments | instances %u/%u (cached %u) | meshlets %u/%u (frustum %u cone %u sw %u cached %u) | triangles %u (culled %u) | clipper %llu in %llu out | pages %u/%u | occluded %u (%.2f ms) | shadows %u%s %u draws %.2f ms cull %.2f ms draw | impostors %u",
+		frameStats.gpuCullMs, overlap, frameStats.asyncCompute ? " async" : "", frameStats.depthSorted ? " sorted" : "", frameStats.gpuDrawMs,
+		static_cast<unsigned long long>(frameStats.fragmentInvocations), frameStats.visibleInstances, culling.instancesTested, culling.instancesCached, culling.meshletsPassed, culling.meshletsTested,
+		culling.meshletsFrustumCulled, culling.meshletsConeCulled, culling.meshletsSoftwareRaster, culling.meshletsCached, culling.trianglesEmitted, culling.trianglesCulled,
+		static_cast<unsigned long long>(frameStats.clippingInvocations), static_cast<unsigned long long>(frameStats.clippingPrimitives), frameStats.residentPages, pageCount,
+		frameStats.occludedInstances, frameStats.occlusionMs, frameStats.shadowViews, frameStats.shadowMultiView ? " multiview" : "", frameStats.shadowDraws, frameStats.gpuShadowCullMs,
+		frameStats.gpuShadowDrawMs, frameStats.impostorInstances);
+	SDL_SetWindowTitle(mWindow->window, title);
+	LOG("%s", title);
+}
+
+VkDeviceSize ModuleVulkan::GetMemoryBudget() const
+{
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+	budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+	VkPhysicalDeviceMemoryProperties2 memoryProperties{};
+	memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+	memoryProperties.pNext = memoryBudgetSupported ? &budgetProperties : nullptr;
+	vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &memoryProperties);
+	//The pools go to the biggest device local heap
+	uint32_t heap = 0;
+	VkDeviceSize heapSize = 0;
+	for (uint32_t i = 0; i < memoryProperties.memoryProperties.memoryHeapCount; ++i)
+	{
+		const VkMemoryHeap& memoryHeap = memoryProperties.memoryProperties.memoryHeaps[i];
+		if ((memoryHeap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0 && memoryHeap.size > heapSize)
+		{
+			heap = i;
+			heapSize = memoryHeap.size;
+		}
+	}
+	VkDeviceSize available = heapSize;
+	//What the process can still allocate, the other applications and the rest of the engine included
+	if (memoryBudgetSupported)
+		available = budgetProperties.heapBudget[heap] > budgetProperties.heapUsage[heap] ? budgetProperties.heapBudget[heap] - budgetProperties.heapUsage[heap] : 0;
+	return static_cast<VkDeviceSize>(static_cast<double>(available) * GEOMETRY_BUDGET_SHARE);
+}
+
+void ModuleVulkan::UpdateStreaming()
+{
+	PROFILE_ZONE("UpdateStreaming");
+	using namespace GeometryStreaming;
+	const PageLayout pageLayout{ meshletMaxVertices, meshletMaxPrimitives };
+	//The copies address the staging memory from the start of the buffer, this frame uses its own streamingStagingSize bytes
+	unsigned char* staging = static_cast<unsigned char*>(streamingStagingBufferPtr[0]);
+	const VkDeviceSize stagingBase = streamingStagingSize * currentFrame;
+	uint32_t requestCount = 0;
+	uint32_t uploads = 0;
+	const uint64_t evictions = residency->GetEvictions();
+	//Nothing submitted on this frame slot yet, the feedback is empty
+	const uint64_t frame = frameNumbers[currentFrame];
+	if (frame != 0)
+	{
+		const uint32_t* feedback = static_cast<const uint32_t*>(pageFeedbackBufferPtr[currentFrame]);
+		requestCount = std::min(feedback[0], MAX_PAGE_REQUESTS);
+		const uint32_t* requests = feedback + 1;
+		const uint32_t* pageBits = requests + MAX_PAGE_REQUESTS;
+		//The used pages move to the front of the LRU list before the requests evict anything
+		for (uint32_t word = 0; word < (pageCount + 31) / 32; ++word)
+		{
+			const uint32_t used = pageBits[word * 2 + 1];
+			for (uint32_t bit = 0; used != 0 && bit < 32; ++bit)
+			{
+				if ((used & (1u << bit)) != 0)
+					residency->Touch(word * 32 + bit, frame);
+			}
+		}
+		for (uint32_t i = 0; i < requestCount && uploads < MAX_PAGE_UPLOADS; ++i)
+		{
+			const uint32_t page = requests[i];
+			if (page >= pageCount || residency->IsResident(page))
+				continue;
+			uint32_t evictedPage;
+			const uint32_t slot = residency->MakeResident(page, frame, evictedPage);
+			//The working set does not fit, the records keep drawing their fallback
+			if (slot == NOT_RESIDENT)
+				break;
+			StagePage(page, slot, staging, stagingBase + uploads * pageLayout.SlotSize());
+			++uploads;
+		}
+		memset(pageFeedbackBufferPtr[currentFrame], 0, pageFeedbackSize);
+	}
+	StageTables(staging, stagingBase + MAX_PAGE_UPLOADS * pageLayout.SlotSize());
+	frameStats.residentPages = residency->GetResidentPages();
+	frameStats.pageRequests = requestCount;
+	frameStats.pageUploads = uploads;
+	frameStats.pageEvictions = static_cast<uint32_t>(residency->GetEvictions() - evictions);
+	PROFILE_COUNTER("Page uploads", uploads);
+}
+
+void ModuleVulkan::StagePage(uint32_t page, uint32_t slot, unsigned char* staging, VkDeviceSize stagingOffset)
+{
+	const GeometryStreaming::PageLayout pageLayout{ meshletMaxVertices, meshletMaxPrimitives };
+	const GeometryStreaming::PageUpload upload = GeometryStreaming::ExpandPage(pageData[page], pageLayout, slot, staging + stagingOffset);
+	//Same order as the slot layout and the copy targets
+	const VkDeviceSize slotSizes[] = { pageLayout.SlotMeshletsSize(), pageLayout.SlotMeshletVerticesSize(), pageLayout.SlotTrianglesSize(), pageLayout.SlotVerticesSize() };
+	const VkDeviceSize usedSizes[] = { sizeof(MeshletCompression::Record) * upload.meshletCount, sizeof(uint32_t) * upload.referenceWords,
+		sizeof(uint32_t) * upload.triangleWords, sizeof(Vertex) * upload.vertexCount };
+	for (int i = 0; i < 4; ++i)
+	{
+		VkBufferCopy copy{};
+		copy.srcOffset = stagingOffset;
+		copy.dstOffset = slotSizes[i] * slot;
+		copy.size = usedSizes[i];
+		if (copy.size != 0)
+			streamingCopies[i].push_back(copy);
+		stagingOffset += slotSizes[i];
+	}
+}
 
-		//modelMatrices[i] = glm::mat4(1.0f);
-		//if(i == 1)
-		//	modelMatrices[i] = glm::translate(modelMatrices[i], glm::vec3(400, 0, 0));
+void ModuleVulkan::StageTables(unsigned char* staging, VkDeviceSize stagingOffset)
+{
+	uint32_t first, end;
+	residency->TakeDirtyPages(first, end);
+	if (first != end)
+	{
+		memcpy(staging + stagingOffset, residency->GetPageTable() + first, sizeof(uint32_t) * (end - first));
+		streamingCopies[4].push_back(VkBufferCopy{ stagingOffset, sizeof(uint32_t) * first, sizeof(uint32_t) * (end - first) });
+	}
+	stagingOffset += sizeof(uint32_t) * pageCount;
+	residency->TakeDirtyGroups(first, end);
+	if (first != end)
+	{
+		memcpy(staging + stagingOffset, residency->GetGroupMissingPages() + first, sizeof(uint32_t) * (end - first));
+		streamingCopies[5].push_back(VkBufferCopy{ stagingOffset, sizeof(uint32_t) * first, sizeof(uint32_t) * (end - first) });
 	}
+}
 
-	return true;
+void ModuleVulkan::StageInstances()
+{
+	PROFILE_ZONE("StageInstances");
+	//After the pages and the tables on the staging memory of the frame
+	const GeometryStreaming::PageLayout pageLayout{ meshletMaxVertices, meshletMaxPrimitives };
+	unsigned char* staging = static_cast<unsigned char*>(streamingStagingBufferPtr[0]);
+	const VkDeviceSize meshesOffset = streamingStagingSize * currentFrame + GeometryStreaming::MAX_PAGE_UPLOADS * pageLayout.SlotSize() + sizeof(uint32_t) * (pageCount + numRecords);
+	const VkDeviceSize motionsOffset = meshesOffset + sizeof(uint32_t) * InstanceManager::MAX_UPLOADS;
+	instanceUploadSlots = frameScratch.AllocateArray<uint32_t>(InstanceManager::MAX_UPLOADS);
+	uint32_t* slots = instanceUploadSlots;
+	const uint32_t count = instances->TakeDirtySlots(slots, InstanceManager::MAX_UPLOADS);
+	frameStats.instanceUploads = count;
+	frameStats.instanceBacklog = instances->GetDirtyCount();
+	frameStats.instanceSlots = instances->GetSlotCount();
+	frameStats.liveInstances = instances->GetLiveCount();
+	PROFILE_COUNTER("Instance uploads", count);
+	if (count == 0)
+		return;
+	//Sorted the consecutive slots are consecutive on the staging memory too, each run is a single copy
+	std::sort(slots, slots + count);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const uint32_t slot = slots[i];
+		//the offsets are only 4 byte aligned
+		memcpy(staging + meshesOffset + sizeof(uint32_t) * i, instances->GetMeshes() + slot, sizeof(uint32_t));
+		memcpy(staging + motionsOffset + sizeof(InstanceSimulation::Motion) * i, instances->GetMotions() + slot, sizeof(InstanceSimulation::Motion));
+		if (instanceUploadFrames != nullptr)
+			instanceUploadFrames[slot] = submittedFrames + 1;
+		if (i != 0 && slots[i - 1] + 1 == slot)
+		{
+			streamingCopies[PAGE_COPY_TARGETS].back().size += sizeof(uint32_t);
+			streamingCopies[PAGE_COPY_TARGETS + 1].back().size += sizeof(InstanceSimulation::Motion);
+			continue;
+		}
+		streamingCopies[PAGE_COPY_TARGETS].push_back(VkBufferCopy{ meshesOffset + sizeof(uint32_t) * i, sizeof(uint32_t) * slot, sizeof(uint32_t) });
+		streamingCopies[PAGE_COPY_TARGETS + 1].push_back(VkBufferCopy{ motionsOffset + sizeof(InstanceSimulation::Motion) * i, sizeof(InstanceSimulation::Motion) * slot, sizeof(InstanceSimulation::Motion) });
+	}
 }
 
-UpdateStatus ModuleVulkan::PostUpdate(float dt)
+void ModuleVulkan::UpdateVisibilityCache(CullUniform& uniform)
 {
-	vkWaitForFences(device, 1, &frameFences[currentFrame], VK_TRUE, UINT64_MAX);
-	//parameter buffer
-	*static_cast<uint32_t*>(parameterBufferPtr[currentFrame]) = 0;
-	SetCameraInfo(mCamera->GetProj() * mCamera->GetView(), mCamera->GetPosition());
-	//MODEL MATRICES
-	for (int i = 0; i < NUM_MODELS; ++i)
-		memcpy(static_cast<float*>(modelMatricesBufferPtr[currentFrame]) + 16 * i, &modelMatrices[i], sizeof(float) * 16);
-	// Bounding boxes
-	glm::vec3 AABBPoints[8];
-	modelAABB.GetPoints(AABBPoints);
-	for (int j = 0; j < NUM_MODELS; ++j)
+	PROFILE_ZONE("UpdateVisibilityCache");
+	if (visibilityCacheDirty)
 	{
-		for (int i = 0; i < 8; ++i)
-			memcpy(static_cast<float*>(OBBsBufferPtr[currentFrame]) + (4 * 8 * j) + 4 * i, &AABBPoints[i], sizeof(glm::vec3));
-	}
-	// frustum planes + numCommands(NUM_MODEL)
-	glm::vec4 planes[6];
-	mCamera->GetFrustumPlanes(planes);
-	memcpy(frustumPlanesBufferPtr[currentFrame], planes, sizeof(planes));
-	const uint32_t numModels = NUM_MODELS;
-	memcpy(static_cast<float*>(frustumPlanesBufferPtr[currentFrame]) + 6 * 4, &numModels, sizeof(numModels));
-	VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &swapChainImageIndex);
-	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-		//check window minimized (TODO): handle it :)
-		VkSurfaceCapabilitiesKHR capabilities;
-		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &capabilities);
-		if (capabilities.currentExtent.width != 0 && capabilities.currentExtent.height != 0)
-		{
-			vkDeviceWaitIdle(device);
-			DestroySwapChain();
-			DestroyFrameBuffers();
-			CreateSwapChain();
-			CreateFrameBuffers();
-			mCamera->ChangeAspectRatio(static_cast<float>(capabilities.currentExtent.width) / static_cast<float>(capabilities.currentExtent.height));
+		//Drops every epoch, the entries written with other settings are never valid again
+		visibilityTracker->Init(VisibilityCache::DEFAULT_DISTANCE, VisibilityCache::DEFAULT_ANGLE, visibilityCacheRefresh);
+		visibilityCacheDirty = false;
+	}
+	frameVisibilityCached[currentFrame] = visibilityCache;
+	frameCacheEpochStarted[currentFrame] = false;
+	frameValidCacheEpochs[currentFrame] = 0;
+	if (visibilityCache)
+	{
+		visibilityTracker->Update(uniform.frustumPlanes, mCamera->GetPosition());
+		//A frustum that does not close a volume has no epoch, every slot is tested
+		const bool cacheMeshlets = meshletCache && meshletStateWords != 0;
+		if ((visibilityTracker->GetValidMask() & 1) != 0)
+			uniform.visibilityCache = cacheMeshlets ? 3u : 1u;
+		uniform.cacheEpoch = visibilityTracker->GetEpoch();
+		uniform.cacheValidMask = visibilityTracker->GetValidMask();
+		uniform.cacheFrame = visibilityTracker->GetFrame();
+		uniform.cacheRefreshFrames = visibilityTracker->GetRefreshFrames();
+		uniform.meshletStateWords = cacheMeshlets ? meshletStateWords : 0;
+		memcpy(uniform.inflatedPlanes, visibilityTracker->GetInflatedPlanes(), sizeof(uniform.inflatedPlanes));
+		memcpy(uniform.deflatedPlanes, visibilityTracker->GetDeflatedPlanes(), sizeof(uniform.deflatedPlanes));
+		frameCacheEpochStarted[currentFrame] = visibilityTracker->IsNewEpoch();
+		for (uint32_t mask = visibilityTracker->GetValidMask(); mask != 0; mask &= mask - 1)
+			++frameValidCacheEpochs[currentFrame];
+		//The slots uploaded for this frame hold another mesh or motion now, their entries are written again
+		uint32_t* bits = static_cast<uint32_t*>(cacheInvalidBitsBufferPtr[currentFrame]);
+		memset(bits, 0, sizeof(uint32_t) * ((frameSlotCounts[currentFrame] + 31) / 32));
+		for (uint32_t i = 0; i < frameStats.instanceUploads; ++i)
+			bits[instanceUploadSlots[i] >> 5] |= 1u << (instanceUploadSlots[i] & 31);
+	}
+	else
+		visibilityTracker->Invalidate();
+}
+
+void ModuleVulkan::UpdateOcclusion(const glm::mat4& viewProj)
+{
+	PROFILE_ZONE("UpdateOcclusion");
+	uint32_t* bits = static_cast<uint32_t*>(occlusionBitsBufferPtr[currentFrame]);
+	const uint32_t slotCount = frameSlotCounts[currentFrame];
+	frameStats.occludedInstances = 0;
+	frameStats.occluderTriangles = 0;
+	frameStats.occlusionMs = 0.0f;
+	if (!occlusionCulling)
+	{
+		//culling.comp reads the bits of every slot it goes through
+		memset(bits, 0, sizeof(uint32_t) * ((slotCount + 31) / 32));
+		return;
+	}
+	const auto start = std::chrono::steady_clock::now();
+	const uint32_t* meshes = instances->GetMeshes();
+	const InstanceSimulation::Motion* motions = instances->GetMotions();
+	const float time = frameSimulationTimes[currentFrame];
+	const float projectionScale = glm::abs(mCamera->GetProj()[1][1]);
+	glm::mat4* occlusionModels = frameScratch.AllocateArray<glm::mat4>(slotCount);
+	float* occluderScores = frameScratch.AllocateArray<float>(slotCount);
+	uint8_t* occlusionSkip = frameScratch.AllocateArray<uint8_t>(slotCount);
+	uint32_t* occluderSlots = frameScratch.AllocateArray<uint32_t>(MAX_OCCLUDERS);
+	uint32_t* occluderMeshIndices = frameScratch.AllocateArray<uint32_t>(MAX_OCCLUDERS);
+	glm::mat4* occluderTransforms = frameScratch.AllocateArray<glm::mat4>(MAX_OCCLUDERS);
+	//Same transforms InstanceSim.comp writes for the frame. The slots still waiting for their upload hold other data on the GPU, they are never occluded
+	occlusionBuffer->GetWorkerPool().ParallelFor(slotCount, 4096, [&](uint32_t begin, uint32_t end)
+	{
+		InstanceSimulation::Simulate(motions + begin, end - begin, instanceKeyframes, time, occlusionModels + begin);
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			occluderScores[i] = 0.0f;
+			occlusionSkip[i] = instances->IsDirty(i) ? 1 : 0;
+			if (meshes[i] == InstanceManager::DEAD_INSTANCE || occlusionSkip[i] != 0)
+				continue;
+			const OcclusionCulling::Box& box = meshBoxes[meshes[i]];
+			const glm::mat4& model = occlusionModels[i];
+			const glm::vec4 center = viewProj * (model * glm::vec4((box.min + box.max) * 0.5f, 1.0f));
+			if (center.w <= 0.0f || glm::abs(center.x) > center.w || glm::abs(center.y) > center.w)
+				continue;
+			//projected radius of the bounding sphere
+			const float scale = glm::sqrt(glm::max(glm::dot(model[0], model[0]), glm::max(glm::dot(model[1], model[1]), glm::dot(model[2], model[2]))));
+			occluderScores[i] = glm::length(box.max - box.min) * 0.5f * scale * projectionScale / center.w;
 		}
-		return UpdateStatus::UPDATE_CONTINUE;
+	});
+	//The MAX_OCCLUDERS largest on a min heap, then the largest first under the triangle budget
+	auto larger = [occluderScores](uint32_t a, uint32_t b) { return occluderScores[a] > occluderScores[b]; };
+	uint32_t candidates = 0;
+	for (uint32_t i = 0; i < slotCount; ++i)
+	{
+		if (occluderScores[i] < MIN_OCCLUDER_SIZE)
+			continue;
+		if (candidates == MAX_OCCLUDERS)
+		{
+			if (occluderScores[i] <= occluderScores[occluderSlots[0]])
+				continue;
+			std::pop_heap(occluderSlots, occluderSlots + candidates, larger);
+			--candidates;
+		}
+		occluderSlots[candidates++] = i;
+		std::push_heap(occluderSlots, occluderSlots + candidates, larger);
 	}
-	//Reset the fence just if we know that we are going to submit work
-	else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
-		LOG("Runtime error aquiring the next image to present");
-		return UpdateStatus::UPDATE_ERROR;
+	std::sort_heap(occluderSlots, occluderSlots + candidates, larger);
+	uint32_t occluderCount = 0;
+	uint32_t triangles = 0;
+	for (uint32_t i = 0; i < candidates; ++i)
+	{
+		const uint32_t slot = occluderSlots[i];
+		const uint32_t meshTriangles = static_cast<uint32_t>(occluderMeshes[meshes[slot]].indices.size() / 3);
+		if (triangles + meshTriangles > MAX_OCCLUDER_TRIANGLES)
+			continue;
+		triangles += meshTriangles;
+		occluderMeshIndices[occluderCount] = meshes[slot];
+		occluderTransforms[occluderCount++] = viewProj * occlusionModels[slot];
 	}
-	vkResetFences(device, 1, &frameFences[currentFrame]);
-	vkResetCommandBuffer(commandBuffers[currentFrame], 0);
-	RecordCommandBuffer(commandBuffers[currentFrame], swapChainImageIndex, meshletMesh.meshletCount);
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = &imageAvailableSemaphores[currentFrame];
-	submitInfo.pWaitDstStageMask = waitStages;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = &renderFinishedSemaphores[swapChainImageIndex];
-	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, frameFences[currentFrame]) != VK_SUCCESS) {
-		LOG("failed to submit draw command buffer!");
-		return UpdateStatus::UPDATE_ERROR;
+	occlusionBuffer->Clear();
+	frameStats.occluderTriangles = occlusionBuffer->RenderOccluders(occluderMeshes, occluderMeshIndices, occluderTransforms, occluderCount);
+	frameStats.occludedInstances = occlusionBuffer->TestInstances(viewProj, occlusionModels, meshes, occlusionSkip, slotCount, meshBoxes, bits);
+	frameStats.occlusionMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void ModuleVulkan::RecordStreamingCopies(VkCommandBuffer commandBuffer, VkBuffer stagingBuffer)
+{
+	const VkBuffer targets[STREAMING_COPY_TARGETS] = { meshletBuffer, meshletVerticesBuffer, meshletTrianglesBuffer, vertexBuffer, pageTableBuffer, recordResidencyBuffer,
+		instanceMeshesBuffer, instanceMotionsBuffer };
+	for (int i = 0; i < STREAMING_COPY_TARGETS; ++i)
+	{
+		if (!streamingCopies[i].empty())
+			vkCmdCopyBuffer(commandBuffer, stagingBuffer, targets[i], static_cast<uint32_t>(streamingCopies[i].size()), streamingCopies[i].data());
+		streamingCopies[i].clear();
 	}
-	VkPresentInfoKHR presentInfo{};
-	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = &renderFinishedSemaphores[swapChainImageIndex];
-	presentInfo.swapchainCount = 1;
-	presentInfo.pSwapchains = &swapChain;
-	presentInfo.pImageIndices = &swapChainImageIndex;
-	presentInfo.pResults = nullptr; // Optional
-	vkQueuePresentKHR(graphicsQueue, &presentInfo);
+}
 
-	currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
-	return UpdateStatus::UPDATE_CONTINUE;
+bool ModuleVulkan::HasPendingStreamingCopies(int targetCount) const
+{
+	for (int i = 0; i < targetCount; ++i)
+	{
+		if (!streamingCopies[i].empty())
+			return true;
+	}
+	return false;
+}
+
+void ModuleVulkan::RecordStreaming(VkCommandBuffer commandBuffer, VkPipelineStageFlags dstStages)
+{
+	if (!HasPendingStreamingCopies())
+		return;
+	//The slots and the tables are shared by the frames in flight, the previous frame must be done reading the evicted slots
+	//(on the compute queue the submit waits the previous frame draw on the timeline semaphore, the barrier orders this queue)
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+	RecordStreamingCopies(commandBuffer, streamingStagingBuffer);
+	VkMemoryBarrier memBarrier{};
+	memBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	memBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStages, 0, 1, &memBarrier, 0, nullptr, 0, nullptr);
 }
 
 bool ModuleVulkan::CleanUp()
 {
+	WaitSceneImport();
+	//Only left when Init failed before the meshlets were built
+	for (unsigned int i = 0; importedMeshes != nullptr && i < numMeshes; ++i)
+		importedMeshes[i].Free();
+	delete[] importedMeshes;
+	importedMeshes = nullptr;
+	importScratch.Release();
+	asyncIO.CleanUp();
 	if (device == VK_NULL_HANDLE)
 		return true;
 	vkDeviceWaitIdle(device);
+	//The device idle does not cover the presents
+	if (swapChainMaintenanceSupported)
+		vkWaitForFences(device, MAX_FRAMES_IN_FLIGHT, presentFences, VK_TRUE, UINT64_MAX);
 	vkDestroyDescriptorPool(device, descriptorPool, nullptr);
 	delete[] descriptorSets;
 	vkDestroyCommandPool(device, commandPool, nullptr);
+	if (computeCommandPool != VK_NULL_HANDLE)
+		vkDestroyCommandPool(device, computeCommandPool, nullptr);
+	if (cullTimelineSemaphore != VK_NULL_HANDLE)
+		vkDestroySemaphore(device, cullTimelineSemaphore, nullptr);
+	if (drawTimelineSemaphore != VK_NULL_HANDLE)
+		vkDestroySemaphore(device, drawTimelineSemaphore, nullptr);
+	if (timestampQueryPool != VK_NULL_HANDLE)
+		vkDestroyQueryPool(device, timestampQueryPool, nullptr);
+	if (pipelineStatisticsQueryPool != VK_NULL_HANDLE)
+		vkDestroyQueryPool(device, pipelineStatisticsQueryPool, nullptr);
 	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
 	{
 		vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
 		vkDestroyFence(device, frameFences[i], nullptr);
-	}
-	for (int i = 0; i < swapChainImageCount; ++i)
-	{
-		vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
+		if (presentFences[i] != VK_NULL_HANDLE)
+			vkDestroyFence(device, presentFences[i], nullptr);
 	}
 	vkDestroyRenderPass(device, renderPass, nullptr);
-	DestroySwapChain();
-	DestroyFrameBuffers();
-	delete[] swapChainImages;
-	delete[] swapChainImageViews;
-	delete[] renderFinishedSemaphores;
-	delete[] swapChainFramebuffers;
+	vkDestroyRenderPass(device, visRenderPass, nullptr);
+	RetireSwapChain();
+	DestroyRetiredSwapChains(UINT64_MAX, true);
 	vkDestroyPipeline(device, graphicsPipeline, nullptr);
+	if (impostorPipeline != VK_NULL_HANDLE)
+		vkDestroyPipeline(device, impostorPipeline, nullptr);
 	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 	vkDestroyPipeline(device, computePipeline, nullptr);
+	vkDestroyPipeline(device, clusterLightsPipeline, nullptr);
 	vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+	vkDestroyPipeline(device, instanceSimPipeline, nullptr);
+	vkDestroyPipelineLayout(device, instanceSimPipelineLayout, nullptr);
+	for (VkPipeline sortPipeline : sortPipelines)
+		vkDestroyPipeline(device, sortPipeline, nullptr);
+	vkDestroyPipelineLayout(device, sortPipelineLayout, nullptr);
+	vkDestroyPipeline(device, visPipeline, nullptr);
+	vkDestroyPipeline(device, visShadePipeline, nullptr);
+	vkDestroyPipelineLayout(device, visShadePipelineLayout, nullptr);
+	vkDestroyPipeline(device, swRasterPipeline, nullptr);
+	vkDestroyPipelineLayout(device, swRasterPipelineLayout, nullptr);
+	if (shadowCascades != 0)
+	{
+		for (uint32_t v = 0; v < shadowCascades; ++v)
+		{
+			vkDestroyFramebuffer(device, shadowFramebuffers[v], nullptr);
+			vkDestroyImageView(device, shadowLayerViews[v], nullptr);
+		}
+		vkDestroyFramebuffer(device, shadowMultiViewFramebuffer, nullptr);
+		vkDestroyImageView(device, shadowArrayView, nullptr);
+		vkDestroyImage(device, shadowImage, nullptr);
+		vkFreeMemory(device, shadowImageMemory, nullptr);
+		vkDestroyRenderPass(device, shadowRenderPass, nullptr);
+		vkDestroyRenderPass(device, shadowMultiViewRenderPass, nullptr);
+		vkDestroyPipeline(device, shadowPipeline, nullptr);
+		vkDestroyPipeline(device, shadowMultiViewPipeline, nullptr);
+		vkDestroyPipelineLayout(device, shadowPipelineLayout, nullptr);
+		vkDestroyPipeline(device, shadowCullPipeline, nullptr);
+		vkDestroyPipelineLayout(device, shadowCullPipelineLayout, nullptr);
+	}
 	vkDestroySurfaceKHR(instance, surface, nullptr);
 	vkDestroyDevice(device, nullptr);
 #ifndef NDEBUG
@@ -1236,34 +3827,47 @@ bool ModuleVulkan::CleanUp()
 	}
 #endif
 	vkDestroyInstance(instance, nullptr);
-	delete[] modelMatrices;
+	delete instances;
+	delete[] instanceKeyframes;
+	delete[] instanceUploadFrames;
+	frameScratch.Release();
+	instanceUploadSlots = nullptr;
+	delete occlusionBuffer;
+	delete[] occluderMeshes;
+	delete[] meshBoxes;
+	delete visibilityTracker;
+	delete[] meshRecords;
+	delete[] meshAABBPoints;
+	//Only left when Init failed before the pages were staged
+	for (unsigned int i = 0; meshletMeshes != nullptr && i < numMeshes; ++i)
+		meshletMeshes[i].Free();
+	delete[] meshletMeshes;
+	delete residency;
+	delete[] pageData;
+	for (unsigned int i = 0; pageFiles != nullptr && i < numMeshes; ++i)
+		FileSystem::Unmap(pageFiles[i]);
+	delete[] pageFiles;
 	return true;
 }
 
-bool ModuleVulkan::CreateSwapChain()
+bool ModuleVulkan::CreateSwapChain(VkSwapchainKHR oldSwapChain)
 {
 	VkSurfaceCapabilitiesKHR capabilities;
 	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &capabilities);
-	//TODO: do not render while the window is minimized
-	//while (SDL_GetWindowFlags(mWindow->window) & SDL_WINDOW_MINIMIZED)
-	//{
-	//	SDL_WaitEvent(NULL);
-	//}
-	if(capabilities.currentExtent.width == 0 && capabilities.currentExtent.height == 0)
-	{
-		LOG("Window minimized");
-	}
-	if (capabilities.currentExtent.width == UINT32_MAX)
+	int width, height;
+	SDL_GetWindowSizeInPixels(mWindow->window, &width, &height);
+	swapChainWindowSize = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+	//UINT32_MAX: the surface takes the size of the swapchain
+	if (capabilities.currentExtent.width != UINT32_MAX)
 	{
 		swapChainExtent = capabilities.currentExtent;
 	}
 	else
 	{
-		int width, height;
-		SDL_GetWindowSizeInPixels(mWindow->window, &width, &height);
-		swapChainExtent.width = (width < capabilities.minImageExtent.width) ? width : capabilities.minImageExtent.width;
-		swapChainExtent.height = (height < capabilities.minImageExtent.height) ? height : capabilities.minImageExtent.height;
+		swapChainExtent.width = std::max(capabilities.minImageExtent.width, std::min(static_cast<uint32_t>(width), capabilities.maxImageExtent.width));
+		swapChainExtent.height = std::max(capabilities.minImageExtent.height, std::min(static_cast<uint32_t>(height), capabilities.maxImageExtent.height));
 	}
+	swapChainPresentMode = ChoosePresentMode(presentMode);
 	swapChainImageCount = capabilities.minImageCount + 1;
 	if (capabilities.maxImageCount > 0 && swapChainImageCount > capabilities.maxImageCount)
 		swapChainImageCount = capabilities.maxImageCount;
@@ -1276,7 +3880,8 @@ bool ModuleVulkan::CreateSwapChain()
 	swapChainCreateInfo.imageColorSpace = swapChainSurfaceFormat.colorSpace;
 	swapChainCreateInfo.imageExtent = swapChainExtent;
 	swapChainCreateInfo.imageArrayLayers = 1;
-	swapChainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	//transfer dst: the visibility buffer path blits the shaded image
+	swapChainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 	//if (indices.graphicsFamily != indices.presentFamily) {
 	//	createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
 	//	createInfo.queueFamilyIndexCount = 2;
@@ -1291,12 +3896,16 @@ bool ModuleVulkan::CreateSwapChain()
 	swapChainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	swapChainCreateInfo.presentMode = swapChainPresentMode;
 	swapChainCreateInfo.clipped = VK_TRUE;
-	swapChainCreateInfo.oldSwapchain = VK_NULL_HANDLE;
+	//The presents already queued on the old one can still complete
+	swapChainCreateInfo.oldSwapchain = oldSwapChain;
 	if (vkCreateSwapchainKHR(device, &swapChainCreateInfo, nullptr, &swapChain) != VK_SUCCESS) {
 		LOG("Error creating the swapChain");
 		return false;
 	}
+	presentId = 0;
 	vkGetSwapchainImagesKHR(device, swapChain, &swapChainImageCount, nullptr);
+	swapChainImageAcquired.assign(swapChainImageCount, false);
+	swapChainImagesAcquired = 0;
 	if(swapChainImages == nullptr)
 		swapChainImages = new VkImage[swapChainImageCount];
 	vkGetSwapchainImagesKHR(device, swapChain, &swapChainImageCount, swapChainImages);
@@ -1323,6 +3932,18 @@ bool ModuleVulkan::CreateSwapChain()
 			return false;
 		}
 	}
+	//One per image, the present of an image waits the submit that rendered it
+	VkSemaphoreCreateInfo semaphoreCreateInfo{};
+	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	renderFinishedSemaphores = new VkSemaphore[swapChainImageCount];
+	for (int i = 0; i < swapChainImageCount; ++i)
+	{
+		if (vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS)
+		{
+			LOG("Error creating swap chain semaphores");
+			return false;
+		}
+	}
 	return true;
 }
 
@@ -1373,22 +3994,207 @@ bool ModuleVulkan::CreateFrameBuffers()
 			return false;
 		}
 	}
+
+	//Visibility buffer targets
+	if (!CreateBuffer(static_cast<VkDeviceSize>(swapChainExtent.width) * swapChainExtent.height * sizeof(uint64_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, visibilityBuffer, visibilityBufferMemory) ||
+		!CreateImage(swapChainExtent.width, swapChainExtent.height, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, shadedImage, shadedImageMemory))
+	{
+		LOG("Error creating the visibility buffer images");
+		return false;
+	}
+	imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageViewCreateInfo.image = shadedImage;
+	imageViewCreateInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+	if (vkCreateImageView(device, &imageViewCreateInfo, nullptr, &shadedImageView) != VK_SUCCESS) {
+		LOG("Error creating the shaded image view");
+		return false;
+	}
+	VkFramebufferCreateInfo visFramebufferInfo{};
+	visFramebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	visFramebufferInfo.renderPass = visRenderPass;
+	visFramebufferInfo.attachmentCount = 1;
+	visFramebufferInfo.pAttachments = &depthImageView;
+	visFramebufferInfo.width = swapChainExtent.width;
+	visFramebufferInfo.height = swapChainExtent.height;
+	visFramebufferInfo.layers = 1;
+	if (vkCreateFramebuffer(device, &visFramebufferInfo, nullptr, &visFramebuffer) != VK_SUCCESS) {
+		LOG("Error creating the visibility buffer framebuffer");
+		return false;
+	}
+	//On Init the sets are not allocated yet, Init writes them. Otherwise each frame in flight updates its sets once its fence is signaled
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+		visibilityDescriptorsDirty[i] = descriptorSets != nullptr;
 	return true;
 }
 
-void ModuleVulkan::DestroySwapChain()
+void ModuleVulkan::UpdateVisibilityDescriptors(uint32_t frame)
 {
-	vkDestroySwapchainKHR(device, swapChain, nullptr);
+	VkDescriptorBufferInfo visibilityInfo{};
+	visibilityInfo.buffer = visibilityBuffer;
+	visibilityInfo.offset = 0;
+	visibilityInfo.range = VK_WHOLE_SIZE;
+	VkDescriptorImageInfo imageInfo{};
+	imageInfo.imageView = shadedImageView;
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	VkWriteDescriptorSet descriptorWrite[4]{};
+	//shading
+	descriptorWrite[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite[0].dstSet = descriptorSets[frame + MAX_FRAMES_IN_FLIGHT * 2];
+	descriptorWrite[0].dstBinding = 0;
+	descriptorWrite[0].dstArrayElement = 0;
+	descriptorWrite[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	descriptorWrite[0].descriptorCount = 1;
+	descriptorWrite[0].pBufferInfo = &visibilityInfo;
+	descriptorWrite[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite[1].dstSet = descriptorSets[frame + MAX_FRAMES_IN_FLIGHT * 2];
+	descriptorWrite[1].dstBinding = 1;
+	descriptorWrite[1].dstArrayElement = 0;
+	descriptorWrite[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	descriptorWrite[1].descriptorCount = 1;
+	descriptorWrite[1].pImageInfo = &imageInfo;
+	//hardware raster (fragment shader)
+	descriptorWrite[2] = descriptorWrite[0];
+	descriptorWrite[2].dstSet = descriptorSets[frame];
+	descriptorWrite[2].dstBinding = 12;
+	//software raster
+	descriptorWrite[3] = descriptorWrite[0];
+	descriptorWrite[3].dstSet = descriptorSets[frame + MAX_FRAMES_IN_FLIGHT * 3];
+	descriptorWrite[3].dstBinding = 9;
+	vkUpdateDescriptorSets(device, sizeof(descriptorWrite) / sizeof(VkWriteDescriptorSet), descriptorWrite, 0, nullptr);
 }
 
-void ModuleVulkan::DestroyFrameBuffers()
+bool ModuleVulkan::RecreateSwapChain()
 {
-	for (int i = 0; i < swapChainImageCount; ++i)
-		vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
-	for (int i = 0; i < swapChainImageCount; ++i)
-		vkDestroyImageView(device, swapChainImageViews[i], nullptr);
-	vkDestroyImage(device, depthImage, nullptr);
-	vkFreeMemory(device, depthImageMemory, nullptr);
+	//No device idle: the old swapchain keeps presenting what is queued and its targets stay alive for the frames in flight
+	const VkSwapchainKHR oldSwapChain = swapChain;
+	RetireSwapChain();
+	if (!CreateSwapChain(oldSwapChain) || !CreateFrameBuffers())
+	{
+		LOG("Error recreating the swapchain");
+		return false;
+	}
+	//The fence of the current frame was waited, its sets can point to the new targets now (the other frames in flight update theirs later)
+	UpdateVisibilityDescriptors(currentFrame);
+	visibilityDescriptorsDirty[currentFrame] = false;
+	swapChainDirty = false;
+	++frameStats.swapChainRecreations;
+	mCamera->ChangeAspectRatio(static_cast<float>(swapChainExtent.width) / static_cast<float>(swapChainExtent.height));
+	LOG("Swapchain recreated: %ux%u, %u images", swapChainExtent.width, swapChainExtent.height, swapChainImageCount);
+	return true;
+}
+
+void ModuleVulkan::RetireSwapChain()
+{
+	RetiredSwapChain retired;
+	retired.swapChain = swapChain;
+	retired.imageCount = swapChainImageCount;
+	retired.imageViews = swapChainImageViews;
+	retired.framebuffers = swapChainFramebuffers;
+	retired.renderFinishedSemaphores = renderFinishedSemaphores;
+	retired.depthImage = depthImage;
+	retired.depthImageMemory = depthImageMemory;
+	retired.depthImageView = depthImageView;
+	retired.visFramebuffer = visFramebuffer;
+	retired.visibilityBuffer = visibilityBuffer;
+	retired.visibilityBufferMemory = visibilityBufferMemory;
+	retired.shadedImage = shadedImage;
+	retired.shadedImageMemory = shadedImageMemory;
+	retired.shadedImageView = shadedImageView;
+	retired.lastFrame = submittedFrames;
+	retiredSwapChains.push_back(retired);
+	//The images belong to the swapchain, the arrays are allocated again by CreateSwapChain and CreateFrameBuffers
+	delete[] swapChainImages;
+	swapChainImages = nullptr;
+	swapChainImageViews = nullptr;
+	swapChainFramebuffers = nullptr;
+	renderFinishedSemaphores = nullptr;
+	swapChain = VK_NULL_HANDLE;
+}
+
+void ModuleVulkan::DestroyRetiredSwapChains(uint64_t completedFrame, bool presentsCompleted)
+{
+	//The semaphores of the retired swapchains may still be waited by their presents
+	if (!presentsCompleted)
+		return;
+	for (size_t i = 0; i < retiredSwapChains.size();)
+	{
+		const RetiredSwapChain& retired = retiredSwapChains[i];
+		if (retired.lastFrame > completedFrame)
+		{
+			++i;
+			continue;
+		}
+		for (unsigned int j = 0; j < retired.imageCount; ++j)
+		{
+			vkDestroyFramebuffer(device, retired.framebuffers[j], nullptr);
+			vkDestroyImageView(device, retired.imageViews[j], nullptr);
+			vkDestroySemaphore(device, retired.renderFinishedSemaphores[j], nullptr);
+		}
+		delete[] retired.framebuffers;
+		delete[] retired.imageViews;
+		delete[] retired.renderFinishedSemaphores;
+		vkDestroyImageView(device, retired.depthImageView, nullptr);
+		vkDestroyImage(device, retired.depthImage, nullptr);
+		vkFreeMemory(device, retired.depthImageMemory, nullptr);
+		vkDestroyFramebuffer(device, retired.visFramebuffer, nullptr);
+		vkDestroyImageView(device, retired.shadedImageView, nullptr);
+		vkDestroyBuffer(device, retired.visibilityBuffer, nullptr);
+		vkFreeMemory(device, retired.visibilityBufferMemory, nullptr);
+		vkDestroyImage(device, retired.shadedImage, nullptr);
+		vkFreeMemory(device, retired.shadedImageMemory, nullptr);
+		vkDestroySwapchainKHR(device, retired.swapChain, nullptr);
+		retiredSwapChains.erase(retiredSwapChains.begin() + i);
+	}
+}
+
+VkPresentModeKHR ModuleVulkan::ChoosePresentMode(PresentMode mode) const
+{
+	VkPresentModeKHR vkMode = VK_PRESENT_MODE_FIFO_KHR;
+	switch (mode)
+	{
+	case PresentMode::MAILBOX:
+		vkMode = VK_PRESENT_MODE_MAILBOX_KHR;
+		break;
+	case PresentMode::IMMEDIATE:
+		vkMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+		break;
+	default:
+		break;
+	}
+	//FIFO is always supported
+	if ((supportedPresentModes & (1u << vkMode)) == 0)
+	{
+		static const char* modeNames[] = { "FIFO", "MAILBOX", "IMMEDIATE" };
+		LOG("Warning: the surface does not support the %s present mode, using FIFO", modeNames[static_cast<unsigned char>(mode)]);
+		return VK_PRESENT_MODE_FIFO_KHR;
+	}
+	return vkMode;
+}
+
+void ModuleVulkan::SetPresentMode(PresentMode mode)
+{
+	if (mode == presentMode)
+		return;
+	presentMode = mode;
+	//Before Init the first swapchain takes it
+	if (swapChain != VK_NULL_HANDLE)
+		swapChainDirty = true;
+}
+
+void ModuleVulkan::WaitForPresent()
+{
+	frameStats.presentWaitMs = 0.0f;
+	//the ids restart with the swapchain, the first frameLatency presents have nothing to wait for
+	if (!presentWaitSupported || frameLatency == 0 || presentId <= frameLatency || swapChainDirty)
+		return;
+	PROFILE_ZONE("WaitForPresent");
+	const auto start = std::chrono::steady_clock::now();
+	//At most frameLatency presents queued: the next frame samples the input closer to its display
+	const VkResult result = vkWaitForPresentKHR(device, swapChain, presentId - frameLatency, PRESENT_WAIT_TIMEOUT_NS);
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+		swapChainDirty = true;
+	frameStats.presentWaitMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
 }
 
 void ModuleVulkan::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t numMeshlets)
@@ -1403,31 +4209,412 @@ void ModuleVulkan::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t i
 			return;
 	}
 
+	const uint32_t firstQuery = currentFrame * TIMESTAMPS_PER_FRAME;
+	if (!asyncCompute)
+	{
+		RecordCull(commandBuffer);
+		//the draw begins when the cull ends
+		if (timestampsSupported)
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, timestampQueryPool, firstQuery + 2);
+	}
+	else if (timestampsSupported)
+	{
+		//The cull is on the compute queue, the submit waits its semaphore only on the stages reading its results. ReadFrameStats takes the latest of both
+		//when the queues share a clock, the draw includes the wait otherwise
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool, firstQuery + 2);
+	}
+	//Outside of the render pass, RecordDrawMeshlets begins the query
+	if (pipelineStatisticsSupported)
+		vkCmdResetQueryPool(commandBuffer, pipelineStatisticsQueryPool, currentFrame, 1);
+	const bool visibilityPath = renderPath == RenderPath::VISIBILITY_BUFFER && visibilityBufferSupported;
+	if (visibilityPath)
+	{
+		//The visibility buffer and the cluster list are shared by the frames in flight, the previous frame shading must be done before clearing them
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+		//all ones is VisibilityBuffer::EMPTY, farther than any depth
+		vkCmdFillBuffer(commandBuffer, visibilityBuffer, 0, VK_WHOLE_SIZE, 0xFFFFFFFF);
+		//clusterCount + swClusterCount
+		vkCmdFillBuffer(commandBuffer, visibleClustersBuffer, 0, sizeof(uint32_t) * 2, 0);
+	}
+
+	//With async compute the semaphore already made the cull results visible, the barrier only orders the clears (and is harmless otherwise)
+	VkMemoryBarrier memBarrier{};
+	memBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT;
+	//Shadow.mesh reads the views, the transforms and the draws of ShadowCull.comp too, Impostor.mesh the impostor draws of culling.comp
+	if (shadowCascades != 0 || impostorsBaked)
+		dstStages |= VK_PIPELINE_STAGE_MESH_SHADER_BIT_EXT;
+	//Shader.frag walks the cluster grid of ClusterLights.comp
+	if (lightCount != 0)
+		dstStages |= VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	if (visibilityPath)
+	{
+		//the clears must land before the task shader atomics and the fragment shader atomics
+		memBarrier.srcAccessMask |= VK_ACCESS_TRANSFER_WRITE_BIT;
+		memBarrier.dstAccessMask |= VK_ACCESS_SHADER_WRITE_BIT;
+		srcStages |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+		dstStages |= VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	}
+	vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 1, &memBarrier, 0, nullptr, 0, nullptr);
+	//Before the camera pass, the shading of the frame can sample the cascades
+	RecordShadowDraw(commandBuffer);
+
+	if (visibilityPath)
+	{
+		VkRenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = visRenderPass;
+		renderPassInfo.framebuffer = visFramebuffer;
+		renderPassInfo.renderArea.offset = { 0, 0 };
+		renderPassInfo.renderArea.extent = swapChainExtent;
+		VkClearValue clearValues[2];
+		VkClearValue clearValue;
+		clearValue.depthStencil.depth = 1.0f;
+		clearValue.depthStencil.stencil = 0;
+		renderPassInfo.clearValueCount = 1;
+		renderPassInfo.pClearValues = &clearValue;
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, visPipeline);
+		RecordDrawMeshlets(commandBuffer);
+		vkCmdEndRenderPass(commandBuffer);
+		//visible and software clusters from the task shader, hardware ids from the fragment shader
+		memBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memBarrier, 0, nullptr, 0, nullptr);
+		if (swRasterThreshold > 0.0f)
+			RecordSoftwareRaster(commandBuffer);
+		RecordVisibilityShading(commandBuffer, imageIndex);
+	}
+	else
+	{
+		VkRenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = renderPass;
+		renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+		renderPassInfo.renderArea.offset = { 0, 0 };
+		renderPassInfo.renderArea.extent = swapChainExtent;
+		VkClearValue clearColor[2];
+		clearColor[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+		clearColor[1].depthStencil.depth = 1.0f;
+		clearColor[1].depthStencil.stencil = 0.0f;
+		renderPassInfo.clearValueCount = 2;
+		renderPassInfo.pClearValues = clearColor;
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+		RecordDrawMeshlets(commandBuffer);
+		//Same layout, the viewport and the descriptors stay bound. The group count was written by culling.comp
+		if (frameImpostors[currentFrame])
+		{
+			const size_t impostorCountsSize = sizeof(uint32_t) * 4;
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, impostorPipeline);
+			vkCmdDrawMeshTasksIndirectEXT(commandBuffer, impostorCountsBuffer, (impostorCountsSize + GetInbetweenAlignmentSpace(impostorCountsSize, minStorageBufferOffsetAlignment)) * currentFrame, 1, 0);
+		}
+		vkCmdEndRenderPass(commandBuffer);
+	}
+	if (timestampsSupported)
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool, firstQuery + 3);
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		LOG("Error recording the command buffer");
+	}
+}
+
+void ModuleVulkan::RecordCull(VkCommandBuffer commandBuffer)
+{
+	//Page uploads and table changes staged by UpdateStreaming, before the cull timestamp
+	VkPipelineStageFlags streamingDstStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	//culling.comp, the task and mesh shaders, SoftwareRaster.comp and the visibility buffer shading read the pools and the tables
+	//The compute queue only has the compute stage, the graphics submit waits the copies with the timeline semaphore
+	if (!asyncCompute)
+		streamingDstStages |= VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT | VK_PIPELINE_STAGE_MESH_SHADER_BIT_EXT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	RecordStreaming(commandBuffer, streamingDstStages);
+	const uint32_t firstQuery = currentFrame * TIMESTAMPS_PER_FRAME;
+	//The queries of the frame were reset on the host after its fence
+	if (timestampsSupported)
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool, firstQuery);
+	RecordInstanceSimulation(commandBuffer);
 	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
 	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &descriptorSets[currentFrame + MAX_FRAMES_IN_FLIGHT], 0, nullptr);
-	vkCmdDispatch(commandBuffer, NUM_MODELS, 1, 1);
+	//culling.comp has 64 invocations per workgroup
+	vkCmdDispatch(commandBuffer, (frameSlotCounts[currentFrame] + 63) / 64, 1, 1);
+	//Same layout and set as the cull, one invocation per cluster. Part of the cull time
+	if (lightCount != 0)
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, clusterLightsPipeline);
+		vkCmdDispatch(commandBuffer, (ClusteredLighting::CLUSTER_COUNT + ClusteredLighting::GROUP_SIZE - 1) / ClusteredLighting::GROUP_SIZE, 1, 1);
+	}
+	//Part of the cull time, its own timestamps tell its share
+	RecordShadowCull(commandBuffer);
+	if (timestampsSupported)
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, timestampQueryPool, firstQuery + 4);
+	if (depthSort)
+		RecordDepthSort(commandBuffer);
+	if (timestampsSupported)
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, timestampQueryPool, firstQuery + 1);
+}
+
+void ModuleVulkan::RecordShadowCull(VkCommandBuffer commandBuffer)
+{
+	const uint32_t firstQuery = currentFrame * TIMESTAMPS_PER_FRAME;
+	//Written without the cascades too, ReadFrameStats reads every query of the frame
+	if (timestampsSupported)
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, timestampQueryPool, firstQuery + 5);
+	if (shadowCascades != 0)
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, shadowCullPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, shadowCullPipelineLayout, 0, 1, &descriptorSets[currentFrame + MAX_FRAMES_IN_FLIGHT * 6], 0, nullptr);
+		//viewBase, viewCount, partition, slotCount. ShadowCull.comp has 64 invocations per workgroup
+		const uint32_t groups = (frameSlotCounts[currentFrame] + 63) / 64;
+		if (frameShadowMultiView[currentFrame])
+		{
+			const uint32_t pass[] = { 0, shadowCascades, 0, frameSlotCounts[currentFrame] };
+			vkCmdPushConstants(commandBuffer, shadowCullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pass), pass);
+			vkCmdDispatch(commandBuffer, groups, 1, 1);
+		}
+		else
+		{
+			//The partitions do not overlap, the dispatches need no barrier between them
+			for (uint32_t v = 0; v < shadowCascades; ++v)
+			{
+				const uint32_t pass[] = { v, 1, v, frameSlotCounts[currentFrame] };
+				vkCmdPushConstants(commandBuffer, shadowCullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pass), pass);
+				vkCmdDispatch(commandBuffer, groups, 1, 1);
+			}
+		}
+	}
+	if (timestampsSupported)
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, timestampQueryPool, firstQuery + 6);
+}
+
+void ModuleVulkan::RecordShadowDraw(VkCommandBuffer commandBuffer)
+{
+	const uint32_t firstQuery = currentFrame * TIMESTAMPS_PER_FRAME;
+	if (timestampsSupported)
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool, firstQuery + 7);
+	if (shadowCascades != 0)
+	{
+		const VkExtent2D extent = { MultiView::DEFAULT_RESOLUTION, MultiView::DEFAULT_RESOLUTION };
+		VkClearValue clearValue;
+		clearValue.depthStencil.depth = 1.0f;
+		clearValue.depthStencil.stencil = 0;
+		VkRenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderArea.offset = { 0, 0 };
+		renderPassInfo.renderArea.extent = extent;
+		renderPassInfo.clearValueCount = 1;
+		renderPassInfo.pClearValues = &clearValue;
+		VkViewport viewport{};
+		viewport.width = static_cast<float>(extent.width);
+		viewport.height = static_cast<float>(extent.height);
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		VkRect2D scissor{};
+		scissor.offset = { 0, 0 };
+		scissor.extent = extent;
+		const VkDeviceSize commandsOffset = (shadowCommandsSize + GetInbetweenAlignmentSpace(shadowCommandsSize, minStorageBufferOffsetAlignment)) * currentFrame;
+		const size_t countsSize = sizeof(uint32_t) * MAX_SHADOW_CASCADES;
+		const VkDeviceSize countsOffset = (countsSize + GetInbetweenAlignmentSpace(countsSize, minStorageBufferOffsetAlignment)) * currentFrame;
+		const uint32_t passCount = frameShadowMultiView[currentFrame] ? 1 : shadowCascades;
+		for (uint32_t v = 0; v < passCount; ++v)
+		{
+			//A single pass over every layer with multiview, the mesh shader runs once per view. Otherwise a pass per layer and partition
+			renderPassInfo.renderPass = frameShadowMultiView[currentFrame] ? shadowMultiViewRenderPass : shadowRenderPass;
+			renderPassInfo.framebuffer = frameShadowMultiView[currentFrame] ? shadowMultiViewFramebuffer : shadowFramebuffers[v];
+			vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, frameShadowMultiView[currentFrame] ? shadowMultiViewPipeline : shadowPipeline);
+			vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+			vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowPipelineLayout, 0, 1, &descriptorSets[currentFrame + MAX_FRAMES_IN_FLIGHT * 7], 0, nullptr);
+			//viewBase, viewCount, partition
+			const uint32_t pass[] = { v, frameShadowMultiView[currentFrame] ? shadowCascades : 1, v };
+			vkCmdPushConstants(commandBuffer, shadowPipelineLayout, VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT, 0, sizeof(pass), pass);
+			vkCmdDrawMeshTasksIndirectCountEXT(commandBuffer, shadowCommandsBuffer, commandsOffset + sizeof(uint32_t) * 3 * MAX_INSTANCES * v, shadowCountsBuffer, countsOffset + sizeof(uint32_t) * v,
+				frameSlotCounts[currentFrame], sizeof(uint32_t) * 3);
+			vkCmdEndRenderPass(commandBuffer);
+		}
+	}
+	if (timestampsSupported)
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool, firstQuery + 8);
+}
+
+void ModuleVulkan::UpdateShadowViews()
+{
+	frameShadowMultiView[currentFrame] = GetShadowMultiView();
+	if (shadowCascades == 0)
+		return;
+	//The counts of the frame were read by ReadFrameStats, ShadowCull.comp appends from 0
+	memset(shadowCountsBufferPtr[currentFrame], 0, sizeof(uint32_t) * MAX_SHADOW_CASCADES);
+	glm::mat4 viewProjs[MAX_SHADOW_CASCADES];
+	glm::vec4 planes[MAX_SHADOW_CASCADES * 6];
+	//Same light as Shader.frag
+	MultiView::CascadeViews(mCamera->GetView(), mCamera->GetProj(), SHADOW_NEAR_PLANE, glm::normalize(glm::vec3(0.0f, 1.0f, 1.0f)), shadowCascades, MultiView::DEFAULT_DISTANCE,
+		MultiView::DEFAULT_SPLIT_LAMBDA, MultiView::DEFAULT_CASTER_DISTANCE, MultiView::DEFAULT_RESOLUTION, viewProjs);
+	for (uint32_t v = 0; v < shadowCascades; ++v)
+		MultiView::PlanesFromMatrix(viewProjs[v], *reinterpret_cast<glm::vec4(*)[6]>(&planes[v * 6]));
+	//std140 ShadowViews: the matrices of every cascade, then the planes
+	memcpy(shadowViewsBufferPtr[currentFrame], viewProjs, sizeof(glm::mat4) * shadowCascades);
+	memcpy(static_cast<char*>(shadowViewsBufferPtr[currentFrame]) + sizeof(viewProjs), planes, sizeof(glm::vec4) * 6 * shadowCascades);
+}
+
+void ModuleVulkan::RecordDepthSort(VkCommandBuffer commandBuffer)
+{
+	//Every pass reads what the previous dispatch wrote: the survivors of culling.comp, the block counts, the other half
 	VkMemoryBarrier memBarrier{};
 	memBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
 	memBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-	memBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
-	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT, 0, 1, &memBarrier, 0, nullptr, 0, nullptr);
+	memBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memBarrier, 0, nullptr, 0, nullptr);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, sortPipelineLayout, 0, 1, &descriptorSets[currentFrame + MAX_FRAMES_IN_FLIGHT * 5], 0, nullptr);
+	//The survivor count is only known on the GPU, the blocks cover every slot and the ones past the count do nothing
+	const uint32_t blockCount = DepthSort::BlockCount(frameSlotCounts[currentFrame]);
+	if (blockCount == 0)
+		return;
+	for (uint32_t pass = 0; pass < DepthSort::PASSES; ++pass)
+	{
+		const uint32_t pushConstants[] = { pass, blockCount, MAX_INSTANCES };
+		vkCmdPushConstants(commandBuffer, sortPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), pushConstants);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, sortPipelines[0]);
+		vkCmdDispatch(commandBuffer, blockCount, 1, 1);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memBarrier, 0, nullptr, 0, nullptr);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, sortPipelines[1]);
+		vkCmdDispatch(commandBuffer, 1, 1, 1);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memBarrier, 0, nullptr, 0, nullptr);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, sortPipelines[2]);
+		vkCmdDispatch(commandBuffer, blockCount, 1, 1);
+		if (pass + 1 < DepthSort::PASSES)
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memBarrier, 0, nullptr, 0, nullptr);
+	}
+	//The draw reads the commands after the cull barrier or the cull semaphore, the validation copies the model ids here
+	if (instanceValidation)
+	{
+		memBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memBarrier, 0, nullptr, 0, nullptr);
+		VkBufferCopy region{};
+		region.srcOffset = (modelIDsSize + GetInbetweenAlignmentSpace(modelIDsSize, minStorageBufferOffsetAlignment)) * currentFrame;
+		region.dstOffset = modelIDsSize * currentFrame;
+		region.size = sizeof(uint32_t) * 2 * frameSlotCounts[currentFrame];
+		vkCmdCopyBuffer(commandBuffer, modelIDsBuffer, depthOrderReadbackBuffer, 1, &region);
+	}
+}
 
-	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-	
-	VkRenderPassBeginInfo renderPassInfo{};
-	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderPassInfo.renderPass = renderPass;
-	renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
-	renderPassInfo.renderArea.offset = { 0, 0 };
-	renderPassInfo.renderArea.extent = swapChainExtent;
-	VkClearValue clearColor[2];
-	clearColor[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
-	clearColor[1].depthStencil.depth = 1.0f;
-	clearColor[1].depthStencil.stencil = 0.0f;
-	renderPassInfo.clearValueCount = 2;
-	renderPassInfo.pClearValues = clearColor;
-	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+void ModuleVulkan::RecordInstanceSimulation(VkCommandBuffer commandBuffer)
+{
+	//The transforms of the frame in flight were last read by its previous draw, the fence (or the draw timeline) already ordered it
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, instanceSimPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, instanceSimPipelineLayout, 0, 1, &descriptorSets[currentFrame + MAX_FRAMES_IN_FLIGHT * 4], 0, nullptr);
+	vkCmdDispatch(commandBuffer, (frameSlotCounts[currentFrame] + InstanceSimulation::WORKGROUP_SIZE - 1) / InstanceSimulation::WORKGROUP_SIZE, 1, 1);
+	//culling.comp reads them next, the draw stages after the cull barrier or the cull semaphore
+	VkMemoryBarrier memBarrier{};
+	memBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	//Visibility cache: the entries of the previous cull are read and written again, the meshlet states the previous task shaders read are written
+	//(on the compute queue the submit waits the previous draw)
+	if (frameVisibilityCached[currentFrame])
+	{
+		memBarrier.dstAccessMask |= VK_ACCESS_SHADER_WRITE_BIT;
+		if (!asyncCompute)
+			srcStages |= VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT;
+	}
+	if (instanceValidation)
+	{
+		memBarrier.dstAccessMask |= VK_ACCESS_TRANSFER_READ_BIT;
+		dstStages |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+	}
+	vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 1, &memBarrier, 0, nullptr, 0, nullptr);
+	if (instanceValidation && frameSlotCounts[currentFrame] != 0)
+	{
+		VkBufferCopy region{};
+		region.srcOffset = (modelMatricesSize + GetInbetweenAlignmentSpace(modelMatricesSize, minStorageBufferOffsetAlignment)) * currentFrame;
+		region.dstOffset = modelMatricesSize * currentFrame;
+		region.size = sizeof(glm::mat4) * frameSlotCounts[currentFrame];
+		vkCmdCopyBuffer(commandBuffer, modelMatricesBuffer, instanceReadbackBuffer, 1, &region);
+	}
+}
+
+void ModuleVulkan::ValidateInstances()
+{
+	const float time = frameSimulationTimes[currentFrame];
+	const uint64_t frame = frameNumbers[currentFrame];
+	const uint32_t* meshes = instances->GetMeshes();
+	const InstanceSimulation::Motion* motions = instances->GetMotions();
+	const glm::mat4* gpuTransforms = static_cast<const glm::mat4*>(instanceReadbackBufferPtr[currentFrame]);
+	float error = 0.0f;
+	uint32_t worstInstance = 0;
+	for (uint32_t i = 0; i < frameSlotCounts[currentFrame]; ++i)
+	{
+		//Only the slots the frame had with their current motion: live, not waiting for an upload and not uploaded after the frame
+		if (meshes[i] == InstanceManager::DEAD_INSTANCE || instances->IsDirty(i) || instanceUploadFrames[i] > frame)
+			continue;
+		const float instanceError = InstanceSimulation::TransformError(InstanceSimulation::Evaluate(motions[i], instanceKeyframes, time), gpuTransforms[i]);
+		if (instanceError > error)
+		{
+			error = instanceError;
+			worstInstance = i;
+		}
+	}
+	frameStats.instancesValidated = true;
+	frameStats.instanceSimError = error;
+	if (error > INSTANCE_SIM_TOLERANCE)
+		LOG("Warning: instance %u differs %f from the CPU reference at t=%f", worstInstance, error, time);
+}
+
+void ModuleVulkan::ValidateDepthOrder()
+{
+	//Same key as culling.comp from the planes of the frame (its uniform is rewritten after ReadFrameStats) and the read back transforms
+	const glm::vec4* planes = frameUniforms[currentFrame].frustumPlanes;
+	const float range = planes[0].w + planes[1].w;
+	const uint32_t count = std::min(frameStats.visibleInstances, frameSlotCounts[currentFrame]);
+	const uint32_t* modelIDs = static_cast<const uint32_t*>(depthOrderReadbackBufferPtr[currentFrame]);
+	const glm::mat4* gpuTransforms = static_cast<const glm::mat4*>(instanceReadbackBufferPtr[currentFrame]);
+	const uint32_t* meshes = instances->GetMeshes();
+	const uint64_t frame = frameNumbers[currentFrame];
+	uint32_t errors = 0;
+	uint32_t previousKey = 0;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const uint32_t slot = modelIDs[i * 2];
+		//The slots changed since the frame hold other meshes now, their key is not known
+		if (slot >= frameSlotCounts[currentFrame] || meshes[slot] == InstanceManager::DEAD_INSTANCE || instances->IsDirty(slot) || instanceUploadFrames[slot] > frame)
+			continue;
+		const glm::vec3 center = glm::vec3(gpuTransforms[slot] * glm::vec4((meshBoxes[meshes[slot]].min + meshBoxes[meshes[slot]].max) * 0.5f, 1.0f));
+		const uint32_t key = DepthSort::DepthKey(planes[0].w - glm::dot(glm::vec3(planes[0]), center), range);
+		//one step for the rounding of the GPU division
+		if (key + 1 < previousKey)
+			++errors;
+		previousKey = key;
+	}
+	frameStats.depthOrderValidated = true;
+	frameStats.depthOrderErrors = errors;
+	if (errors != 0)
+		LOG("Warning: %u of %u sorted commands are nearer than the one before", errors, count);
+}
+
+bool ModuleVulkan::RecordComputeCommandBuffer(VkCommandBuffer commandBuffer)
+{
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+	{
+		LOG("Error beginning the compute command buffer");
+		return false;
+	}
+	RecordCull(commandBuffer);
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+	{
+		LOG("Error recording the compute command buffer");
+		return false;
+	}
+	return true;
+}
 
+void ModuleVulkan::RecordDrawMeshlets(VkCommandBuffer commandBuffer)
+{
 	VkViewport viewport{};
 	viewport.x = 0.0f;
 	viewport.y = 0.0f;
@@ -1446,14 +4633,75 @@ void ModuleVulkan::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t i
 
 	//vkCmdDrawMeshTasksEXT(commandBuffer, numMeshlets, 1, 1);
 	//NOTE: Draw without the indirect count(uncomment the line below and comment 2 lines below)
-	//vkCmdDrawMeshTasksIndirectEXT(commandBuffer, dispatchIndirectBuffer, 0, NUM_MODELS, sizeof(uint32_t) * 3);
-	vkCmdDrawMeshTasksIndirectCountEXT(commandBuffer, dispatchIndirectBuffer, 0, parameterBuffer, (sizeof(uint32_t) + GetInbetweenAlignmentSpace(sizeof(uint32_t), minStorageBufferOffsetAlignment))*currentFrame, NUM_MODELS, sizeof(uint32_t) * 3);
+	//vkCmdDrawMeshTasksIndirectEXT(commandBuffer, dispatchIndirectBuffer, 0, MAX_INSTANCES, sizeof(uint32_t) * 3);
+	if (pipelineStatisticsSupported)
+		vkCmdBeginQuery(commandBuffer, pipelineStatisticsQueryPool, currentFrame, 0);
+	vkCmdDrawMeshTasksIndirectCountEXT(commandBuffer, dispatchIndirectBuffer, (dispatchIndirectSize + GetInbetweenAlignmentSpace(dispatchIndirectSize, minStorageBufferOffsetAlignment)) * currentFrame, parameterBuffer, (sizeof(uint32_t) + GetInbetweenAlignmentSpace(sizeof(uint32_t), minStorageBufferOffsetAlignment))*currentFrame, frameSlotCounts[currentFrame], sizeof(uint32_t) * 3);
+	if (pipelineStatisticsSupported)
+		vkCmdEndQuery(commandBuffer, pipelineStatisticsQueryPool, currentFrame);
+}
 
-	vkCmdEndRenderPass(commandBuffer);
+void ModuleVulkan::RecordSoftwareRaster(VkCommandBuffer commandBuffer)
+{
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, swRasterPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, swRasterPipelineLayout, 0, 1, &descriptorSets[currentFrame + MAX_FRAMES_IN_FLIGHT * 3], 0, nullptr);
+	//The software cluster count is only known on the GPU, the workgroups loop over them
+	vkCmdDispatch(commandBuffer, SOFTWARE_RASTER_WORKGROUPS, 1, 1);
+	VkMemoryBarrier memBarrier{};
+	memBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memBarrier, 0, nullptr, 0, nullptr);
+}
 
-	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-		LOG("Error recording the command buffer");
-	}
+void ModuleVulkan::RecordVisibilityShading(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	//RecordCommandBuffer already made the ids visible to the compute stage
+	VkImageMemoryBarrier barriers[2]{};
+	barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[0].srcAccessMask = 0;
+	barriers[0].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].image = shadedImage;
+	barriers[0].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barriers[0].subresourceRange.levelCount = 1;
+	barriers[0].subresourceRange.layerCount = 1;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, barriers);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, visShadePipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, visShadePipelineLayout, 0, 1, &descriptorSets[currentFrame + MAX_FRAMES_IN_FLIGHT * 2], 0, nullptr);
+	//VisibilityShade.comp has 8x8 invocations per workgroup
+	vkCmdDispatch(commandBuffer, (swapChainExtent.width + 7) / 8, (swapChainExtent.height + 7) / 8, 1);
+
+	barriers[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barriers[1] = barriers[0];
+	barriers[1].srcAccessMask = 0;
+	barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barriers[1].image = swapChainImages[imageIndex];
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 2, barriers);
+
+	//The blit converts the linear UNORM color to the sRGB swapchain, same result as the forward path
+	VkImageBlit blit{};
+	blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	blit.srcSubresource.layerCount = 1;
+	blit.srcOffsets[1] = { static_cast<int32_t>(swapChainExtent.width), static_cast<int32_t>(swapChainExtent.height), 1 };
+	blit.dstSubresource = blit.srcSubresource;
+	blit.dstOffsets[1] = blit.srcOffsets[1];
+	vkCmdBlitImage(commandBuffer, shadedImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, swapChainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_NEAREST);
+
+	barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barriers[1].dstAccessMask = 0;
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barriers[1]);
 }
 
 void ModuleVulkan::SetModelMatrix(const glm::mat4& model)
@@ -1461,6 +4709,12 @@ void ModuleVulkan::SetModelMatrix(const glm::mat4& model)
 	memcpy(transformsBufferPtr[currentFrame], &model, sizeof(float) * 16);
 }
 
+void ModuleVulkan::SetSoftwareRasterThreshold(float pixels)
+{
+	//The projected size is an estimation, half the extent SoftwareRaster.comp accepts leaves room for it
+	swRasterThreshold = std::min(std::max(pixels, 0.0f), SoftwareRaster::MAX_TRIANGLE_EXTENT * 0.5f);
+}
+
 void ModuleVulkan::SetCameraInfo(const glm::mat4& viewProj, const glm::vec3& cameraPos)
 {
 	memcpy(static_cast<char*>(transformsBufferPtr[currentFrame]), &viewProj, sizeof(float) * 16);
@@ -1573,7 +4827,16 @@ bool ModuleVulkan::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkM
 	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	bufferCreateInfo.size = size;
 	bufferCreateInfo.usage = usage;//VK_SHADER_STAGE_FRAGMENT_BIT;
-	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	//With async compute the buffers are used by both queue families without ownership transfers
+	const uint32_t queueFamilyIndices[] = { static_cast<uint32_t>(graphicsQueueFamilyIndex), static_cast<uint32_t>(computeQueueFamilyIndex) };
+	if (asyncCompute)
+	{
+		bufferCreateInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		bufferCreateInfo.queueFamilyIndexCount = 2;
+		bufferCreateInfo.pQueueFamilyIndices = queueFamilyIndices;
+	}
+	else
+		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	if (vkCreateBuffer(device, &bufferCreateInfo, nullptr, &buffer))
 	{
 		LOG("Error creating the buffer");
@@ -1603,7 +4866,7 @@ bool ModuleVulkan::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkM
 	return true;
 }
 
-bool ModuleVulkan::CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) {
+bool ModuleVulkan::CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory, uint32_t layers) {
 	VkImageCreateInfo imageInfo{};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 	imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -1611,7 +4874,7 @@ bool ModuleVulkan::CreateImage(uint32_t width, uint32_t height, VkFormat format,
 	imageInfo.extent.height = height;
 	imageInfo.extent.depth = 1;
 	imageInfo.mipLevels = 1;
-	imageInfo.arrayLayers = 1;
+	imageInfo.arrayLayers = layers;
 	imageInfo.format = format;
 	imageInfo.tiling = tiling;
 	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -1641,36 +4904,10 @@ bool ModuleVulkan::CreateImage(uint32_t width, uint32_t height, VkFormat format,
 	return true;
 }
 
-void ModuleVulkan::GenerateMeshlet(Mesh& mesh, MeshletMesh& meshletMesh) const
+void ModuleVulkan::GenerateMeshlet(Mesh& mesh, MeshletMesh& meshletMesh, HostMemory::Arena& scratch) const
 {
-	meshletMesh.maxMeshlets = meshopt_buildMeshletsBound(mesh.numIndices, meshletMaxOutputVertices, meshletMaxOutputPrimitives);
-	meshopt_Meshlet* meshlets = new meshopt_Meshlet[meshletMesh.maxMeshlets];
-	unsigned int* meshletVertices = new unsigned int[mesh.numIndices];
-	unsigned char* meshletTriangles = new unsigned char[mesh.numIndices];
-	meshletMesh.meshletCount = meshopt_buildMeshlets(meshlets, meshletVertices, meshletTriangles, mesh.indices, mesh.numIndices, &mesh.vertices->position[0], mesh.numVertices, sizeof(Vertex), meshletMaxOutputVertices, meshletMaxOutputPrimitives, 0.0f);
-	for (int i = 0; i < meshletMesh.meshletCount; ++i)
-		meshopt_optimizeMeshlet(&meshletVertices[meshlets[i].vertex_offset], &meshletTriangles[meshlets[i].triangle_offset], meshlets[i].triangle_count, meshlets[i].vertex_count);
-	meshletMesh.meshlets = new meshopt_Meshlet[meshletMesh.meshletCount];
-	memcpy(meshletMesh.meshlets, meshlets, sizeof(meshopt_Meshlet) * meshletMesh.meshletCount);
-	delete[] meshlets;
-	const meshopt_Meshlet& last = meshletMesh.meshlets[meshletMesh.meshletCount - 1];
-	unsigned int trimedSize = last.vertex_offset + last.vertex_count;
-	meshletMesh.meshletVertices = new unsigned int[trimedSize];
-	memcpy(meshletMesh.meshletVertices, meshletVertices, sizeof(unsigned int) * trimedSize);
-	delete[] meshletVertices;
-	trimedSize = (last.triangle_offset + last.triangle_count) * sizeof(unsigned char) * 3;
-	meshletMesh.meshletTriangles = new unsigned char[trimedSize];
-	memcpy(meshletMesh.meshletTriangles, meshletTriangles, trimedSize);
-	delete[] meshletTriangles;
-	memcpy(&meshletMesh.mesh, &mesh, sizeof(Mesh));
-	mesh.indices = nullptr;
-	mesh.vertices = nullptr;
-	mesh.numIndices = 0;
-	mesh.numVertices = 0;
-
-	meshletMesh.meshletBounds = new meshopt_Bounds[meshletMesh.meshletCount];
-	for (int i = 0; i < meshletMesh.meshletCount; ++i)
-		meshletMesh.meshletBounds[i] = meshopt_computeMeshletBounds(&meshletMesh.meshletVertices[meshletMesh.meshlets[i].vertex_offset], &meshletMesh.meshletTriangles[meshletMesh.meshlets[i].triangle_offset], meshletMesh.meshlets[i].triangle_count, reinterpret_cast<float*>(meshletMesh.mesh.vertices), meshletMesh.mesh.numVertices, sizeof(Vertex));
+	PROFILE_ZONE("GenerateMeshlet");
+	OptimizeMesh::BuildMeshlets(mesh, meshletMesh, meshletMaxVertices, meshletMaxPrimitives, &scratch);
 }
 
 unsigned int MeshletMesh::GetMeshletsVerticeCount()
@@ -1682,7 +4919,8 @@ unsigned int MeshletMesh::GetMeshletsVerticeCount()
 unsigned int MeshletMesh::GetMeshletsTriangleCount()
 {
 	const meshopt_Meshlet& last = meshlets[meshletCount - 1];
-	return (last.triangle_offset + last.triangle_count) * sizeof(unsigned char) * 3;
+	//triangle_offset is already in indices (3 per triangle)
+	return last.triangle_offset + last.triangle_count * 3;
 }
 
 bool ModuleVulkan::FindSupportedFormat(const VkFormat* candidates, size_t numCandidates, VkImageTiling tiling, VkFormatFeatureFlags features, VkFormat& out, VkPhysicalDevice* pDevice)
@@ -2,6 +2,9 @@
 #define __MODULE_VULKAN_H__
 
 #include "Module.h"
+#include "AsyncIO.h"
+#include "FileSystem.h"
+#include "HostMemory.h"
 
 class ModuleWindow;
 class ModuleEditorCamera;
@@ -17,12 +20,19 @@ struct Vertex
 	float normal[4];
 };
 
+//The arrays are allocated with HostMemory (Tag::MESHES) and owned by the mesh until Free
 struct Mesh
 {
 	unsigned int numIndices;
 	unsigned int* indices;
 	unsigned int numVertices;
 	Vertex* vertices;
+	void Free()
+	{
+		HostMemory::Free(indices);
+		HostMemory::Free(vertices);
+		*this = Mesh{};
+	}
 };
 
 struct meshopt_Meshlet;
@@ -36,11 +46,42 @@ struct MeshletMesh
 	size_t meshletCount;
 	size_t maxMeshlets;
 	Mesh mesh;
+	//The meshlet arrays are Tag::MESHLETS allocations
+	void Free()
+	{
+		HostMemory::Free(meshlets);
+		HostMemory::Free(meshletBounds);
+		HostMemory::Free(meshletVertices);
+		HostMemory::Free(meshletTriangles);
+		mesh.Free();
+		*this = MeshletMesh{};
+	}
 	unsigned int GetMeshletsVerticeCount();
 	unsigned int GetMeshletsTriangleCount();
 };
 
+//Where the meshlets of a mesh are. Same layout as MeshRecord on the shaders
+//There are two records per mesh: the full detail one (index = mesh) and its coarse fallback LOD (index = mesh + numMeshes)
+struct MeshRecord
+{
+	//first culling info of the record, the culling info is always resident
+	uint32_t meshletOffset;
+	uint32_t meshletCount;
+	//first page of the record on the page table, the meshlet geometry is on the pool slots of its pages (GeometryStreaming.h)
+	uint32_t pageOffset;
+	//record drawn while this one misses pages, the record itself on the fallback records
+	uint32_t fallbackRecord;
+};
+
+namespace GeometryStreaming { class ResidencyManager; }
+namespace InstanceSimulation { struct Motion; struct Keyframe; }
+class InstanceManager;
+namespace OcclusionCulling { class MaskedDepthBuffer; struct OccluderMesh; struct Box; }
+namespace VisibilityCache { class Tracker; }
+
 #include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+#include <stddef.h>
 class AABB
 {
 public:
@@ -48,11 +89,178 @@ public:
 	AABB(const Mesh& mesh) { Generate(mesh); }
 	void Generate(const Mesh& mesh);
 	void GetPoints(glm::vec3(&points)[8]) const;
+	const glm::vec3& GetMin() const { return minPoint; }
+	const glm::vec3& GetMax() const { return maxPoint; }
 private:
 	glm::vec3 minPoint;
 	glm::vec3 maxPoint;
 };
 
+//GPU counters written by culling.comp, the task and the mesh shaders. Same layout as the Stats buffer on the shaders
+struct CullingStats
+{
+	uint32_t instancesTested;
+	uint32_t instancesPassed;
+	uint32_t meshletsTested;
+	uint32_t meshletsFrustumCulled;
+	uint32_t meshletsConeCulled;
+	uint32_t meshletsPassed;
+	uint32_t trianglesEmitted;
+	uint32_t meshletsSoftwareRaster;
+	//rejected by the mesh shader, see PrimitiveCulling.h
+	uint32_t trianglesCulled;
+	//frustum tests skipped with the visibility cache, see VisibilityCache.h
+	uint32_t instancesCached;
+	uint32_t meshletsCached;
+};
+
+//Frame uniform of culling.comp, InstanceSim.comp, the task, mesh and visibility shaders. Same std140 layout as uboData on shaders/CullUniform.glsl
+struct CullUniform
+{
+	glm::vec4 frustumPlanes[6];
+	uint32_t numCommands;
+	uint32_t statsEnabled;
+	//projected diameter in pixels under which the meshlets go to SoftwareRaster.comp, 0 disables it
+	float swRasterThreshold;
+	//pixels per unit at view depth 1
+	float projectionScale;
+	uint32_t screenWidth;
+	uint32_t screenHeight;
+	uint32_t primitiveCulling;
+	float simulationTime;
+	uint32_t depthSort;
+	//Visibility cache: bit 0 the instances, bit 1 the meshlets. Newest epoch, valid epochs by age, frame and refresh period of the tracker
+	uint32_t visibilityCache;
+	uint32_t cacheEpoch;
+	uint32_t cacheValidMask;
+	uint32_t cacheFrame;
+	uint32_t cacheRefreshFrames;
+	uint32_t meshletStateWords;
+	//0 when the frame has no impostors
+	float impostorThreshold;
+	glm::vec4 inflatedPlanes[6];
+	glm::vec4 deflatedPlanes[6];
+	//VkPhysicalDeviceLimits::subPixelPrecisionBits, the primitive culling snaps like the rasterizer
+	uint32_t subPixelBits;
+	uint32_t padding[3];
+};
+//std140 puts the vec4 arrays on 16 byte boundaries and packs the scalars at 4 bytes
+static_assert(offsetof(CullUniform, numCommands) == 96, "CullUniform does not match uboData");
+static_assert(offsetof(CullUniform, statsEnabled) == 100, "CullUniform does not match uboData");
+static_assert(offsetof(CullUniform, swRasterThreshold) == 104, "CullUniform does not match uboData");
+static_assert(offsetof(CullUniform, projectionScale) == 108, "CullUniform does not match uboData");
+static_assert(offsetof(CullUniform, screenWidth) == 112, "CullUniform does not match uboData");
+static_assert(offsetof(CullUniform, screenHeight) == 116, "CullUniform does not match uboData");
+static_assert(offsetof(CullUniform, primitiveCulling) == 120, "CullUniform does not match uboData");
+static_assert(offsetof(CullUniform, simulationTime) == 124, "CullUniform does not match uboData");
+static_assert(offsetof(CullUniform, depthSort) == 128, "CullUniform does not match uboData");
+static_assert(offsetof(CullUniform, visibilityCache) == 132, "CullUniform does not match uboData");
+static_assert(offsetof(CullUniform, cacheEpoch) == 136, "CullUniform does not match uboData");
+static_assert(offsetof(CullUniform, cacheValidMask) == 140, "CullUniform does not match uboData");
+static_assert(offsetof(CullUniform, cacheFrame) == 144, "CullUniform does not match uboData");
+static_assert(offsetof(CullUniform, cacheRefreshFrames) == 148, "CullUniform does not match uboData");
+static_assert(offsetof(CullUniform, meshletStateWords) == 152, "CullUniform does not match uboData");
+static_assert(offsetof(CullUniform, impostorThreshold) == 156, "CullUniform does not match uboData");
+static_assert(offsetof(CullUniform, inflatedPlanes) == 160, "CullUniform does not match uboData");
+static_assert(offsetof(CullUniform, deflatedPlanes) == 256, "CullUniform does not match uboData");
+static_assert(offsetof(CullUniform, subPixelBits) == 352, "CullUniform does not match uboData");
+static_assert(sizeof(CullUniform) == 368, "CullUniform does not match uboData");
+
+//Results of the last frame retired by the GPU (read after its fence, MAX_FRAMES_IN_FLIGHT frames late)
+struct FrameStats
+{
+	uint64_t frameNumber = 0;
+	float gpuCullMs = 0.0f;
+	float gpuDrawMs = 0.0f;
+	uint32_t visibleInstances = 0;
+	uint32_t visibleMeshlets = 0;
+	CullingStats culling{};
+	//Pipeline statistics of the draw: primitives reaching the clipper and primitives leaving it, 0 when the queries are not supported
+	uint64_t clippingInvocations = 0;
+	uint64_t clippingPrimitives = 0;
+	//Geometry streaming, the uploads and evictions are the ones done for this frame
+	uint32_t residentPages = 0;
+	uint32_t pageRequests = 0;
+	uint32_t pageUploads = 0;
+	uint32_t pageEvictions = 0;
+	//The cull ran on the async compute queue, overlap is the part of its interval inside the previous frame draw (both are GPU timestamps). The compute
+	//and the graphics queues are only compared on the device time domain of VK_EXT_calibrated_timestamps, the overlap is negative without it
+	bool asyncCompute = false;
+	float cullOverlapMs = 0.0f;
+	//CPU side, of the last frame: time blocked on the present wait and swapchains created since Init
+	float presentWaitMs = 0.0f;
+	uint32_t swapChainRecreations = 0;
+	//Instance simulation time of the frame and, with SetInstanceValidation, the largest InstanceSimulation::TransformError of its GPU transforms
+	float simulationTime = 0.0f;
+	bool instancesValidated = false;
+	float instanceSimError = 0.0f;
+	//Instance slots, live instances and dirty slots uploaded for the frame and still waiting for the next ones
+	uint32_t instanceSlots = 0;
+	uint32_t liveInstances = 0;
+	uint32_t instanceUploads = 0;
+	uint32_t instanceBacklog = 0;
+	//CPU occlusion culling of the frame: instances rejected before culling.comp, occluder triangles rasterized and the CPU time of the whole pass
+	uint32_t occludedInstances = 0;
+	uint32_t occluderTriangles = 0;
+	float occlusionMs = 0.0f;
+	//Front to back sort of the culled commands (part of the cull time) and fragment shader invocations of the draw, 0 without the pipeline statistics
+	bool depthSorted = false;
+	float gpuSortMs = 0.0f;
+	uint64_t fragmentInvocations = 0;
+	//With SetInstanceValidation, sorted commands whose key recomputed on the CPU is nearer than the one before
+	bool depthOrderValidated = false;
+	uint32_t depthOrderErrors = 0;
+	//Visibility cache of the frame: the cull tested the instances with the cache, an epoch started on it (the entries were tested again) and epochs still valid
+	bool visibilityCached = false;
+	bool cacheEpochStarted = false;
+	uint32_t validCacheEpochs = 0;
+	//Shadow cascades of the frame (0 without them), culled and drawn as a single multiview pass or once per cascade. The draws are the ones
+	//ShadowCull.comp wrote for every cascade (one per instance and cascade set with multiview)
+	uint32_t shadowViews = 0;
+	bool shadowMultiView = false;
+	float gpuShadowCullMs = 0.0f;
+	float gpuShadowDrawMs = 0.0f;
+	uint32_t shadowDraws = 0;
+	//Far field impostors of the frame: instances culling.comp sent to Impostor.mesh instead of their meshlets (not in visibleInstances)
+	uint32_t impostorInstances = 0;
+};
+
+//Limits the meshlets are built with and how full they are (meshlet vertices / (meshlets * max vertices))
+struct MeshletStats
+{
+	uint32_t maxVertices = 0;
+	uint32_t maxPrimitives = 0;
+	uint32_t meshletCount = 0;
+	float vertexOccupancy = 0.0f;
+	float triangleOccupancy = 0.0f;
+};
+
+//Build time default, the first pair of the MESHLET_LIMITS cmake option
+#ifndef MESHLET_DEFAULT_MAX_VERTICES
+#define MESHLET_DEFAULT_MAX_VERTICES 64
+#endif
+#ifndef MESHLET_DEFAULT_MAX_PRIMITIVES
+#define MESHLET_DEFAULT_MAX_PRIMITIVES 124
+#endif
+
+enum class RenderPath : unsigned char
+{
+	//mesh shader + Shader.frag shading every rasterized fragment
+	FORWARD,
+	//mesh shader and SoftwareRaster.comp write depth + triangle ids, VisibilityShade.comp shades each pixel once
+	VISIBILITY_BUFFER
+};
+
+enum class PresentMode : unsigned char
+{
+	//vsync, the presented frames queue up
+	FIFO,
+	//vsync, a new frame replaces the one waiting for the display
+	MAILBOX,
+	//no vsync, it can tear
+	IMMEDIATE
+};
+
 class ModuleVulkan final : public Module
 {
 public:
@@ -63,49 +271,279 @@ public:
 	bool Init() override;
 	UpdateStatus PostUpdate(float dt) override;
 	bool CleanUp() override;
+	const char* GetName() const override { return "ModuleVulkan"; }
 	void SetModelMatrix(const glm::mat4& model);
 	void SetCameraInfo(const glm::mat4& viewProj, const glm::vec3& cameraPos);
+	//Must be called before Init, only the physical devices whose name contains the string are considered
+	void SetPreferredDevice(const char* deviceName) { preferredDeviceName = deviceName; }
+	const FrameStats& GetFrameStats() const { return frameStats; }
+	//The counters cost a few atomics per workgroup on the cull, task and mesh stages
+	void SetStatsEnabled(bool enabled) { statsEnabled = enabled; }
+	//Both paths are built on Init, it can be changed between frames
+	void SetRenderPath(RenderPath path) { renderPath = path; }
+	RenderPath GetRenderPath() const { return renderPath; }
+	//Projected meshlet diameter in pixels under which the visibility buffer path rasterizes on a compute shader, 0 disables it
+	void SetSoftwareRasterThreshold(float pixels);
+	float GetSoftwareRasterThreshold() const { return swRasterThreshold; }
+	//Back facing, zero area and small triangles are rejected on the mesh shader instead of the fixed function culling
+	void SetPrimitiveCulling(bool enabled) { primitiveCulling = enabled; }
+	bool GetPrimitiveCulling() const { return primitiveCulling; }
+	//Must be called before Init, clamped to the device limits. There must be a mesh shader variant built for the pair (MESHLET_LIMITS cmake option)
+	void SetMeshletLimits(uint32_t maxVertices, uint32_t maxPrimitives) { meshletMaxVertices = maxVertices; meshletMaxPrimitives = maxPrimitives; }
+	const MeshletStats& GetMeshletStats() const { return meshletStats; }
+	//Must be called before Init, device memory of the streamed geometry pools. 0 takes GEOMETRY_BUDGET_SHARE of the free device local memory
+	void SetGeometryBudget(VkDeviceSize bytes) { geometryBudget = bytes; }
+	uint32_t GetGeometryPageCount() const { return pageCount; }
+	//Must be called before Init, the cull runs on a dedicated compute queue when the device has one (and timeline semaphores), the graphics queue otherwise
+	void SetAsyncCompute(bool enabled) { asyncComputeRequested = enabled; }
+	bool GetAsyncCompute() const { return asyncCompute; }
+	//Applied on the next frame recreating the swapchain, FIFO when the surface does not support the mode
+	void SetPresentMode(PresentMode mode);
+	PresentMode GetPresentMode() const { return presentMode; }
+	//Presents the CPU runs ahead of the display with VK_KHR_present_wait, lower is less input latency. 0 does not wait
+	void SetFrameLatency(uint32_t frames) { frameLatency = frames; }
+	uint32_t GetFrameLatency() const { return frameLatency; }
+	bool IsPresentWaitSupported() const { return presentWaitSupported; }
+	//InstanceSim.comp writes the instance transforms from their motion every frame, disabled the simulation time stays where it is
+	void SetInstanceMotion(bool enabled) { instanceMotion = enabled; }
+	bool GetInstanceMotion() const { return instanceMotion; }
+	//Seconds the simulation advances per frame, 0 follows the frame time
+	void SetSimulationStep(float seconds) { simulationStep = seconds; }
+	//Must be called before Init, the GPU transforms of every frame are read back and compared with the CPU reference (InstanceSimulation.h)
+	void SetInstanceValidation(bool enabled) { instanceValidation = enabled; }
+	bool GetInstanceValidation() const { return instanceValidation; }
+	//Valid after Init, the scene is on it. The changes reach the GPU with the next frames, InstanceManager::MAX_UPLOADS slots per frame
+	InstanceManager* GetInstances() { return instances; }
+	uint32_t GetMeshCount() const { return numMeshes; }
+	//The motions are evaluated at this time, an instance added now with velocity v starts at position + v * time
+	double GetSimulationTime() const { return simulationTime; }
+	//The instances hidden behind the largest ones on a CPU masked depth buffer (OcclusionCulling.h) are skipped by culling.comp. The CPU evaluates
+	//the instance motions of every frame for it
+	void SetOcclusionCulling(bool enabled) { occlusionCulling = enabled; }
+	bool GetOcclusionCulling() const { return occlusionCulling; }
+	//The commands culling.comp keeps are sorted front to back on the GPU (RadixSort.comp, DepthSort.h) before the draw, so early Z rejects the hidden fragments
+	void SetDepthSort(bool enabled) { depthSort = enabled; }
+	bool GetDepthSort() const { return depthSort; }
+	//Temporal visibility cache (VisibilityCache.h): culling.comp keeps the frustum state of the static instances while the camera stays inside the margins
+	//of the epoch and only tests the ones on the boundary. With the meshlet cache the task shader also skips the test of the cached meshlets
+	//The settings drop the cached states, the cull waits the previous draw while it is enabled (the task shader reads the states it writes)
+	void SetVisibilityCache(bool enabled) { visibilityCache = enabled; visibilityCacheDirty = true; }
+	bool GetVisibilityCache() const { return visibilityCache; }
+	//Only when the meshlet states of every slot fit on MAX_MESHLET_STATE_BYTES
+	void SetMeshletCache(bool enabled) { meshletCache = enabled; visibilityCacheDirty = true; }
+	bool GetMeshletCache() const { return meshletCache && meshletStateWords != 0; }
+	//Every frame starts an epoch and each slot is tested again every frames frames (up to VisibilityCache::EPOCHS), 0 tests them when the camera leaves the margins
+	void SetVisibilityCacheRefresh(uint32_t frames) { visibilityCacheRefresh = frames; visibilityCacheDirty = true; }
+	uint32_t GetVisibilityCacheRefresh() const { return visibilityCacheRefresh; }
+	//Must be called before Init, shadow cascades of the light of Shader.frag (MultiView.h, clamped to MultiView::MAX_VIEWS). 0 creates no shadow resources
+	//The shading does not sample them yet, they are the multi-view pass to measure
+	void SetShadowCascades(uint32_t cascades) { shadowCascades = cascades; }
+	uint32_t GetShadowCascades() const { return shadowCascades; }
+	//One cull dispatch with view masks and one multiview render pass for every cascade, otherwise a dispatch and a pass per cascade. It can be
+	//changed between frames, without VK_KHR_multiview on the mesh shaders the cascades are always drawn separately
+	void SetShadowMultiView(bool enabled) { shadowMultiView = enabled; }
+	bool GetShadowMultiView() const { return shadowMultiView && multiViewSupported; }
+	bool IsMultiViewSupported() const { return multiViewSupported; }
+	//Projected bounding sphere diameter in pixels under which the forward path draws an instance as an octahedral impostor (Impostor.h) instead of its
+	//meshlets, 0 disables them. A threshold set before Init bakes the atlases of every mesh, without them it has no effect. It can be changed between frames
+	void SetImpostorThreshold(float pixels) { impostorThreshold = pixels > 0.0f ? pixels : 0.0f; }
+	float GetImpostorThreshold() const { return impostorThreshold; }
+	bool AreImpostorsBaked() const { return impostorsBaked; }
+	//Must be called before Init, point lights spread over the scene (ClusteredLighting.h, clamped to ClusteredLighting::MAX_LIGHTS). They are binned every
+	//frame into the clusters of the camera and the shading walks the lights of the cluster of the fragment. 0 only binds empty buffers and skips the binning
+	void SetLightCount(uint32_t count) { lightCount = count; }
+	uint32_t GetLightCount() const { return lightCount; }
 
 	static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+	//Instances of the scene built on Init and the instance slots of the GPU buffers, the rest are free for the instances added later
 	static constexpr int NUM_MODELS = 100000;
+	static constexpr uint32_t MAX_INSTANCES = 1u << 17;
+	//cull begin, cull end (after the sort), draw begin, draw end, sort begin, shadow cull begin and end, shadow draw begin and end
+	static constexpr int TIMESTAMPS_PER_FRAME = 9;
+	//Seconds between the stats written on the window title and the log
+	static constexpr float STATS_REPORT_INTERVAL = 1.0f;
+	//Capacity of the visible cluster list of the visibility buffer path, the meshlets past it are dropped
+	static constexpr uint32_t MAX_VISIBLE_CLUSTERS = 1u << 21;
+	static constexpr float DEFAULT_SOFTWARE_RASTER_THRESHOLD = 16.0f;
+	//Workgroups of SoftwareRaster.comp, each one loops over the software clusters
+	static constexpr uint32_t SOFTWARE_RASTER_WORKGROUPS = 1024;
+	//Largest meshlet: the shared arrays of the mesh shaders and SoftwareRaster.comp, the 8 bit triangle of the visibility buffer ids
+	static constexpr uint32_t MAX_MESHLET_OUTPUTS = 256;
+	//Share of the memory budget (VK_EXT_memory_budget, the device local heap size without it) the geometry pools take by default
+	static constexpr float GEOMETRY_BUDGET_SHARE = 0.5f;
+	//A present that never completes (the window hidden) must not hang the frame
+	static constexpr uint64_t PRESENT_WAIT_TIMEOUT_NS = 100000000;
+	//Largest transform difference between InstanceSim.comp and the CPU reference before the validation logs it
+	static constexpr float INSTANCE_SIM_TOLERANCE = 1e-3f;
+	//Occluders rasterized per frame and their triangles (the fallback LOD of their meshes), the largest instances on screen first
+	static constexpr uint32_t MAX_OCCLUDERS = 256;
+	static constexpr uint32_t MAX_OCCLUDER_TRIANGLES = 32768;
+	//Projected radius (NDC, 2 is the screen height) under which an instance is never an occluder
+	static constexpr float MIN_OCCLUDER_SIZE = 0.05f;
+	//Memory of the meshlet states of the visibility cache (2 bits per meshlet of the largest mesh for every slot), the meshlet cache is off past it
+	static constexpr VkDeviceSize MAX_MESHLET_STATE_BYTES = 64 * 1024 * 1024;
+	//Same as MultiView::MAX_VIEWS
+	static constexpr uint32_t MAX_SHADOW_CASCADES = 4;
+	//Depth bias of the cascade passes, the caster surfaces do not shadow themselves
+	static constexpr float SHADOW_DEPTH_BIAS_CONSTANT = 1.25f;
+	static constexpr float SHADOW_DEPTH_BIAS_SLOPE = 1.75f;
+	//The first cascade starts at the camera near plane (ModuleEditorCamera::ChangeAspectRatio)
+	static constexpr float SHADOW_NEAR_PLANE = 0.1f;
 private:
+	//Swapchain and the targets sized like it. RecreateSwapChain retires them, they are destroyed once the frames that used them are done
+	struct RetiredSwapChain
+	{
+		VkSwapchainKHR swapChain;
+		unsigned int imageCount;
+		VkImageView* imageViews;
+		VkFramebuffer* framebuffers;
+		VkSemaphore* renderFinishedSemaphores;
+		VkImage depthImage;
+		VkDeviceMemory depthImageMemory;
+		VkImageView depthImageView;
+		VkFramebuffer visFramebuffer;
+		VkBuffer visibilityBuffer;
+		VkDeviceMemory visibilityBufferMemory;
+		VkImage shadedImage;
+		VkDeviceMemory shadedImageMemory;
+		VkImageView shadedImageView;
+		//last frame submitted with them
+		uint64_t lastFrame;
+	};
+
 	static bool CheckVulkanExtensionsSupport(const char* const* ppEnabledExtensionNames, const unsigned int enabledExtensionCount);
 	static bool CheckVulkanLayersSupport(const char* const* ppEnabledExtensionNames, const unsigned int enabledExtensionCount);
 	static bool CheckDeviceExtensionSupport(VkPhysicalDevice device, const char* const* ppEnabledExtensionNames, const unsigned int enabledExtensionCount);
 	bool CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
-	bool CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
+	bool CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory, uint32_t layers = 1);
 	uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
 	void RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t numMeshlets);
-	bool CreateSwapChain();
+	//Streaming copies, InstanceSim.comp, culling.comp and its timestamps. On the compute command buffer with async compute, at the start of the graphics one otherwise
+	void RecordCull(VkCommandBuffer commandBuffer);
+	void RecordInstanceSimulation(VkCommandBuffer commandBuffer);
+	//ShadowCull.comp after culling.comp, a single dispatch for every cascade with multiview
+	void RecordShadowCull(VkCommandBuffer commandBuffer);
+	//Depth passes of the cascades, after the cull barrier
+	void RecordShadowDraw(VkCommandBuffer commandBuffer);
+	//Cascade views and planes of the camera of the frame
+	void UpdateShadowViews();
+	//RadixSort.comp passes over the survivors of culling.comp, the last one writes the indirect commands and the model ids
+	void RecordDepthSort(VkCommandBuffer commandBuffer);
+	//Compares the read back transforms of the retired frame with InstanceSimulation::Evaluate
+	void ValidateInstances();
+	//Recomputes the keys of the read back sorted model ids from the read back transforms, after ValidateInstances
+	void ValidateDepthOrder();
+	//Stages the dirty instance slots (mesh + motion) and queues their copies with the streaming ones
+	void StageInstances();
+	//Writes the occluded bits of the frame culling.comp reads, after StageInstances
+	void UpdateOcclusion(const glm::mat4& viewProj);
+	//Epochs of the visibility cache for the camera of the frame, its uniform parameters and the invalid bits of the uploaded slots, after StageInstances
+	void UpdateVisibilityCache(CullUniform& uniform);
+	bool RecordComputeCommandBuffer(VkCommandBuffer commandBuffer);
+	void RecordDrawMeshlets(VkCommandBuffer commandBuffer);
+	void RecordSoftwareRaster(VkCommandBuffer commandBuffer);
+	void RecordVisibilityShading(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	//The sets of a frame in flight, only when its command buffers are not pending
+	void UpdateVisibilityDescriptors(uint32_t frame);
+	//Default geometry budget, see SetGeometryBudget
+	VkDeviceSize GetMemoryBudget() const;
+	//Reads the page feedback of the retired frame and stages the page uploads and the table changes for the next command buffer
+	void UpdateStreaming();
+	//Expands the page on the staging memory (SlotSize bytes at stagingOffset) and queues its copies to the slot
+	void StagePage(uint32_t page, uint32_t slot, unsigned char* staging, VkDeviceSize stagingOffset);
+	//Queues the copies of the dirty page table and record residency ranges
+	void StageTables(unsigned char* staging, VkDeviceSize stagingOffset);
+	void RecordStreamingCopies(VkCommandBuffer commandBuffer, VkBuffer stagingBuffer);
+	//dstStages: the stages of the queue that read the pools and the tables after the copies
+	void RecordStreaming(VkCommandBuffer commandBuffer, VkPipelineStageFlags dstStages);
+	bool HasPendingStreamingCopies(int targetCount = STREAMING_COPY_TARGETS) const;
+	void ReadFrameStats();
+	void ReportStats(float dt);
+	bool CreateSwapChain(VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE);
 	bool CreateFrameBuffers();
-	void DestroySwapChain();
-	void DestroyFrameBuffers();
-	void GenerateMeshlet(Mesh& mesh, MeshletMesh& meshletMesh) const;
+	//New swapchain and targets without waiting for the device, the old ones are retired
+	bool RecreateSwapChain();
+	void RetireSwapChain();
+	//presentsCompleted: every present queued on the retired swapchains waited its semaphore
+	void DestroyRetiredSwapChains(uint64_t completedFrame, bool presentsCompleted);
+	VkPresentModeKHR ChoosePresentMode(PresentMode mode) const;
+	void WaitForPresent();
+	//The temporaries of the build come from scratch
+	void GenerateMeshlet(Mesh& mesh, MeshletMesh& meshletMesh, HostMemory::Arena& scratch) const;
+	void ImportScene();
+	void WaitSceneImport();
 	bool FindSupportedFormat(const VkFormat* candidates, size_t numCandidates, VkImageTiling tiling, VkFormatFeatureFlags features, VkFormat& out, VkPhysicalDevice* pDevice = nullptr);
 	ModuleWindow* mWindow;
 	ModuleEditorCamera* mCamera;
 	VkInstance instance;
 	const char** extensions;
+	const char* preferredDeviceName = nullptr;
 	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
 	VkDevice device = VK_NULL_HANDLE;
 	VkQueue graphicsQueue;
 	int graphicsQueueFamilyIndex = 0;
+	//Async compute: a compute only queue family runs the cull, the frames are chained with timeline semaphores (value = frame number)
+	//The graphics submit of a frame waits its cull, the cull waits the previous frame draw only when it copies streamed pages
+	bool asyncComputeRequested = true;
+	bool asyncCompute = false;
+	int computeQueueFamilyIndex = -1;
+	VkQueue computeQueue = VK_NULL_HANDLE;
+	VkCommandPool computeCommandPool = VK_NULL_HANDLE;
+	VkCommandBuffer computeCommandBuffers[MAX_FRAMES_IN_FLIGHT];
+	VkSemaphore cullTimelineSemaphore = VK_NULL_HANDLE;
+	VkSemaphore drawTimelineSemaphore = VK_NULL_HANDLE;
 	//TODO: Get the present Queue -> It could be different than the graphics queue
 	//VkQueue presentQueue;
 	VkSurfaceKHR surface;
 	VkSwapchainKHR swapChain;
 	VkSurfaceFormatKHR swapChainSurfaceFormat;
 	VkExtent2D swapChainExtent{0,0};
+	//window size in pixels when the swapchain was created, a different one recreates it
+	VkExtent2D swapChainWindowSize{0,0};
 	VkImage* swapChainImages = nullptr;
 	VkImageView* swapChainImageViews = nullptr;
 	unsigned int swapChainImageCount = 0;
+	//Images of the current swapchain acquired at least once, the retired swapchains wait all of them without VK_EXT_swapchain_maintenance1
+	std::vector<bool> swapChainImageAcquired;
+	unsigned int swapChainImagesAcquired = 0;
 	VkPresentModeKHR swapChainPresentMode;
+	PresentMode presentMode = PresentMode::MAILBOX;
+	//1 << VkPresentModeKHR of the core modes the surface supports
+	uint32_t supportedPresentModes = 0;
+	bool swapChainDirty = false;
+	std::vector<RetiredSwapChain> retiredSwapChains;
+	bool visibilityDescriptorsDirty[MAX_FRAMES_IN_FLIGHT] = {};
+	//VK_KHR_present_id + VK_KHR_present_wait, the ids restart with every swapchain
+	bool presentWaitSupported = false;
+	uint32_t frameLatency = 0;
+	uint64_t presentId = 0;
+	PFN_vkWaitForPresentKHR vkWaitForPresentKHR = nullptr;
+	//VK_EXT_surface_maintenance1 on the instance and VK_EXT_swapchain_maintenance1, one present fence per frame in flight
+	bool surfaceMaintenanceSupported = false;
+	bool swapChainMaintenanceSupported = false;
+	VkFence presentFences[MAX_FRAMES_IN_FLIGHT] = {};
 	VkFramebuffer* swapChainFramebuffers = nullptr;
 	VkRenderPass renderPass;
 	VkPipelineLayout pipelineLayout;
 	VkPipelineLayout cullPipelineLayout;
 	VkPipeline graphicsPipeline;
 	VkPipeline computePipeline;
+	VkPipeline instanceSimPipeline;
+	VkPipelineLayout instanceSimPipelineLayout;
+	//histogram, scan and scatter stages of RadixSort.comp
+	VkPipeline sortPipelines[3];
+	VkPipelineLayout sortPipelineLayout;
+	RenderPath renderPath = RenderPath::FORWARD;
+	bool visibilityBufferSupported = false;
+	VkRenderPass visRenderPass;
+	VkPipeline visPipeline = VK_NULL_HANDLE;
+	VkPipeline visShadePipeline;
+	VkPipelineLayout visShadePipelineLayout;
+	VkPipeline swRasterPipeline = VK_NULL_HANDLE;
+	VkPipelineLayout swRasterPipelineLayout;
+	float swRasterThreshold = DEFAULT_SOFTWARE_RASTER_THRESHOLD;
+	bool primitiveCulling = false;
+	VkFramebuffer visFramebuffer;
 	VkCommandPool commandPool;
 	VkCommandBuffer commandBuffers[MAX_FRAMES_IN_FLIGHT];
 	VkFence frameFences[MAX_FRAMES_IN_FLIGHT];
@@ -113,14 +551,42 @@ private:
 	VkSemaphore* renderFinishedSemaphores;
 	uint32_t currentFrame = 0;
 	uint32_t swapChainImageIndex = 0;
+	uint64_t submittedFrames = 0;
+	uint64_t frameNumbers[MAX_FRAMES_IN_FLIGHT] = {};
+	FrameStats frameStats;
+	VkQueryPool timestampQueryPool = VK_NULL_HANDLE;
+	bool timestampsSupported = false;
+	//one query per frame in flight around the draw
+	VkQueryPool pipelineStatisticsQueryPool = VK_NULL_HANDLE;
+	bool pipelineStatisticsSupported = false;
+	float timestampPeriod = 0.0f;
+	//VK_EXT_calibrated_timestamps with the device time domain
+	bool calibratedTimestampsSupported = false;
+	PFN_vkGetCalibratedTimestampsEXT vkGetCalibratedTimestampsEXT = nullptr;
+	//draw begin and end ticks of the last frame read, for the cull overlap of the next one
+	uint64_t lastDrawTimestamps[2] = {};
+	uint64_t lastDrawFrame = 0;
+	bool statsEnabled = true;
+	float statsReportTimer = 0.0f;
+	//device limits
 	uint32_t meshletMaxOutputVertices = 0;
 	uint32_t meshletMaxOutputPrimitives = 0;
+	//limits the meshlets are built with
+	uint32_t meshletMaxVertices = MESHLET_DEFAULT_MAX_VERTICES;
+	uint32_t meshletMaxPrimitives = MESHLET_DEFAULT_MAX_PRIMITIVES;
+	MeshletStats meshletStats;
 	uint32_t maxPreferredMeshWorkGroupInvocations = 0;
 	uint32_t maxPreferredTaskWorkGroupInvocations = 0;
 	VkDeviceSize minStorageBufferOffsetAlignment = 0;
 	VkDeviceSize minUniformBufferOffsetAlignment = 0;
+	VkDeviceSize maxStorageBufferRange = 0;
+	//fixed point precision of the rasterizer, the primitive culling snaps the vertices with it
+	uint32_t subPixelPrecisionBits = 0;
+	bool memoryBudgetSupported = false;
 	VkDescriptorPool descriptorPool;
-	VkDescriptorSet* descriptorSets;
+	//graphics sets, cull sets, visibility shade sets, software raster sets, instance simulation sets, depth sort sets, shadow cull and shadow draw sets
+	//with the shadow cascades (MAX_FRAMES_IN_FLIGHT each)
+	VkDescriptorSet* descriptorSets = nullptr;
 #ifndef NDEBUG
 	VkDebugUtilsMessengerEXT debugMessenger;
 	bool layersEnabled = false;
@@ -139,34 +605,217 @@ private:
 	VkDeviceMemory transformsBufferMemory;
 	void* transformsBufferPtr[MAX_FRAMES_IN_FLIGHT];
 
-	VkBuffer numMeshletsBuffer;
-	VkDeviceMemory numMeshletsBufferMemory;
+	//mesh index of every instance slot (InstanceManager::DEAD_INSTANCE on the dead ones) + the MeshRecord of every mesh
+	VkBuffer instanceMeshesBuffer;
+	VkDeviceMemory instanceMeshesBufferMemory;
+	VkBuffer meshRecordsBuffer;
+	VkDeviceMemory meshRecordsBufferMemory;
+	//indirect commands and (instance, record) of every draw written by culling.comp, one range per frame in flight (the cull of a frame runs while the previous one draws)
 	VkBuffer dispatchIndirectBuffer;
 	VkDeviceMemory dispatchIndirectBufferMemory;
+	VkDeviceSize dispatchIndirectSize = 0;
 	VkBuffer modelIDsBuffer;
 	VkDeviceMemory modelIDsBufferMemory;
+	VkDeviceSize modelIDsSize = 0;
 	VkBuffer parameterBuffer;
 	VkDeviceMemory parameterBufferMemory;
 	void* parameterBufferPtr[MAX_FRAMES_IN_FLIGHT];
+	VkBuffer statsBuffer;
+	VkDeviceMemory statsBufferMemory;
+	void* statsBufferPtr[MAX_FRAMES_IN_FLIGHT];
 	VkBuffer frustumPlanesBuffer;
 	VkDeviceMemory frustumPlanesBufferMemory;
 	void* frustumPlanesBufferPtr[MAX_FRAMES_IN_FLIGHT];
+	//Host copy of the uniform of every frame, filled during PostUpdate and copied whole before the frame is recorded
+	CullUniform frameUniforms[MAX_FRAMES_IN_FLIGHT] = {};
+	//Instance transforms written by InstanceSim.comp, one range per frame in flight. Device local, the host never writes them
 	VkBuffer modelMatricesBuffer;
 	VkDeviceMemory modelMatricesBufferMemory;
-	void* modelMatricesBufferPtr[MAX_FRAMES_IN_FLIGHT];
+	VkDeviceSize modelMatricesSize = 0;
+	//Local bounding box points of every mesh, uploaded once
 	VkBuffer OBBsBuffer;
 	VkDeviceMemory OBBsBufferMemory;
-	void* OBBsBufferPtr[MAX_FRAMES_IN_FLIGHT];
+	//Instance simulation: the motion of every instance slot (patched with the dirty slots) and the keyframe tracks (uploaded once)
+	VkBuffer instanceMotionsBuffer;
+	VkDeviceMemory instanceMotionsBufferMemory;
+	VkBuffer instanceKeyframesBuffer;
+	VkDeviceMemory instanceKeyframesBufferMemory;
+	bool instanceMotion = true;
+	float simulationStep = 0.0f;
+	double simulationTime = 0.0;
+	float frameSimulationTimes[MAX_FRAMES_IN_FLIGHT] = {};
+	//InstanceManager::GetSlotCount() when the frame was recorded, the slots InstanceSim.comp and culling.comp went through
+	uint32_t frameSlotCounts[MAX_FRAMES_IN_FLIGHT] = {};
+	InstanceManager* instances = nullptr;
+	//dirty slots taken by StageInstances, MAX_UPLOADS on frameScratch
+	uint32_t* instanceUploadSlots = nullptr;
+	//SetInstanceValidation: host copy of the transforms of every frame in flight, frame whose copies wrote each slot last
+	bool instanceValidation = false;
+	uint64_t* instanceUploadFrames = nullptr;
+	VkBuffer instanceReadbackBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory instanceReadbackBufferMemory;
+	void* instanceReadbackBufferPtr[MAX_FRAMES_IN_FLIGHT];
+	//CPU occlusion culling: occluder and bounds of every mesh, the CPU transforms, occluder scores and skipped (not uploaded yet) flags of every slot are
+	//on frameScratch. A bit per slot for every frame in flight, host visible
+	bool occlusionCulling = false;
+	OcclusionCulling::MaskedDepthBuffer* occlusionBuffer = nullptr;
+	OcclusionCulling::OccluderMesh* occluderMeshes = nullptr;
+	OcclusionCulling::Box* meshBoxes = nullptr;
+	VkBuffer occlusionBitsBuffer;
+	VkDeviceMemory occlusionBitsBufferMemory;
+	void* occlusionBitsBufferPtr[MAX_FRAMES_IN_FLIGHT];
+	//Depth sort: two halves of MAX_INSTANCES keys and (instance, record) values and the block counts of every frame in flight, device local
+	//With SetInstanceValidation the sorted model ids are read back too
+	bool depthSort = false;
+	bool frameDepthSorted[MAX_FRAMES_IN_FLIGHT] = {};
+	VkBuffer sortKeysBuffer;
+	VkDeviceMemory sortKeysBufferMemory;
+	VkDeviceSize sortKeysSize = 0;
+	VkBuffer sortValuesBuffer;
+	VkDeviceMemory sortValuesBufferMemory;
+	VkDeviceSize sortValuesSize = 0;
+	VkBuffer sortBlockCountsBuffer;
+	VkDeviceMemory sortBlockCountsBufferMemory;
+	VkDeviceSize sortBlockCountsSize = 0;
+	VkBuffer depthOrderReadbackBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory depthOrderReadbackBufferMemory;
+	void* depthOrderReadbackBufferPtr[MAX_FRAMES_IN_FLIGHT];
+	//Visibility cache: the epochs of the camera, the entry and the meshlet states of every slot (device local, kept across the frames) and a bit per slot
+	//uploaded on the frame for every frame in flight (host visible). The settings reach the tracker on the next frame
+	bool visibilityCache = false;
+	bool meshletCache = true;
+	bool visibilityCacheDirty = true;
+	uint32_t visibilityCacheRefresh = 0;
+	VisibilityCache::Tracker* visibilityTracker = nullptr;
+	uint32_t meshletStateWords = 0;
+	bool frameVisibilityCached[MAX_FRAMES_IN_FLIGHT] = {};
+	bool frameCacheEpochStarted[MAX_FRAMES_IN_FLIGHT] = {};
+	uint32_t frameValidCacheEpochs[MAX_FRAMES_IN_FLIGHT] = {};
+	VkBuffer cacheEntriesBuffer;
+	VkDeviceMemory cacheEntriesBufferMemory;
+	VkBuffer meshletStatesBuffer;
+	VkDeviceMemory meshletStatesBufferMemory;
+	VkBuffer cacheInvalidBitsBuffer;
+	VkDeviceMemory cacheInvalidBitsBufferMemory;
+	void* cacheInvalidBitsBufferPtr[MAX_FRAMES_IN_FLIGHT];
+	//Shadow cascades (MultiView.h): one depth layer per cascade, a view per layer for the separate passes and one for the whole array for the multiview pass
+	//The views uniform (view projections + planes), the commands and draws of MAX_INSTANCES per partition and the draw counts are per frame in flight
+	uint32_t shadowCascades = 0;
+	bool shadowMultiView = true;
+	bool multiViewSupported = false;
+	bool frameShadowMultiView[MAX_FRAMES_IN_FLIGHT] = {};
+	VkRenderPass shadowRenderPass = VK_NULL_HANDLE;
+	VkRenderPass shadowMultiViewRenderPass = VK_NULL_HANDLE;
+	VkPipelineLayout shadowCullPipelineLayout;
+	VkPipeline shadowCullPipeline = VK_NULL_HANDLE;
+	VkPipelineLayout shadowPipelineLayout;
+	VkPipeline shadowPipeline = VK_NULL_HANDLE;
+	VkPipeline shadowMultiViewPipeline = VK_NULL_HANDLE;
+	VkImage shadowImage;
+	VkDeviceMemory shadowImageMemory;
+	VkImageView shadowArrayView = VK_NULL_HANDLE;
+	VkImageView shadowLayerViews[MAX_SHADOW_CASCADES] = {};
+	VkFramebuffer shadowFramebuffers[MAX_SHADOW_CASCADES] = {};
+	VkFramebuffer shadowMultiViewFramebuffer = VK_NULL_HANDLE;
+	VkBuffer shadowViewsBuffer;
+	VkDeviceMemory shadowViewsBufferMemory;
+	void* shadowViewsBufferPtr[MAX_FRAMES_IN_FLIGHT];
+	VkBuffer shadowCommandsBuffer;
+	VkDeviceMemory shadowCommandsBufferMemory;
+	VkDeviceSize shadowCommandsSize = 0;
+	VkBuffer shadowDrawsBuffer;
+	VkDeviceMemory shadowDrawsBufferMemory;
+	VkDeviceSize shadowDrawsSize = 0;
+	VkBuffer shadowCountsBuffer;
+	VkDeviceMemory shadowCountsBufferMemory;
+	void* shadowCountsBufferPtr[MAX_FRAMES_IN_FLIGHT];
+	//Far field impostors (Impostor.h): record and atlas frames of every mesh baked on Init, indirect groups + count (reset by the CPU) and the
+	//instance + mesh of every impostor per frame in flight
+	float impostorThreshold = 0.0f;
+	bool impostorsBaked = false;
+	bool frameImpostors[MAX_FRAMES_IN_FLIGHT] = {};
+	VkPipeline impostorPipeline = VK_NULL_HANDLE;
+	VkBuffer impostorRecordsBuffer;
+	VkDeviceMemory impostorRecordsBufferMemory;
+	VkBuffer impostorAtlasBuffer;
+	VkDeviceMemory impostorAtlasBufferMemory;
+	VkBuffer impostorCountsBuffer;
+	VkDeviceMemory impostorCountsBufferMemory;
+	void* impostorCountsBufferPtr[MAX_FRAMES_IN_FLIGHT];
+	VkBuffer impostorDrawsBuffer;
+	VkDeviceMemory impostorDrawsBufferMemory;
+	VkDeviceSize impostorDrawsSize = 0;
+	//Clustered lights (ClusteredLighting.h): the lights generated on Init, the grid parameters from the camera and the cluster grid ClusterLights.comp
+	//writes, both per frame in flight. The binning shares the set and the layout of the cull
+	uint32_t lightCount = 0;
+	VkPipeline clusterLightsPipeline = VK_NULL_HANDLE;
+	VkBuffer lightsBuffer;
+	VkDeviceMemory lightsBufferMemory;
+	VkBuffer clusterParamsBuffer;
+	VkDeviceMemory clusterParamsBufferMemory;
+	void* clusterParamsBufferPtr[MAX_FRAMES_IN_FLIGHT];
+	VkBuffer clusterGridBuffer;
+	VkDeviceMemory clusterGridBufferMemory;
+	//visibility buffer path: counters + (instance, meshlet) of every visible meshlet, the ones sent to the software rasterizer
+	VkBuffer visibleClustersBuffer;
+	VkDeviceMemory visibleClustersBufferMemory;
+	VkBuffer swClustersBuffer;
+	VkDeviceMemory swClustersBufferMemory;
+	//Geometry streaming: the meshlet, meshlet vertices, triangles and vertex buffers are pools of page slots
+	//page -> slot and missing pages of every record (device local, updated with copies), the page feedback of every frame in flight
+	VkDeviceSize geometryBudget = 0;
+	GeometryStreaming::ResidencyManager* residency = nullptr;
+	FileSystem::MappedFile* pageFiles = nullptr;
+	//Every page on its mapped page file
+	const unsigned char** pageData = nullptr;
+	uint32_t pageCount = 0;
+	uint32_t numRecords = 0;
+	VkBuffer pageTableBuffer;
+	VkDeviceMemory pageTableBufferMemory;
+	VkBuffer recordResidencyBuffer;
+	VkDeviceMemory recordResidencyBufferMemory;
+	VkBuffer pageFeedbackBuffer;
+	VkDeviceMemory pageFeedbackBufferMemory;
+	void* pageFeedbackBufferPtr[MAX_FRAMES_IN_FLIGHT];
+	VkDeviceSize pageFeedbackSize = 0;
+	//MAX_PAGE_UPLOADS slots + both tables + InstanceManager::MAX_UPLOADS instance slots per frame in flight
+	VkBuffer streamingStagingBuffer;
+	VkDeviceMemory streamingStagingBufferMemory;
+	void* streamingStagingBufferPtr[MAX_FRAMES_IN_FLIGHT];
+	VkDeviceSize streamingStagingSize = 0;
+	//Copies queued by StagePage, StageTables and StageInstances: meshlets, meshlet vertices, triangles, vertices, page table, record residency,
+	//instance meshes and motions. Only the page copies (the first PAGE_COPY_TARGETS) write buffers the draw reads
+	static constexpr int PAGE_COPY_TARGETS = 6;
+	static constexpr int STREAMING_COPY_TARGETS = 8;
+	std::vector<VkBufferCopy> streamingCopies[STREAMING_COPY_TARGETS];
 
 	PFN_vkCmdDrawMeshTasksEXT vkCmdDrawMeshTasksEXT = nullptr;
 	PFN_vkCmdDrawMeshTasksIndirectEXT vkCmdDrawMeshTasksIndirectEXT = nullptr;
 	PFN_vkCmdDrawMeshTasksIndirectCountEXT vkCmdDrawMeshTasksIndirectCountEXT = nullptr;
-	MeshletMesh meshletMesh;
+	//Shader reads in flight during Init and the scene meshes imported by importThread while the device is created
+	AsyncIO asyncIO;
+	std::thread importThread;
+	Mesh* importedMeshes = nullptr;
+	//Temporaries of the import and of the meshlet build, used by importThread and then by Init after WaitSceneImport. Reset per mesh, released after Init
+	HostMemory::Arena importScratch{ HostMemory::Tag::IMPORT_SCRATCH };
+	//Host temporaries of a frame, reset after the frame fence
+	HostMemory::Arena frameScratch{ HostMemory::Tag::FRAME_SCRATCH };
+	bool sceneImported = false;
+	MeshletMesh* meshletMeshes = nullptr;
+	MeshRecord* meshRecords = nullptr;
+	unsigned int numMeshes = 0;
+	uint32_t maxMeshletsPerMesh = 0;
 
 	VkImage depthImage;
 	VkFormat depthFormat;
 	VkDeviceMemory depthImageMemory;
 	VkImageView depthImageView;
+	//visibility buffer targets, same size as the swapchain. 64 bits per pixel (see VisibilityBuffer.h)
+	VkBuffer visibilityBuffer;
+	VkDeviceMemory visibilityBufferMemory;
+	VkImage shadedImage;
+	VkDeviceMemory shadedImageMemory;
+	VkImageView shadedImageView;
 
 	static unsigned int GetInbetweenAlignmentSpace(unsigned int structSize, unsigned int alignment) {
 		return AlignedStructSize(structSize, alignment) - structSize;
@@ -175,8 +824,8 @@ private:
 	{
 		return (structSize + (alignment - 1)) & ~(alignment - 1);
 	}
-	AABB modelAABB;
-	glm::mat4* modelMatrices;
+	glm::vec3 (*meshAABBPoints)[8] = nullptr;
+	InstanceSimulation::Keyframe* instanceKeyframes = nullptr;
 	
 };
 
@@ -46,6 +46,8 @@ bool ModuleWindow::Init()
 #ifdef WINDOW_RESIZEABLE
 		flags |= SDL_WINDOW_RESIZABLE;
 #endif
+	if (hidden)
+		flags |= SDL_WINDOW_HIDDEN;
 
 	window = SDL_CreateWindow("Engine", width, heigth, flags);
 
@@ -14,12 +14,17 @@ public:
 
 	bool Init() override;
 	bool CleanUp() override;
+	const char* GetName() const override { return "ModuleWindow"; }
 	unsigned int GetWidth() const { return width; }
 	unsigned int GetHeight() const { return heigth; }
+	//Must be called before Init, used by the benchmark so the window does not cover the screen. It is still a window with a Vulkan surface,
+	//there is no offscreen path: a display server (or a virtual one like Xvfb) is needed
+	void SetHidden(bool hide) { hidden = hide; }
 	SDL_Window* window;
 private:
 	unsigned int width;
 	unsigned int heigth;
+	bool hidden = false;
 };
 
 #endif // !__MODULE_WINDOW_H__
\ No newline at end of file
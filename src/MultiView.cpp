@@ -0,0 +1,122 @@
+#include "MultiView.h"
+#include "glm/geometric.hpp"
+#include "glm/matrix.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include <math.h>
+#include <algorithm>
+
+void MultiView::PlanesFromMatrix(const glm::mat4& viewProj, glm::vec4(&planes)[6])
+{
+	//Rows of the matrix, a point is inside the clip plane r when dot(r, (p, 1)) >= 0
+	glm::vec4 rows[4];
+	for (uint32_t i = 0; i < 4; ++i)
+		rows[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+	const glm::vec4 inside[6] = { rows[2], rows[3] - rows[2], rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1] };
+	for (uint32_t i = 0; i < 6; ++i)
+	{
+		const float length = glm::length(glm::vec3(inside[i]));
+		planes[i] = glm::vec4(-glm::vec3(inside[i]) / length, inside[i].w / length);
+	}
+}
+
+void MultiView::CascadeSplits(float nearPlane, float farPlane, uint32_t count, float lambda, float* splits)
+{
+	for (uint32_t i = 0; i <= count; ++i)
+	{
+		const float f = static_cast<float>(i) / static_cast<float>(count);
+		const float logarithmic = nearPlane * powf(farPlane / nearPlane, f);
+		const float uniform = nearPlane + (farPlane - nearPlane) * f;
+		splits[i] = lambda * logarithmic + (1.0f - lambda) * uniform;
+	}
+}
+
+void MultiView::CascadeViews(const glm::mat4& view, const glm::mat4& proj, float nearPlane, const glm::vec3& lightDirection, uint32_t count, float distance, float lambda, float casterDistance,
+	uint32_t resolution, glm::mat4* viewProjs)
+{
+	const glm::mat4 cameraWorld = glm::inverse(view);
+	const glm::vec3 eye(cameraWorld[3]);
+	const glm::vec3 right(cameraWorld[0]);
+	const glm::vec3 up(cameraWorld[1]);
+	const glm::vec3 forward = -glm::vec3(cameraWorld[2]);
+	const float tanHalfX = 1.0f / fabsf(proj[0][0]);
+	const float tanHalfY = 1.0f / fabsf(proj[1][1]);
+	float splits[MAX_VIEWS + 1];
+	count = std::min(count, MAX_VIEWS);
+	CascadeSplits(nearPlane, std::max(distance, nearPlane * 2.0f), count, lambda, splits);
+
+	//The light looks along -lightDirection, the up vector only has to be away from it
+	const glm::vec3 lightForward = -glm::normalize(lightDirection);
+	const glm::vec3 lightUp = fabsf(lightForward.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	const glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), lightForward, lightUp);
+	for (uint32_t c = 0; c < count; ++c)
+	{
+		glm::vec3 corners[8];
+		for (uint32_t k = 0; k < 8; ++k)
+		{
+			const float depth = splits[c + ((k & 4) != 0 ? 1 : 0)];
+			const float x = ((k & 1) != 0 ? 1.0f : -1.0f) * tanHalfX * depth;
+			const float y = ((k & 2) != 0 ? 1.0f : -1.0f) * tanHalfY * depth;
+			corners[k] = eye + forward * depth + right * x + up * y;
+		}
+		glm::vec3 center(0.0f);
+		for (uint32_t k = 0; k < 8; ++k)
+			center += corners[k] * 0.125f;
+		float radius = 0.0f;
+		for (uint32_t k = 0; k < 8; ++k)
+			radius = std::max(radius, glm::length(corners[k] - center));
+		//Rounded up so the size of the texels does not change with the camera
+		radius = ceilf(radius * 16.0f) / 16.0f;
+
+		//Light space center snapped to the texels
+		const float texel = 2.0f * radius / static_cast<float>(resolution);
+		glm::vec3 lightCenter(lightView * glm::vec4(center, 1.0f));
+		lightCenter.x = floorf(lightCenter.x / texel) * texel;
+		lightCenter.y = floorf(lightCenter.y / texel) * texel;
+		//Depth along the light, from the casters in front of the sphere to its back
+		const float depthNear = -lightCenter.z - radius - casterDistance;
+		const float depthRange = 2.0f * radius + casterDistance;
+		glm::mat4 ortho(1.0f);
+		ortho[0][0] = 1.0f / radius;
+		ortho[3][0] = -lightCenter.x / radius;
+		ortho[1][1] = 1.0f / radius;
+		ortho[3][1] = -lightCenter.y / radius;
+		ortho[2][2] = -1.0f / depthRange;
+		ortho[3][2] = -depthNear / depthRange;
+		viewProjs[c] = ortho * lightView;
+	}
+}
+
+uint32_t MultiView::BoxViewMask(const glm::vec3(&points)[8], const glm::vec4* planes, uint32_t viewCount)
+{
+	uint32_t mask = 0;
+	for (uint32_t v = 0; v < viewCount; ++v)
+	{
+		bool visible = true;
+		for (uint32_t i = 0; i < 6 && visible; ++i)
+		{
+			const glm::vec4& plane = planes[v * 6 + i];
+			uint32_t outPoints = 0;
+			for (uint32_t k = 0; k < 8; ++k)
+			{
+				if (glm::dot(glm::vec3(plane), points[k]) - plane.w >= 0.0f)
+					++outPoints;
+			}
+			visible = outPoints != 8;
+		}
+		mask |= visible ? 1u << v : 0u;
+	}
+	return mask;
+}
+
+uint32_t MultiView::SphereViewMask(const glm::vec3& center, float radius, const glm::vec4* planes, uint32_t viewCount)
+{
+	uint32_t mask = 0;
+	for (uint32_t v = 0; v < viewCount; ++v)
+	{
+		bool visible = true;
+		for (uint32_t i = 0; i < 6 && visible; ++i)
+			visible = glm::dot(glm::vec3(planes[v * 6 + i]), center) - planes[v * 6 + i].w <= radius;
+		mask |= visible ? 1u << v : 0u;
+	}
+	return mask;
+}
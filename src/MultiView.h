@@ -0,0 +1,40 @@
+#ifndef __MULTI_VIEW_H__
+#define __MULTI_VIEW_H__
+
+#include "glm/mat4x4.hpp"
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+#include <stdint.h>
+
+//Multi-view culling of the shadow cascades. ShadowCull.comp reads every instance once and tests its box against the planes of up to MAX_VIEWS views,
+//a draw is written with the mask of the views it reaches. With VK_KHR_multiview the cascades are the layers of a single render pass and the mesh shader
+//of the draw runs once per view of the mask (gl_ViewIndex), without it the same cull runs once per view (one view per mask) and every layer is its own pass
+//This is also the CPU reference of the tests of ShadowCull.comp and Shadow.task
+namespace MultiView
+{
+	//Same as ShadowCull.comp, Shadow.task and Shadow.mesh
+	constexpr uint32_t MAX_VIEWS = 4;
+	constexpr uint32_t DEFAULT_RESOLUTION = 2048;
+	//View distance the cascades cover, the camera far plane is much further than what the shadows need
+	constexpr float DEFAULT_DISTANCE = 4000.0f;
+	//Blend of the logarithmic (1) and uniform (0) splits
+	constexpr float DEFAULT_SPLIT_LAMBDA = 0.75f;
+	//Casters between the light and a cascade still shade it, the depth range of each cascade reaches this much further toward the light
+	constexpr float DEFAULT_CASTER_DISTANCE = 2000.0f;
+
+	//Planes of a Vulkan clip space (0 <= z <= w) view projection in the Camera::GetPlanes order and sign (near, far, left, right, top, bottom, outside when
+	//dot(xyz, p) - w >= 0)
+	void PlanesFromMatrix(const glm::mat4& viewProj, glm::vec4(&planes)[6]);
+	//count + 1 view distances from nearPlane to farPlane
+	void CascadeSplits(float nearPlane, float farPlane, uint32_t count, float lambda, float* splits);
+	//Orthographic light view projection of every cascade of the camera (view and projection of Camera, only the field of view is read from the projection),
+	//the first one starts at nearPlane. Each one bounds a sphere around its slice of the view frustum and its center moves in whole texels, the cascades
+	//do not shimmer while the camera turns. lightDirection points toward the light (the one of Shader.frag)
+	void CascadeViews(const glm::mat4& view, const glm::mat4& proj, float nearPlane, const glm::vec3& lightDirection, uint32_t count, float distance, float lambda, float casterDistance,
+		uint32_t resolution, glm::mat4* viewProjs);
+	//Bit v is set when the box (the 8 points of culling.comp) or the sphere (the meshlet test of the task shader) is not outside the planes of view v
+	uint32_t BoxViewMask(const glm::vec3(&points)[8], const glm::vec4* planes, uint32_t viewCount);
+	uint32_t SphereViewMask(const glm::vec3& center, float radius, const glm::vec4* planes, uint32_t viewCount);
+}
+
+#endif // !__MULTI_VIEW_H__
@@ -0,0 +1,553 @@
+#include "OcclusionCulling.h"
+#include "Profiler.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <utility>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define OCCLUSION_AVX2
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define AVX2_FUNCTION
+#else
+//Only these functions are compiled for AVX2, the rest of the engine keeps running on the CPUs without it
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+#endif
+#endif
+
+using namespace OcclusionCulling;
+
+namespace
+{
+	//Span of the unused edges
+	constexpr float NO_EDGE = 1e30f;
+	//Edges flatter than this (pixels of height) limit the rows instead of the spans
+	constexpr float MIN_EDGE_HEIGHT = 1.0f / 256.0f;
+	//The plane evaluated at the tile corner is moved this much farther, it covers the rounding of the plane against the exact depths
+	constexpr float PLANE_EPSILON = 1e-5f;
+	//Occluders set up per task and instances tested per task (whole words of the bits)
+	constexpr uint32_t OCCLUDER_BATCH = 8;
+	constexpr uint32_t INSTANCE_BATCH = 1024;
+
+	uint32_t ShiftLeft(uint32_t value, int32_t bits) { return bits >= 32 ? 0u : value << bits; }
+	//Bits [start, end) of a row
+	uint32_t SpanBits(int32_t start, int32_t end) { return ShiftLeft(~0u, start) & ~ShiftLeft(~0u, end); }
+
+#ifdef OCCLUSION_AVX2
+	//Same operations as CoverageScalar in the same order (no FMA), both paths produce the same bits. A lane per row
+	AVX2_FUNCTION void CoverageAVX2(const MaskedDepthBuffer::Triangle& triangle, float tileX, float tileY, uint32_t* coverage)
+	{
+		const __m256 center = _mm256_add_ps(_mm256_add_ps(_mm256_set1_ps(tileY), _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f)), _mm256_set1_ps(0.5f));
+		__m256 left = _mm256_set1_ps(-NO_EDGE);
+		__m256 right = _mm256_set1_ps(NO_EDGE);
+		for (uint32_t e = 0; e < 3; ++e)
+		{
+			const __m256 leftY = _mm256_set1_ps(triangle.leftY[e]);
+			const __m256 leftSlope = _mm256_set1_ps(triangle.leftSlope[e]);
+			left = _mm256_max_ps(left, _mm256_add_ps(_mm256_set1_ps(triangle.leftX[e]), _mm256_mul_ps(_mm256_sub_ps(center, leftY), leftSlope)));
+			const __m256 rightY = _mm256_set1_ps(triangle.rightY[e]);
+			const __m256 rightSlope = _mm256_set1_ps(triangle.rightSlope[e]);
+			right = _mm256_min_ps(right, _mm256_add_ps(_mm256_set1_ps(triangle.rightX[e]), _mm256_mul_ps(_mm256_sub_ps(center, rightY), rightSlope)));
+		}
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256 x = _mm256_set1_ps(tileX);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 width = _mm256_set1_ps(static_cast<float>(TILE_WIDTH));
+		__m256 start = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_ceil_ps(_mm256_sub_ps(left, half)), x), zero), width);
+		__m256 end = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_add_ps(_mm256_floor_ps(_mm256_sub_ps(right, half)), _mm256_set1_ps(1.0f)), x), zero), width);
+		const __m256 rows = _mm256_and_ps(_mm256_cmp_ps(center, _mm256_set1_ps(triangle.rowMinY), _CMP_GE_OQ), _mm256_cmp_ps(center, _mm256_set1_ps(triangle.rowMaxY), _CMP_LE_OQ));
+		start = _mm256_and_ps(start, rows);
+		end = _mm256_and_ps(end, rows);
+		//variable shifts of 32 or more give 0 like ShiftLeft
+		const __m256i ones = _mm256_set1_epi32(-1);
+		const __m256i mask = _mm256_andnot_si256(_mm256_sllv_epi32(ones, _mm256_cvttps_epi32(end)), _mm256_sllv_epi32(ones, _mm256_cvttps_epi32(start)));
+		_mm256_store_si256(reinterpret_cast<__m256i*>(coverage), mask);
+	}
+
+	//Rows [firstRow, lastRow] of rowBits are all inside mask
+	AVX2_FUNCTION bool RectCoveredAVX2(const uint32_t* mask, uint32_t rowBits, int32_t firstRow, int32_t lastRow)
+	{
+		const __m256i rowIndices = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+		const __m256i rows = _mm256_andnot_si256(_mm256_cmpgt_epi32(_mm256_set1_epi32(firstRow), rowIndices), _mm256_cmpgt_epi32(_mm256_set1_epi32(lastRow + 1), rowIndices));
+		const __m256i rect = _mm256_and_si256(rows, _mm256_set1_epi32(static_cast<int32_t>(rowBits)));
+		return _mm256_testc_si256(_mm256_load_si256(reinterpret_cast<const __m256i*>(mask)), rect) != 0;
+	}
+#endif
+
+	bool RectCoveredScalar(const uint32_t* mask, uint32_t rowBits, int32_t firstRow, int32_t lastRow)
+	{
+		for (int32_t r = firstRow; r <= lastRow; ++r)
+		{
+			if ((rowBits & ~mask[r]) != 0)
+				return false;
+		}
+		return true;
+	}
+
+	//Max depth of the triangle over the tile: the plane at the farthest corner, never past the farthest vertex
+	float TileDepth(const MaskedDepthBuffer::Triangle& triangle, float tileX, float tileY)
+	{
+		const float x = triangle.dzdx > 0.0f ? tileX + static_cast<float>(TILE_WIDTH) : tileX;
+		const float y = triangle.dzdy > 0.0f ? tileY + static_cast<float>(TILE_HEIGHT) : tileY;
+		const float plane = triangle.z0 + (x - triangle.x0) * triangle.dzdx + (y - triangle.y0) * triangle.dzdy;
+		return std::min(plane - plane * PLANE_EPSILON, triangle.zMax);
+	}
+}
+
+void OcclusionCulling::CoverageScalar(const MaskedDepthBuffer::Triangle& triangle, float tileX, float tileY, uint32_t* coverage)
+{
+	for (uint32_t r = 0; r < TILE_HEIGHT; ++r)
+	{
+		const float center = tileY + static_cast<float>(r) + 0.5f;
+		float left = -NO_EDGE;
+		float right = NO_EDGE;
+		for (uint32_t e = 0; e < 3; ++e)
+		{
+			left = std::max(left, triangle.leftX[e] + (center - triangle.leftY[e]) * triangle.leftSlope[e]);
+			right = std::min(right, triangle.rightX[e] + (center - triangle.rightY[e]) * triangle.rightSlope[e]);
+		}
+		//pixel i is covered when left <= i + 0.5 <= right
+		float start = std::min(std::max(ceilf(left - 0.5f) - tileX, 0.0f), static_cast<float>(TILE_WIDTH));
+		float end = std::min(std::max(floorf(right - 0.5f) + 1.0f - tileX, 0.0f), static_cast<float>(TILE_WIDTH));
+		if (!(center >= triangle.rowMinY && center <= triangle.rowMaxY))
+			start = end = 0.0f;
+		coverage[r] = SpanBits(static_cast<int32_t>(start), static_cast<int32_t>(end));
+	}
+}
+
+bool OcclusionCulling::SetupTriangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2, float width, float height, MaskedDepthBuffer::Triangle& triangle)
+{
+	const glm::vec4* clip[3] = { &c0, &c1, &c2 };
+	float x[3], y[3], z[3];
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		if (clip[i]->w < NEAR_CLIP_W || clip[i]->z < 0.0f)
+			return false;
+		const float invW = 1.0f / clip[i]->w;
+		x[i] = (clip[i]->x * invW * 0.5f + 0.5f) * width;
+		y[i] = (clip[i]->y * invW * 0.5f + 0.5f) * height;
+		z[i] = -invW;
+	}
+	//Counter clockwise front faces are negative on the y down framebuffer, same as SoftwareRaster
+	const float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+	if (!(area < 0.0f))
+		return false;
+	//inside positive from now on
+	std::swap(x[1], x[2]);
+	std::swap(y[1], y[2]);
+	std::swap(z[1], z[2]);
+
+	const float minX = std::min(x[0], std::min(x[1], x[2]));
+	const float maxX = std::max(x[0], std::max(x[1], x[2]));
+	const float minY = std::min(y[0], std::min(y[1], y[2]));
+	const float maxY = std::max(y[0], std::max(y[1], y[2]));
+	if (maxX <= 0.0f || maxY <= 0.0f || minX >= width || minY >= height)
+		return false;
+	const uint32_t lastX = static_cast<uint32_t>(std::min(ceilf(maxX), width)) - 1;
+	const uint32_t lastY = static_cast<uint32_t>(std::min(ceilf(maxY), height)) - 1;
+	triangle.tileMinX = static_cast<uint32_t>(std::max(floorf(minX), 0.0f)) / TILE_WIDTH;
+	triangle.tileMinY = static_cast<uint32_t>(std::max(floorf(minY), 0.0f)) / TILE_HEIGHT;
+	triangle.tileMaxX = lastX / TILE_WIDTH;
+	triangle.tileMaxY = lastY / TILE_HEIGHT;
+
+	triangle.rowMinY = minY;
+	triangle.rowMaxY = maxY;
+	for (uint32_t e = 0; e < 3; ++e)
+	{
+		const uint32_t a = e;
+		const uint32_t b = (e + 1) % 3;
+		const float dy = y[b] - y[a];
+		triangle.leftX[e] = -NO_EDGE;
+		triangle.leftY[e] = 0.0f;
+		triangle.leftSlope[e] = 0.0f;
+		triangle.rightX[e] = NO_EDGE;
+		triangle.rightY[e] = 0.0f;
+		triangle.rightSlope[e] = 0.0f;
+		if (fabsf(dy) < MIN_EDGE_HEIGHT)
+		{
+			//the inside is below the edges going right and above the ones going left
+			if (x[b] > x[a])
+				triangle.rowMinY = std::max(triangle.rowMinY, std::max(y[a], y[b]));
+			else
+				triangle.rowMaxY = std::min(triangle.rowMaxY, std::min(y[a], y[b]));
+		}
+		else if (dy < 0.0f)
+		{
+			triangle.leftX[e] = x[a];
+			triangle.leftY[e] = y[a];
+			triangle.leftSlope[e] = (x[b] - x[a]) / dy;
+		}
+		else
+		{
+			triangle.rightX[e] = x[a];
+			triangle.rightY[e] = y[a];
+			triangle.rightSlope[e] = (x[b] - x[a]) / dy;
+		}
+	}
+
+	const float e1x = x[1] - x[0], e1y = y[1] - y[0], e1z = z[1] - z[0];
+	const float e2x = x[2] - x[0], e2y = y[2] - y[0], e2z = z[2] - z[0];
+	const float det = e1x * e2y - e1y * e2x;
+	triangle.x0 = x[0];
+	triangle.y0 = y[0];
+	triangle.z0 = z[0];
+	triangle.dzdx = (e1z * e2y - e2z * e1y) / det;
+	triangle.dzdy = (e2z * e1x - e1z * e2x) / det;
+	triangle.zMax = std::max(z[0], std::max(z[1], z[2]));
+	return true;
+}
+
+bool OcclusionCulling::ProjectBox(const Box& box, const glm::mat4& transform, float width, float height, int32_t* rect, float& depth)
+{
+	const glm::vec4 origin = transform * glm::vec4(box.min, 1.0f);
+	const glm::vec4 axisX = transform[0] * (box.max.x - box.min.x);
+	const glm::vec4 axisY = transform[1] * (box.max.y - box.min.y);
+	const glm::vec4 axisZ = transform[2] * (box.max.z - box.min.z);
+	float minX = NO_EDGE, minY = NO_EDGE, maxX = -NO_EDGE, maxY = -NO_EDGE;
+	depth = 0.0f;
+	for (uint32_t i = 0; i < 8; ++i)
+	{
+		glm::vec4 corner = origin;
+		if (i & 1)
+			corner += axisX;
+		if (i & 2)
+			corner += axisY;
+		if (i & 4)
+			corner += axisZ;
+		if (corner.w < NEAR_CLIP_W || corner.z < 0.0f)
+			return false;
+		const float invW = 1.0f / corner.w;
+		const float x = (corner.x * invW * 0.5f + 0.5f) * width;
+		const float y = (corner.y * invW * 0.5f + 0.5f) * height;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		depth = std::min(depth, -invW);
+	}
+	if (maxX <= 0.0f || maxY <= 0.0f || minX >= width || minY >= height)
+		return false;
+	rect[0] = static_cast<int32_t>(std::max(floorf(minX), 0.0f));
+	rect[1] = static_cast<int32_t>(std::max(floorf(minY), 0.0f));
+	rect[2] = std::max(static_cast<int32_t>(std::min(ceilf(maxX), width)) - 1, rect[0]);
+	rect[3] = std::max(static_cast<int32_t>(std::min(ceilf(maxY), height)) - 1, rect[1]);
+	return true;
+}
+
+void OcclusionCulling::MakeBoxOccluder(const Box& box, OccluderMesh& mesh)
+{
+	mesh.positions.resize(8);
+	for (uint32_t i = 0; i < 8; ++i)
+		mesh.positions[i] = glm::vec3((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y, (i & 4) ? box.max.z : box.min.z);
+	//Corner bits x, y, z. Every face wound counter clockwise seen from outside
+	static const uint32_t indices[36] =
+	{
+		0, 4, 6, 0, 6, 2, //-x
+		1, 3, 7, 1, 7, 5, //+x
+		0, 1, 5, 0, 5, 4, //-y
+		2, 6, 7, 2, 7, 3, //+y
+		0, 2, 3, 0, 3, 1, //-z
+		4, 5, 7, 4, 7, 6  //+z
+	};
+	mesh.indices.assign(indices, indices + 36);
+}
+
+bool OcclusionCulling::HasAVX2()
+{
+#if !defined(OCCLUSION_AVX2)
+	return false;
+#elif defined(_MSC_VER) && !defined(__clang__)
+	int info[4];
+	__cpuid(info, 1);
+	//AVX and the OS saving the YMM registers
+	if ((info[2] & (1 << 28)) == 0 || (info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+void WorkerPool::Start(uint32_t threadCount)
+{
+	quitting = false;
+	//No job runs while they start, the ones done before are not run again
+	for (uint32_t i = 1; i < threadCount; ++i)
+		workers.emplace_back(&WorkerPool::WorkerLoop, this, job);
+}
+
+void WorkerPool::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quitting = true;
+	}
+	wake.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+	workers.clear();
+}
+
+void WorkerPool::Run(uint32_t count, uint32_t chunk, Call call, const void* fn)
+{
+	const uint32_t chunks = (count + chunk - 1) / chunk;
+	//Not worth waking the workers
+	if (chunks <= 1 || workers.empty())
+	{
+		for (uint32_t begin = 0; begin < count; begin += chunk)
+			call(fn, begin, std::min(begin + chunk, count));
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobCall = call;
+		jobFn = fn;
+		jobCount = count;
+		jobChunk = chunk;
+		nextChunk = 0;
+		busyWorkers = static_cast<uint32_t>(workers.size());
+		++job;
+	}
+	wake.notify_all();
+	RunChunks();
+	//fn lives on the caller stack, no worker may still be on it
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [this]() { return busyWorkers == 0; });
+}
+
+void WorkerPool::RunChunks()
+{
+	const uint32_t chunks = (jobCount + jobChunk - 1) / jobChunk;
+	for (uint32_t c = nextChunk++; c < chunks; c = nextChunk++)
+		jobCall(jobFn, c * jobChunk, std::min(c * jobChunk + jobChunk, jobCount));
+}
+
+void WorkerPool::WorkerLoop(uint64_t lastJob)
+{
+	PROFILE_THREAD("Occlusion worker");
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		wake.wait(lock, [&]() { return quitting || job != lastJob; });
+		if (quitting)
+			return;
+		lastJob = job;
+		lock.unlock();
+		RunChunks();
+		lock.lock();
+		if (--busyWorkers == 0)
+			finished.notify_one();
+	}
+}
+
+void MaskedDepthBuffer::Init(uint32_t width, uint32_t height, uint32_t threads, bool avx2)
+{
+	tilesX = (width + TILE_WIDTH - 1) / TILE_WIDTH;
+	tilesY = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+	threadCount = threads != 0 ? threads : std::max(std::thread::hardware_concurrency(), 1u);
+	useAVX2 = avx2 && HasAVX2();
+	workers.Stop();
+	workers.Start(threadCount);
+	tiles.resize(tilesX * tilesY);
+	Clear();
+}
+
+void MaskedDepthBuffer::Clear()
+{
+	for (Tile& tile : tiles)
+	{
+		memset(tile.mask, 0, sizeof(tile.mask));
+		tile.zMask = 0.0f;
+		tile.zTile = 0.0f;
+	}
+}
+
+uint32_t MaskedDepthBuffer::RenderOccluders(const OccluderMesh* meshes, const uint32_t* occluders, const glm::mat4* transforms, uint32_t count)
+{
+	PROFILE_ZONE("RenderOccluders");
+	const uint32_t batchCount = (count + OCCLUDER_BATCH - 1) / OCCLUDER_BATCH;
+	if (batches.size() < batchCount)
+		batches.resize(batchCount);
+	const float width = static_cast<float>(GetWidth());
+	const float height = static_cast<float>(GetHeight());
+	std::atomic<uint32_t> triangleCount(0);
+	workers.ParallelFor(count, OCCLUDER_BATCH, [&](uint32_t begin, uint32_t end)
+	{
+		std::vector<Triangle>& batch = batches[begin / OCCLUDER_BATCH];
+		batch.clear();
+		std::vector<glm::vec4> clip;
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			const OccluderMesh& mesh = meshes[occluders[i]];
+			clip.resize(mesh.positions.size());
+			for (size_t v = 0; v < mesh.positions.size(); ++v)
+				clip[v] = transforms[i] * glm::vec4(mesh.positions[v], 1.0f);
+			Triangle triangle;
+			for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+			{
+				if (SetupTriangle(clip[mesh.indices[t]], clip[mesh.indices[t + 1]], clip[mesh.indices[t + 2]], width, height, triangle))
+					batch.push_back(triangle);
+			}
+		}
+		triangleCount += static_cast<uint32_t>(batch.size());
+	});
+	//A few bands per thread so the busy parts of the screen are shared
+	const uint32_t bandRows = std::max(tilesY / (threadCount * 4), 1u);
+	workers.ParallelFor(tilesY, bandRows, [&](uint32_t firstRow, uint32_t endRow) { RasterizeBand(batches.data(), batchCount, firstRow, endRow); });
+	return triangleCount;
+}
+
+void MaskedDepthBuffer::RasterizeBand(const std::vector<Triangle>* triangleBatches, uint32_t batchCount, uint32_t firstRow, uint32_t endRow)
+{
+	PROFILE_ZONE("RasterizeBand");
+	alignas(32) uint32_t coverage[TILE_HEIGHT];
+	//Same triangle order on every band and every thread count, the buffer is deterministic
+	for (uint32_t b = 0; b < batchCount; ++b)
+	{
+		for (const Triangle& triangle : triangleBatches[b])
+		{
+			const uint32_t minY = std::max(triangle.tileMinY, firstRow);
+			const uint32_t maxY = std::min(triangle.tileMaxY, endRow - 1);
+			for (uint32_t ty = minY; ty <= maxY && ty < endRow; ++ty)
+			{
+				for (uint32_t tx = triangle.tileMinX; tx <= triangle.tileMaxX; ++tx)
+				{
+					Tile& tile = tiles[ty * tilesX + tx];
+					const float tileX = static_cast<float>(tx * TILE_WIDTH);
+					const float tileY = static_cast<float>(ty * TILE_HEIGHT);
+					const float zTriangle = TileDepth(triangle, tileX, tileY);
+					if (zTriangle >= tile.zTile)
+						continue;
+#ifdef OCCLUSION_AVX2
+					if (useAVX2)
+						CoverageAVX2(triangle, tileX, tileY, coverage);
+					else
+#endif
+						CoverageScalar(triangle, tileX, tileY, coverage);
+					UpdateTile(tile, coverage, zTriangle);
+				}
+			}
+		}
+	}
+}
+
+void MaskedDepthBuffer::UpdateTile(Tile& tile, const uint32_t* coverage, float zTriangle)
+{
+	uint32_t covered = 0;
+	uint32_t layer = 0;
+	for (uint32_t r = 0; r < TILE_HEIGHT; ++r)
+	{
+		covered |= coverage[r];
+		layer |= tile.mask[r];
+	}
+	if (covered == 0 || zTriangle >= tile.zTile)
+		return;
+	//A triangle far behind the working layer would push its depth back, the layer is dropped instead (the tile depth still bounds those pixels)
+	if (layer == 0 || zTriangle - tile.zMask > tile.zTile - zTriangle)
+	{
+		memcpy(tile.mask, coverage, sizeof(tile.mask));
+		tile.zMask = zTriangle;
+	}
+	else
+	{
+		for (uint32_t r = 0; r < TILE_HEIGHT; ++r)
+			tile.mask[r] |= coverage[r];
+		tile.zMask = std::max(tile.zMask, zTriangle);
+	}
+	uint32_t full = ~0u;
+	for (uint32_t r = 0; r < TILE_HEIGHT; ++r)
+		full &= tile.mask[r];
+	if (full == ~0u)
+	{
+		tile.zTile = tile.zMask;
+		memset(tile.mask, 0, sizeof(tile.mask));
+		tile.zMask = 0.0f;
+	}
+}
+
+bool MaskedDepthBuffer::IsRectOccluded(int32_t minX, int32_t minY, int32_t maxX, int32_t maxY, float depth) const
+{
+	const int32_t width = static_cast<int32_t>(TILE_WIDTH);
+	const int32_t height = static_cast<int32_t>(TILE_HEIGHT);
+	for (int32_t ty = minY / height; ty <= maxY / height; ++ty)
+	{
+		for (int32_t tx = minX / width; tx <= maxX / width; ++tx)
+		{
+			const Tile& tile = tiles[ty * tilesX + tx];
+			if (depth > tile.zTile)
+				continue;
+			//The empty masks have depth 0
+			if (!(depth > tile.zMask))
+				return false;
+			const int32_t firstRow = std::max(minY - ty * height, 0);
+			const int32_t lastRow = std::min(maxY - ty * height, height - 1);
+			const uint32_t rowBits = SpanBits(std::max(minX - tx * width, 0), std::min(maxX - tx * width, width - 1) + 1);
+#ifdef OCCLUSION_AVX2
+			if (useAVX2)
+			{
+				if (!RectCoveredAVX2(tile.mask, rowBits, firstRow, lastRow))
+					return false;
+				continue;
+			}
+#endif
+			if (!RectCoveredScalar(tile.mask, rowBits, firstRow, lastRow))
+				return false;
+		}
+	}
+	return true;
+}
+
+bool MaskedDepthBuffer::IsOccluded(const Box& box, const glm::mat4& transform) const
+{
+	int32_t rect[4];
+	float depth;
+	if (!ProjectBox(box, transform, static_cast<float>(GetWidth()), static_cast<float>(GetHeight()), rect, depth))
+		return false;
+	return IsRectOccluded(rect[0], rect[1], rect[2], rect[3], depth);
+}
+
+uint32_t MaskedDepthBuffer::TestInstances(const glm::mat4& viewProj, const glm::mat4* models, const uint32_t* meshes, const uint8_t* skip, uint32_t count, const Box* bounds, uint32_t* occludedBits) const
+{
+	std::atomic<uint32_t> occluded(0);
+	//The tasks start on whole words, no two threads write the same one
+	workers.ParallelFor(count, INSTANCE_BATCH, [&](uint32_t begin, uint32_t end)
+	{
+		memset(occludedBits + begin / 32, 0, sizeof(uint32_t) * ((end - begin + 31) / 32));
+		uint32_t chunkOccluded = 0;
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			if (meshes[i] == NO_MESH || (skip != nullptr && skip[i] != 0))
+				continue;
+			if (IsOccluded(bounds[meshes[i]], viewProj * models[i]))
+			{
+				occludedBits[i / 32] |= 1u << (i % 32);
+				++chunkOccluded;
+			}
+		}
+		occluded += chunkOccluded;
+	});
+	return occluded;
+}
+
+float MaskedDepthBuffer::GetDepth(uint32_t x, uint32_t y) const
+{
+	const Tile& tile = tiles[(y / TILE_HEIGHT) * tilesX + x / TILE_WIDTH];
+	if ((tile.mask[y % TILE_HEIGHT] >> (x % TILE_WIDTH)) & 1)
+		return tile.zMask;
+	return tile.zTile;
+}
+
+bool MaskedDepthBuffer::Matches(const MaskedDepthBuffer& other) const
+{
+	if (tilesX != other.tilesX || tilesY != other.tilesY)
+		return false;
+	for (size_t i = 0; i < tiles.size(); ++i)
+	{
+		if (memcmp(tiles[i].mask, other.tiles[i].mask, sizeof(tiles[i].mask)) != 0 || tiles[i].zMask != other.tiles[i].zMask || tiles[i].zTile != other.tiles[i].zTile)
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,174 @@
+#ifndef __OCCLUSION_CULLING_H__
+#define __OCCLUSION_CULLING_H__
+
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+#include "glm/mat4x4.hpp"
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//CPU masked software occlusion culling. A few occluders are rasterized on a low resolution masked depth buffer and the instance bounds are tested
+//against it before culling.comp builds the draw commands, the occluded instances never reach the GPU command list
+//The buffer is made of TILE_WIDTH x TILE_HEIGHT tiles: a coverage mask (one 32 bit row per tile row) and two conservative max depths, the one of the
+//covered pixels and the one of the whole tile. The tile depths are the coarse level of the hierarchy, the masks the fine one
+//A pixel is covered when its center is inside the triangle like the GPU rasterizer (an instance can peek less than half a buffer pixel past an
+//occluder edge), the instances test every pixel their screen rectangle touches with their nearest depth. Depth is -1/w, linear on screen space and
+//precise far from the camera (the NDC depth of the engine projection has a resolution of tens of units at the scene distances), larger is farther
+//and 0 is an empty tile
+namespace OcclusionCulling
+{
+	//One AVX2 register of masks per tile, each 32 bit lane is a row
+	constexpr uint32_t TILE_WIDTH = 32;
+	constexpr uint32_t TILE_HEIGHT = 8;
+	//Resolution of the buffer of ModuleVulkan, rounded up to whole tiles
+	constexpr uint32_t DEFAULT_WIDTH = 320;
+	constexpr uint32_t DEFAULT_HEIGHT = 192;
+	//Triangles with a vertex closer than this clip w or in front of the near plane are not rasterized (a missing occluder triangle only rejects less),
+	//the bounds crossing them are never occluded
+	constexpr float NEAR_CLIP_W = 1e-3f;
+
+	//Occluder geometry, the simplified fallback LOD of a mesh or a box. Counter clockwise front faces like the mesh pipeline, the back faces are skipped
+	struct OccluderMesh
+	{
+		std::vector<glm::vec3> positions;
+		std::vector<uint32_t> indices;
+	};
+	struct Box
+	{
+		glm::vec3 min;
+		glm::vec3 max;
+	};
+	void MakeBoxOccluder(const Box& box, OccluderMesh& mesh);
+
+	//Same as DEAD_INSTANCE of InstanceManager, TestInstances skips them
+	constexpr uint32_t NO_MESH = ~0u;
+
+	//Threads started once and parked between the jobs, the caller thread works on every job too
+	class WorkerPool
+	{
+	public:
+		WorkerPool() {}
+		~WorkerPool() { Stop(); }
+		//threadCount - 1 workers, the caller is the other one
+		void Start(uint32_t threadCount);
+		void Stop();
+		uint32_t GetThreadCount() const { return static_cast<uint32_t>(workers.size()) + 1; }
+		//Runs fn(begin, end) over [0, count) split in chunks and returns when all of them are done. One job at a time
+		template<typename F> void ParallelFor(uint32_t count, uint32_t chunk, const F& fn);
+
+	private:
+		typedef void (*Call)(const void* fn, uint32_t begin, uint32_t end);
+		void Run(uint32_t count, uint32_t chunk, Call call, const void* fn);
+		void RunChunks();
+		void WorkerLoop(uint64_t lastJob);
+
+		std::vector<std::thread> workers;
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::condition_variable finished;
+		//Every worker runs each job once, the caller waits until none is left on it
+		uint64_t job = 0;
+		uint32_t busyWorkers = 0;
+		bool quitting = false;
+		Call jobCall = nullptr;
+		const void* jobFn = nullptr;
+		uint32_t jobCount = 0;
+		uint32_t jobChunk = 0;
+		std::atomic<uint32_t> nextChunk{ 0 };
+	};
+
+	class MaskedDepthBuffer
+	{
+	public:
+		//threadCount 0 uses the hardware threads, the workers are started here and kept until the buffer is destroyed. useAVX2 is ignored when the CPU
+		//does not have it
+		void Init(uint32_t width, uint32_t height, uint32_t threadCount, bool useAVX2 = true);
+		void Clear();
+		//Rasterizes the meshes[occluders[i]] with the clip transforms[i] (viewProj * model), every band of tile rows on its own thread
+		//Returns the triangles set up (front facing and in front of the near plane)
+		uint32_t RenderOccluders(const OccluderMesh* meshes, const uint32_t* occluders, const glm::mat4* transforms, uint32_t count);
+		//The box under the clip transform is hidden behind the rasterized occluders
+		bool IsOccluded(const Box& box, const glm::mat4& transform) const;
+		//Tests the slots [0, count) in parallel: the box of meshes[i] (bounds) under viewProj * models[i]. Slots with NO_MESH and slots skip[i] != 0
+		//(skip can be null) are never occluded. occludedBits gets a bit per slot, returns the occluded count
+		uint32_t TestInstances(const glm::mat4& viewProj, const glm::mat4* models, const uint32_t* meshes, const uint8_t* skip, uint32_t count, const Box* bounds, uint32_t* occludedBits) const;
+
+		uint32_t GetWidth() const { return tilesX * TILE_WIDTH; }
+		uint32_t GetHeight() const { return tilesY * TILE_HEIGHT; }
+		uint32_t GetThreadCount() const { return threadCount; }
+		//The workers of RenderOccluders and TestInstances, free for other jobs between them
+		WorkerPool& GetWorkerPool() { return workers; }
+		bool IsUsingAVX2() const { return useAVX2; }
+		//Conservative max depth of the pixel, 0 when no occluder covers it
+		float GetDepth(uint32_t x, uint32_t y) const;
+		//Both buffers hold the same masks and depths
+		bool Matches(const MaskedDepthBuffer& other) const;
+
+		struct alignas(32) Tile
+		{
+			uint32_t mask[TILE_HEIGHT];
+			//max depth of the pixels on mask, max depth of the whole tile
+			float zMask;
+			float zTile;
+		};
+		//Screen space triangle (pixels, y down), the pixel centers of a row are covered between the max of the left edges and the min of the right edges.
+		//The edges are x = x0 + (y - y0) * slope, the unused ones never limit the span. The near horizontal edges limit the rows instead
+		struct Triangle
+		{
+			float leftX[3];
+			float leftY[3];
+			float leftSlope[3];
+			float rightX[3];
+			float rightY[3];
+			float rightSlope[3];
+			float rowMinY;
+			float rowMaxY;
+			//depth plane z = z0 + (x - x0) * dzdx + (y - y0) * dzdy and the max vertex depth
+			float x0;
+			float y0;
+			float z0;
+			float dzdx;
+			float dzdy;
+			float zMax;
+			uint32_t tileMinX;
+			uint32_t tileMaxX;
+			uint32_t tileMinY;
+			uint32_t tileMaxY;
+		};
+	private:
+		void RasterizeBand(const std::vector<Triangle>* batches, uint32_t batchCount, uint32_t firstRow, uint32_t endRow);
+		void UpdateTile(Tile& tile, const uint32_t* coverage, float zTriangle);
+		bool IsRectOccluded(int32_t minX, int32_t minY, int32_t maxX, int32_t maxY, float depth) const;
+
+		std::vector<Tile> tiles;
+		//Triangles of each occluder batch, set up on the worker threads
+		std::vector<std::vector<Triangle>> batches;
+		uint32_t tilesX = 0;
+		uint32_t tilesY = 0;
+		uint32_t threadCount = 1;
+		bool useAVX2 = false;
+		//TestInstances is const, the pool holds no state of the buffer
+		mutable WorkerPool workers;
+	};
+
+	bool HasAVX2();
+
+	//Steps of the raster and of the instance tests, the per pixel reference of the MeshTool benchmark is built with the same ones
+	//Front facing triangle of clip vertices to screen space, false when it is skipped
+	bool SetupTriangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2, float width, float height, MaskedDepthBuffer::Triangle& triangle);
+	//Pixels of the TILE_HEIGHT rows from tileY with the center inside the triangle, the bits are the pixels from tileX
+	void CoverageScalar(const MaskedDepthBuffer::Triangle& triangle, float tileX, float tileY, uint32_t* coverage);
+	//Pixels touched by the box under the clip transform and its nearest depth, false when it crosses the near plane or is off screen
+	bool ProjectBox(const Box& box, const glm::mat4& transform, float width, float height, int32_t* rect, float& depth);
+}
+
+template<typename F> void OcclusionCulling::WorkerPool::ParallelFor(uint32_t count, uint32_t chunk, const F& fn)
+{
+	Run(count, chunk, [](const void* f, uint32_t begin, uint32_t end) { (*static_cast<const F*>(f))(begin, end); }, &fn);
+}
+
+#endif // !__OCCLUSION_CULLING_H__
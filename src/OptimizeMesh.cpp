@@ -0,0 +1,211 @@
+#include "OptimizeMesh.h"
+#include "Profiler.h"
+#include "meshoptimizer.h"
+#include <string.h>
+#include <algorithm>
+
+namespace
+{
+	//Spreads the 10 low bits so there are 2 zeros between them
+	uint32_t Part1By2(uint32_t x)
+	{
+		x &= 0x000003ff;
+		x = (x ^ (x << 16)) & 0xff0000ff;
+		x = (x ^ (x << 8)) & 0x0300f00f;
+		x = (x ^ (x << 4)) & 0x030c30c3;
+		x = (x ^ (x << 2)) & 0x09249249;
+		return x;
+	}
+
+	uint32_t Morton(float x, float y, float z)
+	{
+		const uint32_t qx = static_cast<uint32_t>(std::min(std::max(x, 0.0f), 1.0f) * 1023.0f);
+		const uint32_t qy = static_cast<uint32_t>(std::min(std::max(y, 0.0f), 1.0f) * 1023.0f);
+		const uint32_t qz = static_cast<uint32_t>(std::min(std::max(z, 0.0f), 1.0f) * 1023.0f);
+		return Part1By2(qx) | (Part1By2(qy) << 1) | (Part1By2(qz) << 2);
+	}
+
+	//Position and normal, the 4th components are padding
+	void VertexStreams(const Mesh& mesh, meshopt_Stream (&streams)[2])
+	{
+		streams[0] = { &mesh.vertices->position[0], sizeof(float) * 3, sizeof(Vertex) };
+		streams[1] = { &mesh.vertices->normal[0], sizeof(float) * 3, sizeof(Vertex) };
+	}
+
+	//Scratch of the caller or one of the call, sized to the first allocation
+	class ScratchScope
+	{
+	public:
+		explicit ScratchScope(HostMemory::Arena* scratch) : arena(scratch != nullptr ? *scratch : local) {}
+		HostMemory::Arena& arena;
+	private:
+		HostMemory::Arena local{ HostMemory::Tag::IMPORT_SCRATCH, 0 };
+	};
+
+	void* MESHOPTIMIZER_ALLOC_CALLCONV MeshoptAllocate(size_t size)
+	{
+		return HostMemory::Allocate(size, HostMemory::Tag::IMPORT_SCRATCH);
+	}
+
+	void MESHOPTIMIZER_ALLOC_CALLCONV MeshoptFree(void* memory)
+	{
+		HostMemory::Free(memory);
+	}
+}
+
+OptimizeMesh::Metrics OptimizeMesh::Analyze(const Mesh& mesh, HostMemory::Arena* scratch)
+{
+	ScratchScope scope(scratch);
+	Metrics metrics;
+	metrics.vertexCount = mesh.numVertices;
+	meshopt_Stream streams[2];
+	VertexStreams(mesh, streams);
+	unsigned int* remap = scope.arena.AllocateArray<unsigned int>(mesh.numVertices);
+	metrics.uniqueVertices = static_cast<unsigned int>(meshopt_generateVertexRemapMulti(remap, mesh.indices, mesh.numIndices, mesh.numVertices, streams, 2));
+	metrics.acmr = meshopt_analyzeVertexCache(mesh.indices, mesh.numIndices, mesh.numVertices, CACHE_SIZE, 0, 0).acmr;
+	metrics.overfetch = meshopt_analyzeVertexFetch(mesh.indices, mesh.numIndices, mesh.numVertices, sizeof(Vertex)).overfetch;
+	return metrics;
+}
+
+void OptimizeMesh::Optimize(Mesh& mesh, HostMemory::Arena* scratch)
+{
+	PROFILE_ZONE("OptimizeMesh::Optimize");
+	ScratchScope scope(scratch);
+	//Duplicated vertices (same position and normal) get the same index
+	meshopt_Stream streams[2];
+	VertexStreams(mesh, streams);
+	unsigned int* remap = scope.arena.AllocateArray<unsigned int>(mesh.numVertices);
+	const size_t uniqueVertices = meshopt_generateVertexRemapMulti(remap, mesh.indices, mesh.numIndices, mesh.numVertices, streams, 2);
+	Vertex* vertices = HostMemory::NewArray<Vertex>(uniqueVertices, HostMemory::Tag::MESHES);
+	meshopt_remapVertexBuffer(vertices, mesh.vertices, mesh.numVertices, sizeof(Vertex), remap);
+	meshopt_remapIndexBuffer(mesh.indices, mesh.indices, mesh.numIndices, remap);
+	HostMemory::Free(mesh.vertices);
+	mesh.vertices = vertices;
+	mesh.numVertices = static_cast<unsigned int>(uniqueVertices);
+
+	//meshopt_buildMeshlets groups the triangles on index order, the cache order keeps the meshlets compact
+	meshopt_optimizeVertexCache(mesh.indices, mesh.indices, mesh.numIndices, mesh.numVertices);
+	//Vertices on first use, the unused ones are dropped
+	mesh.numVertices = static_cast<unsigned int>(meshopt_optimizeVertexFetch(mesh.vertices, mesh.indices, mesh.numIndices, mesh.vertices, mesh.numVertices, sizeof(Vertex)));
+}
+
+void OptimizeMesh::BuildMeshlets(Mesh& mesh, MeshletMesh& meshletMesh, unsigned int maxVertices, unsigned int maxPrimitives, HostMemory::Arena* scratch)
+{
+	PROFILE_ZONE("OptimizeMesh::BuildMeshlets");
+	ScratchScope scope(scratch);
+	meshletMesh.maxMeshlets = meshopt_buildMeshletsBound(mesh.numIndices, maxVertices, maxPrimitives);
+	//Worst case sizes on scratch, only the trimmed copies are allocated
+	meshopt_Meshlet* meshlets = scope.arena.AllocateArray<meshopt_Meshlet>(meshletMesh.maxMeshlets);
+	unsigned int* meshletVertices = scope.arena.AllocateArray<unsigned int>(mesh.numIndices);
+	unsigned char* meshletTriangles = scope.arena.AllocateArray<unsigned char>(mesh.numIndices);
+	meshletMesh.meshletCount = meshopt_buildMeshlets(meshlets, meshletVertices, meshletTriangles, mesh.indices, mesh.numIndices, &mesh.vertices->position[0], mesh.numVertices, sizeof(Vertex), maxVertices, maxPrimitives, 0.0f);
+	for (int i = 0; i < meshletMesh.meshletCount; ++i)
+		meshopt_optimizeMeshlet(&meshletVertices[meshlets[i].vertex_offset], &meshletTriangles[meshlets[i].triangle_offset], meshlets[i].triangle_count, meshlets[i].vertex_count);
+	meshletMesh.meshlets = HostMemory::NewArray<meshopt_Meshlet>(meshletMesh.meshletCount, HostMemory::Tag::MESHLETS);
+	memcpy(meshletMesh.meshlets, meshlets, sizeof(meshopt_Meshlet) * meshletMesh.meshletCount);
+	const meshopt_Meshlet& last = meshletMesh.meshlets[meshletMesh.meshletCount - 1];
+	unsigned int trimedSize = last.vertex_offset + last.vertex_count;
+	meshletMesh.meshletVertices = HostMemory::NewArray<unsigned int>(trimedSize, HostMemory::Tag::MESHLETS);
+	memcpy(meshletMesh.meshletVertices, meshletVertices, sizeof(unsigned int) * trimedSize);
+	trimedSize = (last.triangle_offset + last.triangle_count * 3) * sizeof(unsigned char);
+	meshletMesh.meshletTriangles = HostMemory::NewArray<unsigned char>(trimedSize, HostMemory::Tag::MESHLETS);
+	memcpy(meshletMesh.meshletTriangles, meshletTriangles, trimedSize);
+	memcpy(&meshletMesh.mesh, &mesh, sizeof(Mesh));
+	mesh.indices = nullptr;
+	mesh.vertices = nullptr;
+	mesh.numIndices = 0;
+	mesh.numVertices = 0;
+
+	meshletMesh.meshletBounds = HostMemory::NewArray<meshopt_Bounds>(meshletMesh.meshletCount, HostMemory::Tag::MESHLETS);
+	for (int i = 0; i < meshletMesh.meshletCount; ++i)
+		meshletMesh.meshletBounds[i] = meshopt_computeMeshletBounds(&meshletMesh.meshletVertices[meshletMesh.meshlets[i].vertex_offset], &meshletMesh.meshletTriangles[meshletMesh.meshlets[i].triangle_offset], meshletMesh.meshlets[i].triangle_count, reinterpret_cast<float*>(meshletMesh.mesh.vertices), meshletMesh.mesh.numVertices, sizeof(Vertex));
+	SortMeshlets(meshletMesh, &scope.arena);
+}
+
+void OptimizeMesh::SortMeshlets(MeshletMesh& meshletMesh, HostMemory::Arena* scratch)
+{
+	PROFILE_ZONE("OptimizeMesh::SortMeshlets");
+	const size_t meshletCount = meshletMesh.meshletCount;
+	if (meshletCount < 2)
+		return;
+	ScratchScope scope(scratch);
+	float minCenter[3] = { meshletMesh.meshletBounds[0].center[0], meshletMesh.meshletBounds[0].center[1], meshletMesh.meshletBounds[0].center[2] };
+	float maxCenter[3] = { minCenter[0], minCenter[1], minCenter[2] };
+	for (size_t i = 1; i < meshletCount; ++i)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			minCenter[axis] = std::min(minCenter[axis], meshletMesh.meshletBounds[i].center[axis]);
+			maxCenter[axis] = std::max(maxCenter[axis], meshletMesh.meshletBounds[i].center[axis]);
+		}
+	}
+	float invExtent[3];
+	for (int axis = 0; axis < 3; ++axis)
+		invExtent[axis] = (maxCenter[axis] > minCenter[axis]) ? 1.0f / (maxCenter[axis] - minCenter[axis]) : 0.0f;
+
+	//Morton code on the high bits, meshlet index on the low ones
+	uint64_t* keys = scope.arena.AllocateArray<uint64_t>(meshletCount);
+	for (size_t i = 0; i < meshletCount; ++i)
+	{
+		const float* center = meshletMesh.meshletBounds[i].center;
+		const uint32_t code = Morton((center[0] - minCenter[0]) * invExtent[0], (center[1] - minCenter[1]) * invExtent[1], (center[2] - minCenter[2]) * invExtent[2]);
+		keys[i] = (static_cast<uint64_t>(code) << 32) | static_cast<uint64_t>(i);
+	}
+	//ties are broken by the meshlet index, the same mesh always gives the same order
+	std::sort(keys, keys + meshletCount);
+
+	const meshopt_Meshlet& last = meshletMesh.meshlets[meshletCount - 1];
+	const unsigned int verticesCount = last.vertex_offset + last.vertex_count;
+	const unsigned int trianglesSize = last.triangle_offset + ((last.triangle_count * 3 + 3) & ~3u);
+	//Sorted on scratch and copied back, only the triangles can grow (the padding of the meshlets moves) and get a new array
+	meshopt_Meshlet* meshlets = scope.arena.AllocateArray<meshopt_Meshlet>(meshletCount);
+	meshopt_Bounds* bounds = scope.arena.AllocateArray<meshopt_Bounds>(meshletCount);
+	unsigned int* meshletVertices = scope.arena.AllocateArray<unsigned int>(verticesCount);
+	//every meshlet starts 4 byte aligned like meshopt_buildMeshlets does
+	unsigned char* meshletTriangles = HostMemory::NewArray<unsigned char>(trianglesSize, HostMemory::Tag::MESHLETS);
+	unsigned int vertexOffset = 0;
+	unsigned int triangleOffset = 0;
+	for (size_t i = 0; i < meshletCount; ++i)
+	{
+		const uint32_t source = static_cast<uint32_t>(keys[i]);
+		meshopt_Meshlet meshlet = meshletMesh.meshlets[source];
+		memcpy(&meshletVertices[vertexOffset], &meshletMesh.meshletVertices[meshlet.vertex_offset], sizeof(unsigned int) * meshlet.vertex_count);
+		memset(&meshletTriangles[triangleOffset], 0, (meshlet.triangle_count * 3 + 3) & ~3u);
+		memcpy(&meshletTriangles[triangleOffset], &meshletMesh.meshletTriangles[meshlet.triangle_offset], meshlet.triangle_count * 3);
+		meshlet.vertex_offset = vertexOffset;
+		meshlet.triangle_offset = triangleOffset;
+		vertexOffset += meshlet.vertex_count;
+		triangleOffset += (meshlet.triangle_count * 3 + 3) & ~3u;
+		meshlets[i] = meshlet;
+		bounds[i] = meshletMesh.meshletBounds[source];
+	}
+	memcpy(meshletMesh.meshlets, meshlets, sizeof(meshopt_Meshlet) * meshletCount);
+	memcpy(meshletMesh.meshletBounds, bounds, sizeof(meshopt_Bounds) * meshletCount);
+	memcpy(meshletMesh.meshletVertices, meshletVertices, sizeof(unsigned int) * verticesCount);
+	HostMemory::Free(meshletMesh.meshletTriangles);
+	meshletMesh.meshletTriangles = meshletTriangles;
+}
+
+void OptimizeMesh::ReorderVertices(MeshletMesh& meshletMesh, HostMemory::Arena* scratch)
+{
+	PROFILE_ZONE("OptimizeMesh::ReorderVertices");
+	ScratchScope scope(scratch);
+	Mesh& mesh = meshletMesh.mesh;
+	const meshopt_Meshlet& last = meshletMesh.meshlets[meshletMesh.meshletCount - 1];
+	const unsigned int verticesCount = last.vertex_offset + last.vertex_count;
+	unsigned int* remap = scope.arena.AllocateArray<unsigned int>(mesh.numVertices);
+	//The meshlet vertex list works as an index buffer: the vertices get numbered on first use
+	const size_t usedVertices = meshopt_optimizeVertexFetchRemap(remap, meshletMesh.meshletVertices, verticesCount, mesh.numVertices);
+	Vertex* vertices = HostMemory::NewArray<Vertex>(usedVertices, HostMemory::Tag::MESHES);
+	meshopt_remapVertexBuffer(vertices, mesh.vertices, mesh.numVertices, sizeof(Vertex), remap);
+	meshopt_remapIndexBuffer(meshletMesh.meshletVertices, meshletMesh.meshletVertices, verticesCount, remap);
+	meshopt_remapIndexBuffer(mesh.indices, mesh.indices, mesh.numIndices, remap);
+	HostMemory::Free(mesh.vertices);
+	mesh.vertices = vertices;
+	mesh.numVertices = static_cast<unsigned int>(usedVertices);
+}
+
+void OptimizeMesh::TrackAllocations()
+{
+	meshopt_setAllocator(MeshoptAllocate, MeshoptFree);
+}
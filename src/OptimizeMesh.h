@@ -0,0 +1,38 @@
+#ifndef __OPTIMIZE_MESH_H__
+#define __OPTIMIZE_MESH_H__
+
+#include "ModuleVulkan.h"
+
+//Import time reordering of the mesh and meshlet buffers for the GPU caches, the geometry is not changed
+namespace OptimizeMesh
+{
+	//FIFO cache size used for the ACMR, close to the post transform cache of the hardware that still has one
+	constexpr unsigned int CACHE_SIZE = 16;
+
+	struct Metrics
+	{
+		unsigned int vertexCount;
+		//vertices left after merging the ones with the same position and normal
+		unsigned int uniqueVertices;
+		//transformed vertices per triangle with a CACHE_SIZE FIFO cache (0.5 is the best, 3 the worst)
+		float acmr;
+		//fetched bytes / vertex buffer size with 64 byte cache lines (1 is the best)
+		float overfetch;
+	};
+
+	//The temporaries (remaps, sort keys, copies) come from scratch, the caller resets it. Without one they come from an arena of the call
+	Metrics Analyze(const Mesh& mesh, HostMemory::Arena* scratch = nullptr);
+	//Merges the duplicated vertices, orders the triangles for the vertex cache and the vertices on first use
+	void Optimize(Mesh& mesh, HostMemory::Arena* scratch = nullptr);
+	//Builds the meshlets of the mesh with the limits, optimizes each one for the vertex cache and sorts them (SortMeshlets). The mesh is moved to meshletMesh
+	void BuildMeshlets(Mesh& mesh, MeshletMesh& meshletMesh, unsigned int maxVertices, unsigned int maxPrimitives, HostMemory::Arena* scratch = nullptr);
+	//Sorts the meshlets along a Morton curve of their bounding sphere centers and repacks their vertices and triangles on the same order
+	//Neighbouring task workgroups read neighbouring memory
+	void SortMeshlets(MeshletMesh& meshletMesh, HostMemory::Arena* scratch = nullptr);
+	//Renumbers the mesh vertices on the order the meshlets use them (after SortMeshlets, the meshlets read the vertex buffer front to back)
+	void ReorderVertices(MeshletMesh& meshletMesh, HostMemory::Arena* scratch = nullptr);
+	//The temporaries meshoptimizer allocates are counted as Tag::IMPORT_SCRATCH. Called once before any import
+	void TrackAllocations();
+}
+
+#endif // !__OPTIMIZE_MESH_H__
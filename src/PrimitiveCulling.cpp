@@ -0,0 +1,59 @@
+#include "PrimitiveCulling.h"
+#include <math.h>
+#include <algorithm>
+
+namespace
+{
+	struct SnappedVertex
+	{
+		int32_t x;
+		int32_t y;
+	};
+
+	//Same as SnapVertex of PrimitiveCulling.glsl, false when the vertex is behind the camera (the projection flips, the clipper must handle it)
+	//or past the guard band
+	bool Snap(const glm::vec4& clip, uint32_t width, uint32_t height, float scale, SnappedVertex& vertex)
+	{
+		if (clip.w <= 0.0f)
+			return false;
+		const float subpixelX = (clip.x / clip.w * 0.5f + 0.5f) * static_cast<float>(width) * scale;
+		const float subpixelY = (clip.y / clip.w * 0.5f + 0.5f) * static_cast<float>(height) * scale;
+		if (fabsf(subpixelX) >= PrimitiveCulling::GUARD_BAND || fabsf(subpixelY) >= PrimitiveCulling::GUARD_BAND)
+			return false;
+		//floor(x + 0.5) instead of round, GLSL round is free to pick either side on the halves
+		vertex.x = static_cast<int32_t>(floorf(subpixelX + 0.5f));
+		vertex.y = static_cast<int32_t>(floorf(subpixelY + 0.5f));
+		return true;
+	}
+
+	//First and last pixel center index between the bounds, in fixed point
+	int32_t FirstSample(int32_t minBound, uint32_t subPixelBits) { return (minBound - (1 << subPixelBits) / 2 + (1 << subPixelBits) - 1) >> subPixelBits; }
+	int32_t LastSample(int32_t maxBound, uint32_t subPixelBits) { return (maxBound - (1 << subPixelBits) / 2) >> subPixelBits; }
+}
+
+PrimitiveCulling::Result PrimitiveCulling::Classify(const glm::vec4& clip0, const glm::vec4& clip1, const glm::vec4& clip2, uint32_t width, uint32_t height, uint32_t subPixelBits)
+{
+	if (subPixelBits > MAX_SUBPIXEL_BITS)
+		return Result::KEPT;
+	const float scale = static_cast<float>(1 << subPixelBits);
+	SnappedVertex v0, v1, v2;
+	if (!Snap(clip0, width, height, scale, v0) || !Snap(clip1, width, height, scale, v1) || !Snap(clip2, width, height, scale, v2))
+		return Result::KEPT;
+	const int32_t minX = std::min(v0.x, std::min(v1.x, v2.x));
+	const int32_t minY = std::min(v0.y, std::min(v1.y, v2.y));
+	const int32_t maxX = std::max(v0.x, std::max(v1.x, v2.x));
+	const int32_t maxY = std::max(v0.y, std::max(v1.y, v2.y));
+	//The big triangles are cheap for the hardware anyway
+	if (maxX - minX > MAX_EXTENT || maxY - minY > MAX_EXTENT)
+		return Result::KEPT;
+	//Same sign as SoftwareRaster::RasterizeTriangle: the counter clockwise front faces are negative on a y down framebuffer
+	const int32_t signedArea = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+	if (signedArea == 0)
+		return Result::ZERO_AREA;
+	if (signedArea > 0)
+		return Result::BACK_FACING;
+	//A sample exactly on the bounds may be covered by the top-left rule, it is kept
+	if (FirstSample(minX, subPixelBits) > LastSample(maxX, subPixelBits) || FirstSample(minY, subPixelBits) > LastSample(maxY, subPixelBits))
+		return Result::NO_SAMPLES;
+	return Result::KEPT;
+}
@@ -0,0 +1,31 @@
+#ifndef __PRIMITIVE_CULLING_H__
+#define __PRIMITIVE_CULLING_H__
+
+#include "glm/vec4.hpp"
+#include <stdint.h>
+
+//CPU reference of the per triangle tests of shaders/PrimitiveCulling.glsl (Shader.mesh and Visibility.mesh)
+//The vertices are snapped with the subpixel precision of the device so the results match its rasterizer, the triangles that can not be tested exactly are kept
+namespace PrimitiveCulling
+{
+	enum class Result : unsigned char
+	{
+		KEPT,
+		BACK_FACING,
+		ZERO_AREA,
+		//The bounds do not contain any pixel center, the triangle can not produce fragments
+		NO_SAMPLES
+	};
+
+	//Snapped vertices farther than this (in subpixels) from the framebuffer are not tested, the triangle is left to the hardware clipper
+	constexpr float GUARD_BAND = 1 << 28;
+	//Wider or taller triangles (in subpixels) are kept, it keeps the edge function inside 32 bits at any precision. 64 pixels with 8 bits
+	constexpr int32_t MAX_EXTENT = 1 << 14;
+	//Above it GUARD_BAND would not fit the framebuffer, VkPhysicalDeviceLimits::subPixelPrecisionBits is 4 or 8 on the known devices
+	constexpr uint32_t MAX_SUBPIXEL_BITS = 12;
+
+	Result Classify(const glm::vec4& clip0, const glm::vec4& clip1, const glm::vec4& clip2, uint32_t width, uint32_t height, uint32_t subPixelBits);
+	inline bool IsCulled(Result result) { return result != Result::KEPT; }
+}
+
+#endif // !__PRIMITIVE_CULLING_H__
@@ -0,0 +1,205 @@
+#include "Profiler.h"
+
+#ifdef ENGINE_PROFILER
+
+#include "Globals.h"
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+	enum class EventType : uint8_t { ZONE, COUNTER, FRAME, GPU_ZONE };
+	struct Event
+	{
+		const char* name;
+		uint64_t begin;
+		//end of the zones, frame number of the markers
+		uint64_t end;
+		double value;
+		EventType type;
+	};
+
+	//Only its thread writes it. The buffers of the finished threads are handed to the next new thread (the short lived workers share a track)
+	struct ThreadBuffer
+	{
+		std::vector<Event> events;
+		uint64_t written = 0;
+		uint32_t id = 0;
+		const char* name = nullptr;
+		bool inUse = false;
+	};
+
+	const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	std::mutex buffersMutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+	uint64_t frameNumber = 0;
+	//CPU - GPU nanoseconds, the smallest one seen
+	int64_t gpuOffset = 0;
+	bool gpuCalibrated = false;
+
+	ThreadBuffer* AcquireBuffer()
+	{
+		std::lock_guard<std::mutex> lock(buffersMutex);
+		for (std::unique_ptr<ThreadBuffer>& buffer : buffers)
+		{
+			if (!buffer->inUse)
+			{
+				buffer->inUse = true;
+				return buffer.get();
+			}
+		}
+		buffers.emplace_back(new ThreadBuffer());
+		ThreadBuffer* buffer = buffers.back().get();
+		buffer->events.resize(Profiler::EVENTS_PER_THREAD);
+		buffer->id = static_cast<uint32_t>(buffers.size());
+		buffer->inUse = true;
+		return buffer;
+	}
+
+	//Gives the buffer back when the thread ends, its events stay until the export
+	struct ThreadSlot
+	{
+		ThreadBuffer* buffer = nullptr;
+		~ThreadSlot()
+		{
+			if (buffer != nullptr)
+			{
+				std::lock_guard<std::mutex> lock(buffersMutex);
+				buffer->inUse = false;
+			}
+		}
+	};
+	thread_local ThreadSlot threadSlot;
+
+	inline ThreadBuffer& GetBuffer()
+	{
+		if (threadSlot.buffer == nullptr)
+			threadSlot.buffer = AcquireBuffer();
+		return *threadSlot.buffer;
+	}
+
+	inline void Push(EventType type, const char* name, uint64_t begin, uint64_t end, double value)
+	{
+		ThreadBuffer& buffer = GetBuffer();
+		Event& event = buffer.events[buffer.written % Profiler::EVENTS_PER_THREAD];
+		event.name = name;
+		event.begin = begin;
+		event.end = end;
+		event.value = value;
+		event.type = type;
+		++buffer.written;
+	}
+
+	//The names are literals of the engine, only the quotes and backslashes need escaping
+	void WriteString(FILE* file, const char* text)
+	{
+		fputc('"', file);
+		for (const char* c = text; *c != '\0'; ++c)
+		{
+			if (*c == '"' || *c == '\\')
+				fputc('\\', file);
+			fputc(*c, file);
+		}
+		fputc('"', file);
+	}
+}
+
+uint64_t Profiler::Now()
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count());
+}
+
+void Profiler::SetThreadName(const char* name)
+{
+	GetBuffer().name = name;
+}
+
+void Profiler::RecordZone(const char* name, uint64_t begin, uint64_t end)
+{
+	Push(EventType::ZONE, name, begin, end, 0.0);
+}
+
+void Profiler::RecordCounter(const char* name, double value)
+{
+	const uint64_t now = Now();
+	Push(EventType::COUNTER, name, now, now, value);
+}
+
+void Profiler::FrameMark()
+{
+	const uint64_t now = Now();
+	Push(EventType::FRAME, "Frame", now, frameNumber++, 0.0);
+}
+
+void Profiler::RecordGpuZone(const char* name, uint64_t gpuBegin, uint64_t gpuEnd)
+{
+	if (gpuEnd >= gpuBegin)
+		Push(EventType::GPU_ZONE, name, gpuBegin, gpuEnd, 0.0);
+}
+
+void Profiler::CalibrateGpu(uint64_t gpuTime)
+{
+	const int64_t offset = static_cast<int64_t>(Now()) - static_cast<int64_t>(gpuTime);
+	if (!gpuCalibrated || offset < gpuOffset)
+		gpuOffset = offset;
+	gpuCalibrated = true;
+}
+
+bool Profiler::WriteChromeTrace(const char* path)
+{
+	FILE* file = fopen(path, "w");
+	if (file == nullptr)
+	{
+		LOG("Error writing the profiler trace to %s", path);
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(buffersMutex);
+	//The GPU zones of every thread go to one track after the threads
+	const uint32_t gpuTrack = static_cast<uint32_t>(buffers.size()) + 1;
+	size_t eventCount = 0;
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"GPU\"}}", gpuTrack);
+	for (const std::unique_ptr<ThreadBuffer>& buffer : buffers)
+	{
+		char threadName[32];
+		snprintf(threadName, sizeof(threadName), "Thread %u", buffer->id);
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", buffer->id);
+		WriteString(file, buffer->name != nullptr ? buffer->name : threadName);
+		fprintf(file, "}}");
+		const uint64_t first = buffer->written > EVENTS_PER_THREAD ? buffer->written - EVENTS_PER_THREAD : 0;
+		for (uint64_t i = first; i < buffer->written; ++i)
+		{
+			const Event& event = buffer->events[i % EVENTS_PER_THREAD];
+			fprintf(file, ",\n{\"name\":");
+			WriteString(file, event.name);
+			//Chrome traces are in microseconds
+			switch (event.type)
+			{
+			case EventType::ZONE:
+				fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", buffer->id, event.begin / 1000.0, (event.end - event.begin) / 1000.0);
+				break;
+			case EventType::COUNTER:
+				fprintf(file, ",\"ph\":\"C\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"args\":{\"value\":%g}}", buffer->id, event.begin / 1000.0, event.value);
+				break;
+			case EventType::FRAME:
+				fprintf(file, ",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"args\":{\"frame\":%llu}}", buffer->id, event.begin / 1000.0, static_cast<unsigned long long>(event.end));
+				break;
+			case EventType::GPU_ZONE:
+				fprintf(file, ",\"ph\":\"X\",\"cat\":\"gpu\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", gpuTrack, (static_cast<int64_t>(event.begin) + gpuOffset) / 1000.0,
+					(event.end - event.begin) / 1000.0);
+				break;
+			}
+		}
+		eventCount += static_cast<size_t>(buffer->written - first);
+	}
+	fprintf(file, "\n]}\n");
+	fclose(file);
+	LOG("Profiler trace: %zu events of %zu threads written to %s", eventCount, buffers.size(), path);
+	return true;
+}
+
+#endif // ENGINE_PROFILER
@@ -0,0 +1,62 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+//CPU zone profiler: scoped zones, counters and frame markers recorded to a ring buffer per thread, plus the GPU timestamps of ModuleVulkan on their own
+//track. WriteChromeTrace exports everything as a Chrome trace (chrome://tracing, Perfetto)
+//Only built with ENGINE_PROFILER (CMake option of the same name), without it the PROFILE_ macros expand to nothing
+#ifdef ENGINE_PROFILER
+
+#include <stdint.h>
+
+namespace Profiler
+{
+	//Events kept per thread, the oldest ones are overwritten
+	constexpr uint32_t EVENTS_PER_THREAD = 1u << 16;
+
+	//Nanoseconds since the start of the process
+	uint64_t Now();
+	//Name of the track of the calling thread, the unnamed ones are "Thread N". name has to outlive the profiler (a literal)
+	void SetThreadName(const char* name);
+	//The names of the events are kept as pointers, they have to be literals too
+	void RecordZone(const char* name, uint64_t begin, uint64_t end);
+	void RecordCounter(const char* name, double value);
+	//Start of a new frame, a global marker on the trace
+	void FrameMark();
+	//GPU interval in nanoseconds of the device clock (timestamp ticks * timestampPeriod)
+	void RecordGpuZone(const char* name, uint64_t gpuBegin, uint64_t gpuEnd);
+	//gpuTime is a timestamp the GPU already wrote when it is called (the end of a frame whose fence is signaled). The smallest CPU - GPU difference seen
+	//is the offset that moves the GPU zones to the CPU clock, without VK_EXT_calibrated_timestamps it is off by the fence latency at most
+	void CalibrateGpu(uint64_t gpuTime);
+	//The other threads must not be recording while it runs (called on shutdown)
+	bool WriteChromeTrace(const char* path);
+
+	class Zone
+	{
+	public:
+		explicit Zone(const char* name) : name(name), begin(Now()) {}
+		~Zone() { RecordZone(name, begin, Now()); }
+		Zone(const Zone&) = delete;
+		Zone& operator=(const Zone&) = delete;
+	private:
+		const char* name;
+		uint64_t begin;
+	};
+}
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) Profiler::Zone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_COUNTER(name, value) Profiler::RecordCounter(name, static_cast<double>(value))
+#define PROFILE_FRAME() Profiler::FrameMark()
+#define PROFILE_THREAD(name) Profiler::SetThreadName(name)
+
+#else
+
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_COUNTER(name, value) ((void)0)
+#define PROFILE_FRAME() ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+
+#endif // ENGINE_PROFILER
+
+#endif // !__PROFILER_H__
@@ -0,0 +1,1106 @@
+#include "Simulations.h"
+#include "GeometryStreaming.h"
+#include "InstanceManager.h"
+#include "DepthSort.h"
+#include "glm/geometric.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+namespace
+{
+	//culling.comp test with the planes of the frame
+	bool BoxVisible(const glm::vec3(&points)[8], const glm::vec4(&planes)[6])
+	{
+		for (uint32_t i = 0; i < 6; ++i)
+		{
+			uint32_t outPoints = 0;
+			for (uint32_t k = 0; k < 8; ++k)
+			{
+				if (glm::dot(glm::vec3(planes[i]), points[k]) - planes[i].w >= 0.0f)
+					++outPoints;
+			}
+			if (outPoints == 8)
+				return false;
+		}
+		return true;
+	}
+
+	//Shader.task test with the planes of the frame
+	bool SphereVisible(const glm::vec3& center, float radius, const glm::vec4(&planes)[6])
+	{
+		for (uint32_t i = 0; i < 6; ++i)
+		{
+			if (glm::dot(glm::vec3(planes[i]), center) - planes[i].w > radius)
+				return false;
+		}
+		return true;
+	}
+
+	bool PointInside(const glm::vec3& point, const glm::vec4(&planes)[6])
+	{
+		for (uint32_t i = 0; i < 6; ++i)
+		{
+			if (glm::dot(glm::vec3(planes[i]), point) - planes[i].w >= 0.0f)
+				return false;
+		}
+		return true;
+	}
+}
+
+glm::mat4 Simulations::SceneBox(Random& random)
+{
+	const glm::vec3 center(random() * 12000.0f - 6000.0f, random() * 12000.0f - 6000.0f, random() * 12000.0f - 6000.0f);
+	const glm::vec3 halfSize(30.0f + random() * 120.0f, 30.0f + random() * 120.0f, 30.0f + random() * 120.0f);
+	const glm::vec3 axis(random() * 2.0f - 1.0f, random() * 2.0f - 1.0f, random() * 2.0f + 0.01f);
+	const float angle = random() * 6.28318530718f;
+	return glm::scale(glm::rotate(glm::translate(glm::mat4(1.0f), center), angle, glm::normalize(axis)), halfSize);
+}
+
+void Simulations::BoxPoints(const glm::mat4& model, glm::vec3(&points)[8])
+{
+	for (uint32_t k = 0; k < 8; ++k)
+		points[k] = glm::vec3(model * glm::vec4((k & 1) != 0 ? 1.0f : -1.0f, (k & 2) != 0 ? 1.0f : -1.0f, (k & 4) != 0 ? 1.0f : -1.0f, 1.0f));
+}
+
+glm::mat4 Simulations::BenchmarkProjection(float width, float height)
+{
+	const float halfFovTangent = tanf(0.5f * 0.785398163f);
+	const float nearPlane = 0.1f;
+	const float farPlane = 10000.0f;
+	return glm::mat4
+	{
+		(height / width) / halfFovTangent, 0.0f, 0.0f, 0.0f,
+		0.0f, -1.0f / halfFovTangent, 0.0f, 0.0f,
+		0.0f, 0.0f, -farPlane / (farPlane - nearPlane), -1.0f,
+		0.0f, 0.0f, -(nearPlane * farPlane) / (farPlane - nearPlane), 0.0f
+	};
+}
+
+void Simulations::CameraPlanes(const glm::vec3& eye, const glm::vec3& forward, float tanHalfX, float tanHalfY, float nearPlane, float farPlane, glm::vec4(&planes)[6])
+{
+	const glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+	const glm::vec3 up = glm::cross(right, forward);
+	planes[0] = glm::vec4(-forward, glm::dot(eye + forward * nearPlane, -forward));
+	planes[1] = glm::vec4(forward, glm::dot(eye + forward * farPlane, forward));
+	//side planes through the eye, the normal points away from the view direction
+	const glm::vec3 normals[4] =
+	{
+		glm::normalize(glm::cross(forward - right * tanHalfX, up)),
+		glm::normalize(glm::cross(up, forward + right * tanHalfX)),
+		glm::normalize(glm::cross(forward + up * tanHalfY, right)),
+		glm::normalize(glm::cross(right, forward - up * tanHalfY))
+	};
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		const glm::vec3 normal = glm::dot(normals[i], forward) > 0.0f ? -normals[i] : normals[i];
+		planes[2 + i] = glm::vec4(normal, glm::dot(normal, eye));
+	}
+}
+
+Simulations::StreamingResult Simulations::SimulateStreaming(const StreamingParams& params)
+{
+	using namespace GeometryStreaming;
+	StreamingResult result;
+	//Full detail pages of every group and then one fallback page per group (group groupCount + g), pinned like the engine does
+	const uint32_t finePages = params.groupCount * params.pagesPerGroup;
+	std::vector<uint32_t> pageGroups(finePages + params.groupCount);
+	for (uint32_t page = 0; page < finePages; ++page)
+		pageGroups[page] = page / params.pagesPerGroup;
+	for (uint32_t group = 0; group < params.groupCount; ++group)
+		pageGroups[finePages + group] = params.groupCount + group;
+	ResidencyManager manager;
+	manager.Init(pageGroups, params.groupCount * 2, params.slotCount);
+	for (uint32_t group = 0; group < params.groupCount; ++group)
+	{
+		if (manager.Pin(finePages + group) == NOT_RESIDENT)
+		{
+			result.valid = false;
+			return result;
+		}
+	}
+
+	struct Feedback
+	{
+		uint64_t frame;
+		std::vector<uint32_t> used;
+		std::vector<uint32_t> requests;
+	};
+	std::deque<Feedback> inFlight;
+	//last frame the manager was told each page was used
+	std::vector<uint64_t> lastTouch(pageGroups.size(), 0);
+	const uint32_t visibleGroups = std::min(params.visibleGroups, params.groupCount);
+	const uint32_t span = params.groupCount - visibleGroups;
+	for (uint64_t frame = 1; frame <= params.frames && result.valid; ++frame)
+	{
+		//The camera goes from one end of the strip to the other and back
+		uint32_t first = 0;
+		if (span != 0)
+		{
+			const uint32_t step = static_cast<uint32_t>((frame / params.framesPerGroup) % (2 * span));
+			first = step < span ? step : 2 * span - step;
+		}
+		//What culling.comp and the task shader write on the feedback buffer
+		Feedback feedback;
+		feedback.frame = frame;
+		for (uint32_t group = first; group < first + visibleGroups; ++group)
+		{
+			if (manager.GetGroupMissingPages()[group] != 0)
+				++result.fallbackFrames;
+			for (uint32_t page = group * params.pagesPerGroup; page < (group + 1) * params.pagesPerGroup; ++page)
+			{
+				++result.pageUses;
+				if (manager.IsResident(page))
+				{
+					++result.residentUses;
+					feedback.used.push_back(page);
+				}
+				else
+					feedback.requests.push_back(page);
+			}
+		}
+		inFlight.push_back(feedback);
+		if (inFlight.size() <= params.latency)
+			continue;
+
+		//The frame retired, its feedback is read like ModuleVulkan::UpdateStreaming does
+		const Feedback& retired = inFlight.front();
+		for (uint32_t page : retired.used)
+		{
+			manager.Touch(page, retired.frame);
+			lastTouch[page] = retired.frame;
+		}
+		uint32_t uploads = 0;
+		for (uint32_t page : retired.requests)
+		{
+			if (manager.IsResident(page))
+				continue;
+			if (uploads == MAX_PAGE_UPLOADS)
+				break;
+			uint32_t evicted;
+			if (manager.MakeResident(page, retired.frame, evicted) == NOT_RESIDENT)
+			{
+				++result.refusedRequests;
+				break;
+			}
+			lastTouch[page] = retired.frame;
+			++uploads;
+			++result.uploads;
+			//a fallback page left its slot or a page used on the same frame was evicted
+			if (evicted != NOT_RESIDENT && (evicted >= finePages || lastTouch[evicted] >= retired.frame))
+				result.valid = false;
+		}
+		inFlight.pop_front();
+		for (uint32_t group = 0; group < params.groupCount && result.valid; ++group)
+			result.valid = manager.IsPinned(finePages + group);
+		if (result.valid)
+			result.valid = manager.Validate();
+	}
+	result.evictions = manager.GetEvictions();
+	//a budget that holds every page never has to evict
+	if (params.slotCount >= pageGroups.size() && result.evictions != 0)
+		result.valid = false;
+	return result;
+}
+
+Simulations::InstanceChurnResult Simulations::SimulateInstanceChurn(const InstanceChurnParams& params)
+{
+	InstanceChurnResult result;
+	uint32_t state = 1;
+	auto random = [&state]() { state ^= state << 13; state ^= state >> 17; state ^= state << 5; return state; };
+	auto makeMotion = [&random]()
+	{
+		InstanceSimulation::Motion motion{};
+		motion.position = glm::vec4(static_cast<float>(random() % 12001) - 6000.0f, static_cast<float>(random() % 12001) - 6000.0f, static_cast<float>(random() % 12001) - 6000.0f, 1.0f);
+		motion.rotation = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		return motion;
+	};
+	InstanceManager manager;
+	manager.Init(params.capacity, params.meshCount);
+
+	//live handles and the last removed ones, which must stay stale
+	std::vector<InstanceHandle> live(params.initialInstances);
+	std::vector<InstanceHandle> stale;
+	std::vector<uint32_t> meshBatch(std::max(params.initialInstances, params.churn));
+	std::vector<InstanceSimulation::Motion> motionBatch(std::max(params.initialInstances, std::max(params.churn, params.updates)));
+	std::vector<InstanceHandle> handleBatch(std::max(params.churn, params.updates));
+	for (uint32_t i = 0; i < params.initialInstances; ++i)
+	{
+		meshBatch[i] = i % params.meshCount;
+		motionBatch[i] = makeMotion();
+	}
+	if (manager.Add(meshBatch.data(), motionBatch.data(), params.initialInstances, live.data()) != params.initialInstances)
+	{
+		result.valid = false;
+		return result;
+	}
+	result.added = params.initialInstances;
+	//The GPU buffers, the first upload is the whole buffers like ModuleVulkan::Init
+	std::vector<uint32_t> gpuMeshes(manager.GetMeshes(), manager.GetMeshes() + params.capacity);
+	std::vector<InstanceSimulation::Motion> gpuMotions(manager.GetMotions(), manager.GetMotions() + params.capacity);
+	manager.TakeDirtySlots(nullptr, params.capacity);
+	std::vector<uint32_t> uploads(InstanceManager::MAX_UPLOADS);
+
+	for (uint32_t frame = 1; frame <= params.frames && result.valid; ++frame)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		const uint32_t churn = std::min(params.churn, static_cast<uint32_t>(live.size()));
+		for (uint32_t i = 0; i < churn; ++i)
+		{
+			const uint32_t index = random() % static_cast<uint32_t>(live.size());
+			handleBatch[i] = live[index];
+			live[index] = live.back();
+			live.pop_back();
+		}
+		if (manager.Remove(handleBatch.data(), churn) != churn)
+			result.valid = false;
+		result.removed += churn;
+		stale.insert(stale.end(), handleBatch.begin(), handleBatch.begin() + churn);
+		for (uint32_t i = 0; i < params.churn; ++i)
+		{
+			meshBatch[i] = random() % params.meshCount;
+			motionBatch[i] = makeMotion();
+		}
+		const size_t liveBefore = live.size();
+		live.resize(liveBefore + params.churn);
+		const uint32_t added = manager.Add(meshBatch.data(), motionBatch.data(), params.churn, live.data() + liveBefore);
+		if (added != params.churn)
+			result.valid = false;
+		result.added += added;
+		const uint32_t updates = live.empty() ? 0 : params.updates;
+		for (uint32_t i = 0; i < updates; ++i)
+		{
+			handleBatch[i] = live[random() % static_cast<uint32_t>(live.size())];
+			motionBatch[i] = makeMotion();
+		}
+		if (manager.Update(handleBatch.data(), motionBatch.data(), updates) != updates)
+			result.valid = false;
+		result.updated += updates;
+		//the removed handles can not remove or move the instances that took their slots
+		if (manager.Remove(stale.data(), static_cast<uint32_t>(stale.size())) != 0 || manager.Update(stale.data(), motionBatch.data(), std::min(static_cast<uint32_t>(stale.size()), updates)) != 0)
+			result.valid = false;
+		const uint32_t uploadCount = manager.TakeDirtySlots(uploads.data(), InstanceManager::MAX_UPLOADS);
+		result.changeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (stale.size() > 4 * params.churn)
+			stale.erase(stale.begin(), stale.begin() + params.churn);
+
+		//What the staged copies write
+		for (uint32_t i = 0; i < uploadCount; ++i)
+		{
+			gpuMeshes[uploads[i]] = manager.GetMeshes()[uploads[i]];
+			gpuMotions[uploads[i]] = manager.GetMotions()[uploads[i]];
+		}
+		result.uploads += uploadCount;
+		result.maxBacklog = std::max(result.maxBacklog, manager.GetDirtyCount());
+		result.maxSlotCount = std::max(result.maxSlotCount, manager.GetSlotCount());
+		//The live instances never outgrow the first slots
+		if (manager.GetSlotCount() > params.initialInstances)
+			result.valid = false;
+		if (frame % 100 == 0 || frame == params.frames)
+		{
+			result.valid = result.valid && manager.Validate();
+			for (uint32_t slot = 0; slot < params.capacity && result.valid; ++slot)
+			{
+				if (!manager.IsDirty(slot) && (gpuMeshes[slot] != manager.GetMeshes()[slot] || memcmp(&gpuMotions[slot], &manager.GetMotions()[slot], sizeof(InstanceSimulation::Motion)) != 0))
+					result.valid = false;
+			}
+			for (const InstanceHandle& handle : live)
+				result.valid = result.valid && manager.IsAlive(handle);
+		}
+	}
+	return result;
+}
+
+Simulations::OcclusionResult Simulations::SimulateOcclusion(const OcclusionParams& params)
+{
+	using namespace OcclusionCulling;
+	OcclusionResult result;
+	Random random;
+
+	//Unit boxes scaled, rotated and spread on the scene cube
+	std::vector<OccluderMesh> meshes(1);
+	const Box unitBox = { glm::vec3(-1.0f), glm::vec3(1.0f) };
+	MakeBoxOccluder(unitBox, meshes[0]);
+	std::vector<glm::mat4> models(params.instanceCount);
+	const std::vector<uint32_t> instanceMeshes(params.instanceCount, 0);
+	for (uint32_t i = 0; i < params.instanceCount; ++i)
+		models[i] = SceneBox(random);
+
+	//Stationary benchmark camera
+	const float width = static_cast<float>(params.width);
+	const float height = static_cast<float>(params.height);
+	const float nearPlane = 0.1f;
+	const glm::mat4 viewProj = BenchmarkProjection(width, height) * glm::lookAt(glm::vec3(0.0f, 0.0f, 7000.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	//The boxes on screen that cover more of it (size over distance) are the occluders
+	std::vector<std::pair<float, uint32_t>> candidates;
+	for (uint32_t i = 0; i < params.instanceCount; ++i)
+	{
+		const glm::vec4 center = viewProj * models[i][3];
+		if (center.w > nearPlane && fabsf(center.x) < center.w && fabsf(center.y) < center.w)
+			candidates.push_back(std::make_pair(-glm::length(glm::vec3(models[i][0])) / center.w, i));
+	}
+	const uint32_t occluderCount = std::min(params.occluderCount, static_cast<uint32_t>(candidates.size()));
+	std::partial_sort(candidates.begin(), candidates.begin() + occluderCount, candidates.end());
+	std::vector<uint32_t> occluders(occluderCount, 0);
+	std::vector<glm::mat4> transforms(occluderCount);
+	for (uint32_t i = 0; i < occluderCount; ++i)
+		transforms[i] = viewProj * models[candidates[i].second];
+
+	//AVX2 path timed when the CPU has it, the scalar one checked against it
+	MaskedDepthBuffer buffers[2];
+	std::vector<uint32_t> bits[2];
+	buffers[0].Init(params.width, params.height, params.threadCount, true);
+	buffers[1].Init(params.width, params.height, params.threadCount, false);
+	result.avx2 = buffers[0].IsUsingAVX2();
+	result.threadCount = buffers[0].GetThreadCount();
+	const uint32_t paths = result.avx2 ? 2 : 1;
+	for (uint32_t path = 0; path < paths; ++path)
+	{
+		bits[path].assign((params.instanceCount + 31) / 32, 0);
+		const uint32_t iterations = path == 0 ? std::max(params.iterations, 1u) : 1;
+		for (uint32_t iteration = 0; iteration < iterations; ++iteration)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			buffers[path].Clear();
+			result.occluderTriangles = buffers[path].RenderOccluders(meshes.data(), occluders.data(), transforms.data(), occluderCount);
+			const auto rendered = std::chrono::steady_clock::now();
+			result.occluded = buffers[path].TestInstances(viewProj, models.data(), instanceMeshes.data(), nullptr, params.instanceCount, &unitBox, bits[path].data());
+			if (path == 0)
+			{
+				result.rasterMs += std::chrono::duration<double, std::milli>(rendered - start).count() / iterations;
+				result.testMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - rendered).count() / iterations;
+			}
+		}
+	}
+	if (paths == 2 && (!buffers[0].Matches(buffers[1]) || bits[0] != bits[1]))
+		result.valid = false;
+
+	//Per pixel buffer of the same coverage with the exact depth of every pixel center, the nearest triangle wins
+	std::vector<float> reference(params.width * params.height, 0.0f);
+	alignas(32) uint32_t coverage[TILE_HEIGHT];
+	for (uint32_t i = 0; i < occluderCount; ++i)
+	{
+		const OccluderMesh& mesh = meshes[occluders[i]];
+		for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+		{
+			MaskedDepthBuffer::Triangle triangle;
+			if (!SetupTriangle(transforms[i] * glm::vec4(mesh.positions[mesh.indices[t]], 1.0f), transforms[i] * glm::vec4(mesh.positions[mesh.indices[t + 1]], 1.0f), transforms[i] * glm::vec4(mesh.positions[mesh.indices[t + 2]], 1.0f), width, height, triangle))
+				continue;
+			for (uint32_t ty = triangle.tileMinY; ty <= triangle.tileMaxY; ++ty)
+			{
+				for (uint32_t tx = triangle.tileMinX; tx <= triangle.tileMaxX; ++tx)
+				{
+					CoverageScalar(triangle, static_cast<float>(tx * TILE_WIDTH), static_cast<float>(ty * TILE_HEIGHT), coverage);
+					for (uint32_t r = 0; r < TILE_HEIGHT; ++r)
+					{
+						for (uint32_t b = 0; b < TILE_WIDTH; ++b)
+						{
+							const uint32_t x = tx * TILE_WIDTH + b;
+							const uint32_t y = ty * TILE_HEIGHT + r;
+							if (((coverage[r] >> b) & 1) == 0 || x >= params.width || y >= params.height)
+								continue;
+							const double depth = triangle.z0 + (x + 0.5 - triangle.x0) * triangle.dzdx + (y + 0.5 - triangle.y0) * triangle.dzdy;
+							reference[y * params.width + x] = std::min(reference[y * params.width + x], static_cast<float>(depth));
+						}
+					}
+				}
+			}
+		}
+	}
+	for (uint32_t i = 0; i < params.instanceCount; ++i)
+	{
+		int32_t rect[4];
+		float depth;
+		if (!ProjectBox(unitBox, viewProj * models[i], width, height, rect, depth))
+			continue;
+		++result.onScreen;
+		bool occluded = true;
+		for (int32_t y = rect[1]; y <= rect[3] && occluded; ++y)
+		{
+			for (int32_t x = rect[0]; x <= rect[2] && occluded; ++x)
+				occluded = reference[y * params.width + x] < depth;
+		}
+		if (occluded)
+			++result.referenceOccluded;
+		else if ((bits[0][i / 32] >> (i % 32)) & 1)
+			result.valid = false;
+	}
+	return result;
+}
+
+Simulations::DepthSortResult Simulations::SimulateDepthSort(const DepthSortParams& params)
+{
+	using namespace DepthSort;
+	DepthSortResult result;
+	Random random;
+
+	//Stationary benchmark camera, same scene as SimulateOcclusion
+	const float width = static_cast<float>(params.width);
+	const float height = static_cast<float>(params.height);
+	const float nearPlane = 0.1f;
+	const float farPlane = 10000.0f;
+	const glm::mat4 proj = BenchmarkProjection(width, height);
+	const glm::vec3 eye(0.0f, 0.0f, 7000.0f);
+	const glm::vec3 forward(0.0f, 0.0f, -1.0f);
+	const glm::mat4 viewProj = proj * glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	//Survivors in slot order with their key and screen rectangle (pixels, nearest w)
+	struct Rect
+	{
+		int32_t minX;
+		int32_t minY;
+		int32_t maxX;
+		int32_t maxY;
+		float depth;
+	};
+	std::vector<uint32_t> keys;
+	std::vector<Rect> rects;
+	for (uint32_t i = 0; i < params.instanceCount; ++i)
+	{
+		const glm::mat4 model = SceneBox(random);
+		const glm::vec3 center(model[3]);
+		Rect rect = { INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN, farPlane };
+		bool inside = true;
+		for (uint32_t corner = 0; corner < 8 && inside; ++corner)
+		{
+			const glm::vec4 clip = viewProj * model * glm::vec4(corner & 1 ? 1.0f : -1.0f, corner & 2 ? 1.0f : -1.0f, corner & 4 ? 1.0f : -1.0f, 1.0f);
+			//the boxes crossing the near plane are drawn by the cull too, the estimate skips them
+			inside = clip.w > nearPlane;
+			const float x = (clip.x / clip.w * 0.5f + 0.5f) * width;
+			const float y = (clip.y / clip.w * 0.5f + 0.5f) * height;
+			rect.minX = std::min(rect.minX, static_cast<int32_t>(floorf(x)));
+			rect.minY = std::min(rect.minY, static_cast<int32_t>(floorf(y)));
+			rect.maxX = std::max(rect.maxX, static_cast<int32_t>(floorf(x)));
+			rect.maxY = std::max(rect.maxY, static_cast<int32_t>(floorf(y)));
+			rect.depth = std::min(rect.depth, clip.w);
+		}
+		rect.minX = std::max(rect.minX, 0);
+		rect.minY = std::max(rect.minY, 0);
+		rect.maxX = std::min(rect.maxX, static_cast<int32_t>(params.width) - 1);
+		rect.maxY = std::min(rect.maxY, static_cast<int32_t>(params.height) - 1);
+		if (!inside || rect.minX > rect.maxX || rect.minY > rect.maxY)
+			continue;
+		keys.push_back(DepthKey(glm::dot(forward, center - eye) - nearPlane, farPlane - nearPlane));
+		rects.push_back(rect);
+	}
+	const uint32_t count = static_cast<uint32_t>(keys.size());
+	result.sorted = count;
+
+	std::vector<uint32_t> sortedKeys(count), sortedValues(count), scratchKeys(count), scratchValues(count), blockCounts(RADIX * BlockCount(count));
+	std::vector<uint32_t> referenceValues(count);
+	const uint32_t iterations = std::max(params.iterations, 1u);
+	for (uint32_t iteration = 0; iteration < iterations; ++iteration)
+	{
+		sortedKeys = keys;
+		std::iota(sortedValues.begin(), sortedValues.end(), 0);
+		const auto start = std::chrono::steady_clock::now();
+		Sort(sortedKeys.data(), sortedValues.data(), count, scratchKeys.data(), scratchValues.data(), blockCounts.data());
+		const auto sorted = std::chrono::steady_clock::now();
+		std::iota(referenceValues.begin(), referenceValues.end(), 0);
+		std::stable_sort(referenceValues.begin(), referenceValues.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+		result.sortMs += std::chrono::duration<double, std::milli>(sorted - start).count() / iterations;
+		result.referenceMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sorted).count() / iterations;
+	}
+	//Same order as the reference, equal keys included
+	for (uint32_t i = 0; i < count && result.valid; ++i)
+		result.valid = sortedValues[i] == referenceValues[i] && sortedKeys[i] == keys[referenceValues[i]];
+
+	//Early Z: a pixel is shaded when the rectangle is nearer than what was drawn there before
+	std::vector<float> depthBuffer(params.width * params.height);
+	for (uint32_t order = 0; order < 2; ++order)
+	{
+		std::fill(depthBuffer.begin(), depthBuffer.end(), farPlane);
+		uint64_t shaded = 0;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const Rect& rect = rects[order == 0 ? i : sortedValues[i]];
+			for (int32_t y = rect.minY; y <= rect.maxY; ++y)
+			{
+				for (int32_t x = rect.minX; x <= rect.maxX; ++x)
+				{
+					float& depth = depthBuffer[y * params.width + x];
+					if (rect.depth < depth)
+					{
+						depth = rect.depth;
+						++shaded;
+					}
+				}
+			}
+		}
+		const uint64_t covered = static_cast<uint64_t>(std::count_if(depthBuffer.begin(), depthBuffer.end(), [farPlane](float depth) { return depth < farPlane; }));
+		(order == 0 ? result.unsortedOverdraw : result.sortedOverdraw) = covered != 0 ? static_cast<double>(shaded) / covered : 0.0;
+	}
+	return result;
+}
+
+Simulations::VisibilityCacheResult Simulations::SimulateVisibilityCache(const VisibilityCacheParams& params)
+{
+	using namespace VisibilityCache;
+	VisibilityCacheResult result;
+	Random random;
+
+	//Same boxes as SimulateOcclusion, the movers drift a few units per frame
+	const uint32_t count = params.instanceCount;
+	std::vector<glm::mat4> models(count);
+	std::vector<glm::vec3> velocities(count, glm::vec3(0.0f));
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		models[i] = SceneBox(random);
+		if (params.movingEvery != 0 && i % params.movingEvery == 0)
+			velocities[i] = glm::vec3(random() * 2.0f - 1.0f, random() * 2.0f - 1.0f, random() * 2.0f - 1.0f) * 10.0f;
+	}
+	//A few meshes of meshlet spheres inside the unit box, the instances use them in turn
+	constexpr uint32_t MESH_COUNT = 8;
+	const uint32_t meshlets = params.meshletsPerInstance;
+	std::vector<glm::vec4> meshletSpheres(MESH_COUNT * meshlets);
+	for (glm::vec4& sphere : meshletSpheres)
+		sphere = glm::vec4(random() * 1.6f - 0.8f, random() * 1.6f - 0.8f, random() * 1.6f - 0.8f, 0.2f + random() * 0.2f);
+	auto meshletSphere = [&](uint32_t instance, uint32_t meshlet, const glm::mat4& model, glm::vec3& center, float& radius)
+	{
+		const glm::vec4& sphere = meshletSpheres[(instance % MESH_COUNT) * meshlets + meshlet];
+		const float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+		center = glm::vec3(model * glm::vec4(glm::vec3(sphere), 1.0f));
+		radius = sphere.w * scale;
+	};
+
+	//Slow fly-through: the benchmark fly-through line at a quarter of the speed (1000 frames cover a quarter of it), the view turns 10 degrees each way
+	const glm::vec3 start(-6000.0f, 500.0f, -6000.0f);
+	const glm::vec3 end(6000.0f, 500.0f, 6000.0f);
+	const glm::vec3 direction = glm::normalize(end - start);
+	const float tanHalfY = tanf(0.5f * 0.785398163f);
+	const float tanHalfX = tanHalfY * 16.0f / 9.0f;
+	Tracker tracker;
+	tracker.Init(params.distance, params.angle, params.refreshFrames);
+
+	std::vector<uint32_t> entries(count, 0);
+	const uint32_t meshletWords = (meshlets + MESHLETS_PER_WORD - 1) / MESHLETS_PER_WORD;
+	std::vector<uint32_t> meshletStates(static_cast<size_t>(count) * meshletWords, 0);
+	std::vector<uint8_t> fullVisible(count), cachedStates(count), cachedVisible(count);
+	std::vector<glm::mat4> frameModels(count);
+	const uint32_t frames = std::max(params.frames, 1u);
+	for (uint32_t frame = 0; frame < frames; ++frame)
+	{
+		const float t = static_cast<float>(frame) / 999.0f;
+		const glm::vec3 eye = glm::mix(start, end, 0.25f * t);
+		const float yaw = 0.174532925f * sinf(6.28318530718f * t);
+		const glm::vec3 forward = glm::vec3(glm::rotate(glm::mat4(1.0f), yaw, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::vec4(direction, 0.0f));
+		glm::vec4 planes[6];
+		CameraPlanes(eye, forward, tanHalfX, tanHalfY, 0.1f, 10000.0f, planes);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			frameModels[i] = models[i];
+			frameModels[i][3] += glm::vec4(velocities[i] * static_cast<float>(frame), 0.0f);
+		}
+
+		//Every box and the meshlets of the visible ones, like culling.comp and the task shader without the cache
+		auto fullStart = std::chrono::steady_clock::now();
+		uint32_t visible = 0;
+		uint32_t visibleMeshlets = 0;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			glm::vec3 points[8];
+			BoxPoints(frameModels[i], points);
+			fullVisible[i] = BoxVisible(points, planes) ? 1 : 0;
+			if (fullVisible[i] == 0)
+				continue;
+			++visible;
+			for (uint32_t m = 0; m < meshlets; ++m)
+			{
+				glm::vec3 center;
+				float radius;
+				meshletSphere(i, m, frameModels[i], center, radius);
+				visibleMeshlets += SphereVisible(center, radius, planes) ? 1 : 0;
+			}
+			result.sphereTests += meshlets;
+		}
+		result.fullMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - fullStart).count();
+		result.boxTests += count;
+		result.visibleInstances += visible;
+		result.visibleMeshlets += visibleMeshlets;
+
+		//Same with the cache
+		auto cachedStart = std::chrono::steady_clock::now();
+		tracker.Update(planes, eye);
+		result.epochs += tracker.IsNewEpoch() ? 1 : 0;
+		const uint32_t epoch = tracker.GetEpoch();
+		const uint32_t validMask = tracker.GetValidMask();
+		const glm::vec4(&inflated)[6] = tracker.GetInflatedPlanes();
+		const glm::vec4(&deflated)[6] = tracker.GetDeflatedPlanes();
+		uint32_t boxTests = 0;
+		uint32_t sphereTests = 0;
+		uint32_t cachedVisibleCount = 0;
+		uint32_t cachedVisibleMeshlets = 0;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const bool moving = velocities[i] != glm::vec3(0.0f);
+			uint32_t cacheState = STATE_UNCACHED;
+			if (!moving && !IsRefreshDue(i, tracker.GetFrame(), tracker.GetRefreshFrames()))
+				cacheState = EntryState(entries[i], epoch, validMask);
+			cachedStates[i] = static_cast<uint8_t>(cacheState);
+			bool boxVisible = cacheState == STATE_INSIDE;
+			if (cacheState == STATE_UNCACHED || cacheState == STATE_BOUNDARY)
+			{
+				glm::vec3 points[8];
+				BoxPoints(frameModels[i], points);
+				boxVisible = BoxVisible(points, planes);
+				++boxTests;
+				if (cacheState == STATE_UNCACHED)
+				{
+					const uint32_t newState = moving ? STATE_UNCACHED : TestBox(points, inflated, deflated);
+					entries[i] = (epoch << 2) | newState;
+					if (newState == STATE_INSIDE || newState == STATE_BOUNDARY)
+					{
+						//culling.comp writes the meshlet states with the entry
+						for (uint32_t w = 0; w < meshletWords; ++w)
+						{
+							uint32_t word = 0;
+							for (uint32_t m = w * MESHLETS_PER_WORD; m < std::min(meshlets, (w + 1) * MESHLETS_PER_WORD); ++m)
+							{
+								glm::vec3 center;
+								float radius;
+								meshletSphere(i, m, frameModels[i], center, radius);
+								word |= TestSphere(center, radius, inflated, deflated) << ((m % MESHLETS_PER_WORD) * 2);
+							}
+							meshletStates[static_cast<size_t>(i) * meshletWords + w] = word;
+						}
+						sphereTests += meshlets;
+					}
+				}
+			}
+			cachedVisible[i] = boxVisible ? 1 : 0;
+			if (!boxVisible)
+				continue;
+			++cachedVisibleCount;
+			//The task shader uses the meshlet states of the cached instances, the moving ones test every meshlet
+			const bool meshletsCached = (entries[i] & 3) != STATE_UNCACHED;
+			for (uint32_t m = 0; m < meshlets; ++m)
+			{
+				const uint32_t meshletState = meshletsCached ? (meshletStates[static_cast<size_t>(i) * meshletWords + m / MESHLETS_PER_WORD] >> ((m % MESHLETS_PER_WORD) * 2)) & 3 : STATE_UNCACHED;
+				if (meshletState == STATE_OUTSIDE || meshletState == STATE_INSIDE)
+				{
+					cachedVisibleMeshlets += meshletState == STATE_INSIDE ? 1 : 0;
+					continue;
+				}
+				glm::vec3 center;
+				float radius;
+				meshletSphere(i, m, frameModels[i], center, radius);
+				cachedVisibleMeshlets += SphereVisible(center, radius, planes) ? 1 : 0;
+				++sphereTests;
+			}
+		}
+		result.cachedMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cachedStart).count();
+		result.cachedBoxTests += boxTests;
+		result.cachedSphereTests += sphereTests;
+		result.cachedVisibleInstances += cachedVisibleCount;
+		result.cachedVisibleMeshlets += cachedVisibleMeshlets;
+		result.maxCachedBoxTests = std::max(result.maxCachedBoxTests, boxTests);
+
+		//A cached rejection must never drop a box or a sphere with a point inside the frustum, a cached acceptance must pass the full test
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			glm::vec3 points[8];
+			BoxPoints(frameModels[i], points);
+			if (cachedStates[i] == STATE_OUTSIDE)
+			{
+				bool seen = PointInside(glm::vec3(frameModels[i][3]), planes);
+				for (uint32_t k = 0; k < 8 && !seen; ++k)
+					seen = PointInside(points[k], planes);
+				result.errors += seen ? 1 : 0;
+			}
+			else if (cachedStates[i] == STATE_INSIDE && fullVisible[i] == 0)
+				++result.errors;
+			if (cachedVisible[i] == 0 || (entries[i] & 3) == STATE_UNCACHED)
+				continue;
+			for (uint32_t m = 0; m < meshlets; ++m)
+			{
+				const uint32_t meshletState = (meshletStates[static_cast<size_t>(i) * meshletWords + m / MESHLETS_PER_WORD] >> ((m % MESHLETS_PER_WORD) * 2)) & 3;
+				glm::vec3 center;
+				float radius;
+				meshletSphere(i, m, frameModels[i], center, radius);
+				if ((meshletState == STATE_OUTSIDE && PointInside(center, planes)) || (meshletState == STATE_INSIDE && !SphereVisible(center, radius, planes)))
+					++result.errors;
+			}
+		}
+	}
+	result.boxTests /= frames;
+	result.cachedBoxTests /= frames;
+	result.sphereTests /= frames;
+	result.cachedSphereTests /= frames;
+	result.visibleInstances /= frames;
+	result.cachedVisibleInstances /= frames;
+	result.visibleMeshlets /= frames;
+	result.cachedVisibleMeshlets /= frames;
+	result.fullMs /= frames;
+	result.cachedMs /= frames;
+	result.valid = result.errors == 0;
+	return result;
+}
+
+Simulations::MultiViewResult Simulations::SimulateMultiView(const MultiViewParams& params)
+{
+	using namespace MultiView;
+	MultiViewResult result;
+	Random random;
+
+	//Same boxes as SimulateOcclusion
+	const uint32_t count = params.instanceCount;
+	std::vector<glm::mat4> models(count);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		models[i] = SceneBox(random);
+	}
+
+	//Benchmark fly-through line, the light of Shader.frag
+	const glm::vec3 start(-6000.0f, 500.0f, -6000.0f);
+	const glm::vec3 end(6000.0f, 500.0f, 6000.0f);
+	const glm::mat4 proj = glm::perspective(0.785398163f, 16.0f / 9.0f, 0.1f, 10000.0f);
+	const glm::vec3 lightDirection = glm::normalize(glm::vec3(0.0f, 1.0f, 1.0f));
+	const uint32_t viewCount = std::max(std::min(params.viewCount, MAX_VIEWS), 1u);
+	const uint32_t frames = std::max(params.frames, 1u);
+	std::vector<uint32_t> lists[MAX_VIEWS];
+	std::vector<uint32_t> masks;
+	for (std::vector<uint32_t>& list : lists)
+		list.reserve(count);
+	masks.reserve(count);
+	for (uint32_t frame = 0; frame < frames; ++frame)
+	{
+		const float t = static_cast<float>(frame) / static_cast<float>(frames);
+		const glm::vec3 eye = glm::mix(start, end, t);
+		const glm::mat4 view = glm::lookAt(eye, end, glm::vec3(0.0f, 1.0f, 0.0f));
+		glm::mat4 viewProjs[MAX_VIEWS];
+		CascadeViews(view, proj, 0.1f, lightDirection, viewCount, params.distance, params.lambda, DEFAULT_CASTER_DISTANCE, DEFAULT_RESOLUTION, viewProjs);
+		glm::vec4 planes[MAX_VIEWS * 6];
+		for (uint32_t v = 0; v < viewCount; ++v)
+			PlanesFromMatrix(viewProjs[v], *reinterpret_cast<glm::vec4(*)[6]>(&planes[v * 6]));
+
+		//One pass per cascade: every pass reads every instance again and writes its own list
+		auto separateStart = std::chrono::steady_clock::now();
+		for (uint32_t v = 0; v < viewCount; ++v)
+		{
+			lists[v].clear();
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				glm::vec3 points[8];
+				BoxPoints(models[i], points);
+				if (BoxViewMask(points, &planes[v * 6], 1) != 0)
+					lists[v].push_back(i);
+			}
+		}
+		result.separateMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - separateStart).count();
+
+		//Single pass: one read per instance, one draw with the mask of the cascades it reaches
+		auto multiStart = std::chrono::steady_clock::now();
+		masks.clear();
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			glm::vec3 points[8];
+			BoxPoints(models[i], points);
+			const uint32_t mask = BoxViewMask(points, planes, viewCount);
+			if (mask != 0)
+				masks.push_back(i << MAX_VIEWS | mask);
+		}
+		result.multiMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - multiStart).count();
+
+		result.separateFetches += static_cast<double>(count) * viewCount;
+		result.multiFetches += count;
+		result.multiDraws += static_cast<double>(masks.size());
+		//Every bit of the masks is on the list of its view in the same order, and nothing else is
+		size_t cursors[MAX_VIEWS] = {};
+		for (uint32_t v = 0; v < viewCount; ++v)
+			result.separateDraws += static_cast<double>(lists[v].size());
+		for (uint32_t draw : masks)
+		{
+			for (uint32_t v = 0; v < viewCount; ++v)
+			{
+				if ((draw & (1u << v)) == 0)
+					continue;
+				if (cursors[v] < lists[v].size() && lists[v][cursors[v]] == draw >> MAX_VIEWS)
+					++cursors[v];
+				else
+					++result.errors;
+			}
+		}
+		for (uint32_t v = 0; v < viewCount; ++v)
+			result.errors += static_cast<uint32_t>(lists[v].size() - cursors[v]);
+	}
+	result.separateFetches /= frames;
+	result.multiFetches /= frames;
+	result.separateDraws /= frames;
+	result.multiDraws /= frames;
+	result.separateMs /= frames;
+	result.multiMs /= frames;
+	result.valid = result.errors == 0;
+	return result;
+}
+
+Simulations::ImpostorResult Simulations::SimulateImpostors(const ImpostorParams& params)
+{
+	using namespace Impostor;
+	ImpostorResult result;
+	Random random;
+
+	//Lumpy stretched sphere, no symmetry the frames could hide an error behind
+	const uint32_t stacks = 32;
+	const uint32_t slices = 64;
+	std::vector<Vertex> vertices((stacks + 1) * (slices + 1));
+	std::vector<unsigned int> indices;
+	for (uint32_t i = 0; i <= stacks; ++i)
+	{
+		for (uint32_t j = 0; j <= slices; ++j)
+		{
+			const float theta = 3.14159265f * i / stacks;
+			const float phi = 6.28318531f * j / slices;
+			const float r = 1.0f + 0.25f * sinf(3.0f * phi) * sinf(2.0f * theta);
+			Vertex& vertex = vertices[i * (slices + 1) + j];
+			vertex.position[0] = 1.6f * r * sinf(theta) * cosf(phi) + 0.3f;
+			vertex.position[1] = r * cosf(theta);
+			vertex.position[2] = 0.8f * r * sinf(theta) * sinf(phi);
+			vertex.position[3] = 1.0f;
+			memset(vertex.normal, 0, sizeof(vertex.normal));
+		}
+	}
+	for (uint32_t i = 0; i < stacks; ++i)
+	{
+		for (uint32_t j = 0; j < slices; ++j)
+		{
+			const unsigned int a = i * (slices + 1) + j;
+			const unsigned int b = a + slices + 1;
+			const unsigned int quad[6] = { a, b, a + 1, a + 1, b, b + 1 };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+	//area weighted face normals
+	for (size_t t = 0; t < indices.size(); t += 3)
+	{
+		glm::vec3 p[3];
+		for (uint32_t k = 0; k < 3; ++k)
+			p[k] = glm::vec3(vertices[indices[t + k]].position[0], vertices[indices[t + k]].position[1], vertices[indices[t + k]].position[2]);
+		const glm::vec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			for (uint32_t c = 0; c < 3; ++c)
+				vertices[indices[t + k]].normal[c] += normal[c];
+		}
+	}
+	Mesh mesh;
+	mesh.numIndices = static_cast<unsigned int>(indices.size());
+	mesh.indices = indices.data();
+	mesh.numVertices = static_cast<unsigned int>(vertices.size());
+	mesh.vertices = vertices.data();
+	result.meshTriangles = mesh.numIndices / 3;
+	result.meshMeshlets = (result.meshTriangles + params.meshletTriangles - 1) / std::max(params.meshletTriangles, 1u);
+
+	std::vector<uint32_t> atlas(MESH_TEXELS);
+	const auto bakeStart = std::chrono::steady_clock::now();
+	const glm::vec4 sphere = Bake(mesh, atlas.data());
+	result.bakeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - bakeStart).count();
+
+	//Every frame maps back to itself, has texels and its normals face its viewer
+	for (uint32_t frame = 0; frame < FRAME_COUNT; ++frame)
+	{
+		const glm::vec3 direction = FrameDirection(frame);
+		if (NearestFrame(direction) != frame)
+			++result.errors;
+		uint32_t covered = 0;
+		for (uint32_t i = 0; i < CELL_TEXELS; ++i)
+		{
+			const uint32_t texel = atlas[frame * CELL_TEXELS + i];
+			if ((texel >> COVERAGE_SHIFT) == 0)
+				continue;
+			++covered;
+			if (glm::dot(DecodeNormal(texel), direction) < -0.02f)
+				++result.errors;
+		}
+		if (covered == 0)
+			++result.errors;
+	}
+
+	//The impostor quad of Impostor.mesh lies on the plane of its frame through the center, the view from direction reads it where its rays cross it
+	std::vector<uint32_t> reference(CELL_TEXELS);
+	const uint32_t samples = std::max(params.viewSamples, 1u);
+	for (uint32_t s = 0; s < samples; ++s)
+	{
+		glm::vec3 direction;
+		do
+			direction = glm::vec3(random(), random(), random()) * 2.0f - 1.0f;
+		while (glm::dot(direction, direction) > 1.0f || glm::dot(direction, direction) < 1e-4f);
+		direction = glm::normalize(direction);
+		RenderView(mesh, sphere, direction, reference.data());
+		const uint32_t frame = NearestFrame(direction);
+		const glm::vec3 frameDirection = FrameDirection(frame);
+		glm::vec3 right, up, frameRight, frameUp;
+		FrameBasis(direction, right, up);
+		FrameBasis(frameDirection, frameRight, frameUp);
+		const uint32_t* cell = atlas.data() + frame * CELL_TEXELS;
+		uint32_t mismatched = 0;
+		uint32_t covered = 0;
+		for (uint32_t y = 0; y < CELL_SIZE; ++y)
+		{
+			for (uint32_t x = 0; x < CELL_SIZE; ++x)
+			{
+				//in sphere radii
+				const glm::vec3 offset = ((x + 0.5f) / CELL_SIZE * 2.0f - 1.0f) * right + ((y + 0.5f) / CELL_SIZE * 2.0f - 1.0f) * up;
+				const glm::vec3 point = offset - glm::dot(offset, frameDirection) / glm::dot(direction, frameDirection) * direction;
+				const float u = (glm::dot(point, frameRight) * 0.5f + 0.5f) * CELL_SIZE;
+				const float v = (glm::dot(point, frameUp) * 0.5f + 0.5f) * CELL_SIZE;
+				const bool impostor = u >= 0.0f && v >= 0.0f && u < CELL_SIZE && v < CELL_SIZE &&
+					(cell[static_cast<uint32_t>(v) * CELL_SIZE + static_cast<uint32_t>(u)] >> COVERAGE_SHIFT) != 0;
+				const bool exact = (reference[y * CELL_SIZE + x] >> COVERAGE_SHIFT) != 0;
+				if (impostor || exact)
+					++covered;
+				if (impostor != exact)
+					++mismatched;
+			}
+		}
+		const double error = covered != 0 ? static_cast<double>(mismatched) / covered : 0.0;
+		result.meanCoverageError += error;
+		result.maxCoverageError = std::max(result.maxCoverageError, error);
+	}
+	result.meanCoverageError /= samples;
+
+	//Same boxes as SimulateOcclusion, the sphere of the [-1, 1] box scaled like culling.comp does
+	const uint32_t count = params.instanceCount;
+	std::vector<glm::mat4> models(count);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		models[i] = SceneBox(random);
+	}
+	const glm::vec3 start(-6000.0f, 500.0f, -6000.0f);
+	const glm::vec3 end(6000.0f, 500.0f, 6000.0f);
+	const glm::mat4 proj = glm::perspective(0.785398163f, 16.0f / 9.0f, 0.1f, 10000.0f);
+	//pixels per world unit at depth 1, the projectionScale of the cull uniform
+	const float projectionScale = fabsf(proj[1][1]) * static_cast<float>(params.screenHeight) * 0.5f;
+	const uint32_t frames = std::max(params.frames, 1u);
+	for (uint32_t frame = 0; frame < frames; ++frame)
+	{
+		const float t = static_cast<float>(frame) / static_cast<float>(frames);
+		const glm::vec3 eye = glm::mix(start, end, t);
+		glm::vec4 planes[6];
+		MultiView::PlanesFromMatrix(proj * glm::lookAt(eye, end, glm::vec3(0.0f, 1.0f, 0.0f)), planes);
+		uint32_t visible = 0;
+		uint32_t impostors = 0;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const glm::mat4& model = models[i];
+			glm::vec3 points[8];
+			BoxPoints(model, points);
+			if (MultiView::BoxViewMask(points, planes, 1) == 0)
+				continue;
+			++visible;
+			const float scale = sqrtf(std::max(glm::dot(model[0], model[0]), std::max(glm::dot(model[1], model[1]), glm::dot(model[2], model[2]))));
+			if (ProjectedDiameter(planes[0], glm::vec3(model[3]), 1.73205081f * scale, projectionScale) < params.threshold)
+				++impostors;
+		}
+		result.visibleInstances += visible;
+		result.impostorInstances += impostors;
+	}
+	result.visibleInstances /= frames;
+	result.impostorInstances /= frames;
+	result.meshletsWithout = result.visibleInstances * result.meshMeshlets;
+	result.meshletsWith = (result.visibleInstances - result.impostorInstances) * result.meshMeshlets;
+	result.valid = result.errors == 0 && result.meanCoverageError <= MAX_MEAN_COVERAGE_ERROR;
+	return result;
+}
+
+Simulations::ClusteredLightingResult Simulations::SimulateClusteredLighting(const ClusteredLightingParams& params)
+{
+	using namespace ClusteredLighting;
+	ClusteredLightingResult result;
+	Random random;
+
+	const uint32_t lightCount = std::min(params.lightCount, MAX_LIGHTS);
+	std::vector<Light> lights(lightCount);
+	SceneLights(lightCount, params.minRadius, params.maxRadius, lights.data());
+
+	//Benchmark fly-through line, the projection of the benchmark camera
+	const glm::vec3 start(-6000.0f, 500.0f, -6000.0f);
+	const glm::vec3 end(6000.0f, 500.0f, 6000.0f);
+	const float tanHalfY = tanf(0.5f * 0.785398163f);
+	const float tanHalfX = tanHalfY * 16.0f / 9.0f;
+	const float nearDepth = 0.1f;
+	const float farDepth = 10000.0f;
+	const uint32_t frames = std::max(params.frames, 1u);
+	std::vector<uint32_t> grid(GRID_WORDS);
+	std::vector<uint32_t> reference(GRID_WORDS);
+	for (uint32_t frame = 0; frame < frames; ++frame)
+	{
+		const float t = static_cast<float>(frame) / static_cast<float>(frames);
+		const glm::vec3 eye = glm::mix(start, end, t);
+		const glm::vec3 forward = glm::normalize(end - eye);
+		const glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+		const glm::vec3 up = glm::cross(right, forward);
+		glm::vec4 planes[6];
+		CameraPlanes(eye, forward, tanHalfX, tanHalfY, nearDepth, farDepth, planes);
+		Params clusterParams;
+		BuildParams(planes, nearDepth, farDepth, lightCount, clusterParams);
+
+		auto binStart = std::chrono::steady_clock::now();
+		const uint32_t overflow = BinLights(clusterParams, lights.data(), grid.data());
+		result.binMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - binStart).count();
+		auto perClusterStart = std::chrono::steady_clock::now();
+		const uint32_t referenceOverflow = BinLightsPerCluster(clusterParams, lights.data(), reference.data());
+		result.perClusterMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - perClusterStart).count();
+
+		//Same counts and the same lists as the loop of the GPU
+		if (overflow != referenceOverflow)
+			++result.errors;
+		uint64_t listed = 0;
+		for (uint32_t cluster = 0; cluster < CLUSTER_COUNT; ++cluster)
+		{
+			if (grid[cluster] != reference[cluster])
+			{
+				++result.errors;
+				continue;
+			}
+			const uint32_t count = std::min(grid[cluster], MAX_LIGHTS_PER_CLUSTER);
+			const uint32_t offset = CLUSTER_COUNT + cluster * MAX_LIGHTS_PER_CLUSTER;
+			if (!std::equal(grid.begin() + offset, grid.begin() + offset + count, reference.begin() + offset))
+				++result.errors;
+			listed += count;
+			result.maxLightsPerCluster = std::max(result.maxLightsPerCluster, grid[cluster]);
+		}
+		result.avgLightsPerCluster += static_cast<double>(listed) / CLUSTER_COUNT;
+		result.overflowClusters += overflow;
+
+		//Points in front of the camera, some of them past the side planes on the open border clusters
+		uint64_t walked = 0;
+		for (uint32_t i = 0; i < params.pointSamples; ++i)
+		{
+			const float depth = nearDepth + powf(random(), 2.0f) * 4000.0f;
+			const float x = (random() * 2.4f - 1.2f) * tanHalfX * depth;
+			const float y = (random() * 2.4f - 1.2f) * tanHalfY * depth;
+			const glm::vec3 position = eye + forward * depth + right * x + up * y;
+			uint32_t pointWalked = 0;
+			ShadePoint(clusterParams, lights.data(), grid.data(), position, -forward, &pointWalked);
+			walked += pointWalked;
+			const uint32_t cluster = ClusterIndex(clusterParams, position);
+			if (grid[cluster] > MAX_LIGHTS_PER_CLUSTER)
+				continue;
+			const uint32_t* begin = grid.data() + CLUSTER_COUNT + cluster * MAX_LIGHTS_PER_CLUSTER;
+			const uint32_t* listEnd = begin + grid[cluster];
+			//Lights that reach the point, away from the radius where the falloff is 0 anyway
+			for (uint32_t l = 0; l < lightCount; ++l)
+			{
+				const float radius = lights[l].positionRadius.w * 0.99f;
+				if (glm::dot(glm::vec3(lights[l].positionRadius) - position, glm::vec3(lights[l].positionRadius) - position) < radius * radius &&
+					std::find(begin, listEnd, l) == listEnd)
+					++result.missedLights;
+			}
+		}
+		result.walkedPerPoint += static_cast<double>(walked) / std::max(params.pointSamples, 1u);
+	}
+	result.binMs /= frames;
+	result.perClusterMs /= frames;
+	result.avgLightsPerCluster /= frames;
+	result.overflowClusters /= frames;
+	result.walkedPerPoint /= frames;
+	result.valid = result.errors == 0 && result.missedLights == 0;
+	return result;
+}
@@ -0,0 +1,255 @@
+#ifndef __SIMULATIONS_H__
+#define __SIMULATIONS_H__
+
+#include "ModuleVulkan.h"
+#include "Impostor.h"
+#include "MultiView.h"
+#include "VisibilityCache.h"
+#include "ClusteredLighting.h"
+#include "OcclusionCulling.h"
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+#include "glm/mat4x4.hpp"
+#include <stdint.h>
+
+//CPU simulations of the render modules run by MeshTool, only MeshTool builds them. Each one drives the module the way ModuleVulkan and the shaders do
+//on a procedural scene and checks it against a reference: valid is false when an invariant broke or a result differs, errors counts the differences
+//of the simulations that count them
+namespace Simulations
+{
+	struct Result
+	{
+		uint32_t errors = 0;
+		bool valid = true;
+	};
+
+	//Same xorshift sequence on every run, [0, 1)
+	struct Random
+	{
+		uint32_t state = 1;
+		float operator()() { state ^= state << 13; state ^= state >> 17; state ^= state << 5; return static_cast<float>(state) / 4294967296.0f; }
+	};
+	//Instance of the procedural scene: the [-1, 1] box scaled, rotated and placed on the 6000 units cube of ModuleVulkan
+	glm::mat4 SceneBox(Random& random);
+	//The 8 corners of the transformed [-1, 1] box, the points culling.comp tests
+	void BoxPoints(const glm::mat4& model, glm::vec3(&points)[8]);
+	//Projection of Camera::SetPerspective (45 degrees vertical) for a width x height screen
+	glm::mat4 BenchmarkProjection(float width, float height);
+	//Same planes as Camera::GetPlanes for a camera looking along forward with the world up
+	void CameraPlanes(const glm::vec3& eye, const glm::vec3& forward, float tanHalfX, float tanHalfY, float nearPlane, float farPlane, glm::vec4(&planes)[6]);
+
+	//Eviction policy of GeometryStreaming::ResidencyManager: a camera sweeping a strip of groups, the feedback arrives `latency` frames late like on the GPU
+	//The manager invariants are checked every frame (pinned pages stay, recently used pages are not evicted, the tables agree) and a budget that holds
+	//every page must never evict
+	struct StreamingParams
+	{
+		uint32_t groupCount = 256;
+		uint32_t pagesPerGroup = 8;
+		//visible groups around the camera, it moves one group every framesPerGroup frames and goes back and forth
+		uint32_t visibleGroups = 24;
+		uint32_t framesPerGroup = 4;
+		uint32_t slotCount = 512;
+		uint32_t frames = 4000;
+		uint32_t latency = ModuleVulkan::MAX_FRAMES_IN_FLIGHT;
+	};
+	struct StreamingResult : Result
+	{
+		uint64_t pageUses = 0;
+		uint64_t residentUses = 0;
+		uint64_t uploads = 0;
+		uint64_t evictions = 0;
+		//visible groups drawn with their fallback, one per group and frame
+		uint64_t fallbackFrames = 0;
+		uint64_t refusedRequests = 0;
+	};
+	StreamingResult SimulateStreaming(const StreamingParams& params);
+
+	//Churn of InstanceManager: every frame removes and adds instances and moves some others, the dirty slots are uploaded under MAX_UPLOADS to a copy of
+	//the GPU buffers that must match the manager once the backlog drains. Stale handles must not touch the slots they had
+	struct InstanceChurnParams
+	{
+		uint32_t capacity = 131072;
+		uint32_t meshCount = 8;
+		uint32_t initialInstances = 100000;
+		//removed and added per frame (24000 per second at 60 fps), moved per frame
+		uint32_t churn = 400;
+		uint32_t updates = 2000;
+		uint32_t frames = 3000;
+	};
+	struct InstanceChurnResult : Result
+	{
+		uint64_t added = 0;
+		uint64_t removed = 0;
+		uint64_t updated = 0;
+		uint64_t uploads = 0;
+		uint32_t maxSlotCount = 0;
+		uint32_t maxBacklog = 0;
+		//CPU time of the batches and of taking the dirty slots
+		double changeMs = 0.0;
+	};
+	InstanceChurnResult SimulateInstanceChurn(const InstanceChurnParams& params);
+
+	//OcclusionCulling on the procedural scene seen by the stationary benchmark camera, the largest boxes on screen are the occluders. Every occluded
+	//instance is checked against a per pixel buffer of the same coverage with the exact depths (the masked buffer must never reject more) and the AVX2
+	//and scalar paths must produce the same buffer and the same results
+	struct OcclusionParams
+	{
+		uint32_t instanceCount = 100000;
+		uint32_t occluderCount = 512;
+		uint32_t width = OcclusionCulling::DEFAULT_WIDTH;
+		uint32_t height = OcclusionCulling::DEFAULT_HEIGHT;
+		uint32_t threadCount = 0;
+		uint32_t iterations = 20;
+	};
+	struct OcclusionResult : Result
+	{
+		uint32_t occluderTriangles = 0;
+		uint32_t occluded = 0;
+		//Rejected by the per pixel buffer of the same occluders, the upper bound of the masked buffer
+		uint32_t referenceOccluded = 0;
+		//in front of the camera, the rest would be frustum culled anyway
+		uint32_t onScreen = 0;
+		double rasterMs = 0.0;
+		double testMs = 0.0;
+		uint32_t threadCount = 0;
+		bool avx2 = false;
+	};
+	OcclusionResult SimulateOcclusion(const OcclusionParams& params);
+
+	//DepthSort on the procedural scene seen by the stationary benchmark camera: the boxes inside the frustum are sorted from the slot order the cull
+	//appends them on and the result must match std::stable_sort of the same keys. The overdraw is estimated drawing the screen rectangle of every
+	//box at its nearest depth with early Z, in slot order and sorted
+	struct DepthSortParams
+	{
+		uint32_t instanceCount = 100000;
+		uint32_t width = 320;
+		uint32_t height = 192;
+		uint32_t iterations = 20;
+	};
+	struct DepthSortResult : Result
+	{
+		uint32_t sorted = 0;
+		double sortMs = 0.0;
+		double referenceMs = 0.0;
+		//shaded pixels over covered pixels
+		double unsortedOverdraw = 0.0;
+		double sortedOverdraw = 0.0;
+	};
+	DepthSortResult SimulateDepthSort(const DepthSortParams& params);
+
+	//VisibilityCache on the procedural scene with a few synthetic meshlet spheres per box, seen from a slow fly-through (the benchmark fly-through line
+	//at a quarter of the speed with a slowly turning view). Every frame the full tests of culling.comp and the task shader run next to the cached ones:
+	//a cached rejection of a box or a sphere with a point inside the frustum of the frame is an error. Some instances move every frame and are never cached
+	struct VisibilityCacheParams
+	{
+		uint32_t instanceCount = 100000;
+		uint32_t meshletsPerInstance = 32;
+		//one instance of every movingEvery moves, 0 none
+		uint32_t movingEvery = 16;
+		uint32_t frames = 240;
+		uint32_t refreshFrames = 0;
+		float distance = VisibilityCache::DEFAULT_DISTANCE;
+		float angle = VisibilityCache::DEFAULT_ANGLE;
+	};
+	struct VisibilityCacheResult : Result
+	{
+		//per frame averages, the cached path counts the boxes and spheres it had to test
+		double boxTests = 0.0;
+		double cachedBoxTests = 0.0;
+		double sphereTests = 0.0;
+		double cachedSphereTests = 0.0;
+		//most boxes tested by the cached path on a single frame (the frames starting an epoch)
+		uint32_t maxCachedBoxTests = 0;
+		uint32_t epochs = 0;
+		double visibleInstances = 0.0;
+		double cachedVisibleInstances = 0.0;
+		double visibleMeshlets = 0.0;
+		double cachedVisibleMeshlets = 0.0;
+		double fullMs = 0.0;
+		double cachedMs = 0.0;
+	};
+	VisibilityCacheResult SimulateVisibilityCache(const VisibilityCacheParams& params);
+
+	//MultiView on the procedural scene seen from the benchmark fly-through: the cascades of every frame culled in a single pass with view masks against
+	//one pass per cascade. The masks have to match the separate passes bit per bit
+	struct MultiViewParams
+	{
+		uint32_t instanceCount = 100000;
+		uint32_t viewCount = MultiView::MAX_VIEWS;
+		uint32_t frames = 60;
+		float distance = MultiView::DEFAULT_DISTANCE;
+		float lambda = MultiView::DEFAULT_SPLIT_LAMBDA;
+	};
+	struct MultiViewResult : Result
+	{
+		//per frame averages, fetches are the instance transforms read and transformed into box points
+		double separateFetches = 0.0;
+		double multiFetches = 0.0;
+		//draws written: one per view and visible instance for the separate passes, one per instance with a mask for the single pass
+		double separateDraws = 0.0;
+		double multiDraws = 0.0;
+		double separateMs = 0.0;
+		double multiMs = 0.0;
+	};
+	MultiViewResult SimulateMultiView(const MultiViewParams& params);
+
+	//Impostor: a procedural mesh is baked and seen from random directions, the silhouette drawn by the impostor quad (nearest frame, oriented like
+	//Impostor.mesh) is compared with the mesh rendered from the exact direction. The instances of the procedural scene are routed with the projected
+	//size test of culling.comp along the benchmark fly-through
+	struct ImpostorParams
+	{
+		uint32_t instanceCount = 100000;
+		uint32_t frames = 60;
+		uint32_t viewSamples = 256;
+		float threshold = Impostor::DEFAULT_THRESHOLD;
+		uint32_t screenHeight = 1080;
+		//triangles of a meshlet, the meshlets an instance emits when drawn whole
+		uint32_t meshletTriangles = 124;
+	};
+	struct ImpostorResult : Result
+	{
+		uint32_t meshTriangles = 0;
+		uint32_t meshMeshlets = 0;
+		double bakeMs = 0.0;
+		//per frame averages
+		double visibleInstances = 0.0;
+		double impostorInstances = 0.0;
+		double meshletsWithout = 0.0;
+		double meshletsWith = 0.0;
+		//texels covered by only one of the silhouettes over the texels covered by any, mean and worst of the view samples
+		double meanCoverageError = 0.0;
+		double maxCoverageError = 0.0;
+	};
+	//The silhouettes of the sampled views have to match within this much on average. The errors are the frames that do not map back to themselves,
+	//the empty frames and the texels whose normal faces away from the frame
+	constexpr double MAX_MEAN_COVERAGE_ERROR = 0.15;
+	ImpostorResult SimulateImpostors(const ImpostorParams& params);
+
+	//ClusteredLighting: point lights spread over the procedural scene seen from the benchmark fly-through. The lights are binned by BinLights and by the
+	//per cluster loop of the GPU, the grids have to match word per word. Sampled points in front of the camera have to find every light that reaches them
+	//on their cluster unless it overflowed
+	struct ClusteredLightingParams
+	{
+		uint32_t lightCount = 4096;
+		uint32_t frames = 30;
+		uint32_t pointSamples = 4096;
+		float minRadius = ClusteredLighting::DEFAULT_MIN_RADIUS;
+		float maxRadius = ClusteredLighting::DEFAULT_MAX_RADIUS;
+	};
+	struct ClusteredLightingResult : Result
+	{
+		//per frame averages
+		double binMs = 0.0;
+		double perClusterMs = 0.0;
+		double avgLightsPerCluster = 0.0;
+		double overflowClusters = 0.0;
+		//lights walked per sampled point against all of them
+		double walkedPerPoint = 0.0;
+		uint32_t maxLightsPerCluster = 0;
+		//lights that reach a sampled point and are not on the list of its cluster (the overflowed clusters excluded)
+		uint32_t missedLights = 0;
+	};
+	ClusteredLightingResult SimulateClusteredLighting(const ClusteredLightingParams& params);
+}
+
+#endif // !__SIMULATIONS_H__
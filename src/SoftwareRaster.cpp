@@ -0,0 +1,67 @@
+#include "SoftwareRaster.h"
+#include "VisibilityBuffer.h"
+#include <math.h>
+#include <algorithm>
+
+SoftwareRaster::ScreenVertex SoftwareRaster::ToScreen(const glm::vec4& clip, uint32_t width, uint32_t height)
+{
+	const float invW = 1.0f / clip.w;
+	const float pixelX = (clip.x * invW * 0.5f + 0.5f) * static_cast<float>(width);
+	const float pixelY = (clip.y * invW * 0.5f + 0.5f) * static_cast<float>(height);
+	ScreenVertex vertex;
+	//floor(x + 0.5) instead of round, GLSL round is free to pick either side on the halves
+	vertex.x = static_cast<int32_t>(floorf(pixelX * SUBPIXEL_SCALE + 0.5f));
+	vertex.y = static_cast<int32_t>(floorf(pixelY * SUBPIXEL_SCALE + 0.5f));
+	vertex.z = clip.z * invW;
+	return vertex;
+}
+
+uint32_t SoftwareRaster::RasterizeTriangle(const ScreenVertex& v0, const ScreenVertex& in1, const ScreenVertex& in2, uint32_t cluster, uint32_t triangle, uint32_t width, uint32_t height, uint64_t* visibility)
+{
+	//The area has the opposite sign of the vulkan one on a y down framebuffer: the counter clockwise front faces are negative
+	const int32_t signedArea = Edge(v0, in1, in2.x, in2.y);
+	if (signedArea >= 0)
+		return 0;
+	//Swap the winding so the edge functions are positive inside
+	const ScreenVertex& v1 = in2;
+	const ScreenVertex& v2 = in1;
+	const int32_t area = -signedArea;
+
+	const int32_t minX = std::min(v0.x, std::min(v1.x, v2.x));
+	const int32_t minY = std::min(v0.y, std::min(v1.y, v2.y));
+	const int32_t maxX = std::max(v0.x, std::max(v1.x, v2.x));
+	const int32_t maxY = std::max(v0.y, std::max(v1.y, v2.y));
+	if (maxX - minX > MAX_TRIANGLE_EXTENT * SUBPIXEL_SCALE || maxY - minY > MAX_TRIANGLE_EXTENT * SUBPIXEL_SCALE)
+		return 0;
+	//Pixels whose center can be inside the bounds, clamped to the target
+	const int32_t startX = std::max(minX >> SUBPIXEL_BITS, 0);
+	const int32_t startY = std::max(minY >> SUBPIXEL_BITS, 0);
+	const int32_t endX = std::min(maxX >> SUBPIXEL_BITS, static_cast<int32_t>(width) - 1);
+	const int32_t endY = std::min(maxY >> SUBPIXEL_BITS, static_cast<int32_t>(height) - 1);
+	//The pixels exactly on an edge are only covered by the top and left edges
+	const int32_t bias0 = IsTopLeft(v1, v2) ? 0 : -1;
+	const int32_t bias1 = IsTopLeft(v2, v0) ? 0 : -1;
+	const int32_t bias2 = IsTopLeft(v0, v1) ? 0 : -1;
+	const float invArea = 1.0f / static_cast<float>(area);
+	uint32_t covered = 0;
+	for (int32_t y = startY; y <= endY; ++y)
+	{
+		const int32_t py = (y << SUBPIXEL_BITS) + SUBPIXEL_SCALE / 2;
+		for (int32_t x = startX; x <= endX; ++x)
+		{
+			const int32_t px = (x << SUBPIXEL_BITS) + SUBPIXEL_SCALE / 2;
+			const int32_t w0 = Edge(v1, v2, px, py);
+			const int32_t w1 = Edge(v2, v0, px, py);
+			const int32_t w2 = Edge(v0, v1, px, py);
+			if (w0 + bias0 < 0 || w1 + bias1 < 0 || w2 + bias2 < 0)
+				continue;
+			//NDC depth is linear on screen space
+			const float depth = v0.z + (static_cast<float>(w1) * invArea) * (v1.z - v0.z) + (static_cast<float>(w2) * invArea) * (v2.z - v0.z);
+			if (depth < 0.0f || depth > 1.0f)
+				continue;
+			VisibilityBuffer::Write(visibility[y * width + x], VisibilityBuffer::Pack(depth, cluster, triangle));
+			++covered;
+		}
+	}
+	return covered;
+}
@@ -0,0 +1,35 @@
+#ifndef __SOFTWARE_RASTER_H__
+#define __SOFTWARE_RASTER_H__
+
+#include "glm/vec4.hpp"
+#include <stdint.h>
+
+//CPU reference of SoftwareRaster.comp, same fixed point snapping, fill rules and visibility buffer writes
+//Pixel centers are sampled, edges follow the top-left rule and the back faces are culled like the hardware pipeline (counter clockwise front)
+namespace SoftwareRaster
+{
+	constexpr int32_t SUBPIXEL_BITS = 8;
+	constexpr int32_t SUBPIXEL_SCALE = 1 << SUBPIXEL_BITS;
+	//Bigger triangles are skipped, it keeps the edge functions inside 32 bits. The task shader only sends clusters smaller than this
+	constexpr int32_t MAX_TRIANGLE_EXTENT = 64;
+
+	struct ScreenVertex
+	{
+		//framebuffer position in fixed point, SUBPIXEL_BITS of precision
+		int32_t x;
+		int32_t y;
+		//NDC depth
+		float z;
+	};
+
+	//Viewport transform + snapping, the clip position must be in front of the camera
+	ScreenVertex ToScreen(const glm::vec4& clip, uint32_t width, uint32_t height);
+	//Edge function of the pixel p against the edge a->b, positive on the inner side of a positive area triangle
+	inline int32_t Edge(const ScreenVertex& a, const ScreenVertex& b, int32_t px, int32_t py) { return (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x); }
+	//Top edges are horizontal going right, left edges go up (framebuffer y goes down)
+	inline bool IsTopLeft(const ScreenVertex& a, const ScreenVertex& b) { return (b.y - a.y) < 0 || ((b.y - a.y) == 0 && (b.x - a.x) > 0); }
+	//Writes the covered pixels of the triangle on the width * height visibility buffer, returns the number of covered pixels
+	uint32_t RasterizeTriangle(const ScreenVertex& v0, const ScreenVertex& v1, const ScreenVertex& v2, uint32_t cluster, uint32_t triangle, uint32_t width, uint32_t height, uint64_t* visibility);
+}
+
+#endif // !__SOFTWARE_RASTER_H__
@@ -0,0 +1,43 @@
+#include "VisibilityBuffer.h"
+#include <assert.h>
+#include <string.h>
+
+uint64_t VisibilityBuffer::Pack(float depth, uint32_t cluster, uint32_t triangle)
+{
+	assert(depth >= 0.0f && "Negative depths do not sort as integers");
+	assert(cluster < MAX_CLUSTERS && "The cluster index does not fit on the visibility id");
+	assert(triangle <= TRIANGLE_MASK && "The triangle index does not fit on the visibility id");
+	uint32_t depthBits;
+	memcpy(&depthBits, &depth, sizeof(depthBits));
+	return (static_cast<uint64_t>(depthBits) << 32) | (cluster << TRIANGLE_BITS) | triangle;
+}
+
+void VisibilityBuffer::Unpack(uint64_t value, float& depth, uint32_t& cluster, uint32_t& triangle)
+{
+	const uint32_t depthBits = static_cast<uint32_t>(value >> 32);
+	memcpy(&depth, &depthBits, sizeof(depth));
+	const uint32_t id = static_cast<uint32_t>(value);
+	cluster = id >> TRIANGLE_BITS;
+	triangle = id & TRIANGLE_MASK;
+}
+
+static float Cross2(const glm::vec2& a, const glm::vec2& b)
+{
+	return a.x * b.y - a.y * b.x;
+}
+
+glm::vec3 VisibilityBuffer::PerspectiveBarycentrics(const glm::vec4& clip0, const glm::vec4& clip1, const glm::vec4& clip2, const glm::vec2& ndc)
+{
+	const glm::vec3 invW(1.0f / clip0.w, 1.0f / clip1.w, 1.0f / clip2.w);
+	const glm::vec2 p0 = glm::vec2(clip0.x, clip0.y) * invW.x;
+	const glm::vec2 p1 = glm::vec2(clip1.x, clip1.y) * invW.y;
+	const glm::vec2 p2 = glm::vec2(clip2.x, clip2.y) * invW.z;
+	const float area = Cross2(p1 - p0, p2 - p0);
+	//Screen space barycentrics
+	const float b1 = Cross2(ndc - p0, p2 - p0) / area;
+	const float b2 = Cross2(p1 - p0, ndc - p0) / area;
+	const glm::vec3 screen(1.0f - b1 - b2, b1, b2);
+	//Undo the perspective division, the attributes are linear on 1/w
+	const glm::vec3 perspective = screen * invW;
+	return perspective / (perspective.x + perspective.y + perspective.z);
+}
@@ -0,0 +1,31 @@
+#ifndef __VISIBILITY_BUFFER_H__
+#define __VISIBILITY_BUFFER_H__
+
+#include "glm/vec2.hpp"
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+#include <stdint.h>
+
+//CPU side of the visibility buffer encoding, must match Visibility.frag, SoftwareRaster.comp and VisibilityShade.comp
+//64 bits per pixel written with atomicMin: depth bits << 32 | visible cluster << TRIANGLE_BITS | triangle inside the meshlet
+//The depth is positive so its float bits sort like integers and the closest triangle wins the atomicMin
+//The visible cluster list written by the task shader maps the cluster to the instance and the global meshlet
+namespace VisibilityBuffer
+{
+	constexpr uint64_t EMPTY = 0xFFFFFFFFFFFFFFFFull;
+	//max_primitives of the mesh shader is 256
+	constexpr uint32_t TRIANGLE_BITS = 8;
+	constexpr uint32_t TRIANGLE_MASK = (1u << TRIANGLE_BITS) - 1;
+	//the last cluster index is reserved for the empty pixels
+	constexpr uint32_t MAX_CLUSTERS = (1u << (32 - TRIANGLE_BITS)) - 1;
+
+	uint64_t Pack(float depth, uint32_t cluster, uint32_t triangle);
+	void Unpack(uint64_t value, float& depth, uint32_t& cluster, uint32_t& triangle);
+	inline bool IsEmpty(uint64_t value) { return static_cast<uint32_t>(value) == static_cast<uint32_t>(EMPTY); }
+	//Same as the shader atomicMin
+	inline void Write(uint64_t& pixel, uint64_t value) { if (value < pixel) pixel = value; }
+	//Perspective correct barycentrics of the pixel (in NDC) inside the triangle given by its clip space vertices
+	glm::vec3 PerspectiveBarycentrics(const glm::vec4& clip0, const glm::vec4& clip1, const glm::vec4& clip2, const glm::vec2& ndc);
+}
+
+#endif // !__VISIBILITY_BUFFER_H__
@@ -0,0 +1,177 @@
+#include "VisibilityCache.h"
+#include "glm/geometric.hpp"
+#include <math.h>
+#include <algorithm>
+
+bool VisibilityCache::ExpandFrustum(const glm::vec4(&planes)[6], const glm::vec3& eye, float distance, float angle, glm::vec4(&inflated)[6], glm::vec4(&deflated)[6])
+{
+	const glm::vec3 forward = -glm::vec3(planes[0]);
+	//The rotation moves the far corners the most
+	glm::vec3 corners[8];
+	bool closed = FrustumCorners(planes, corners);
+	float reach = 0.0f;
+	for (uint32_t i = 0; i < 8 && closed; ++i)
+		reach = std::max(reach, glm::length(corners[i] - eye));
+	const float depthMargin = distance + reach * angle;
+	const float c = cosf(angle);
+	const float s = sinf(angle);
+	//depth along the view where the deflated side planes start to overlap
+	float apex = 0.0f;
+	for (uint32_t i = 2; i < 6; ++i)
+	{
+		//the normal turns away from the view direction to widen the frustum, towards it to narrow it
+		const glm::vec3 normal(planes[i]);
+		const glm::vec3 along = glm::normalize(forward - normal * glm::dot(normal, forward));
+		const glm::vec3 wider = normal * c - along * s;
+		const glm::vec3 narrower = normal * c + along * s;
+		inflated[i] = glm::vec4(wider, glm::dot(wider, eye) + distance);
+		deflated[i] = glm::vec4(narrower, glm::dot(narrower, eye) - distance);
+		//an angle past the field of view leaves nothing inside
+		const float facing = -glm::dot(narrower, forward);
+		if (facing < 1e-4f)
+			closed = false;
+		else
+			apex = std::max(apex, distance / facing);
+	}
+	const float nearDepth = -(planes[0].w + glm::dot(forward, eye));
+	inflated[0] = planes[0];
+	inflated[0].w += depthMargin;
+	inflated[1] = planes[1];
+	inflated[1].w += depthMargin;
+	//The deflated near plane starts past the apex, its corners are the corners of the volume
+	const float deflatedNear = std::max(nearDepth + depthMargin, apex * 1.01f);
+	deflated[0] = glm::vec4(-forward, -glm::dot(forward, eye) - deflatedNear);
+	deflated[1] = planes[1];
+	deflated[1].w -= depthMargin;
+	glm::vec3 deflatedCorners[8];
+	if (!closed || !FrustumCorners(deflated, deflatedCorners))
+	{
+		//every point is behind this near plane, nothing is ever inside
+		deflated[0] = glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+		return false;
+	}
+	return true;
+}
+
+bool VisibilityCache::FrustumCorners(const glm::vec4(&planes)[6], glm::vec3(&corners)[8])
+{
+	for (uint32_t i = 0; i < 8; ++i)
+	{
+		//near or far, left or right, top or bottom
+		const glm::vec4& a = planes[i < 4 ? 0 : 1];
+		const glm::vec4& b = planes[(i & 1) != 0 ? 3 : 2];
+		const glm::vec4& c = planes[(i & 2) != 0 ? 5 : 4];
+		const glm::vec3 na(a), nb(b), nc(c);
+		const float det = glm::dot(na, glm::cross(nb, nc));
+		if (fabsf(det) < 1e-6f)
+			return false;
+		corners[i] = (a.w * glm::cross(nb, nc) + b.w * glm::cross(nc, na) + c.w * glm::cross(na, nb)) / det;
+	}
+	//Planes crossing before the far one (a side plane past the near one) give points out of the volume
+	for (uint32_t i = 0; i < 8; ++i)
+	{
+		for (uint32_t j = 0; j < 6; ++j)
+		{
+			if (glm::dot(glm::vec3(planes[j]), corners[i]) - planes[j].w > 1e-3f * (1.0f + fabsf(planes[j].w)))
+				return false;
+		}
+	}
+	return true;
+}
+
+bool VisibilityCache::ContainsPoints(const glm::vec4(&planes)[6], const glm::vec3* points, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		for (uint32_t j = 0; j < 6; ++j)
+		{
+			if (glm::dot(glm::vec3(planes[j]), points[i]) - planes[j].w >= 0.0f)
+				return false;
+		}
+	}
+	return true;
+}
+
+uint32_t VisibilityCache::TestBox(const glm::vec3(&points)[8], const glm::vec4(&inflated)[6], const glm::vec4(&deflated)[6])
+{
+	bool inside = true;
+	for (uint32_t i = 0; i < 6; ++i)
+	{
+		uint32_t outPoints = 0;
+		for (uint32_t k = 0; k < 8; ++k)
+		{
+			if (glm::dot(glm::vec3(inflated[i]), points[k]) - inflated[i].w >= 0.0f)
+				++outPoints;
+			if (glm::dot(glm::vec3(deflated[i]), points[k]) - deflated[i].w >= 0.0f)
+				inside = false;
+		}
+		if (outPoints == 8)
+			return STATE_OUTSIDE;
+	}
+	return inside ? STATE_INSIDE : STATE_BOUNDARY;
+}
+
+uint32_t VisibilityCache::TestSphere(const glm::vec3& center, float radius, const glm::vec4(&inflated)[6], const glm::vec4(&deflated)[6])
+{
+	bool inside = true;
+	for (uint32_t i = 0; i < 6; ++i)
+	{
+		if (glm::dot(glm::vec3(inflated[i]), center) - inflated[i].w > radius)
+			return STATE_OUTSIDE;
+		if (glm::dot(glm::vec3(deflated[i]), center) - deflated[i].w > -radius)
+			inside = false;
+	}
+	return inside ? STATE_INSIDE : STATE_BOUNDARY;
+}
+
+uint32_t VisibilityCache::EntryState(uint32_t entry, uint32_t epoch, uint32_t validMask)
+{
+	const uint32_t age = (epoch - (entry >> 2)) & EPOCH_MASK;
+	if (age >= EPOCHS || (validMask & (1u << age)) == 0)
+		return STATE_UNCACHED;
+	return entry & 3;
+}
+
+void VisibilityCache::Tracker::Init(float distance, float angle, uint32_t refreshFrames)
+{
+	this->distance = distance;
+	this->angle = angle;
+	this->refreshFrames = std::min(refreshFrames, EPOCHS);
+	invalidated = true;
+}
+
+bool VisibilityCache::Tracker::IsValid(const Epoch& cached, const glm::vec4(&planes)[6], const glm::vec3(&corners)[8]) const
+{
+	return cached.valid && ContainsPoints(cached.inflated, corners, 8) && (cached.deflatedEmpty || ContainsPoints(planes, cached.deflatedCorners, 8));
+}
+
+void VisibilityCache::Tracker::Update(const glm::vec4(&planes)[6], const glm::vec3& eye)
+{
+	++frame;
+	if (invalidated)
+	{
+		for (Epoch& cached : epochs)
+			cached.valid = false;
+	}
+	glm::vec3 corners[8];
+	const bool closed = FrustumCorners(planes, corners);
+	//The entries only depend on the frusta of their epoch, an epoch the camera left can be valid again when it comes back
+	validMask = 0;
+	for (uint32_t age = 0; age < EPOCHS && closed; ++age)
+	{
+		if (IsValid(epochs[(epoch + EPOCHS - age) % EPOCHS], planes, corners))
+			validMask |= 1u << age;
+	}
+	newEpoch = closed && (invalidated || refreshFrames != 0 || (validMask & 1) == 0);
+	if (!newEpoch)
+		return;
+	epoch = (epoch + 1) & EPOCH_MASK;
+	Epoch& started = epochs[epoch % EPOCHS];
+	started.deflatedEmpty = !ExpandFrustum(planes, eye, distance, angle, started.inflated, started.deflated);
+	if (!started.deflatedEmpty)
+		FrustumCorners(started.deflated, started.deflatedCorners);
+	started.valid = true;
+	//one epoch older each, the one that fell off the ring is gone
+	validMask = (validMask << 1) | 1;
+	invalidated = false;
+}
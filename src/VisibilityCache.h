@@ -0,0 +1,88 @@
+#ifndef __VISIBILITY_CACHE_H__
+#define __VISIBILITY_CACHE_H__
+
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+#include <stdint.h>
+
+//Temporal visibility cache of culling.comp and the task shader. Every epoch has two frusta built from the camera it started with: one inflated by
+//the camera motion it absorbs and one deflated by the same amount. A box outside the inflated one or inside the deflated one keeps its answer while the
+//inflated frustum still contains the frustum of the frame and the deflated one is still inside it (the corners are enough, both are convex), the rest
+//are tested every frame. The instance entries keep the epoch they were tested on, the per meshlet states are written by culling.comp with the
+//instance entry and read by the task shader. Moving instances are never cached and the uploaded slots are tested again on the frame of the upload
+//The tracker runs on the CPU once per frame, this is also the CPU reference of the tests of culling.comp
+namespace VisibilityCache
+{
+	//Same as culling.comp and Shader.task: 2 bit states, the instance entries are epoch << 2 | state
+	constexpr uint32_t STATE_UNCACHED = 0;
+	constexpr uint32_t STATE_OUTSIDE = 1;
+	constexpr uint32_t STATE_INSIDE = 2;
+	//crosses the margin, tested every frame
+	constexpr uint32_t STATE_BOUNDARY = 3;
+	constexpr uint32_t EPOCH_MASK = (1u << 30) - 1;
+	//Epochs an entry can refer to, the valid mask of the frame has a bit per epoch age. It also bounds the refresh period
+	constexpr uint32_t EPOCHS = 32;
+	//Meshlet states per 32 bit word
+	constexpr uint32_t MESHLETS_PER_WORD = 16;
+	//Camera motion an epoch absorbs by default: eye translation in units and view rotation in radians (2 degrees)
+	constexpr float DEFAULT_DISTANCE = 200.0f;
+	constexpr float DEFAULT_ANGLE = 0.035f;
+
+	//planes are the ones of Camera::GetPlanes (near, far, left, right, top, bottom, outside when dot(xyz, p) - w >= 0), the side planes go through eye
+	//The side planes turn by angle around the eye and every plane moves by distance, the near and far ones also by what the angle moves the far corners
+	//False when the deflated planes leave nothing inside, they are replaced by planes no point is inside of
+	bool ExpandFrustum(const glm::vec4(&planes)[6], const glm::vec3& eye, float distance, float angle, glm::vec4(&inflated)[6], glm::vec4(&deflated)[6]);
+	//Near corners first, false when the planes do not meet on a closed volume
+	bool FrustumCorners(const glm::vec4(&planes)[6], glm::vec3(&corners)[8]);
+	bool ContainsPoints(const glm::vec4(&planes)[6], const glm::vec3* points, uint32_t count);
+	//Same tests as culling.comp (the 8 points of the transformed box) and culling.comp meshlet states (bounding sphere)
+	uint32_t TestBox(const glm::vec3(&points)[8], const glm::vec4(&inflated)[6], const glm::vec4(&deflated)[6]);
+	uint32_t TestSphere(const glm::vec3& center, float radius, const glm::vec4(&inflated)[6], const glm::vec4(&deflated)[6]);
+	//State of the entry on the frame, STATE_UNCACHED when its epoch is no longer valid
+	uint32_t EntryState(uint32_t entry, uint32_t epoch, uint32_t validMask);
+	//Rotating refresh: every refreshFrames frames each slot is tested again even if its entry is still valid
+	inline bool IsRefreshDue(uint32_t slot, uint32_t frame, uint32_t refreshFrames) { return refreshFrames != 0 && slot % refreshFrames == frame % refreshFrames; }
+
+	class Tracker
+	{
+	public:
+		//refreshFrames 0 starts an epoch only when the frustum leaves the newest one, every slot is tested again on that frame. Otherwise every frame
+		//starts an epoch and IsRefreshDue spreads the tests: the entries of an epoch the camera left are a refreshFrames share of the slots at most
+		void Init(float distance, float angle, uint32_t refreshFrames);
+		//Once per frame with the camera of the frame
+		void Update(const glm::vec4(&planes)[6], const glm::vec3& eye);
+		//Drops every epoch, the next Update starts a new one (the instances moved or the cache settings changed)
+		void Invalidate() { invalidated = true; }
+		uint32_t GetEpoch() const { return epoch; }
+		uint32_t GetValidMask() const { return validMask; }
+		uint32_t GetRefreshFrames() const { return refreshFrames; }
+		uint32_t GetFrame() const { return frame; }
+		//The last Update started an epoch
+		bool IsNewEpoch() const { return newEpoch; }
+		const glm::vec4(&GetInflatedPlanes() const)[6] { return epochs[epoch % EPOCHS].inflated; }
+		const glm::vec4(&GetDeflatedPlanes() const)[6] { return epochs[epoch % EPOCHS].deflated; }
+	private:
+		struct Epoch
+		{
+			glm::vec4 inflated[6];
+			glm::vec4 deflated[6];
+			glm::vec3 deflatedCorners[8];
+			//the deflated planes do not close a volume, no box is ever inside
+			bool deflatedEmpty;
+			bool valid;
+		};
+		bool IsValid(const Epoch& cached, const glm::vec4(&planes)[6], const glm::vec3(&corners)[8]) const;
+
+		Epoch epochs[EPOCHS] = {};
+		float distance = DEFAULT_DISTANCE;
+		float angle = DEFAULT_ANGLE;
+		uint32_t refreshFrames = 0;
+		uint32_t epoch = 0;
+		uint32_t validMask = 0;
+		uint32_t frame = 0;
+		bool newEpoch = false;
+		bool invalidated = true;
+	};
+}
+
+#endif // !__VISIBILITY_CACHE_H__
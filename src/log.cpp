@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <iostream>
+#include <mutex>
 #ifdef _WIN32
 #include <Windows.h>
 #endif // _WIN32
@@ -13,12 +14,23 @@ void log(const char file[], int line, const char* format, ...)
 	static char tmpString[LOG_BUFF_SIZE];
 	static char tmpString2[LOG_BUFF_SIZE];
 	static va_list  ap;
+	//the scene is imported on its own thread (ModuleVulkan::ImportScene)
+	static std::mutex logMutex;
+	std::lock_guard<std::mutex> lock(logMutex);
 
 	// Construct the string from variable arguments
 	va_start(ap, format);
+#ifdef _WIN32
 	vsprintf_s(tmpString, LOG_BUFF_SIZE, format, ap);
+#else
+	vsnprintf(tmpString, LOG_BUFF_SIZE, format, ap);
+#endif // _WIN32
 	va_end(ap);
+#ifdef _WIN32
 	sprintf_s(tmpString2, LOG_BUFF_SIZE, "\n%s(%d) : %s", file, line, tmpString);
+#else
+	snprintf(tmpString2, LOG_BUFF_SIZE, "\n%s(%d) : %s", file, line, tmpString);
+#endif // _WIN32
 	int a = 3;
 	std::cout << a << std::endl;
 	std::cout << tmpString2;